@@ -0,0 +1,111 @@
+#include "arena.hpp"
+
+#include <cstdlib>
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+thread_local uint64_t tlsAllocations = 0;
+
+size_t alignUp(size_t offset, size_t align) {
+    return (offset + align - 1) / align * align;
+}
+
+} // namespace
+
+void *Arena::allocate(size_t bytes, size_t align) {
+    // ブロックの先頭は new char[] なので max_align_t までの境界にそろっている
+    for (; current_ < blocks_.size(); current_++, offset_ = 0) {
+        size_t begin = alignUp(offset_, align);
+        if (begin + bytes <= blocks_[current_].size) {
+            offset_ = begin + bytes;
+            return blocks_[current_].data.get() + begin;
+        }
+    }
+    Block block;
+    block.size = max(blockBytes_, bytes + align);
+    block.data.reset(new char[block.size]);
+    blocks_.push_back(move(block));
+    current_ = blocks_.size() - 1;
+    size_t begin = alignUp(0, align);
+    offset_ = begin + bytes;
+    return blocks_[current_].data.get() + begin;
+}
+
+void Arena::reserve(size_t bytes) {
+    Mark m = mark();
+    allocate(bytes, alignof(max_align_t));
+    rewind(m);
+}
+
+void Arena::reset() {
+    if (blocks_.size() > 1) {
+        Block merged;
+        merged.size = capacity();
+        blocks_.clear();
+        merged.data.reset(new char[merged.size]);
+        blocks_.push_back(move(merged));
+    }
+    current_ = 0;
+    offset_ = 0;
+}
+
+size_t Arena::capacity() const {
+    size_t total = 0;
+    for (const auto &b : blocks_)
+        total += b.size;
+    return total;
+}
+
+uint64_t heapAllocationCount() {
+    return tlsAllocations;
+}
+
+bool heapAllocationsCounted() {
+#ifdef CAMSYNTH_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef CAMSYNTH_COUNT_ALLOCATIONS
+void countHeapAllocation() {
+    tlsAllocations++;
+}
+#endif
+
+} // namespace camsynth
+
+#ifdef CAMSYNTH_COUNT_ALLOCATIONS
+// 置き換えた operator new で回数を数える（nothrow 版は標準どおりこれを呼ぶ）
+void *operator new(size_t size) {
+    camsynth::countHeapAllocation();
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace camsynth {
+
+// 連続した要素列への所有しない参照（C++20 の std::span の代わり）
+// vector から暗黙に作れるので、vector を受け取っていた関数に区間をコピーせずに渡せる。
+// 指す先（vector や Arena）より長く使わない。
+template <typename T>
+class Span {
+public:
+    using value_type = std::remove_cv_t<T>;
+
+    Span() = default;
+    Span(T *data, size_t size) : data_(data), size_(size) {}
+    Span(std::vector<value_type> &v) : data_(v.data()), size_(v.size()) {}
+    template <typename U = T, typename = std::enable_if_t<std::is_const<U>::value>>
+    Span(const std::vector<value_type> &v) : data_(v.data()), size_(v.size()) {}
+    template <typename U, typename = std::enable_if_t<std::is_same<const U, T>::value>>
+    Span(Span<U> other) : data_(other.data()), size_(other.size()) {}
+
+    T *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T *begin() const { return data_; }
+    T *end() const { return data_ + size_; }
+    T &operator[](size_t i) const { return data_[i]; }
+    T &front() const { return data_[0]; }
+    T &back() const { return data_[size_ - 1]; }
+    // [offset, offset + count) を切り出す（範囲外は切り詰める）
+    Span subspan(size_t offset, size_t count) const {
+        offset = offset < size_ ? offset : size_;
+        return Span(data_ + offset, count < size_ - offset ? count : size_ - offset);
+    }
+
+private:
+    T *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// セグメント単位の一時領域（バンプアロケータ）
+// allocate は確保済みのブロックを先頭から順に切り出すだけで、個別には解放しない。
+// reset で全体を空にすると次のセグメントは同じブロックを使い回すので（複数のブロックに分かれていたら
+// 1 つにまとめ直す）、2 つ目以降のセグメントではヒープ確保が起きない。
+// 候補ごとの作業領域は mark / rewind で切り出した分だけを戻して使い回す。
+// 要素のデストラクタは呼ばないので、置けるのはトリビアルに破棄できる型だけ。
+class Arena {
+public:
+    struct Mark {
+        size_t block = 0;
+        size_t offset = 0;
+    };
+
+    explicit Arena(size_t blockBytes = 64 * 1024) : blockBytes_(blockBytes) {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t bytes, size_t align);
+    // n 要素の配列を切り出して値初期化する
+    template <typename T>
+    Span<T> allocateArray(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena cannot destroy elements");
+        T *p = static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < n; i++)
+            new (p + i) T();
+        return Span<T>(p, n);
+    }
+    // 現在の位置から bytes までを切り出しても新しいブロックを確保しないようにしておく
+    void reserve(size_t bytes);
+
+    Mark mark() const { return {current_, offset_}; }
+    void rewind(const Mark &m) {
+        current_ = m.block;
+        offset_ = m.offset;
+    }
+    void reset();
+
+    // 確保済みのバイト数
+    size_t capacity() const;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+    };
+
+    std::vector<Block> blocks_;
+    size_t current_ = 0; // 切り出し中のブロック
+    size_t offset_ = 0;  // そのブロックの使用済みバイト数
+    size_t blockBytes_;
+};
+
+// 呼び出したスレッドでのヒープ確保 (operator new) の回数
+// CAMSYNTH_COUNT_ALLOCATIONS を定義してビルドしたときだけ数える（そうでなければ常に 0）
+std::uint64_t heapAllocationCount();
+bool heapAllocationsCounted();
+
+} // namespace camsynth
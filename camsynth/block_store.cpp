@@ -0,0 +1,833 @@
+#include "block_store.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef CAMSYNTH_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef CAMSYNTH_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "msgpack_io.hpp"
+#include "prefetch.hpp"
+#include "result_cache.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace camsynth {
+
+namespace {
+
+const char kManifestHeader[] = "camsynth-blocks 1";
+const char kMagic[4] = {'C', 'B', 'L', 'K'};
+const uint32_t kVersion = 1;
+const size_t kHeaderBytes = 64;
+
+struct BlockFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t directoryBytes;
+};
+static_assert(sizeof(BlockFileHeader) <= kHeaderBytes, "ブロックファイルのヘッダが大きすぎます");
+static_assert(sizeof(array<double, 4>) == 4 * sizeof(double), "ヒップの列を直接展開できません");
+
+// 面ごとの形式 (Planes)
+enum PlaneTag : uint8_t { ZeroPlane = 0, RawPlane = 1, ConstantPlane = 2, SparsePlane = 3 };
+
+struct Manifest {
+    string source;
+    size_t segments = 0;
+    string codec;
+    vector<pair<string, string>> files; // ファイル名, クリップ番号
+};
+
+Manifest readManifest(const string &storeDir) {
+    string path = storeDir + "/MANIFEST";
+    ifstream ifs(path);
+    string line;
+    if (!ifs || !getline(ifs, line) || line != kManifestHeader)
+        throw runtime_error("Invalid manifest: " + path);
+    Manifest m;
+    while (getline(ifs, line)) {
+        istringstream iss(line);
+        string key, value;
+        if (!(iss >> key >> value))
+            continue;
+        if (key == "source")
+            m.source = value;
+        else if (key == "segments")
+            m.segments = stoull(value);
+        else if (key == "codec")
+            m.codec = value;
+        else
+            m.files.emplace_back(key, value);
+    }
+    return m;
+}
+
+// 1 行前の値との XOR を取り、バイトごとの面に並べる（planes[p * n + i] が i 番目の値の p バイト目）
+template <class T>
+void xorToPlanes(const uint8_t *src, size_t n, size_t stride, uint8_t *planes) {
+    for (size_t i = 0; i < n; i++) {
+        T v, prev;
+        memcpy(&v, src + i * sizeof(T), sizeof(T));
+        if (i >= stride) {
+            memcpy(&prev, src + (i - stride) * sizeof(T), sizeof(T));
+            v ^= prev;
+        }
+        uint8_t bytes[sizeof(T)];
+        memcpy(bytes, &v, sizeof(T));
+        for (size_t p = 0; p < sizeof(T); p++)
+            planes[p * n + i] = bytes[p];
+    }
+}
+
+// xorToPlanes の逆
+// XOR はバイトごとなので面の上で 1 行前との XOR を戻してから（面ごとに連続した配列の XOR になる）、値に並べ直す
+template <class T>
+void planesToValues(uint8_t *planes, size_t n, size_t stride, uint8_t *__restrict dst) {
+    for (size_t p = 0; p < sizeof(T); p++) {
+        uint8_t *plane = planes + p * n;
+        if (stride == 1) {
+            uint8_t acc = 0;
+            for (size_t i = 0; i < n; i++) {
+                acc ^= plane[i];
+                plane[i] = acc;
+            }
+            continue;
+        }
+        for (size_t row = stride; row < n; row += stride) {
+            uint8_t *__restrict cur = plane + row;
+            const uint8_t *__restrict prev = cur - stride;
+            for (size_t j = 0; j < stride; j++)
+                cur[j] ^= prev[j];
+        }
+    }
+    const uint8_t *__restrict src = planes;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t bytes[sizeof(T)];
+        for (size_t p = 0; p < sizeof(T); p++)
+            bytes[p] = src[p * n + i];
+        memcpy(dst + i * sizeof(T), bytes, sizeof(T));
+    }
+}
+
+void toPlanes(const BlockColumn &column, const uint8_t *src, size_t n, uint8_t *planes) {
+    switch (column.width) {
+    case 1: xorToPlanes<uint8_t>(src, n, column.stride, planes); break;
+    case 4: xorToPlanes<uint32_t>(src, n, column.stride, planes); break;
+    case 8: xorToPlanes<uint64_t>(src, n, column.stride, planes); break;
+    default: throw runtime_error("Unsupported block column width: " + to_string(column.width));
+    }
+}
+
+void fromPlanes(const BlockColumn &column, uint8_t *planes, size_t n, void *dst) {
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    switch (column.width) {
+    case 1: planesToValues<uint8_t>(planes, n, column.stride, out); break;
+    case 4: planesToValues<uint32_t>(planes, n, column.stride, out); break;
+    case 8: planesToValues<uint64_t>(planes, n, column.stride, out); break;
+    default: throw runtime_error("Unsupported block column width: " + to_string(column.width));
+    }
+}
+
+// 面ごとに 0 / 定数 / 0 以外のバイトだけ（ビットマップ付き）/ そのまま のうち一番小さいもので書く
+void encodePlanes(const uint8_t *planes, size_t n, size_t width, vector<char> &out) {
+    for (size_t p = 0; p < width; p++) {
+        const uint8_t *plane = planes + p * n;
+        size_t nonzero = 0;
+        bool constant = true;
+        for (size_t i = 0; i < n; i++) {
+            nonzero += plane[i] != 0;
+            constant = constant && plane[i] == plane[0];
+        }
+        if (nonzero == 0) {
+            out.push_back(ZeroPlane);
+        }
+        else if (constant) {
+            out.push_back(ConstantPlane);
+            out.push_back(plane[0]);
+        }
+        else if ((n + 7) / 8 + nonzero < n) {
+            out.push_back(SparsePlane);
+            size_t bitmap = out.size();
+            out.resize(bitmap + (n + 7) / 8, 0);
+            for (size_t i = 0; i < n; i++) {
+                if (plane[i] != 0)
+                    out[bitmap + i / 8] |= char(1 << (i % 8));
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (plane[i] != 0)
+                    out.push_back(plane[i]);
+            }
+        }
+        else {
+            out.push_back(RawPlane);
+            out.insert(out.end(), plane, plane + n);
+        }
+    }
+}
+
+void decodePlanes(const char *data, size_t size, size_t n, size_t width, uint8_t *planes) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = p + size;
+    auto need = [&](size_t k) {
+        if (size_t(end - p) < k)
+            throw runtime_error("Corrupted block");
+    };
+    for (size_t w = 0; w < width; w++) {
+        uint8_t *plane = planes + w * n;
+        need(1);
+        uint8_t tag = *p++;
+        switch (tag) {
+        case ZeroPlane:
+            memset(plane, 0, n);
+            break;
+        case ConstantPlane:
+            need(1);
+            memset(plane, *p++, n);
+            break;
+        case SparsePlane: {
+            size_t bitmapBytes = (n + 7) / 8;
+            need(bitmapBytes);
+            const uint8_t *bitmap = p;
+            p += bitmapBytes;
+            memset(plane, 0, n);
+            for (size_t k = 0; k < bitmapBytes; k++) {
+                uint8_t bits = bitmap[k];
+                // 1 になっているビットの分だけ値を取り出す
+                need(__builtin_popcount(bits));
+                for (; bits; bits &= bits - 1) {
+                    size_t i = k * 8 + __builtin_ctz(bits);
+                    // 面の長さを超えるビット（最後のバイトの余り）が立っていたら壊れている
+                    if (i >= n)
+                        throw runtime_error("Corrupted block");
+                    plane[i] = *p++;
+                }
+            }
+            break;
+        }
+        case RawPlane:
+            need(n);
+            memcpy(plane, p, n);
+            p += n;
+            break;
+        default:
+            throw runtime_error("Corrupted block");
+        }
+    }
+    if (p != end)
+        throw runtime_error("Corrupted block");
+}
+
+// ブロック 1 つを圧縮して out に書き、使った方式を返す（小さくならなければ Stored）
+BlockCodec encodeBlock(const BlockColumn &column, const uint8_t *src, size_t rows, BlockCodec codec, vector<char> &out) {
+    size_t n = rows * column.stride;
+    size_t bytes = n * column.width;
+    out.clear();
+    if (codec != BlockCodec::Stored && bytes > 0) {
+        vector<uint8_t> planes(bytes);
+        toPlanes(column, src, n, planes.data());
+        switch (codec) {
+        case BlockCodec::Planes:
+            encodePlanes(planes.data(), n, column.width, out);
+            break;
+        case BlockCodec::Lz4:
+#ifdef CAMSYNTH_WITH_LZ4
+            out.resize(LZ4_compressBound(bytes));
+            out.resize(max(0, LZ4_compress_default(reinterpret_cast<const char *>(planes.data()), out.data(),
+                                                   bytes, out.size())));
+            break;
+#endif
+        case BlockCodec::Zstd:
+#ifdef CAMSYNTH_WITH_ZSTD
+            if (codec == BlockCodec::Zstd) {
+                out.resize(ZSTD_compressBound(bytes));
+                size_t r = ZSTD_compress(out.data(), out.size(), planes.data(), bytes, 3);
+                out.resize(ZSTD_isError(r) ? 0 : r);
+                break;
+            }
+#endif
+            throw runtime_error(string("Block codec is not available in this build: ") + blockCodecName(codec));
+        default:
+            break;
+        }
+        if (!out.empty() && out.size() < bytes)
+            return codec;
+    }
+    out.assign(reinterpret_cast<const char *>(src), reinterpret_cast<const char *>(src) + bytes);
+    return BlockCodec::Stored;
+}
+
+void packDirectory(msgpack::sbuffer &buf, const BlockClipDirectory &dir) {
+    msgpack::packer<msgpack::sbuffer> pk(&buf);
+    pk.pack_map(5);
+    pk.pack(string("clip"));
+    pk.pack(dir.clipNumber);
+    pk.pack(string("blockFrames"));
+    pk.pack(dir.blockFrames);
+    pk.pack(string("frames"));
+    pk.pack(dir.frames);
+    pk.pack(string("segments"));
+    pk.pack_array(dir.segments.size());
+    for (const DatabaseSegment &s : dir.segments) {
+        pk.pack_array(8);
+        pk.pack(s.fileName);
+        pk.pack(s.start);
+        pk.pack(s.end);
+        pk.pack(s.frames);
+        pk.pack(s.hipFrames);
+        pk.pack(s.musicFrames);
+        pk.pack(s.bpm);
+        pk.pack(uint64_t(s.order));
+    }
+    pk.pack(string("columns"));
+    pk.pack_array(dir.columns.size());
+    for (const BlockColumn &c : dir.columns) {
+        pk.pack_array(4);
+        pk.pack(c.width);
+        pk.pack(c.stride);
+        pk.pack(c.rows);
+        pk.pack_array(c.blocks.size());
+        for (const BlockRef &b : c.blocks) {
+            pk.pack_array(3);
+            pk.pack(b.offset);
+            pk.pack(b.size);
+            pk.pack(int(b.codec));
+        }
+    }
+}
+
+const msgpack::object &requireArray(const msgpack::object &obj, const string &key, size_t minSize = 0) {
+    const msgpack::object *m = getMember(obj, key);
+    if (!m || m->type != msgpack::type::ARRAY || m->via.array.size < minSize)
+        throw runtime_error("Missing '" + key + "' in block file");
+    return *m;
+}
+
+const msgpack::object &element(const msgpack::object &array, size_t i, size_t minSize) {
+    const msgpack::object &e = array.via.array.ptr[i];
+    if (e.type != msgpack::type::ARRAY || e.via.array.size < minSize)
+        throw runtime_error("Invalid entry in block file");
+    return e;
+}
+
+// ヘッダとディレクトリを読む（dataBytes はブロック本体のバイト数。ブロックがその中に収まるか確かめる）
+BlockClipDirectory parseDirectory(const BlockFileHeader &header,
+                                  const char *data,
+                                  uint64_t dataBytes,
+                                  const string &path) {
+    if (memcmp(header.magic, kMagic, 4) != 0 || header.version != kVersion)
+        throw runtime_error("Invalid block file: " + path);
+    msgpack::object_handle oh = msgpack::unpack(data, header.directoryBytes);
+    const msgpack::object &obj = oh.get();
+    BlockClipDirectory dir;
+    const msgpack::object *clip = getMember(obj, "clip");
+    const msgpack::object *blockFrames = getMember(obj, "blockFrames");
+    const msgpack::object *frames = getMember(obj, "frames");
+    if (!clip || !blockFrames || !frames)
+        throw runtime_error("Invalid block file: " + path);
+    dir.clipNumber = clip->as<string>();
+    dir.blockFrames = blockFrames->as<uint32_t>();
+    dir.frames = frames->as<uint64_t>();
+    if (dir.blockFrames == 0)
+        throw runtime_error("Invalid block file: " + path);
+
+    const msgpack::object &segments = requireArray(obj, "segments");
+    for (size_t i = 0; i < segments.via.array.size; i++) {
+        const msgpack::object &s = element(segments, i, 8);
+        const msgpack::object *v = s.via.array.ptr;
+        DatabaseSegment seg;
+        seg.fileName = v[0].as<string>();
+        seg.fileNumber = dir.clipNumber;
+        seg.start = v[1].as<int>();
+        seg.end = v[2].as<int>();
+        seg.frames = v[3].as<int>();
+        seg.hipFrames = v[4].as<int>();
+        seg.musicFrames = v[5].as<int>();
+        seg.bpm = v[6].as<double>();
+        seg.order = v[7].as<uint64_t>();
+        dir.segments.push_back(move(seg));
+    }
+
+    const msgpack::object &columns = requireArray(obj, "columns", NumBlockColumns);
+    for (size_t c = 0; c < columns.via.array.size; c++) {
+        const msgpack::object &col = element(columns, c, 4);
+        BlockColumn column;
+        column.width = col.via.array.ptr[0].as<uint32_t>();
+        column.stride = col.via.array.ptr[1].as<uint32_t>();
+        column.rows = col.via.array.ptr[2].as<uint64_t>();
+        const msgpack::object &blocks = col.via.array.ptr[3];
+        if (blocks.type != msgpack::type::ARRAY ||
+            blocks.via.array.size != (column.rows + dir.blockFrames - 1) / dir.blockFrames)
+            throw runtime_error("Invalid block file: " + path);
+        if (column.width != 1 && column.width != 4 && column.width != 8)
+            throw runtime_error("Unsupported block column width in " + path);
+        for (size_t b = 0; b < blocks.via.array.size; b++) {
+            const msgpack::object &e = element(blocks, b, 3);
+            BlockRef ref;
+            ref.offset = e.via.array.ptr[0].as<uint64_t>();
+            ref.size = e.via.array.ptr[1].as<uint32_t>();
+            ref.codec = BlockCodec(e.via.array.ptr[2].as<int>());
+            if (ref.offset > dataBytes || ref.size > dataBytes - ref.offset)
+                throw runtime_error("Truncated block file: " + path);
+            column.blocks.push_back(ref);
+        }
+        dir.columns.push_back(move(column));
+    }
+    return dir;
+}
+
+// クリップ 1 つ分のファイルを作る
+vector<char> buildClipFile(const string &num,
+                           const MotionClip &clip,
+                           const CameraClip &camera,
+                           vector<DatabaseSegment> segments,
+                           const BlockStoreOptions &options,
+                           BlockStoreStats &stats) {
+    size_t n = clip.frames();
+    size_t joints = 0, dims = 0;
+    for (const FrameData &f : clip.raw)
+        joints = max(joints, f.positions.size());
+    for (const auto &m : clip.music)
+        dims = max(dims, m.size());
+    for (size_t i = 0; i < n; i++) {
+        if (!clip.raw[i].positions.empty() && clip.raw[i].positions.size() != joints)
+            throw runtime_error("Clip " + num + " has frames with different joint counts");
+        if (!clip.music[i].empty() && clip.music[i].size() != dims)
+            throw runtime_error("Clip " + num + " has frames with different music feature dimensions");
+    }
+
+    // 列ごとの値（ホストのバイト順）
+    vector<uint8_t> flags(n, 0);
+    vector<double> positions(n * joints * 3, 0.0), music(n * dims, 0.0);
+    for (size_t i = 0; i < n; i++) {
+        const auto &p = clip.raw[i].positions;
+        for (size_t j = 0; j < p.size(); j++)
+            copy(p[j].begin(), p[j].end(), positions.begin() + (i * joints + j) * 3);
+        copy(clip.music[i].begin(), clip.music[i].end(), music.begin() + i * dims);
+        flags[i] = (p.empty() ? 0 : 1) | (clip.music[i].empty() ? 0 : 2) | (clip.covers(i, i + 1) ? 4 : 0);
+    }
+    struct Source {
+        const void *data;
+        uint32_t width;
+        uint32_t stride;
+        uint64_t rows;
+    };
+    vector<Source> sources = {
+        {flags.data(), 1, 1, n},
+        {positions.data(), 8, uint32_t(joints * 3), n},
+        {clip.hip.data(), 8, 4, n},
+        {music.data(), 8, uint32_t(dims), n},
+    };
+    for (int c = 0; c < CameraClip::NumColumns; c++) {
+        auto col = CameraClip::Column(c);
+        sources.push_back({camera.column(col), 4, 1, camera.length(col)});
+    }
+
+    BlockClipDirectory dir;
+    dir.clipNumber = num;
+    dir.blockFrames = options.blockFrames;
+    dir.frames = n;
+    dir.segments = move(segments);
+    vector<char> body, block;
+    for (const Source &s : sources) {
+        BlockColumn column;
+        column.width = s.width;
+        column.stride = s.stride;
+        column.rows = s.rows;
+        const uint8_t *src = static_cast<const uint8_t *>(s.data);
+        for (size_t first = 0; first < s.rows; first += dir.blockFrames) {
+            size_t rows = min<size_t>(dir.blockFrames, s.rows - first);
+            BlockRef ref;
+            ref.codec = encodeBlock(column, src + first * column.rowBytes(), rows, options.codec, block);
+            ref.offset = body.size();
+            ref.size = block.size();
+            body.insert(body.end(), block.begin(), block.end());
+            column.blocks.push_back(ref);
+            stats.blocks++;
+            stats.storedBlocks += ref.codec == BlockCodec::Stored;
+            stats.columnBytes += rows * column.rowBytes();
+            stats.compressedBytes += ref.size;
+        }
+        dir.columns.push_back(move(column));
+    }
+
+    msgpack::sbuffer directory;
+    packDirectory(directory, dir);
+    BlockFileHeader h;
+    memcpy(h.magic, kMagic, 4);
+    h.version = kVersion;
+    h.directoryBytes = directory.size();
+    vector<char> file(kHeaderBytes + directory.size() + body.size(), 0);
+    memcpy(file.data(), &h, sizeof(h));
+    memcpy(file.data() + kHeaderBytes, directory.data(), directory.size());
+    if (!body.empty())
+        memcpy(file.data() + kHeaderBytes + directory.size(), body.data(), body.size());
+    stats.fileBytes += file.size();
+    return file;
+}
+
+// 展開済みのファイル 1 つ分をデータベースに加える
+void addClipFile(const vector<char> &bytes,
+                 const string &path,
+                 Database &db,
+                 map<string, array<vector<char>, 3>> &loaded,
+                 BlockStoreStats &stats) {
+    if (bytes.size() < kHeaderBytes)
+        throw runtime_error("Invalid block file: " + path);
+    BlockFileHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.directoryBytes > bytes.size() - kHeaderBytes)
+        throw runtime_error("Truncated block file: " + path);
+    const char *body = bytes.data() + kHeaderBytes + header.directoryBytes;
+    BlockClipDirectory dir =
+        parseDirectory(header, bytes.data() + kHeaderBytes, bytes.size() - kHeaderBytes - header.directoryBytes, path);
+    const vector<BlockColumn> &columns = dir.columns;
+    size_t n = dir.frames;
+    if (db.clips.count(dir.clipNumber))
+        throw runtime_error("Duplicate clip " + dir.clipNumber + " in " + path);
+    if (columns[FlagsColumn].width != 1 || columns[FlagsColumn].stride != 1 || columns[JointColumn].width != 8 || columns[JointColumn].stride % 3 != 0 ||
+        columns[HipColumn].width != 8 || columns[HipColumn].stride != 4 || columns[MusicColumn].width != 8)
+        throw runtime_error("Invalid block file: " + path);
+    for (int c = FlagsColumn; c <= MusicColumn; c++) {
+        if (columns[c].rows != n)
+            throw runtime_error("Invalid block file: " + path);
+    }
+    for (int c = CameraColumnBase; c < NumBlockColumns; c++) {
+        if (columns[c].width != 4 || columns[c].stride != 1)
+            throw runtime_error("Invalid block file: " + path);
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    // 列 c の全ブロックを順に展開する。target が返す位置に直接書き、書いた後に done を呼ぶ
+    auto decodeColumn = [&](int c, auto target, auto done) {
+        const BlockColumn &column = columns[c];
+        for (size_t b = 0; b < column.blocks.size(); b++) {
+            size_t rows = dir.blockRows(column, b);
+            void *out = target(b * dir.blockFrames, rows);
+            const BlockRef &ref = column.blocks[b];
+            decodeBlock(column, ref.codec, body + ref.offset, ref.size, rows, out);
+            done(b * dir.blockFrames, rows);
+            stats.columnBytes += rows * column.rowBytes();
+            stats.compressedBytes += ref.size;
+            stats.blocks++;
+        }
+    };
+    auto nothing = [](size_t, size_t) {};
+
+    MotionClip &clip = db.clips[dir.clipNumber];
+    vector<uint8_t> frameFlags(n);
+    decodeColumn(FlagsColumn, [&](size_t first, size_t) { return frameFlags.data() + first; }, nothing);
+    // ヒップ方向と楽曲特徴量・カメラは距離計算で読む配列にそのまま展開する
+    clip.hip.assign(n, {0.0, 0.0, 0.0, 0.0});
+    decodeColumn(HipColumn, [&](size_t first, size_t) { return clip.hip.data() + first; }, nothing);
+
+    // 姿勢はフレームごとの FrameData に分けて持つので、ブロック単位で展開してから並べる
+    size_t joints = columns[JointColumn].stride / 3;
+    vector<double> scratch(size_t(dir.blockFrames) * max<size_t>(columns[JointColumn].stride, columns[MusicColumn].stride));
+    clip.raw.assign(n, FrameData{});
+    decodeColumn(JointColumn, [&](size_t, size_t) { return scratch.data(); }, [&](size_t first, size_t rows) {
+        for (size_t r = 0; r < rows; r++) {
+            FrameData &f = clip.raw[first + r];
+            f.hipQuaternion = clip.hip[first + r];
+            if (!(frameFlags[first + r] & 1))
+                continue;
+            const double *p = scratch.data() + r * joints * 3;
+            f.positions.resize(joints);
+            for (size_t j = 0; j < joints; j++)
+                f.positions[j] = {p[j * 3], p[j * 3 + 1], p[j * 3 + 2]};
+        }
+    });
+    size_t dims = columns[MusicColumn].stride;
+    clip.music.assign(n, {});
+    decodeColumn(MusicColumn, [&](size_t, size_t) { return scratch.data(); }, [&](size_t first, size_t rows) {
+        for (size_t r = 0; r < rows; r++) {
+            if (frameFlags[first + r] & 2)
+                clip.music[first + r].assign(scratch.data() + r * dims, scratch.data() + (r + 1) * dims);
+        }
+    });
+
+    array<size_t, CameraClip::NumColumns> lengths;
+    for (int c = 0; c < CameraClip::NumColumns; c++)
+        lengths[c] = columns[CameraColumnBase + c].rows;
+    CameraClip camera(lengths);
+    for (int c = 0; c < CameraClip::NumColumns; c++) {
+        float *out = camera.mutableColumn(CameraClip::Column(c));
+        decodeColumn(CameraColumnBase + c, [&](size_t first, size_t) { return out + first; }, nothing);
+    }
+    stats.decodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    // 区間ファイルから読んだときと同じく、揃っているフレームだけを読めたことにする
+    for (auto &f : loaded[dir.clipNumber]) {
+        f.assign(n, 0);
+        for (size_t i = 0; i < n; i++)
+            f[i] = (frameFlags[i] & 4) ? 1 : 0;
+    }
+    db.cameras.emplace(dir.clipNumber, move(camera));
+    for (DatabaseSegment &seg : dir.segments)
+        db.segments.push_back(move(seg));
+    stats.clips++;
+    stats.fileBytes += bytes.size();
+}
+
+} // namespace
+
+const char *blockCodecName(BlockCodec codec) {
+    switch (codec) {
+    case BlockCodec::Stored: return "stored";
+    case BlockCodec::Planes: return "planes";
+    case BlockCodec::Lz4: return "lz4";
+    case BlockCodec::Zstd: return "zstd";
+    }
+    return "unknown";
+}
+
+BlockCodec parseBlockCodec(const string &name) {
+    for (BlockCodec c : {BlockCodec::Stored, BlockCodec::Planes, BlockCodec::Lz4, BlockCodec::Zstd}) {
+        if (name == blockCodecName(c))
+            return c;
+    }
+    throw runtime_error("Unknown block codec: " + name);
+}
+
+bool blockCodecAvailable(BlockCodec codec) {
+    switch (codec) {
+    case BlockCodec::Stored:
+    case BlockCodec::Planes:
+        return true;
+    case BlockCodec::Lz4:
+#ifdef CAMSYNTH_WITH_LZ4
+        return true;
+#else
+        return false;
+#endif
+    case BlockCodec::Zstd:
+#ifdef CAMSYNTH_WITH_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+size_t BlockClipDirectory::blockRows(const BlockColumn &column, size_t block) const {
+    return min<size_t>(blockFrames, column.rows - block * blockFrames);
+}
+
+void decodeBlock(const BlockColumn &column, BlockCodec codec, const char *data, size_t size, size_t rows, void *out) {
+    size_t n = rows * column.stride;
+    size_t bytes = n * column.width;
+    if (codec == BlockCodec::Stored) {
+        if (size != bytes)
+            throw runtime_error("Corrupted block");
+        memcpy(out, data, bytes);
+        return;
+    }
+    // 面の並びに展開してから、XOR を戻しつつ out に書く
+    thread_local vector<uint8_t> planes;
+    planes.resize(bytes);
+    switch (codec) {
+    case BlockCodec::Planes:
+        decodePlanes(data, size, n, column.width, planes.data());
+        break;
+    case BlockCodec::Lz4:
+#ifdef CAMSYNTH_WITH_LZ4
+        if (LZ4_decompress_safe(data, reinterpret_cast<char *>(planes.data()), size, bytes) != int(bytes))
+            throw runtime_error("Corrupted block");
+        break;
+#endif
+    case BlockCodec::Zstd:
+#ifdef CAMSYNTH_WITH_ZSTD
+        if (codec == BlockCodec::Zstd) {
+            if (ZSTD_decompress(planes.data(), bytes, data, size) != bytes)
+                throw runtime_error("Corrupted block");
+            break;
+        }
+#endif
+        throw runtime_error(string("Block codec is not available in this build: ") + blockCodecName(codec));
+    default:
+        throw runtime_error("Unknown block codec");
+    }
+    fromPlanes(column, planes.data(), n, out);
+}
+
+BlockClipFile::BlockClipFile(const string &path) : path_(path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        throw runtime_error("Cannot open file: " + path);
+    try {
+        struct stat st;
+        BlockFileHeader header;
+        if (fstat(fd_, &st) != 0 || (size_t)st.st_size < kHeaderBytes ||
+            pread(fd_, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+            throw runtime_error("Invalid block file: " + path);
+        if (header.directoryBytes > st.st_size - kHeaderBytes)
+            throw runtime_error("Truncated block file: " + path);
+        vector<char> directory(header.directoryBytes);
+        if (pread(fd_, directory.data(), directory.size(), kHeaderBytes) != (ssize_t)directory.size())
+            throw runtime_error("Cannot read file: " + path);
+        directory_ = parseDirectory(header, directory.data(), st.st_size - kHeaderBytes - header.directoryBytes, path);
+        // ブロックの位置をファイル先頭からにしておく
+        for (BlockColumn &c : directory_.columns) {
+            for (BlockRef &b : c.blocks)
+                b.offset += kHeaderBytes + header.directoryBytes;
+        }
+    }
+    catch (...) {
+        close(fd_);
+        throw;
+    }
+}
+
+BlockClipFile::~BlockClipFile() {
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+size_t BlockClipFile::decodeBlock(int column, size_t block, void *out) const {
+    if (column < 0 || column >= (int)directory_.columns.size() || block >= directory_.columns[column].blocks.size())
+        throw runtime_error("Block out of range: " + path_);
+    const BlockColumn &c = directory_.columns[column];
+    const BlockRef &ref = c.blocks[block];
+    thread_local vector<char> data;
+    data.resize(ref.size);
+    if (pread(fd_, data.data(), ref.size, ref.offset) != (ssize_t)ref.size)
+        throw runtime_error("Cannot read file: " + path_);
+    size_t rows = directory_.blockRows(c, block);
+    camsynth::decodeBlock(c, ref.codec, data.data(), data.size(), rows, out);
+    return rows;
+}
+
+void BlockClipFile::decodeRows(int column, size_t firstRow, size_t count, void *out) const {
+    if (column < 0 || column >= (int)directory_.columns.size() ||
+        firstRow + count > directory_.columns[column].rows)
+        throw runtime_error("Rows out of range: " + path_);
+    const BlockColumn &c = directory_.columns[column];
+    size_t rowBytes = c.rowBytes();
+    size_t blockFrames = directory_.blockFrames;
+    char *dst = static_cast<char *>(out);
+    vector<char> partial;
+    for (size_t row = firstRow; row < firstRow + count;) {
+        size_t block = row / blockFrames;
+        size_t begin = block * blockFrames;
+        size_t rows = directory_.blockRows(c, block);
+        size_t take = min(begin + rows, firstRow + count) - row;
+        if (row == begin && take == rows) {
+            // ブロック全体が範囲に入るときは out に直接展開する
+            decodeBlock(column, block, dst);
+        }
+        else {
+            partial.resize(rows * rowBytes);
+            decodeBlock(column, block, partial.data());
+            memcpy(dst, partial.data() + (row - begin) * rowBytes, take * rowBytes);
+        }
+        dst += take * rowBytes;
+        row += take;
+    }
+}
+
+BlockStoreStats writeBlockStore(const Database &db,
+                                const DatabaseDirs &sourceDirs,
+                                const string &storeDir,
+                                const BlockStoreOptions &options) {
+    if (options.blockFrames <= 0)
+        throw runtime_error("Block frames must be positive");
+    if (!blockCodecAvailable(options.codec))
+        throw runtime_error(string("Block codec is not available in this build: ") + blockCodecName(options.codec));
+    fs::create_directories(storeDir);
+    // 書いている間は古いストアを使わせない（MANIFEST は全ファイルを書き終えてから置く）
+    fs::remove(storeDir + "/MANIFEST");
+
+    map<string, vector<DatabaseSegment>> segments;
+    for (const DatabaseSegment &seg : db.segments)
+        segments[seg.fileNumber].push_back(seg);
+    BlockStoreStats stats;
+    string manifest = string(kManifestHeader) + "\n" + "source " + resultCacheDatabaseVersion(sourceDirs, false) +
+                      "\n" + "segments " + to_string(db.scannedSegments) + "\n" + "codec " +
+                      blockCodecName(options.codec) + "\n";
+    vector<string> names;
+    for (const auto &kv : db.clips) {
+        const CameraClip *camera = db.camera(kv.first);
+        if (!camera)
+            continue;
+        vector<char> file = buildClipFile(kv.first, kv.second, *camera, segments[kv.first], options, stats);
+        string name = "c" + kv.first + ".cblk";
+        writeFileAtomically(storeDir + "/" + name, file.data(), file.size());
+        manifest += name + " " + kv.first + "\n";
+        names.push_back(name);
+        stats.clips++;
+    }
+    writeFileAtomically(storeDir + "/MANIFEST", manifest.data(), manifest.size());
+
+    // 前に作ったクリップで今回なかったものを消す
+    for (const auto &entry : fs::directory_iterator(storeDir)) {
+        string name = entry.path().filename().string();
+        if (entry.path().extension() == ".cblk" && find(names.begin(), names.end(), name) == names.end())
+            fs::remove(entry.path());
+    }
+    return stats;
+}
+
+bool loadBlockStore(const DatabaseDirs &dirs,
+                    Database &db,
+                    map<string, array<vector<char>, 3>> &loaded,
+                    BlockStoreStats *stats) {
+    error_code ec;
+    if (dirs.BlockStoreDir.empty() || !fs::exists(dirs.BlockStoreDir + "/MANIFEST", ec))
+        return false;
+    try {
+        Manifest manifest = readManifest(dirs.BlockStoreDir);
+        if (manifest.source != resultCacheDatabaseVersion(dirs, false)) {
+            cerr << "[WARN] ブロック圧縮データベースが元のデータと合わないため区間ファイルから読み込みます: "
+                 << dirs.BlockStoreDir << "（scripts/blockdb build で作り直してください）" << endl;
+            return false;
+        }
+        vector<string> paths;
+        for (const auto &f : manifest.files) {
+            if (dirs.ShardCount <= 1 || shardOfClip(f.second, dirs.ShardCount) == dirs.ShardIndex)
+                paths.push_back(dirs.BlockStoreDir + "/" + f.first);
+        }
+        BlockStoreStats st;
+        PrefetchReader reader(paths, dirs.IoThreads, dirs.PrefetchDepth);
+        for (size_t i = 0; i < paths.size(); i++) {
+            vector<char> bytes;
+            string error;
+            if (!reader.take(i, bytes, error))
+                throw runtime_error(error);
+            addClipFile(bytes, paths[i], db, loaded, st);
+        }
+        // 区間は区間ファイルの走査順に並べる
+        stable_sort(db.segments.begin(), db.segments.end(),
+                    [](const DatabaseSegment &a, const DatabaseSegment &b) { return a.order < b.order; });
+        db.scannedSegments = manifest.segments;
+        cout << "[INFO] ブロック圧縮データベースから " << st.clips << " クリップを読み込みました（"
+             << manifest.codec << ", 圧縮率 " << st.ratio() << " 倍, 展開 " << st.decodeGBps() << " GB/s）" << endl;
+        if (stats)
+            *stats = st;
+        return true;
+    }
+    catch (const std::exception &e) {
+        cerr << "[WARN] ブロック圧縮データベースを読み込めないため区間ファイルから読み込みます: " << dirs.BlockStoreDir
+             << " (" << e.what() << ")" << endl;
+        db = Database();
+        loaded.clear();
+        return false;
+    }
+}
+
+} // namespace camsynth
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "database.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// ブロック圧縮データベース
+// 区間ファイル (Split / Hip_Direction_Split / Music_Features_Split) とカメラデータをクリップごとに 1 ファイル
+// (c<N>.cblk) にまとめ、列（姿勢・ヒップ方向・楽曲特徴量・カメラの各列）ごとに blockFrames フレームずつの
+// ブロックに分けて圧縮したもの。DatabaseDirs::BlockStoreDir（既定 Database/Blocks）に scripts/blockdb で作る。
+// 区間ファイルの msgpack を unpack せずにブロックを展開するだけで読み込めるので、区間ファイルより読み込みが速い。
+//
+// ブロックの圧縮は、同じ列の 1 行前（姿勢なら前のフレームの同じジョイント・座標）との XOR を取り、
+// 値のバイトごとの面 (byte plane) に並べ替えてから codec で圧縮する。
+// 滑らかに動く値は XOR の上位バイト（符号・指数部）がほぼ 0 になるので、面ごとに見ると圧縮しやすい。
+// 圧縮しても小さくならないブロックはそのまま (Stored) 置く。ブロックの先頭の行は XOR を取らないので、
+// どのブロックも単独で展開できる（BlockClipFile でブロック単位に読める）。
+//
+//   MANIFEST   1 行目 "camsynth-blocks 1"、続けて "source <元データの版>" / "segments <走査した区間ファイル数>" /
+//              "codec <codec>"、以降 1 行に 1 ファイル（"ファイル名 クリップ番号"）
+//   c<N>.cblk  ヘッダ 64 バイト ("CBLK" / version (uint32) / ディレクトリのバイト数 (uint64))、
+//              msgpack のディレクトリ（区間と列ごとのブロックの位置）、ブロック本体（ホストのバイト順）
+//
+// 元データの版 (resultCacheDatabaseVersion) が MANIFEST と違うときは使わずに区間ファイルから読む。
+
+// ブロックの圧縮方式
+// Planes は外部ライブラリを使わない方式（面ごとに 0 / 定数 / 0 以外のバイトだけ / そのまま のどれか）
+// Lz4 / Zstd は CAMSYNTH_WITH_LZ4 / CAMSYNTH_WITH_ZSTD を定義して liblz4 / libzstd とリンクしたときだけ使える
+enum class BlockCodec : std::uint8_t { Stored = 0, Planes = 1, Lz4 = 2, Zstd = 3 };
+
+const char *blockCodecName(BlockCodec codec);
+// "planes" / "lz4" / "zstd" / "stored"（知らない名前なら例外）
+BlockCodec parseBlockCodec(const std::string &name);
+// このビルドで使えるか
+bool blockCodecAvailable(BlockCodec codec);
+
+// ファイル内の列の番号（カメラの列は CameraColumnBase + CameraClip::Column）
+enum BlockColumnId {
+    FlagsColumn,  // フレームごとのフラグ (uint8): 1 = 姿勢あり, 2 = 楽曲特徴量あり, 4 = 全て揃っている
+    JointColumn,  // 姿勢 (double, 1 行 = ジョイント数 × 3)
+    HipColumn,    // ヒップのクォータニオン (double, 1 行 = 4)
+    MusicColumn,  // 楽曲特徴量 (double, 1 行 = 次元数)
+    CameraColumnBase,
+    NumBlockColumns = CameraColumnBase + CameraClip::NumColumns
+};
+
+struct BlockRef {
+    std::uint64_t offset = 0; // ブロック本体の先頭からの位置（BlockClipFile の directory() ではファイル先頭から）
+    std::uint32_t size = 0;   // 圧縮後のバイト数
+    BlockCodec codec = BlockCodec::Stored;
+};
+
+struct BlockColumn {
+    std::uint32_t width = 0;  // 値 1 つのバイト数 (1 / 4 / 8)
+    std::uint32_t stride = 0; // 1 行の値の数
+    std::uint64_t rows = 0;
+    std::vector<BlockRef> blocks;
+
+    size_t rowBytes() const { return size_t(width) * stride; }
+};
+
+// c<N>.cblk のディレクトリ
+struct BlockClipDirectory {
+    std::string clipNumber;
+    std::uint32_t blockFrames = 0;
+    std::uint64_t frames = 0;
+    std::vector<DatabaseSegment> segments;
+    std::vector<BlockColumn> columns;
+
+    size_t blockRows(const BlockColumn &column, size_t block) const;
+};
+
+// ブロック 1 つを展開する（out には rows × column.rowBytes() バイト書く。壊れていれば例外）
+void decodeBlock(const BlockColumn &column, BlockCodec codec, const char *data, size_t size, size_t rows, void *out);
+
+// c<N>.cblk をブロック単位で読む（必要なブロックだけを pread で読んで展開する）
+class BlockClipFile {
+public:
+    explicit BlockClipFile(const std::string &path);
+    ~BlockClipFile();
+
+    BlockClipFile(const BlockClipFile &) = delete;
+    BlockClipFile &operator=(const BlockClipFile &) = delete;
+
+    const BlockClipDirectory &directory() const { return directory_; }
+
+    // 列 column の block 番目のブロックを out に展開し、行数を返す
+    size_t decodeBlock(int column, size_t block, void *out) const;
+    // 列 column の [firstRow, firstRow + count) 行を out に展開する（範囲外なら例外）
+    void decodeRows(int column, size_t firstRow, size_t count, void *out) const;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    BlockClipDirectory directory_;
+};
+
+struct BlockStoreOptions {
+    BlockCodec codec = BlockCodec::Planes;
+    int blockFrames = 1024;
+};
+
+// 書き込み・読み込みの集計
+struct BlockStoreStats {
+    size_t clips = 0;
+    size_t blocks = 0;
+    size_t storedBlocks = 0;          // 圧縮しなかったブロック数
+    std::uint64_t columnBytes = 0;     // 展開後のバイト数
+    std::uint64_t compressedBytes = 0; // ブロック本体のバイト数
+    std::uint64_t fileBytes = 0;       // ヘッダ・ディレクトリを含むファイルのバイト数
+    double decodeSeconds = 0.0;        // 展開にかかった時間（読み込みのときだけ）
+
+    double ratio() const { return compressedBytes ? double(columnBytes) / compressedBytes : 0.0; }
+    double decodeGBps() const { return decodeSeconds > 0 ? columnBytes / decodeSeconds / 1e9 : 0.0; }
+};
+
+// 区間ファイルから読み込んだデータベース（取り込んだクリップを含まず、シャードに分けていないもの）を
+// storeDir に書き出す。sourceDirs はその読み込みに使ったディレクトリ（元データの版を MANIFEST に書く）
+BlockStoreStats writeBlockStore(const Database &db,
+                                const DatabaseDirs &sourceDirs,
+                                const std::string &storeDir,
+                                const BlockStoreOptions &options = {});
+
+// dirs.BlockStoreDir が使えれば db にクリップ・区間・カメラデータを読み込んで true を返す
+// loaded にはクリップごとの各フレームのデータが揃っているか (raw, hip, music) を入れる。
+// ストアがない・元データと合わない・読めないときは db と loaded を空のままにして false を返す
+bool loadBlockStore(const DatabaseDirs &dirs,
+                    Database &db,
+                    std::map<std::string, std::array<std::vector<char>, 3>> &loaded,
+                    BlockStoreStats *stats = nullptr);
+
+} // namespace camsynth
@@ -0,0 +1,205 @@
+#include "bvh.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+namespace camsynth {
+
+// joint_extraction.py の target_indices を new_order で並べ替えたもの
+const array<int, 23> kDatabaseBvhNodes = {1, 10, 12, 13, 14, 16, 17, 2, 3, 4, 5, 6, 7, 8, 9,
+                                          18, 19, 20, 21, 37, 38, 39, 40};
+
+namespace {
+
+int channelIndex(const string &name) {
+    static const char *kNames[6] = {"Xposition", "Yposition", "Zposition", "Xrotation", "Yrotation", "Zrotation"};
+    for (int c = 0; c < 6; c++) {
+        if (name == kNames[c])
+            return c;
+    }
+    return -1;
+}
+
+// 3x3 行列（行優先）の積 a * b
+array<double, 9> multiply(const array<double, 9> &a, const array<double, 9> &b) {
+    array<double, 9> r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++)
+            r[i * 3 + j] = a[i * 3] * b[j] + a[i * 3 + 1] * b[3 + j] + a[i * 3 + 2] * b[6 + j];
+    }
+    return r;
+}
+
+// 軸 axis (0: X, 1: Y, 2: Z) 回りに degrees 度回す行列
+array<double, 9> axisRotation(int axis, double degrees) {
+    double rad = degrees * M_PI / 180.0;
+    double c = cos(rad), s = sin(rad);
+    switch (axis) {
+    case 0: return {1.0, 0.0, 0.0, 0.0, c, -s, 0.0, s, c};
+    case 1: return {c, 0.0, s, 0.0, 1.0, 0.0, -s, 0.0, c};
+    default: return {c, -s, 0.0, s, c, 0.0, 0.0, 0.0, 1.0};
+    }
+}
+
+const array<double, 9> kIdentityMatrix = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+
+} // namespace
+
+BvhReader::BvhReader(const string &path) : file_(path), path_(path) {
+    if (!file_)
+        throw runtime_error("Cannot open file: " + path);
+    string token;
+    if (!(file_ >> token) || token != "HIERARCHY")
+        throw runtime_error("Not a BVH file (HIERARCHY not found): " + path);
+    if (!(file_ >> token) || token != "ROOT")
+        throw runtime_error("BVH root not found: " + path);
+    parseNode(token, -1);
+
+    if (!(file_ >> token) || token != "MOTION")
+        throw runtime_error("MOTION section not found in BVH file: " + path);
+    // Frames: N / Frame Time: t
+    string frameTimeWord;
+    long long frames = 0;
+    if (!(file_ >> token >> frames) || token != "Frames:" || frames < 0 ||
+        !(file_ >> token >> frameTimeWord >> frameTime_) || token != "Frame" || frameTimeWord != "Time:")
+        throw runtime_error("Invalid MOTION header in BVH file: " + path);
+    declaredFrames_ = static_cast<size_t>(frames);
+    getline(file_, lineBuffer_);
+    rotations_.resize(nodes_.size());
+}
+
+void BvhReader::parseNode(const string &keyword, int parent) {
+    BvhNode node;
+    node.parent = parent;
+    string token;
+    if (keyword == "End") {
+        if (!(file_ >> token) || token != "Site")
+            throw runtime_error("Expected 'End Site' in BVH file: " + path_);
+        node.name = "End Site";
+        node.endSite = true;
+    } else if (!(file_ >> node.name)) {
+        throw runtime_error("Unexpected end of BVH hierarchy: " + path_);
+    }
+    if (!(file_ >> token) || token != "{")
+        throw runtime_error("Expected '{' after " + node.name + " in BVH file: " + path_);
+    int index = static_cast<int>(nodes_.size());
+    node.firstChannel = numChannels_;
+    nodes_.push_back(node);
+
+    while (file_ >> token) {
+        if (token == "}")
+            return;
+        if (token == "OFFSET") {
+            array<double, 3> &offset = nodes_[index].offset;
+            if (!(file_ >> offset[0] >> offset[1] >> offset[2]))
+                throw runtime_error("Invalid OFFSET of " + nodes_[index].name + " in BVH file: " + path_);
+        } else if (token == "CHANNELS") {
+            int n = 0;
+            if (!(file_ >> n) || n < 0 || n > 6)
+                throw runtime_error("Invalid CHANNELS of " + nodes_[index].name + " in BVH file: " + path_);
+            for (int c = 0; c < n; c++) {
+                int channel = (file_ >> token) ? channelIndex(token) : -1;
+                if (channel < 0)
+                    throw runtime_error("Unknown channel '" + token + "' in BVH file: " + path_);
+                nodes_[index].channels.push_back(channel);
+            }
+            numChannels_ += n;
+        } else if (token == "JOINT" || token == "End") {
+            parseNode(token, index);
+        } else {
+            throw runtime_error("Unexpected '" + token + "' in BVH hierarchy: " + path_);
+        }
+    }
+    throw runtime_error("Unexpected end of BVH hierarchy: " + path_);
+}
+
+bool BvhReader::nextFrame(vector<double> &values) {
+    values.resize(numChannels_);
+    while (getline(file_, lineBuffer_)) {
+        const char *p = lineBuffer_.c_str();
+        char *end = nullptr;
+        int count = 0;
+        for (; count < numChannels_; count++) {
+            values[count] = strtod(p, &end);
+            if (end == p)
+                break;
+            p = end;
+        }
+        if (count == 0 && lineBuffer_.find_first_not_of(" \t\r") == string::npos)
+            continue; // 空行
+        line_++;
+        if (count < numChannels_)
+            throw runtime_error("Frame " + to_string(line_ - 1) + " has " + to_string(count) + " of " +
+                                to_string(numChannels_) + " channel values in BVH file: " + path_);
+        return true;
+    }
+    return false;
+}
+
+void BvhReader::forwardKinematics(const double *values, vector<array<double, 3>> &positions) {
+    positions.resize(nodes_.size());
+    // 深さ優先順なので親は必ず先に計算済み
+    for (size_t i = 0; i < nodes_.size(); i++) {
+        const BvhNode &node = nodes_[i];
+        array<double, 3> local = node.offset;
+        array<double, 9> localRotation = kIdentityMatrix;
+        int numPositions = 0;
+        bool hasRotation = false;
+        for (size_t c = 0; c < node.channels.size(); c++) {
+            int channel = node.channels[c];
+            double v = values[node.firstChannel + c];
+            if (channel < 3) {
+                local[channel] = v;
+                numPositions++;
+            } else {
+                localRotation = hasRotation ? multiply(localRotation, axisRotation(channel - 3, v))
+                                            : axisRotation(channel - 3, v);
+                hasRotation = true;
+            }
+        }
+        if (numPositions != 3)
+            local = node.offset;
+
+        if (node.parent < 0) {
+            positions[i] = local;
+            rotations_[i] = localRotation;
+            continue;
+        }
+        const array<double, 9> &parentRotation = rotations_[node.parent];
+        const array<double, 3> &parentPosition = positions[node.parent];
+        for (int k = 0; k < 3; k++)
+            positions[i][k] = parentPosition[k] + parentRotation[k * 3] * local[0] +
+                              parentRotation[k * 3 + 1] * local[1] + parentRotation[k * 3 + 2] * local[2];
+        rotations_[i] = hasRotation ? multiply(parentRotation, localRotation) : parentRotation;
+    }
+}
+
+vector<FrameData> loadBvhMotion(const string &path) {
+    BvhReader reader(path);
+    if (reader.nodes().size() <= static_cast<size_t>(kDatabaseBvhNodes.back()))
+        throw runtime_error("BVH file has " + to_string(reader.nodes().size()) + " nodes, but " +
+                            to_string(kDatabaseBvhNodes.back() + 1) + " are needed for the database joints: " + path);
+
+    vector<FrameData> frames;
+    frames.reserve(reader.declaredFrames());
+    vector<double> values;
+    vector<array<double, 3>> positions;
+    while (reader.nextFrame(values)) {
+        reader.forwardKinematics(values.data(), positions);
+        FrameData fd{};
+        fd.positions.resize(kDatabaseBvhNodes.size());
+        for (size_t j = 0; j < kDatabaseBvhNodes.size(); j++)
+            fd.positions[j] = positions[kDatabaseBvhNodes[j]];
+        frames.push_back(move(fd));
+    }
+    return frames;
+}
+
+bool isBvhPath(const string &path) {
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bvh") == 0;
+}
+
+} // namespace camsynth
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace camsynth {
+
+// BVH のモーションを読み込み、データベースと同じ 23 ジョイントの raw モーションを求める
+// （scripts/my_utils/bvh2json.py・joint_extraction.py と同じ計算）
+// 階層を読んだ後はフレームを 1 行ずつ読みながら順運動学を計算するので、BVH 全体をメモリに載せない。
+
+// BVH のノード 1 つ分（End Site も含めて階層の深さ優先順に並べる）
+struct BvhNode {
+    std::string name;
+    int parent = -1;                      // 親ノードの番号（root は -1）
+    std::array<double, 3> offset = {0.0, 0.0, 0.0};
+    int firstChannel = 0;                 // フレームの値の中でのこのノードのチャンネルの先頭
+    std::vector<int> channels;            // 0 ～ 2: X/Y/Z position, 3 ～ 5: X/Y/Z rotation
+    bool endSite = false;
+};
+
+// 23 ジョイントの並びに対応する BVH のノード番号（深さ優先順、End Site も数える）
+extern const std::array<int, 23> kDatabaseBvhNodes;
+
+class BvhReader {
+public:
+    // 階層と MOTION の見出し (Frames / Frame Time) まで読む。読めない形式のときは例外
+    explicit BvhReader(const std::string &path);
+
+    const std::vector<BvhNode> &nodes() const { return nodes_; }
+    int numChannels() const { return numChannels_; }
+    // Frames: に書かれたフレーム数
+    size_t declaredFrames() const { return declaredFrames_; }
+    double frameTime() const { return frameTime_; }
+
+    // 次のフレームのチャンネルの値を読む（numChannels() 個）。終わりなら false
+    bool nextFrame(std::vector<double> &values);
+
+    // 1 フレーム分の全ノードのグローバル位置を求める（positions は nodes() と同じ並び）
+    // root はチャンネルの位置、それ以外は親の回転を掛けたオフセット（位置のチャンネルが 3 つあればその値）を足す。
+    // 回転はチャンネルの順に掛ける (scipy の from_euler(順序の逆, 値の逆) と同じ)。
+    void forwardKinematics(const double *values, std::vector<std::array<double, 3>> &positions);
+
+private:
+    void parseNode(const std::string &keyword, int parent);
+
+    std::ifstream file_;
+    std::string path_;
+    std::vector<BvhNode> nodes_;
+    int numChannels_ = 0;
+    size_t declaredFrames_ = 0;
+    double frameTime_ = 0.0;
+    size_t line_ = 0;                     // エラー表示用のフレームの番号
+    std::string lineBuffer_;
+    std::vector<std::array<double, 9>> rotations_; // ノードごとのグローバル回転（forwardKinematics の作業用）
+};
+
+// BVH ファイルから 23 ジョイントの raw モーション（raw.msgpack と同じ FrameData 列）を読み込む
+std::vector<FrameData> loadBvhMotion(const std::string &path);
+
+// パスが BVH ファイル（拡張子 .bvh）か
+bool isBvhPath(const std::string &path);
+
+} // namespace camsynth
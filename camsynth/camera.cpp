@@ -0,0 +1,92 @@
+#include "camera.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace camsynth {
+
+void appendCameraSegment(const Database &db,
+                         CameraTrack &track,
+                         const string &fileName,
+                         int lengthFrames,
+                         int offset,
+                         const vector<array<double, 3>> *translations) {
+    if (fileName.empty()) {
+        for (int i = 0; i < lengthFrames; i++) {
+            size_t k = track.position.size();
+            if (translations && k < translations->size())
+                track.position.push_back((*translations)[k]);
+            else
+                track.position.push_back({0, 0, 0});
+            track.rotation.push_back({0, 0, 0});
+            track.viewangle.push_back(60.0);
+        }
+        return;
+    }
+    ClipWindow window;
+    const CameraClip *clip = db.resolveWindow(fileName, window) ? window.camera : nullptr;
+    if (!clip) {
+        cerr << "カメラデータが不足しています: " << fileName << "\n";
+        return;
+    }
+    int startIndex = max(window.start + offset, 0);
+    int endIndex = startIndex + lengthFrames;
+    endIndex = min(endIndex, (int)clip->eyeFrames());
+    endIndex = min(endIndex, (int)clip->rotationFrames());
+    endIndex = min(endIndex, (int)clip->fovFrames());
+    if (endIndex <= startIndex)
+        return;
+    size_t n = endIndex - startIndex;
+    size_t base = track.position.size();
+    track.position.resize(base + n);
+    track.rotation.resize(base + n);
+    const float *fov = clip->column(CameraClip::Fov) + startIndex;
+    track.viewangle.insert(track.viewangle.end(), fov, fov + n);
+
+    // 列ごとの連続領域から (x, y, z) の並びに詰め直す。平行移動はこのコピーの中で加える
+    const float *__restrict ex = clip->column(CameraClip::EyeX) + startIndex;
+    const float *__restrict ey = clip->column(CameraClip::EyeY) + startIndex;
+    const float *__restrict ez = clip->column(CameraClip::EyeZ) + startIndex;
+    double *__restrict pos = track.position[base].data();
+    size_t numTranslated = 0;
+    if (translations && translations->size() > base)
+        numTranslated = min(n, translations->size() - base);
+    if (numTranslated > 0) {
+        const double *__restrict tr = (*translations)[base].data();
+        for (size_t i = 0; i < numTranslated; i++) {
+            pos[3 * i + 0] = ex[i] + tr[3 * i + 0];
+            pos[3 * i + 1] = ey[i] + tr[3 * i + 1];
+            pos[3 * i + 2] = ez[i] + tr[3 * i + 2];
+        }
+    }
+    for (size_t i = numTranslated; i < n; i++) {
+        pos[3 * i + 0] = ex[i];
+        pos[3 * i + 1] = ey[i];
+        pos[3 * i + 2] = ez[i];
+    }
+    const float *__restrict rx = clip->column(CameraClip::RotationX) + startIndex;
+    const float *__restrict ry = clip->column(CameraClip::RotationY) + startIndex;
+    const float *__restrict rz = clip->column(CameraClip::RotationZ) + startIndex;
+    double *__restrict rot = track.rotation[base].data();
+    for (size_t i = 0; i < n; i++) {
+        rot[3 * i + 0] = rx[i];
+        rot[3 * i + 1] = ry[i];
+        rot[3 * i + 2] = rz[i];
+    }
+}
+
+CameraTrack assembleCameraTrack(const Database &db,
+                                const vector<SegmentChoice> &choices,
+                                const vector<int> &lengths,
+                                const vector<array<double, 3>> &translations) {
+    CameraTrack track;
+    for (size_t segIndex = 0; segIndex < choices.size(); segIndex++) {
+        appendCameraSegment(db, track, choices[segIndex].file, lengths[segIndex], choices[segIndex].offset,
+                            &translations);
+    }
+    return track;
+}
+
+} // namespace camsynth
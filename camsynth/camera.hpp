@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "database.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// 1 セグメント分のカメラデータを track の末尾に追加する
+// fileName が空のときは既定のカメラ（原点・FOV 60）で埋める
+// translations を渡すと、track の k フレーム目の位置に translations[k] を加えながらコピーする
+void appendCameraSegment(const Database &db,
+                         CameraTrack &track,
+                         const std::string &fileName,
+                         int lengthFrames,
+                         int offset = 0,
+                         const std::vector<std::array<double, 3>> *translations = nullptr);
+
+// 選ばれた候補のカメラデータをつなぎ、平行移動を加える
+CameraTrack assembleCameraTrack(const Database &db,
+                                const std::vector<SegmentChoice> &choices,
+                                const std::vector<int> &lengths,
+                                const std::vector<std::array<double, 3>> &translations);
+
+} // namespace camsynth
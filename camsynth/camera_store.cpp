@@ -0,0 +1,124 @@
+#include "camera_store.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "prefetch.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+const char kMagic[4] = {'C', 'C', 'O', 'L'};
+const uint32_t kVersion = 1;
+const size_t kHeaderBytes = 128;
+const size_t kColumnAlign = 16; // float 16 個 = 64 バイト
+
+struct ColumnFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t lengths[CameraClip::NumColumns];
+};
+static_assert(sizeof(ColumnFileHeader) <= kHeaderBytes, "列ファイルのヘッダが大きすぎます");
+
+size_t alignedLength(size_t n) {
+    return (n + kColumnAlign - 1) / kColumnAlign * kColumnAlign;
+}
+
+} // namespace
+
+CameraClip::CameraClip(const vector<array<double, 3>> &eye,
+                       const vector<array<double, 3>> &rotation,
+                       const vector<double> &fov,
+                       const vector<double> &distance)
+    : CameraClip({eye.size(), eye.size(), eye.size(), rotation.size(), rotation.size(), rotation.size(), fov.size(),
+                  distance.size()}) {
+    for (int d = 0; d < 3; d++) {
+        float *e = mutableColumn(Column(EyeX + d));
+        for (size_t i = 0; i < eye.size(); i++)
+            e[i] = eye[i][d];
+        float *r = mutableColumn(Column(RotationX + d));
+        for (size_t i = 0; i < rotation.size(); i++)
+            r[i] = rotation[i][d];
+    }
+    copy(fov.begin(), fov.end(), mutableColumn(Fov));
+    copy(distance.begin(), distance.end(), mutableColumn(Distance));
+}
+
+CameraClip::CameraClip(const array<size_t, NumColumns> &lengths) : lengths_(lengths) {
+    size_t total = 0;
+    array<size_t, NumColumns> offsets;
+    for (int c = 0; c < NumColumns; c++) {
+        offsets[c] = total;
+        total += alignedLength(lengths_[c]);
+    }
+    storage_.assign(total, 0.0f);
+    for (int c = 0; c < NumColumns; c++)
+        columns_[c] = storage_.data() + offsets[c];
+}
+
+CameraClip CameraClip::mapFile(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Cannot open file: " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kHeaderBytes) {
+        close(fd);
+        throw runtime_error("Invalid camera column file: " + path);
+    }
+    size_t size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        throw runtime_error("Cannot mmap file: " + path);
+    shared_ptr<const void> mapping(addr, [size](const void *p) { munmap(const_cast<void *>(p), size); });
+
+    ColumnFileHeader header;
+    memcpy(&header, addr, sizeof(header));
+    if (memcmp(header.magic, kMagic, 4) != 0 || header.version != kVersion)
+        throw runtime_error("Invalid camera column file: " + path);
+    CameraClip clip;
+    size_t offset = kHeaderBytes / sizeof(float);
+    for (int c = 0; c < NumColumns; c++) {
+        clip.lengths_[c] = header.lengths[c];
+        clip.columns_[c] = static_cast<const float *>(addr) + offset;
+        offset += alignedLength(header.lengths[c]);
+    }
+    if (offset * sizeof(float) > size)
+        throw runtime_error("Truncated camera column file: " + path);
+    clip.mapping_ = move(mapping);
+    return clip;
+}
+
+void CameraClip::writeFile(const string &path) const {
+    // ヘッダと 64 バイトにそろえた列を 1 つのバッファに並べ、一時ファイルからの rename で置き換える
+    // （書きかけのファイルを読まない。同時に書くプロセスがあっても一時ファイルは別になる）
+    size_t total = kHeaderBytes / sizeof(float);
+    for (int c = 0; c < NumColumns; c++)
+        total += alignedLength(lengths_[c]);
+    vector<float> buf(total, 0.0f);
+    ColumnFileHeader h;
+    memcpy(h.magic, kMagic, 4);
+    h.version = kVersion;
+    for (int c = 0; c < NumColumns; c++)
+        h.lengths[c] = lengths_[c];
+    memcpy(buf.data(), &h, sizeof(h));
+    size_t offset = kHeaderBytes / sizeof(float);
+    for (int c = 0; c < NumColumns; c++) {
+        copy(columns_[c], columns_[c] + lengths_[c], buf.begin() + offset);
+        offset += alignedLength(lengths_[c]);
+    }
+    writeFileAtomically(path, reinterpret_cast<const char *>(buf.data()), buf.size() * sizeof(float));
+}
+
+} // namespace camsynth
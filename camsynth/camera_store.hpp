@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace camsynth {
+
+// クリップ 1 つ分のカメラデータ（CameraCentric / CameraInterpolated）
+// 列 (eye xyz, rotation xyz, fov, distance) ごとに連続した float 配列で持つので、
+// 区間の取り出しは列ごとの連続コピーになる。
+// 列ファイル (.ccol) から読む場合はファイルを mmap し、その領域をそのまま参照する。
+//
+// 列ファイルの形式（ホストのバイト順）
+//   ヘッダ 128 バイト: "CCOL" / version (uint32) / 列ごとのフレーム数 (uint64 × 8)
+//   続けて各列の float 配列。各列の先頭は 64 バイト境界にそろえる。
+class CameraClip {
+public:
+    enum Column { EyeX, EyeY, EyeZ, RotationX, RotationY, RotationZ, Fov, Distance, NumColumns };
+
+    CameraClip() = default;
+    // msgpack から読んだ値から作る（列ごとの長さは揃っていなくてよい）
+    CameraClip(const std::vector<std::array<double, 3>> &eye,
+               const std::vector<std::array<double, 3>> &rotation,
+               const std::vector<double> &fov,
+               const std::vector<double> &distance);
+
+    // 列は storage_ か mmap 領域を指すのでコピーはしない
+    CameraClip(const CameraClip &) = delete;
+    CameraClip &operator=(const CameraClip &) = delete;
+    CameraClip(CameraClip &&) = default;
+    CameraClip &operator=(CameraClip &&) = default;
+
+    // 列ごとの長さだけ決めて 0 で埋めた列を用意する（値は mutableColumn に直接書く）
+    explicit CameraClip(const std::array<size_t, NumColumns> &lengths);
+
+    // 列ファイルを mmap して読む（開けない・形式が違うときは例外）
+    static CameraClip mapFile(const std::string &path);
+    // 列ファイルに書き出す
+    void writeFile(const std::string &path) const;
+
+    const float *column(Column c) const { return columns_[c]; }
+    // 長さを指定して作った列に書き込む（mmap した列には使えない）
+    float *mutableColumn(Column c) { return const_cast<float *>(columns_[c]); }
+    size_t length(Column c) const { return lengths_[c]; }
+
+    size_t eyeFrames() const { return lengths_[EyeX]; }
+    size_t rotationFrames() const { return lengths_[RotationX]; }
+    size_t fovFrames() const { return lengths_[Fov]; }
+    size_t distanceFrames() const { return lengths_[Distance]; }
+
+    std::array<double, 3> eye(size_t i) const {
+        return {columns_[EyeX][i], columns_[EyeY][i], columns_[EyeZ][i]};
+    }
+    double fov(size_t i) const { return columns_[Fov][i]; }
+    double distance(size_t i) const { return columns_[Distance][i]; }
+
+private:
+    std::vector<float> storage_;             // msgpack から作った場合の列データ
+    std::shared_ptr<const void> mapping_;    // mmap した列ファイル（最後の参照で munmap）
+    std::array<const float *, NumColumns> columns_{};
+    std::array<size_t, NumColumns> lengths_{};
+};
+
+} // namespace camsynth
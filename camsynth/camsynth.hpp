@@ -0,0 +1,20 @@
+#pragma once
+
+// libcamsynth の公開ヘッダ一式
+#include "types.hpp"
+#include "arena.hpp"
+#include "kernels.hpp"
+#include "motion.hpp"
+#include "bvh.hpp"
+#include "segmentation.hpp"
+#include "music_features.hpp"
+#include "pose_index.hpp"
+#include "database.hpp"
+#include "block_store.hpp"
+#include "search.hpp"
+#include "camera.hpp"
+#include "streaming.hpp"
+#include "engine.hpp"
+#include "concurrent_engine.hpp"
+#include "shard.hpp"
+#include "result_cache.hpp"
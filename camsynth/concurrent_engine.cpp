@@ -0,0 +1,111 @@
+#include "concurrent_engine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+
+using namespace std;
+
+namespace camsynth {
+
+ConcurrentEngine::ConcurrentEngine(const DatabaseDirs &dirs, size_t maxReaders)
+    : current_(new Version{make_unique<const Engine>(dirs), 1}), slots_(max<size_t>(1, maxReaders)) {}
+
+ConcurrentEngine::ConcurrentEngine(Database db, size_t maxReaders)
+    : current_(new Version{make_unique<const Engine>(move(db)), 1}), slots_(max<size_t>(1, maxReaders)) {}
+
+ConcurrentEngine::~ConcurrentEngine() {
+    if (reloadThread_.joinable())
+        reloadThread_.join();
+    for (auto &r : retired_)
+        delete r.first;
+    delete current_.load();
+}
+
+ConcurrentEngine::Snapshot ConcurrentEngine::pin() const {
+    // スロットに今のエポックを書いてから current_ を読む。
+    // publish は current_ を差し替えてからエポックを進めるので、差し替え後のエポックを書いたスロットは
+    // 必ず新しい版を読み、古い版を持ちうるのは差し替え前のエポックを書いたスロットだけになる。
+    size_t n = slots_.size();
+    size_t start = hash<thread::id>()(this_thread::get_id()) % n;
+    for (;;) {
+        for (size_t k = 0; k < n; k++) {
+            atomic<uint64_t> &slot = slots_[(start + k) % n].epoch;
+            if (slot.load(memory_order_relaxed) != 0)
+                continue;
+            uint64_t expected = 0;
+            if (slot.compare_exchange_strong(expected, epoch_.load()))
+                return Snapshot(&slot, current_.load());
+        }
+        this_thread::yield();
+    }
+}
+
+uint64_t ConcurrentEngine::version() const {
+    return current_.load()->number;
+}
+
+uint64_t ConcurrentEngine::publish(Database db) {
+    return publish(make_unique<const Engine>(move(db)));
+}
+
+uint64_t ConcurrentEngine::publish(unique_ptr<const Engine> engine) {
+    lock_guard<mutex> lock(writerMutex_);
+    const Version *next = new Version{move(engine), ++nextVersion_};
+    const Version *old = current_.exchange(next);
+    retired_.emplace_back(old, epoch_.fetch_add(1) + 1);
+    reclaimLocked();
+    return next->number;
+}
+
+size_t ConcurrentEngine::reclaim() {
+    lock_guard<mutex> lock(writerMutex_);
+    return reclaimLocked();
+}
+
+size_t ConcurrentEngine::reclaimLocked() {
+    // pin 中のスロットで最も古いエポック。差し替え後のエポックがそれ以下の版は誰も持っていない
+    uint64_t oldest = numeric_limits<uint64_t>::max();
+    for (const ReaderSlot &slot : slots_) {
+        uint64_t e = slot.epoch.load();
+        if (e != 0)
+            oldest = min(oldest, e);
+    }
+    auto unused = [oldest](const pair<const Version *, uint64_t> &r) { return r.second <= oldest; };
+    for (auto &r : retired_) {
+        if (unused(r))
+            delete r.first;
+    }
+    retired_.erase(remove_if(retired_.begin(), retired_.end(), unused), retired_.end());
+    return retired_.size();
+}
+
+void ConcurrentEngine::reloadAsync(const DatabaseDirs &dirs) {
+    if (reloadThread_.joinable())
+        reloadThread_.join();
+    reloadError_ = nullptr;
+    reloadThread_ = thread([this, dirs]() {
+        try {
+            publish(make_unique<const Engine>(dirs));
+            // 古い版の解放も検索スレッドではなくここで行う
+            while (reclaim() > 0)
+                this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        catch (...) {
+            reloadError_ = current_exception();
+        }
+    });
+}
+
+void ConcurrentEngine::waitForReload() {
+    if (reloadThread_.joinable())
+        reloadThread_.join();
+    if (reloadError_) {
+        exception_ptr error = reloadError_;
+        reloadError_ = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+} // namespace camsynth
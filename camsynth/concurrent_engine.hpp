@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace camsynth {
+
+// データベースを止めずに差し替えられるエンジン（常駐サービス向け）
+// 読み込み済みのデータベースを変更しないスナップショット（Engine）として保持し、検索スレッドは
+// pin() で今のスナップショットを取って使う。pin() と解放はスロットへの原子的な書き込みだけで、ロックを取らない。
+// 新しいデータベースは publish() / reloadAsync() で原子的に差し替え、古いスナップショットはそれを
+// pin していた検索が全て終わってから（エポックで判定して）差し替えた側のスレッドで解放する。
+//
+//   camsynth::ConcurrentEngine engine(camsynth::DatabaseDirs{});
+//   // 検索スレッド
+//   {
+//       auto snapshot = engine.pin();
+//       SearchResult res = snapshot->search(input, frameIntervals, modes);
+//       CameraTrack track = snapshot->assembleCamera(res);   // 検索と同じスナップショットで組み立てる
+//   }
+//   // 管理スレッド
+//   engine.reloadAsync(camsynth::DatabaseDirs{});             // 裏で読み込んで差し替える
+//
+// Snapshot は ConcurrentEngine より長く持たないこと。
+class ConcurrentEngine {
+    struct Version {
+        std::unique_ptr<const Engine> engine;
+        std::uint64_t number;
+    };
+    // 検索スレッドごとのスロット（隣のスロットとキャッシュラインを共有しないように揃える）
+    struct alignas(64) ReaderSlot {
+        std::atomic<std::uint64_t> epoch{0};
+    };
+
+public:
+    // pin したスナップショット（ムーブのみ。破棄すると pin を外す）
+    class Snapshot {
+    public:
+        Snapshot(Snapshot &&other) noexcept : slot_(std::exchange(other.slot_, nullptr)), version_(other.version_) {}
+        Snapshot &operator=(Snapshot &&other) noexcept {
+            if (this != &other) {
+                release();
+                slot_ = std::exchange(other.slot_, nullptr);
+                version_ = other.version_;
+            }
+            return *this;
+        }
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        ~Snapshot() { release(); }
+
+        const Engine &engine() const { return *version_->engine; }
+        const Engine *operator->() const { return version_->engine.get(); }
+        const Database &database() const { return version_->engine->database(); }
+        // publish のたびに 1 ずつ増える版の番号（最初のデータベースは 1）
+        std::uint64_t version() const { return version_->number; }
+
+    private:
+        friend class ConcurrentEngine;
+        Snapshot(std::atomic<std::uint64_t> *slot, const Version *version) : slot_(slot), version_(version) {}
+        void release() {
+            if (slot_)
+                slot_->store(0);
+            slot_ = nullptr;
+        }
+
+        std::atomic<std::uint64_t> *slot_;
+        const Version *version_;
+    };
+
+    // maxReaders: 同時に pin できる数（超えた分は空くまで待つ）
+    explicit ConcurrentEngine(const DatabaseDirs &dirs, size_t maxReaders = 256);
+    explicit ConcurrentEngine(Database db, size_t maxReaders = 256);
+    ~ConcurrentEngine();
+
+    ConcurrentEngine(const ConcurrentEngine &) = delete;
+    ConcurrentEngine &operator=(const ConcurrentEngine &) = delete;
+
+    // 今のスナップショットを pin する（ロックなし）
+    Snapshot pin() const;
+    std::uint64_t version() const;
+
+    // 新しいデータベースに差し替え、その版の番号を返す。古いスナップショットは使われなくなったものから解放する
+    std::uint64_t publish(Database db);
+    std::uint64_t publish(std::unique_ptr<const Engine> engine);
+
+    // 別スレッドで dirs を読み込んで publish し、古いスナップショットを全て解放するまで待つ
+    // （前の reloadAsync が終わっていなければ、終わるのを待ってから始める）
+    void reloadAsync(const DatabaseDirs &dirs);
+    // reloadAsync の終わりを待つ（読み込みで例外が出ていればここで投げる）
+    void waitForReload();
+
+    // どの検索にも pin されていない古いスナップショットを解放し、残っている数を返す
+    size_t reclaim();
+
+private:
+    size_t reclaimLocked();
+
+    std::atomic<const Version *> current_;
+    std::atomic<std::uint64_t> epoch_{1};
+    mutable std::vector<ReaderSlot> slots_;                 // pin した時点のエポック（0 は空き）
+
+    std::mutex writerMutex_;                                // publish / reclaim 同士の排他（検索側は使わない）
+    std::vector<std::pair<const Version *, std::uint64_t>> retired_; // 差し替えられた版と差し替え後のエポック
+    std::uint64_t nextVersion_ = 1;
+
+    std::thread reloadThread_;
+    std::exception_ptr reloadError_;
+};
+
+} // namespace camsynth
@@ -0,0 +1,556 @@
+#include "database.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+
+#include "block_store.hpp"
+#include "ingest.hpp"
+#include "msgpack_io.hpp"
+#include "prefetch.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace camsynth {
+
+// ファイル名から (file_number, start_frame, end_frame) を抽出
+bool parseSegmentFilename(const string &filename, string &outFileNumber, int &outStart, int &outEnd) {
+    string name = filename;
+    if (name.size() > 7 && name.substr(name.size() - 7) == ".msgpack") {
+        name = name.substr(0, name.size() - 7);
+    }
+    size_t underscorePos = name.find('_');
+    if (underscorePos == string::npos)
+        return false;
+    string part1 = name.substr(0, underscorePos);
+    string part2 = name.substr(underscorePos + 1);
+    if (part1.size() <= 1)
+        return false;
+    outFileNumber = part1.substr(1);
+    if (!part2.empty() && part2.front() == '(')
+        part2.erase(0, 1);
+    if (!part2.empty() && part2.back() == ')')
+        part2.pop_back();
+    size_t commaPos = part2.find(',');
+    if (commaPos == string::npos)
+        return false;
+    outStart = stoi(part2.substr(0, commaPos));
+    outEnd = stoi(part2.substr(commaPos + 1));
+    return true;
+}
+
+int shardOfClip(const string &fileNumber, int shardCount) {
+    if (shardCount <= 1)
+        return 0;
+    // FNV-1a（プロセスや実行環境によらず同じ値になるもの）
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : fileNumber) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h % shardCount;
+}
+
+string windowFileName(const string &fileNumber, int start, int end) {
+    return "m" + fileNumber + "_(" + to_string(start) + "," + to_string(end) + ").msgpack";
+}
+
+bool MotionClip::covers(int start, int end) const {
+    if (start < 0 || end > frames() || end <= start)
+        return false;
+    return gapPrefix[end] == gapPrefix[start];
+}
+
+double MotionClip::windowBpm(int start, int end) const {
+    start = max(start, 0);
+    end = min(end, frames());
+    if (end <= start)
+        return 0.0;
+    return (bpmPrefix[end] - bpmPrefix[start]) / (end - start);
+}
+
+vector<double> MotionClip::windowMusicMean(int start, int end) const {
+    start = max(start, 0);
+    end = min(end, frames());
+    vector<double> mean(musicPrefix.empty() ? 0 : musicPrefix[0].size(), 0.0);
+    if (end <= start)
+        return mean;
+    for (size_t k = 0; k < mean.size(); k++)
+        mean[k] = (musicPrefix[end][k] - musicPrefix[start][k]) / (end - start);
+    return mean;
+}
+
+const DatabaseSegment *Database::find(const string &fileName) const {
+    auto it = index_.find(fileName);
+    return (it == index_.end()) ? nullptr : &segments[it->second];
+}
+
+const MotionClip *Database::clip(const string &fileNumber) const {
+    auto it = clips.find(fileNumber);
+    return (it == clips.end()) ? nullptr : &it->second;
+}
+
+const CameraClip *Database::camera(const string &fileNumber) const {
+    auto it = cameras.find(fileNumber);
+    return (it == cameras.end()) ? nullptr : &it->second;
+}
+
+bool Database::resolveWindow(const string &fileName, ClipWindow &window) const {
+    string fileNumber;
+    int start, end;
+    if (!parseSegmentFilename(fileName, fileNumber, start, end))
+        return false;
+    window.motion = clip(fileNumber);
+    window.camera = camera(fileNumber);
+    window.start = start;
+    window.end = end;
+    return window.motion != nullptr;
+}
+
+shared_ptr<const PoseIndex> Database::poseIndex(int pcaComponents) const {
+    lock_guard<mutex> lock(poseCache_->mutex);
+    auto &index = poseCache_->indices[pcaComponents];
+    if (!index)
+        index = make_shared<PoseIndex>(*this, pcaComponents);
+    return index;
+}
+
+void Database::selectKernels() {
+    // 揃っていなければ 0（汎用版）にする
+    int numJoints = -1, musicDims = -1;
+    for (const auto &kv : clips) {
+        for (const auto &f : kv.second.raw) {
+            if (f.positions.empty())
+                continue;
+            if (numJoints < 0)
+                numJoints = f.positions.size();
+            else if (numJoints != (int)f.positions.size())
+                numJoints = 0;
+        }
+        for (const auto &m : kv.second.music) {
+            if (m.empty())
+                continue;
+            if (musicDims < 0)
+                musicDims = m.size();
+            else if (musicDims != (int)m.size())
+                musicDims = 0;
+        }
+    }
+    kernels = selectDistanceKernels(max(numJoints, 0), max(musicDims, 0));
+    for (auto &kv : clips) {
+        MotionClip &clip = kv.second;
+        clip.musicFlat.clear();
+        if (kernels.musicDims == 0)
+            continue;
+        // 欠けたフレームは 0 で埋める（covers で候補から外れる）
+        clip.musicFlat.assign(clip.music.size() * kernels.musicDims, 0.0);
+        for (size_t i = 0; i < clip.music.size(); i++)
+            copy(clip.music[i].begin(), clip.music[i].end(), clip.musicFlat.begin() + i * kernels.musicDims);
+    }
+}
+
+void Database::buildIndex() {
+    index_.clear();
+    for (size_t i = 0; i < segments.size(); i++)
+        index_[segments[i].fileName] = i;
+}
+
+map<string, vector<BpmInterval>> loadBpmTable(const string &BpmData) {
+    map<string, vector<BpmInterval>> table;
+    msgpack::object_handle oh = readMsgpack(BpmData);
+    msgpack::object obj = oh.get();
+    if (obj.type != msgpack::type::MAP)
+        return table;
+    for (size_t k = 0; k < obj.via.map.size; k++) {
+        const msgpack::object &key = obj.via.map.ptr[k].key;
+        const msgpack::object &fileObj = obj.via.map.ptr[k].val;
+        if (key.type != msgpack::type::STR || fileObj.type != msgpack::type::ARRAY)
+            continue;
+        auto &intervals = table[string(key.via.str.ptr, key.via.str.size)];
+        for (size_t i = 0; i < fileObj.via.array.size; i++) {
+            msgpack::object intervalObj = fileObj.via.array.ptr[i];
+            const msgpack::object* fr = getMember(intervalObj, "interval_frames");
+            const msgpack::object* avgBpmObj = getMember(intervalObj, "average_bpm");
+            if (!fr || fr->type != msgpack::type::ARRAY || fr->via.array.size < 2 || !avgBpmObj)
+                continue;
+            intervals.push_back({fr->via.array.ptr[0].as<int>(), fr->via.array.ptr[1].as<int>(), avgBpmObj->as<double>()});
+        }
+    }
+    return table;
+}
+
+namespace {
+
+// BPM 値を取得する（区間が一致するものがなければ 0）
+double lookupBpm(const map<string, vector<BpmInterval>> &table, const string &fileNumberStr, int startFrame, int endFrame) {
+    auto it = table.find(fileNumberStr);
+    if (it == table.end())
+        return 0.0;
+    for (const auto &iv : it->second) {
+        if (iv.start == startFrame && iv.end == endFrame)
+            return iv.bpm;
+    }
+    return 0.0;
+}
+
+array<double, 3> toVec3(const msgpack::object &o) {
+    array<double, 3> v = {0.0, 0.0, 0.0};
+    if (o.type == msgpack::type::ARRAY && o.via.array.size >= 3) {
+        v[0] = o.via.array.ptr[0].as<double>();
+        v[1] = o.via.array.ptr[1].as<double>();
+        v[2] = o.via.array.ptr[2].as<double>();
+    }
+    return v;
+}
+
+} // namespace
+
+CameraClip loadCameraMsgpack(const string &positionPath, const string &rotationPath) {
+    vector<array<double, 3>> eye, rotation;
+    vector<double> fov, distance;
+    msgpack::object_handle posOh = readMsgpack(positionPath);
+    msgpack::object posObj = posOh.get();
+    msgpack::object_handle rotOh = readMsgpack(rotationPath);
+    msgpack::object rotObj = rotOh.get();
+    const msgpack::object* eyeArray = getMember(posObj, "camera_eye");
+    const msgpack::object* fovArray = getMember(posObj, "Fov");
+    const msgpack::object* distArray = getMember(posObj, "Distance");
+    const msgpack::object* rotArray = getMember(rotObj, "Rotation");
+    if (eyeArray && eyeArray->type == msgpack::type::ARRAY) {
+        for (size_t i = 0; i < eyeArray->via.array.size; i++)
+            eye.push_back(toVec3(eyeArray->via.array.ptr[i]));
+    }
+    if (rotArray && rotArray->type == msgpack::type::ARRAY) {
+        for (size_t i = 0; i < rotArray->via.array.size; i++)
+            rotation.push_back(toVec3(rotArray->via.array.ptr[i]));
+    }
+    if (fovArray && fovArray->type == msgpack::type::ARRAY) {
+        for (size_t i = 0; i < fovArray->via.array.size; i++)
+            fov.push_back(fovArray->via.array.ptr[i].as<double>());
+    }
+    if (distArray && distArray->type == msgpack::type::ARRAY) {
+        for (size_t i = 0; i < distArray->via.array.size; i++)
+            distance.push_back(distArray->via.array.ptr[i].as<double>());
+    }
+    if (!eyeArray || !fovArray || !rotArray)
+        cerr << "カメラデータが不足しています: " << positionPath << "\n";
+    return CameraClip(eye, rotation, fov, distance);
+}
+
+namespace {
+
+CameraClip parseCameraClip(const string &fileNumberStr, const DatabaseDirs &dirs) {
+    return loadCameraMsgpack(dirs.CameraPositionDir + "/c" + fileNumberStr + ".msgpack",
+                             dirs.CameraRotationDir + "/c" + fileNumberStr + ".msgpack");
+}
+
+// 列ファイルが msgpack より新しければ mmap して使う
+// なければ msgpack から作り、CameraColumnDir があれば列ファイルを書いておく
+CameraClip loadCameraClip(const string &fileNumberStr, const DatabaseDirs &dirs) {
+    string columnPath = dirs.CameraColumnDir + "/c" + fileNumberStr + ".ccol";
+    string posPath = dirs.CameraPositionDir + "/c" + fileNumberStr + ".msgpack";
+    string rotPath = dirs.CameraRotationDir + "/c" + fileNumberStr + ".msgpack";
+    error_code ec;
+    auto columnTime = fs::last_write_time(columnPath, ec);
+    if (!ec && columnTime >= fs::last_write_time(posPath, ec) && !ec &&
+        columnTime >= fs::last_write_time(rotPath, ec) && !ec) {
+        try {
+            return CameraClip::mapFile(columnPath);
+        }
+        catch (const std::exception &e) {
+            cerr << "[WARN] 列ファイルを読めないため msgpack から読み込みます: " << columnPath << " (" << e.what() << ")" << endl;
+        }
+    }
+    CameraClip clip = parseCameraClip(fileNumberStr, dirs);
+    if (fs::is_directory(dirs.CameraColumnDir, ec)) {
+        try {
+            clip.writeFile(columnPath);
+        }
+        catch (const std::exception &e) {
+            cerr << "[WARN] 列ファイルを書き出せません: " << columnPath << " (" << e.what() << ")" << endl;
+        }
+    }
+    return clip;
+}
+
+// データベースディレクトリ内の各ファイルを走査し、クリップ内の元の位置に並べる
+// 走査した区間ファイルの数（シャードの外のものも含む）を返す
+size_t loadSplitSegments(const DatabaseDirs &dirs,
+                         Database &db,
+                         const map<string, vector<BpmInterval>> &bpmTable,
+                         map<string, array<vector<char>, 3>> &loaded) {
+    // Stand_Split は Split から root を引いただけのものなので読まない
+    struct SegmentFiles {
+        DatabaseSegment seg;
+        array<string, 3> paths; // raw, hip, music
+    };
+    vector<SegmentFiles> files;
+    size_t order = 0;
+    auto inShard = [&](const string &num) {
+        return dirs.ShardCount <= 1 || shardOfClip(num, dirs.ShardCount) == dirs.ShardIndex;
+    };
+    for (const auto &entry : fs::directory_iterator(dirs.PositionDatabaseDir)) {
+        if (!entry.is_regular_file())
+            continue;
+        string fname = entry.path().filename().string(); // 例："m62_(0,550).msgpack"
+        if (fname.size() <= 8 || fname.substr(fname.size() - 8) != ".msgpack")
+            continue;
+        SegmentFiles f;
+        DatabaseSegment &seg = f.seg;
+        seg.fileName = fname;
+        if (!parseSegmentFilename(fname, seg.fileNumber, seg.start, seg.end) || seg.start < 0)
+            continue;
+        seg.order = order++;
+        if (!inShard(seg.fileNumber))
+            continue;
+        f.paths[0] = entry.path().string();
+        // ヒップ方向データのファイル名は "m62_(0, 550).msgpack" のようにカンマの後に空白が入る
+        f.paths[1] = dirs.HipDirectionDatabaseDir + "/m" + seg.fileNumber + "_(" + to_string(seg.start) + ", " +
+                     to_string(seg.end) + ").msgpack";
+        f.paths[2] = dirs.MusicDatabaseDir + "/m" + seg.fileNumber + "_(" + to_string(seg.start) + "," +
+                     to_string(seg.end) + ").msgpack";
+        files.push_back(move(f));
+    }
+
+    // ファイルの読み込みは先読みに任せ、ここでは読み終わったものから unpack して並べる
+    vector<string> paths;
+    for (const auto &f : files)
+        paths.insert(paths.end(), f.paths.begin(), f.paths.end());
+    PrefetchReader reader(move(paths), dirs.IoThreads, dirs.PrefetchDepth);
+    for (size_t s = 0; s < files.size(); s++) {
+        DatabaseSegment &seg = files[s].seg;
+        const string &fname = seg.fileName;
+        // 3 つとも取り出してから判定する（取り出さないと先読みが進まない）
+        array<vector<char>, 3> bytes;
+        string error;
+        bool ok = true;
+        for (int k = 0; k < 3; k++) {
+            string e;
+            if (!reader.take(s * 3 + k, bytes[k], e) && ok) {
+                ok = false;
+                error = e;
+            }
+        }
+        vector<FrameData> raw, hip;
+        vector<vector<double>> music;
+        try {
+            if (!ok)
+                throw runtime_error(error);
+            raw = parseJointPositions(unpackMsgpack(bytes[0], files[s].paths[0]).get());
+            hip = parseJointPositions(unpackMsgpack(bytes[1], files[s].paths[1]).get());
+            // 楽曲特徴量ファイルはクリップ先頭からのフレーム番号で並んでいるので [start, end) だけを取り出す
+            msgpack::object_handle musicOh = unpackMsgpack(bytes[2], files[s].paths[2]);
+            music = extractMusicFeatureSegment(musicOh.get(), seg.start, seg.end);
+        }
+        catch (const std::exception &e) {
+            cerr << "[WARN] 区間を読み込めないため除外します: " << fname << " (" << e.what() << ")" << endl;
+            continue;
+        }
+        seg.frames = raw.size();
+        seg.hipFrames = hip.size();
+        seg.musicFrames = music.size();
+        seg.bpm = lookupBpm(bpmTable, seg.fileNumber, seg.start, seg.end);
+
+        MotionClip &clip = db.clips[seg.fileNumber];
+        auto &flags = loaded[seg.fileNumber];
+        size_t needed = seg.start + max({raw.size(), hip.size(), music.size()});
+        if (clip.raw.size() < needed) {
+            clip.raw.resize(needed);
+            clip.hip.resize(needed, {0.0, 0.0, 0.0, 0.0});
+            clip.music.resize(needed);
+            for (auto &f : flags)
+                f.resize(needed, 0);
+        }
+        for (size_t i = 0; i < raw.size(); i++) {
+            clip.raw[seg.start + i] = move(raw[i]);
+            flags[0][seg.start + i] = 1;
+        }
+        for (size_t i = 0; i < hip.size(); i++) {
+            clip.hip[seg.start + i] = hip[i].hipQuaternion;
+            flags[1][seg.start + i] = 1;
+        }
+        for (size_t i = 0; i < music.size(); i++) {
+            clip.music[seg.start + i] = move(music[i]);
+            flags[2][seg.start + i] = 1;
+        }
+        db.segments.push_back(move(seg));
+    }
+    return order;
+}
+
+} // namespace
+
+Database loadDatabase(const DatabaseDirs &dirs) {
+    Database db;
+    map<string, vector<BpmInterval>> bpmTable = loadBpmTable(dirs.BpmData);
+    // クリップごとに、各フレームのデータが読めたか (raw, hip, music)
+    map<string, array<vector<char>, 3>> loaded;
+
+    // ブロック圧縮データベースが使えればそこから、なければ区間ファイルから読む
+    if (!loadBlockStore(dirs, db, loaded))
+        db.scannedSegments = loadSplitSegments(dirs, db, bpmTable, loaded);
+    size_t order = db.scannedSegments;
+    auto inShard = [&](const string &num) {
+        return dirs.ShardCount <= 1 || shardOfClip(num, dirs.ShardCount) == dirs.ShardIndex;
+    };
+
+    // 追記型ストアに取り込んだクリップ（MANIFEST の 1 つの世代をまとめて読む）
+    error_code ec;
+    if (fs::is_directory(dirs.IngestDir, ec)) {
+        vector<IngestClip> ingested;
+        try {
+            ingested = loadIngestStore(dirs.IngestDir);
+        }
+        catch (const std::exception &e) {
+            cerr << "[WARN] 取り込んだクリップを読み込めません: " << dirs.IngestDir << " (" << e.what() << ")" << endl;
+        }
+        for (auto &ic : ingested) {
+            const string &num = ic.clipNumber;
+            size_t firstOrder = order;
+            order += ic.segments.size();
+            if (!inShard(num))
+                continue;
+            if (db.clips.count(num)) {
+                cerr << "[WARN] クリップ番号が重複しているため取り込んだクリップを除外します: " << num << endl;
+                continue;
+            }
+            MotionClip &clip = db.clips[num];
+            auto &flags = loaded[num];
+            size_t n = ic.raw.size();
+            clip.hip.resize(n);
+            for (size_t i = 0; i < n; i++)
+                clip.hip[i] = ic.raw[i].hipQuaternion;
+            clip.raw = move(ic.raw);
+            clip.music = move(ic.music);
+            clip.music.resize(n);
+            for (auto &f : flags)
+                f.assign(n, 1);
+            for (size_t i = 0; i < n; i++)
+                flags[2][i] = !clip.music[i].empty();
+            for (const auto &s : ic.segments) {
+                bpmTable[num].push_back({s.start, s.end, s.bpm});
+                DatabaseSegment seg;
+                seg.fileName = windowFileName(num, s.start, s.end);
+                seg.fileNumber = num;
+                seg.start = s.start;
+                seg.end = s.end;
+                seg.frames = seg.hipFrames = seg.musicFrames = max(0, min(s.end, (int)n) - s.start);
+                seg.bpm = s.bpm;
+                seg.order = firstOrder++;
+                db.segments.push_back(move(seg));
+            }
+            db.cameras.emplace(num, move(ic.camera));
+        }
+    }
+
+    // カメラデータはクリップごとに 1 回だけ読む
+    for (const auto &kv : db.clips) {
+        const string &num = kv.first;
+        if (db.cameras.count(num))
+            continue;
+        try {
+            db.cameras.emplace(num, loadCameraClip(num, dirs));
+        }
+        catch (const std::exception &e) {
+            cerr << "[WARN] カメラデータを読み込めないためクリップを除外します: c" << num << " (" << e.what() << ")" << endl;
+        }
+    }
+    vector<DatabaseSegment> kept;
+    for (auto &seg : db.segments) {
+        if (db.cameras.count(seg.fileNumber))
+            kept.push_back(move(seg));
+    }
+    db.segments = move(kept);
+    for (auto it = db.clips.begin(); it != db.clips.end();) {
+        if (db.cameras.count(it->first))
+            ++it;
+        else
+            it = db.clips.erase(it);
+    }
+
+    // 欠けたフレーム数・BPM・楽曲特徴量の累積和を作る
+    for (auto &kv : db.clips) {
+        MotionClip &clip = kv.second;
+        const auto &flags = loaded[kv.first];
+        int n = clip.frames();
+        vector<double> frameBpm(n, 0.0);
+        auto it = bpmTable.find(kv.first);
+        if (it != bpmTable.end()) {
+            for (const auto &iv : it->second) {
+                for (int i = max(iv.start, 0); i < min(iv.end, n); i++)
+                    frameBpm[i] = iv.bpm;
+            }
+        }
+        size_t dims = 0;
+        for (const auto &m : clip.music)
+            dims = max(dims, m.size());
+        clip.gapPrefix.assign(n + 1, 0);
+        clip.bpmPrefix.assign(n + 1, 0.0);
+        clip.musicPrefix.assign(n + 1, vector<double>(dims, 0.0));
+        for (int i = 0; i < n; i++) {
+            bool complete = flags[0][i] && flags[1][i] && flags[2][i] && clip.music[i].size() == dims;
+            clip.gapPrefix[i + 1] = clip.gapPrefix[i] + (complete ? 0 : 1);
+            clip.bpmPrefix[i + 1] = clip.bpmPrefix[i] + frameBpm[i];
+            for (size_t k = 0; k < dims; k++)
+                clip.musicPrefix[i + 1][k] = clip.musicPrefix[i][k] + (k < clip.music[i].size() ? clip.music[i][k] : 0.0);
+        }
+    }
+    db.buildIndex();
+    db.selectKernels();
+    return db;
+}
+
+double getDistanceAverageForCandidate(const Database &db, const string &candidateFile,
+                                      int lengthFrames, int offset) {
+    ClipWindow window;
+    const CameraClip *clip = db.resolveWindow(candidateFile, window) ? window.camera : nullptr;
+    if (!clip)
+        return 0.0;
+    int totalSize = clip->distanceFrames();
+    int startIndex = window.start + offset;
+    int endIndex = startIndex + lengthFrames;
+    if (startIndex < 0)
+        startIndex = 0;
+    if (endIndex > totalSize)
+        endIndex = totalSize;
+    if (endIndex <= startIndex)
+        return 0.0;
+    const float *distance = clip->column(CameraClip::Distance);
+    double sumDist = 0.0;
+    int count = 0;
+    for (int i = startIndex; i < endIndex; i++) {
+        sumDist += distance[i];
+        count++;
+    }
+    return (count == 0) ? 0.0 : sumDist / count;
+}
+
+double getPositionAverageForCandidate(const Database &db, const string &candidateFile,
+                                      int segmentLen, int offset) {
+    ClipWindow window;
+    const CameraClip *clip = db.resolveWindow(candidateFile, window) ? window.camera : nullptr;
+    if (!clip) {
+        cerr << "camera_eye がありません: " << candidateFile << endl;
+        return 0.0;
+    }
+    int totalSize = clip->eyeFrames();
+    int startIndex = window.start + offset;
+    int endIndex = startIndex + segmentLen;
+    if (startIndex < 0)
+        startIndex = 0;
+    if (endIndex > totalSize)
+        endIndex = totalSize;
+    if (endIndex <= startIndex)
+        return 0.0;
+    array<double, 3> firstPos = clip->eye(startIndex);
+    array<double, 3> lastPos = clip->eye(endIndex - 1);
+    double dx = lastPos[0] - firstPos[0];
+    double dy = lastPos[1] - firstPos[1];
+    double dz = lastPos[2] - firstPos[2];
+    return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+} // namespace camsynth
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "camera_store.hpp"
+#include "kernels.hpp"
+#include "pose_index.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// ファイル名から (file_number, start_frame, end_frame) を抽出
+bool parseSegmentFilename(const std::string &filename, std::string &outFileNumber, int &outStart, int &outEnd);
+
+// クリップ番号の属するシャード（0 ～ shardCount - 1、番号の文字列のハッシュで決める）
+int shardOfClip(const std::string &fileNumber, int shardCount);
+
+// クリップ内の区間を切り出しファイルと同じ形の名前にする（例："m62_(100,250).msgpack"）
+std::string windowFileName(const std::string &fileNumber, int start, int end);
+
+// クリップ 1 つ分のモーション・楽曲データ（切り出しファイルを元の位置に並べ直したもの）
+// 切り出し区間が重なっていても（Frame_Intervals の違いなど）フレームは 1 回だけ保持する。
+// 任意の区間 [start, end) はフレーム番号で切り出せ、BPM と楽曲特徴量の平均は累積和から O(1) で求まる。
+struct MotionClip {
+    std::vector<FrameData> raw;                  // Split
+    std::vector<std::array<double, 4>> hip;      // Hip_Direction_Split のクォータニオン (x, y, z, w)
+    std::vector<std::vector<double>> music;      // Music_Features_Split
+    std::vector<int> gapPrefix;                  // データが揃っていないフレーム数の累積和（フレーム数 + 1 個）
+    std::vector<double> bpmPrefix;               // フレームごとの BPM（average_bpm の区間値）の累積和
+    std::vector<std::vector<double>> musicPrefix; // 楽曲特徴量の次元ごとの累積和
+    std::vector<double> musicFlat;               // 楽曲特徴量をフレーム順に詰めたもの（次元数が揃っているときだけ）
+
+    int frames() const { return raw.size(); }
+    // [start, end) の全フレームでモーション・ヒップ・楽曲特徴量が揃っているか
+    bool covers(int start, int end) const;
+    // [start, end) のフレームごとの BPM の平均
+    double windowBpm(int start, int end) const;
+    // [start, end) の楽曲特徴量の次元ごとの平均
+    std::vector<double> windowMusicMean(int start, int end) const;
+};
+
+// データベースの切り出し区間 1 つ分（Split のファイル 1 つに対応）
+// データ本体は MotionClip が持ち、区間はその中の位置だけを表す
+struct DatabaseSegment {
+    std::string fileName;   // 例："m62_(0,550).msgpack"
+    std::string fileNumber; // 例："62"
+    int start = 0;
+    int end = 0;
+    int frames = 0;         // ファイルから読めたモーションのフレーム数
+    int hipFrames = 0;      // ヒップ方向のフレーム数
+    int musicFrames = 0;    // 楽曲特徴量のフレーム数
+    double bpm = 0.0;       // average_bpm.msgpack の区間 BPM
+    size_t order = 0;       // シャードに分けずに読んだときの走査順（Split の並び、続けて取り込んだクリップ）
+};
+
+// クリップ内の区間 [start, end)
+struct ClipWindow {
+    const MotionClip *motion = nullptr;
+    const CameraClip *camera = nullptr;
+    int start = 0;
+    int end = 0;
+};
+
+// 読み込み済みのデータベース
+// 候補の走査順は Split の directory_iterator の順
+class Database {
+public:
+    std::vector<DatabaseSegment> segments;
+    std::map<std::string, MotionClip> clips;   // クリップ番号 → モーション・楽曲データ
+    std::map<std::string, CameraClip> cameras; // クリップ番号 → カメラデータ
+    // 走査した Split の区間ファイル数（取り込んだクリップの走査順はこの続きになる）
+    size_t scannedSegments = 0;
+    // 全フレームで揃っているジョイント数・楽曲特徴量の次元数から選んだ距離計算（読み込み時に 1 回だけ決める）
+    DistanceKernels kernels;
+
+    // ファイル名から区間を引く（見つからなければ nullptr）
+    const DatabaseSegment *find(const std::string &fileName) const;
+    // クリップ番号からモーション・楽曲データを引く（見つからなければ nullptr）
+    const MotionClip *clip(const std::string &fileNumber) const;
+    // クリップ番号からカメラデータを引く（見つからなければ nullptr）
+    const CameraClip *camera(const std::string &fileNumber) const;
+    // "m62_(100,250).msgpack" の形の名前をクリップ内の区間に解決する
+    // 切り出しファイルとして存在しない区間でもよい（クリップがなければ false）
+    bool resolveWindow(const std::string &fileName, ClipWindow &window) const;
+
+    // 二乗 L2 距離用の姿勢特徴量（pcaComponents ごとに最初の呼び出しで作って保持する。スレッドセーフ）
+    std::shared_ptr<const PoseIndex> poseIndex(int pcaComponents) const;
+
+    void buildIndex();
+    // ジョイント数・楽曲特徴量の次元数を調べて kernels を選び、musicFlat を作る
+    void selectKernels();
+
+private:
+    struct PoseIndexCache {
+        std::mutex mutex;
+        std::map<int, std::shared_ptr<const PoseIndex>> indices;
+    };
+
+    std::unordered_map<std::string, size_t> index_;
+    std::shared_ptr<PoseIndexCache> poseCache_ = std::make_shared<PoseIndexCache>();
+};
+
+// BPM データ（クリップ番号 → 区間ごとの平均 BPM）
+struct BpmInterval {
+    int start;
+    int end;
+    double bpm;
+};
+std::map<std::string, std::vector<BpmInterval>> loadBpmTable(const std::string &BpmData);
+
+// データベースのディレクトリ一式を読み込む
+// 読めないファイルは警告を出してその区間（クリップ）を除外する
+Database loadDatabase(const DatabaseDirs &dirs);
+
+// CameraCentric (camera_eye / Fov / Distance) と CameraInterpolated (Rotation) の msgpack からカメラデータを作る
+CameraClip loadCameraMsgpack(const std::string &positionPath, const std::string &rotationPath);
+
+// 距離の平均値算出
+// offset: 候補セグメント先頭からのずれ（スライディング照合で選ばれた位置）
+double getDistanceAverageForCandidate(const Database &db, const std::string &candidateFile,
+                                      int lengthFrames, int offset = 0);
+
+// カメラ位置の平均（移動距離）を取得する
+double getPositionAverageForCandidate(const Database &db, const std::string &candidateFile,
+                                      int segmentLen, int offset = 0);
+
+} // namespace camsynth
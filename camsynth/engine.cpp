@@ -0,0 +1,94 @@
+#include "engine.hpp"
+
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "motion.hpp"
+#include "msgpack_io.hpp"
+#include "search.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace camsynth {
+
+Engine::Engine(const DatabaseDirs &dirs) : db_(loadDatabase(dirs)) {}
+
+Engine::Engine(Database db) : db_(move(db)) {
+    db_.buildIndex();
+}
+
+InputData loadInputData(const string &motionDir, const string &musicDir, const string &inputNumber) {
+    InputData input;
+    input.inputNumber = inputNumber;
+    // 入力モーションデータ
+    // BVH ファイルを渡した場合はそこから raw を求める。stand.msgpack / hip.msgpack がなければ raw から求める
+    if (isBvhPath(motionDir)) {
+        input.raw = loadBvhMotion(motionDir);
+        input.stand = deriveStandPositions(input.raw);
+        input.hip = deriveHipDirections(input.raw);
+    } else {
+        input.raw = loadJointPositions(motionDir + "/raw.msgpack");
+        if (fs::exists(motionDir + "/stand.msgpack")) {
+            input.stand = loadJointPositions(motionDir + "/stand.msgpack");
+        } else {
+            cout << "[INFO] stand.msgpack がないため raw.msgpack から求めます" << endl;
+            input.stand = deriveStandPositions(input.raw);
+        }
+        if (fs::exists(motionDir + "/hip.msgpack")) {
+            input.hip = loadJointPositions(motionDir + "/hip.msgpack");
+        } else {
+            cout << "[INFO] hip.msgpack がないため raw.msgpack から求めます" << endl;
+            input.hip = deriveHipDirections(input.raw);
+        }
+    }
+    // 入力音楽データ
+    input.beats = loadBeatsMsgpack(musicDir + "/beat.msgpack");
+    input.music = loadMusicFeaturesMsgpack(musicDir + "/music.msgpack");
+    return input;
+}
+
+void Engine::loadInput(const string &motionDir, const string &musicDir, const string &inputNumber) {
+    input_ = loadInputData(motionDir, musicDir, inputNumber);
+}
+
+void Engine::loadInput(InputData input) {
+    input_ = move(input);
+}
+
+SearchResult Engine::search(const vector<int> &frameIntervals,
+                            const vector<int> &modes,
+                            const SearchOptions &options) const {
+    return search(input_, frameIntervals, modes, options);
+}
+
+SearchResult Engine::search(const InputData &input,
+                            const vector<int> &frameIntervals,
+                            const vector<int> &modes,
+                            const SearchOptions &options) const {
+    return searchSegments(db_, input, frameIntervals, modes, options);
+}
+
+vector<SearchResult> Engine::searchBatch(const vector<SearchRequest> &requests,
+                                        const SearchOptions &options) const {
+    return searchSegmentsBatch(db_, requests, options);
+}
+
+vector<SearchResult> Engine::alternatives(const SearchResult &result, int count,
+                                         const SearchOptions &options) const {
+    return alternatives(input_, result, count, options);
+}
+
+vector<SearchResult> Engine::alternatives(const InputData &input, const SearchResult &result, int count,
+                                         const SearchOptions &options) const {
+    return buildAlternativeResults(db_, input, result, count, options);
+}
+
+CameraTrack Engine::assembleCamera(const SearchResult &result) const {
+    return assembleCameraTrack(db_, result.choices, result.lengths, result.translations);
+}
+
+} // namespace camsynth
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "database.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// 入力モーション（raw / stand / hip.msgpack）と入力音楽（beat / music.msgpack）を読み込む
+// stand / hip.msgpack がなければ raw.msgpack から求める（motionDir に .bvh ファイルを渡すと BVH から raw を求める）
+InputData loadInputData(const std::string &motionDir, const std::string &musicDir,
+                        const std::string &inputNumber = "0");
+
+// カメラワーク合成エンジン
+// データベースを 1 回だけ読み込んで保持し、入力ごとの検索とカメラデータの組み立てを行う。
+//
+//   camsynth::Engine engine(camsynth::DatabaseDirs{});
+//   engine.loadInput("intermediate/motion", "intermediate/music");
+//   camsynth::SearchResult res = engine.search(frameIntervals, modes);
+//   camsynth::CameraTrack track = engine.assembleCamera(res);
+//
+// search / assembleCamera は const なので、同じデータベースを複数スレッドから使ってよい
+// （入力ごとに loadInput する場合は Engine を分けるか、InputData を渡す版を使う）。
+class Engine {
+public:
+    explicit Engine(const DatabaseDirs &dirs);
+    explicit Engine(Database db);
+
+    // 入力モーション（raw / stand / hip.msgpack）と入力音楽（beat / music.msgpack）を読み込む
+    // stand / hip.msgpack がなければ raw.msgpack から求める（新しいデータは raw だけでよい）
+    // inputNumber と同じ番号のデータベース候補は検索から除外する
+    void loadInput(const std::string &motionDir, const std::string &musicDir,
+                   const std::string &inputNumber = "0");
+    // 読み込み済みの入力データを使う
+    void loadInput(InputData input);
+
+    const InputData &input() const { return input_; }
+    const Database &database() const { return db_; }
+
+    // フレーム間隔ごとに類似ファイルを検索し、平行移動（平滑化済み）まで求める
+    SearchResult search(const std::vector<int> &frameIntervals,
+                        const std::vector<int> &modes,
+                        const SearchOptions &options = SearchOptions()) const;
+    SearchResult search(const InputData &input,
+                        const std::vector<int> &frameIntervals,
+                        const std::vector<int> &modes,
+                        const SearchOptions &options = SearchOptions()) const;
+
+    // 複数の入力をまとめて検索する（データベースの走査はバッチ全体で 1 回）
+    std::vector<SearchResult> searchBatch(const std::vector<SearchRequest> &requests,
+                                          const SearchOptions &options = SearchOptions()) const;
+
+    // 検索結果の候補リストから別案を count 個作る（0 番目は result そのもの）
+    // search のときに options.alternatives を count 以上にしておくと、各案で異なるクリップを選べる
+    std::vector<SearchResult> alternatives(const SearchResult &result, int count,
+                                           const SearchOptions &options = SearchOptions()) const;
+    std::vector<SearchResult> alternatives(const InputData &input, const SearchResult &result, int count,
+                                           const SearchOptions &options = SearchOptions()) const;
+
+    // 検索結果からカメラデータを組み立てる
+    CameraTrack assembleCamera(const SearchResult &result) const;
+
+private:
+    Database db_;
+    InputData input_;
+};
+
+} // namespace camsynth
@@ -0,0 +1,398 @@
+#include "ingest.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "database.hpp"
+#include "kernels.hpp"
+#include "motion.hpp"
+#include "msgpack_io.hpp"
+#include "prefetch.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace camsynth {
+
+namespace {
+
+const char kManifestHeader[] = "camsynth-ingest 1";
+const int kFileVersion = 1;
+
+struct ManifestEntry {
+    string file;
+    vector<string> clips;
+};
+
+// ストアのディレクトリ内のファイルに対する flock（デストラクタで解放）
+class StoreLock {
+public:
+    StoreLock(const string &path, bool wait) {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0)
+            throw runtime_error("Cannot open lock file: " + path);
+        if (flock(fd_, LOCK_EX | (wait ? 0 : LOCK_NB)) != 0) {
+            close(fd_);
+            fd_ = -1;
+            if (wait)
+                throw runtime_error("Cannot lock: " + path);
+        }
+    }
+    ~StoreLock() {
+        if (fd_ >= 0) {
+            flock(fd_, LOCK_UN);
+            close(fd_);
+        }
+    }
+    StoreLock(const StoreLock &) = delete;
+    StoreLock &operator=(const StoreLock &) = delete;
+
+    bool locked() const { return fd_ >= 0; }
+
+private:
+    int fd_ = -1;
+};
+
+string newFileName(const string &prefix) {
+    auto now = chrono::system_clock::now().time_since_epoch();
+    return prefix + "-" + to_string(chrono::duration_cast<chrono::nanoseconds>(now).count()) + "-" +
+           to_string(getpid()) + ".cseg";
+}
+
+vector<ManifestEntry> readManifest(const string &storeDir) {
+    vector<ManifestEntry> entries;
+    ifstream ifs(storeDir + "/MANIFEST");
+    if (!ifs)
+        return entries;
+    string line;
+    if (!getline(ifs, line) || line != kManifestHeader)
+        throw runtime_error("Invalid manifest: " + storeDir + "/MANIFEST");
+    while (getline(ifs, line)) {
+        istringstream iss(line);
+        ManifestEntry e;
+        if (!(iss >> e.file))
+            continue;
+        string clip;
+        while (iss >> clip)
+            e.clips.push_back(clip);
+        entries.push_back(move(e));
+    }
+    return entries;
+}
+
+void writeManifest(const string &storeDir, const vector<ManifestEntry> &entries) {
+    string text = string(kManifestHeader) + "\n";
+    for (const auto &e : entries) {
+        text += e.file;
+        for (const auto &c : e.clips)
+            text += " " + c;
+        text += "\n";
+    }
+    writeFileAtomically(storeDir + "/MANIFEST", text.data(), text.size());
+}
+
+void packDoubles(msgpack::packer<msgpack::sbuffer> &pk, const double *v, size_t n) {
+    pk.pack_array(n);
+    for (size_t i = 0; i < n; i++)
+        pk.pack(v[i]);
+}
+
+void packClip(msgpack::packer<msgpack::sbuffer> &pk, const IngestClip &clip) {
+    const CameraClip &cam = clip.camera;
+    pk.pack_map(9);
+    pk.pack(string("clip"));
+    pk.pack(clip.clipNumber);
+    pk.pack(string("segments"));
+    pk.pack_array(clip.segments.size());
+    for (const auto &s : clip.segments) {
+        pk.pack_array(3);
+        pk.pack(s.start);
+        pk.pack(s.end);
+        pk.pack(s.bpm);
+    }
+    pk.pack(string("raw"));
+    pk.pack_array(clip.raw.size());
+    for (const auto &f : clip.raw) {
+        pk.pack_array(f.positions.size());
+        for (const auto &p : f.positions)
+            packDoubles(pk, p.data(), 3);
+    }
+    pk.pack(string("hip"));
+    pk.pack_array(clip.raw.size());
+    for (const auto &f : clip.raw)
+        packDoubles(pk, f.hipQuaternion.data(), 4);
+    pk.pack(string("music"));
+    pk.pack_array(clip.music.size());
+    for (const auto &m : clip.music)
+        packDoubles(pk, m.data(), m.size());
+    // カメラは CameraCentric / CameraInterpolated と同じキーで持つ
+    pk.pack(string("camera_eye"));
+    pk.pack_array(cam.eyeFrames());
+    for (size_t i = 0; i < cam.eyeFrames(); i++) {
+        array<double, 3> e = cam.eye(i);
+        packDoubles(pk, e.data(), 3);
+    }
+    pk.pack(string("Rotation"));
+    pk.pack_array(cam.rotationFrames());
+    for (size_t i = 0; i < cam.rotationFrames(); i++) {
+        array<double, 3> r = {cam.column(CameraClip::RotationX)[i], cam.column(CameraClip::RotationY)[i],
+                              cam.column(CameraClip::RotationZ)[i]};
+        packDoubles(pk, r.data(), 3);
+    }
+    pk.pack(string("Fov"));
+    pk.pack_array(cam.fovFrames());
+    for (size_t i = 0; i < cam.fovFrames(); i++)
+        pk.pack(cam.fov(i));
+    pk.pack(string("Distance"));
+    pk.pack_array(cam.distanceFrames());
+    for (size_t i = 0; i < cam.distanceFrames(); i++)
+        pk.pack(cam.distance(i));
+}
+
+void packFile(msgpack::sbuffer &buf, const vector<const IngestClip *> &clips) {
+    msgpack::packer<msgpack::sbuffer> pk(&buf);
+    pk.pack_map(2);
+    pk.pack(string("version"));
+    pk.pack(kFileVersion);
+    pk.pack(string("clips"));
+    pk.pack_array(clips.size());
+    for (const IngestClip *c : clips)
+        packClip(pk, *c);
+}
+
+const msgpack::object &requireArray(const msgpack::object &obj, const string &key) {
+    const msgpack::object *m = getMember(obj, key);
+    if (!m || m->type != msgpack::type::ARRAY)
+        throw runtime_error("Missing '" + key + "' in ingest file");
+    return *m;
+}
+
+vector<double> toDoubles(const msgpack::object &o) {
+    vector<double> v;
+    if (o.type != msgpack::type::ARRAY)
+        return v;
+    v.reserve(o.via.array.size);
+    for (size_t i = 0; i < o.via.array.size; i++)
+        v.push_back(o.via.array.ptr[i].as<double>());
+    return v;
+}
+
+array<double, 3> toVec3(const msgpack::object &o) {
+    vector<double> v = toDoubles(o);
+    v.resize(3, 0.0);
+    return {v[0], v[1], v[2]};
+}
+
+IngestClip parseClip(const msgpack::object &obj) {
+    IngestClip clip;
+    const msgpack::object *num = getMember(obj, "clip");
+    if (!num)
+        throw runtime_error("Missing 'clip' in ingest file");
+    clip.clipNumber = num->as<string>();
+    const msgpack::object &segments = requireArray(obj, "segments");
+    for (size_t i = 0; i < segments.via.array.size; i++) {
+        vector<double> s = toDoubles(segments.via.array.ptr[i]);
+        if (s.size() >= 3)
+            clip.segments.push_back({(int)s[0], (int)s[1], s[2]});
+    }
+    const msgpack::object &raw = requireArray(obj, "raw");
+    const msgpack::object &hip = requireArray(obj, "hip");
+    clip.raw.resize(raw.via.array.size);
+    for (size_t t = 0; t < raw.via.array.size; t++) {
+        const msgpack::object &joints = raw.via.array.ptr[t];
+        FrameData &f = clip.raw[t];
+        for (size_t j = 0; j < joints.via.array.size; j++)
+            f.positions.push_back(toVec3(joints.via.array.ptr[j]));
+        if (t < hip.via.array.size) {
+            vector<double> q = toDoubles(hip.via.array.ptr[t]);
+            q.resize(4, 0.0);
+            copy(q.begin(), q.end(), f.hipQuaternion.begin());
+        }
+    }
+    const msgpack::object &music = requireArray(obj, "music");
+    for (size_t t = 0; t < music.via.array.size; t++)
+        clip.music.push_back(toDoubles(music.via.array.ptr[t]));
+    vector<array<double, 3>> eye, rotation;
+    const msgpack::object &eyeArray = requireArray(obj, "camera_eye");
+    for (size_t i = 0; i < eyeArray.via.array.size; i++)
+        eye.push_back(toVec3(eyeArray.via.array.ptr[i]));
+    const msgpack::object &rotArray = requireArray(obj, "Rotation");
+    for (size_t i = 0; i < rotArray.via.array.size; i++)
+        rotation.push_back(toVec3(rotArray.via.array.ptr[i]));
+    clip.camera = CameraClip(eye, rotation, toDoubles(requireArray(obj, "Fov")),
+                             toDoubles(requireArray(obj, "Distance")));
+    return clip;
+}
+
+// ファイル 1 つ分のクリップを読む（ファイルが消えていたら false）
+bool readIngestFile(const string &path, vector<IngestClip> &clips) {
+    vector<char> bytes;
+    string error;
+    if (!readWholeFile(path, bytes, error))
+        return false;
+    msgpack::object_handle oh = unpackMsgpack(bytes, path);
+    const msgpack::object &obj = oh.get();
+    const msgpack::object *version = getMember(obj, "version");
+    if (!version || version->as<int>() != kFileVersion)
+        throw runtime_error("Unsupported ingest file: " + path);
+    const msgpack::object &list = requireArray(obj, "clips");
+    for (size_t i = 0; i < list.via.array.size; i++)
+        clips.push_back(parseClip(list.via.array.ptr[i]));
+    return true;
+}
+
+} // namespace
+
+IngestClip buildIngestClip(const string &clipNumber,
+                           const string &motionDir,
+                           const string &musicDir,
+                           const string &cameraPositionPath,
+                           const string &cameraRotationPath,
+                           const vector<int> &frameIntervals) {
+    IngestClip clip;
+    clip.clipNumber = clipNumber;
+    clip.raw = loadJointPositions(motionDir + "/raw.msgpack");
+    vector<FrameData> hip = fs::exists(motionDir + "/hip.msgpack") ? loadJointPositions(motionDir + "/hip.msgpack")
+                                                                    : deriveHipDirections(clip.raw);
+    for (size_t t = 0; t < clip.raw.size() && t < hip.size(); t++)
+        clip.raw[t].hipQuaternion = hip[t].hipQuaternion;
+    clip.music = loadMusicFeaturesMsgpack(musicDir + "/music.msgpack");
+    vector<BeatData> beats = loadBeatsMsgpack(musicDir + "/beat.msgpack");
+
+    // 候補区間と BPM（average_bpm.msgpack と同じく区間内のビートの BPM の平均）
+    int n = clip.raw.size();
+    vector<int> intervals = frameIntervals.empty() ? vector<int>{n} : frameIntervals;
+    int start = 0;
+    for (int len : intervals) {
+        int end = min(start + len, n);
+        if (end <= start)
+            break;
+        clip.segments.push_back({start, end, calculateAverageBpmInInterval(beats, start, end, 30)});
+        start = end;
+    }
+    clip.camera = loadCameraMsgpack(cameraPositionPath, cameraRotationPath);
+    return clip;
+}
+
+string appendIngestClip(const string &storeDir, const IngestClip &clip) {
+    fs::create_directories(storeDir);
+    msgpack::sbuffer buf;
+    packFile(buf, {&clip});
+    string name = newFileName("seg");
+    writeFileAtomically(storeDir + "/" + name, buf.data(), buf.size());
+
+    // ファイルを書き終えてから MANIFEST に載せる
+    StoreLock lock(storeDir + "/LOCK", true);
+    vector<ManifestEntry> entries = readManifest(storeDir);
+    for (const auto &e : entries) {
+        if (find(e.clips.begin(), e.clips.end(), clip.clipNumber) != e.clips.end()) {
+            fs::remove(storeDir + "/" + name);
+            throw runtime_error("Clip " + clip.clipNumber + " is already ingested");
+        }
+    }
+    entries.push_back({name, {clip.clipNumber}});
+    writeManifest(storeDir, entries);
+    return name;
+}
+
+vector<IngestClip> loadIngestStore(const string &storeDir) {
+    for (int attempt = 0; attempt < 5; attempt++) {
+        vector<IngestClip> clips;
+        bool complete = true;
+        for (const auto &e : readManifest(storeDir)) {
+            if (!readIngestFile(storeDir + "/" + e.file, clips)) {
+                complete = false;
+                break;
+            }
+        }
+        if (complete)
+            return clips;
+    }
+    throw runtime_error("Cannot read a consistent snapshot of " + storeDir);
+}
+
+size_t countIngestFiles(const string &storeDir) {
+    return readManifest(storeDir).size();
+}
+
+bool compactIngestStore(const string &storeDir, size_t minFiles) {
+    StoreLock compacting(storeDir + "/COMPACT", false);
+    if (!compacting.locked())
+        return false;
+    vector<ManifestEntry> snapshot;
+    {
+        StoreLock lock(storeDir + "/LOCK", true);
+        snapshot = readManifest(storeDir);
+    }
+    if (snapshot.size() < max<size_t>(minFiles, 2))
+        return false;
+
+    // まとめたファイルを書く間は MANIFEST をロックしない（追記・読み込みは止まらない）
+    vector<IngestClip> clips;
+    ManifestEntry merged;
+    for (const auto &e : snapshot) {
+        if (!readIngestFile(storeDir + "/" + e.file, clips))
+            throw runtime_error("Missing ingest file: " + e.file);
+        merged.clips.insert(merged.clips.end(), e.clips.begin(), e.clips.end());
+    }
+    vector<const IngestClip *> ptrs;
+    for (const auto &c : clips)
+        ptrs.push_back(&c);
+    msgpack::sbuffer buf;
+    packFile(buf, ptrs);
+    merged.file = newFileName("pack");
+    writeFileAtomically(storeDir + "/" + merged.file, buf.data(), buf.size());
+
+    // 圧縮中に追記されたファイルはそのまま後ろに残す
+    {
+        StoreLock lock(storeDir + "/LOCK", true);
+        set<string> replaced;
+        for (const auto &e : snapshot)
+            replaced.insert(e.file);
+        vector<ManifestEntry> entries = {merged};
+        for (auto &e : readManifest(storeDir)) {
+            if (!replaced.count(e.file))
+                entries.push_back(move(e));
+        }
+        writeManifest(storeDir, entries);
+    }
+    // 古い世代を読んでいる途中の読み手は、ファイルが見つからなければ新しい MANIFEST を読み直す
+    for (const auto &e : snapshot)
+        fs::remove(storeDir + "/" + e.file);
+    return true;
+}
+
+void startBackgroundCompaction(const string &storeDir, size_t minFiles) {
+    cout.flush();
+    cerr.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // 孫プロセスで圧縮し、子はすぐ終わる（呼び出し側はゾンビを残さずに戻れる）
+        if (fork() == 0) {
+            setsid();
+            try {
+                compactIngestStore(storeDir, minFiles);
+            }
+            catch (const std::exception &e) {
+                cerr << "[WARN] 圧縮に失敗しました: " << storeDir << " (" << e.what() << ")" << endl;
+            }
+            _exit(0);
+        }
+        _exit(0);
+    }
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+}
+
+} // namespace camsynth
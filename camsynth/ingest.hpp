@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "camera_store.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// 追記型のデータベース取り込み
+// 取り込んだクリップは DatabaseDirs::IngestDir（既定 Database/Ingest）の下に、書いた後は変更しない
+// ファイル (*.cseg) として置き、有効なファイルの一覧 MANIFEST を差し替えて公開する。
+// 取り込みの手間は新しいクリップの大きさだけで決まり、Split などの既存のファイルや average_bpm.msgpack は触らない。
+//
+//   MANIFEST   1 行目 "camsynth-ingest 1"、以降 1 行に 1 ファイル（"ファイル名 クリップ番号..."）
+//   *.cseg     msgpack の {"version": 1, "clips": [クリップ, ...]}
+//   LOCK       MANIFEST を書き換えるときの排他ロック (flock)
+//
+// MANIFEST は一時ファイルに書いてから rename で置き換えるので、読む側は常にどれか 1 つの世代を丸ごと見る。
+// 圧縮はいくつものファイルを 1 つにまとめた新しいファイルを書き、MANIFEST を差し替えてから古いファイルを消す。
+
+struct IngestSegment {
+    int start = 0;   // クリップ先頭からのフレーム番号 [start, end)
+    int end = 0;
+    double bpm = 0.0;
+};
+
+struct IngestClip {
+    std::string clipNumber;
+    std::vector<FrameData> raw;             // 姿勢（Split と同じ座標）とヒップのクォータニオン
+    std::vector<std::vector<double>> music; // フレームごとの楽曲特徴量
+    std::vector<IngestSegment> segments;    // 候補区間（Split のファイルに相当）
+    CameraClip camera;
+};
+
+// 入力と同じ形式のファイルから取り込み用のクリップを作る
+//   motionDir: raw.msgpack（hip.msgpack がなければ raw から求める）
+//   musicDir : music.msgpack, beat.msgpack（区間の BPM は beat から求める）
+//   frameIntervals: 候補区間の長さ（空ならクリップ全体を 1 区間にする）
+IngestClip buildIngestClip(const std::string &clipNumber,
+                           const std::string &motionDir,
+                           const std::string &musicDir,
+                           const std::string &cameraPositionPath,
+                           const std::string &cameraRotationPath,
+                           const std::vector<int> &frameIntervals);
+
+// クリップを 1 ファイルに書いてストアに追加する（同じ番号がすでにあれば例外）。書いたファイル名を返す
+std::string appendIngestClip(const std::string &storeDir, const IngestClip &clip);
+
+// MANIFEST の現在の世代が指すクリップを全部読む（MANIFEST がなければ空）
+// 読んでいる途中で圧縮されてファイルが消えた場合は、新しい世代を読み直す
+std::vector<IngestClip> loadIngestStore(const std::string &storeDir);
+
+// 現在のファイル数（MANIFEST の行数）
+size_t countIngestFiles(const std::string &storeDir);
+
+// ファイルが minFiles 個以上あれば 1 つにまとめる（まとめたら true）
+// 別の圧縮が動いている間は何もしない。まとめている間も追記・読み込みはできる
+bool compactIngestStore(const std::string &storeDir, size_t minFiles = 2);
+
+// 圧縮を別プロセスで始めて、終わりを待たずに戻る
+void startBackgroundCompaction(const std::string &storeDir, size_t minFiles = 2);
+
+} // namespace camsynth
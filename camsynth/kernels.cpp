@@ -0,0 +1,621 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace std;
+
+namespace camsynth {
+
+// JSONに依存しない計算処理
+double calculateJointDistanceSparse(const vector<FrameData> &frames1,
+                                    const vector<FrameData> &frames2,
+                                    int step) {
+    double total_distance = 0.0;
+    int minLen = min(frames1.size(), frames2.size());
+    for (int i = 0; i < minLen; i += step) {
+        const auto &joints1 = frames1[i].positions;
+        const auto &joints2 = frames2[i].positions;
+        int numJoints = min(joints1.size(), joints2.size());
+        double frameDistance = 0.0;
+        for (int j = 0; j < numJoints; j++) {
+            double dx = joints1[j][0] - joints2[j][0];
+            double dy = joints1[j][1] - joints2[j][1];
+            double dz = joints1[j][2] - joints2[j][2];
+            frameDistance += sqrt(dx * dx + dy * dy + dz * dz);
+        }
+        total_distance += frameDistance;
+    }
+    return total_distance;
+}
+
+double calculateRootRelativeJointDistanceSparse(FrameSpan standFrames,
+                                                const FrameData *rawFrames,
+                                                int step) {
+    double total_distance = 0.0;
+    int len = standFrames.size();
+    for (int i = 0; i < len; i += step) {
+        const auto &joints1 = standFrames[i].positions;
+        const auto &joints2 = rawFrames[i].positions;
+        int numJoints = min(joints1.size(), joints2.size());
+        if (numJoints == 0)
+            continue;
+        const auto &root = joints2[0];
+        double frameDistance = 0.0;
+        for (int j = 0; j < numJoints; j++) {
+            double dx = joints1[j][0] - (joints2[j][0] - root[0]);
+            double dy = joints1[j][1] - (joints2[j][1] - root[1]);
+            double dz = joints1[j][2] - (joints2[j][2] - root[2]);
+            frameDistance += sqrt(dx * dx + dy * dy + dz * dz);
+        }
+        total_distance += frameDistance;
+    }
+    return total_distance;
+}
+
+namespace {
+
+// 1 フレーム分のジョイント距離（ジョイントの順に足すので汎用版と同じ値になる）
+template <size_t... J>
+inline double rootRelativeFrameDistance(const array<double, 3> *joints1, const array<double, 3> *joints2,
+                                        index_sequence<J...>) {
+    const array<double, 3> &root = joints2[0];
+    double frameDistance = 0.0;
+    ((frameDistance += sqrt((joints1[J][0] - (joints2[J][0] - root[0])) * (joints1[J][0] - (joints2[J][0] - root[0])) +
+                            (joints1[J][1] - (joints2[J][1] - root[1])) * (joints1[J][1] - (joints2[J][1] - root[1])) +
+                            (joints1[J][2] - (joints2[J][2] - root[2])) * (joints1[J][2] - (joints2[J][2] - root[2])))),
+     ...);
+    return frameDistance;
+}
+
+} // namespace
+
+template <int NumJoints>
+double rootRelativeJointDistanceFixed(FrameSpan standFrames, const FrameData *rawFrames, int step) {
+    double total_distance = 0.0;
+    int len = standFrames.size();
+    for (int i = 0; i < len; i += step)
+        total_distance += rootRelativeFrameDistance(standFrames[i].positions.data(), rawFrames[i].positions.data(),
+                                                    make_index_sequence<NumJoints>());
+    return total_distance;
+}
+
+template <int MusicDims>
+double musicFeatureDistanceFixed(const double *input, const double *candidate, size_t count, int step, int) {
+    double diff = 0.0;
+    for (size_t i = 0; i < count; i += step)
+        diff += fabs(input[i * MusicDims] - candidate[i * MusicDims]);
+    return diff;
+}
+
+template double rootRelativeJointDistanceFixed<23>(FrameSpan, const FrameData *, int);
+template double musicFeatureDistanceFixed<1>(const double *, const double *, size_t, int, int);
+template double musicFeatureDistanceFixed<4>(const double *, const double *, size_t, int, int);
+template double musicFeatureDistanceFixed<16>(const double *, const double *, size_t, int, int);
+
+double calculateMusicFeatureDistanceFlat(const double *input, const double *candidate, size_t count, int step, int dims) {
+    double diff = 0.0;
+    for (size_t i = 0; i < count; i += step)
+        diff += fabs(input[i * dims] - candidate[i * dims]);
+    return diff;
+}
+
+DistanceKernels selectDistanceKernels(int numJoints, int musicDims) {
+    DistanceKernels k;
+    k.numJoints = numJoints;
+    k.musicDims = musicDims;
+    if (numJoints == 23) {
+        k.jointDistance = rootRelativeJointDistanceFixed<23>;
+        k.fixedJoints = true;
+    }
+    switch (musicDims) {
+    case 1:
+        k.musicDistance = musicFeatureDistanceFixed<1>;
+        k.fixedMusic = true;
+        break;
+    case 4:
+        k.musicDistance = musicFeatureDistanceFixed<4>;
+        k.fixedMusic = true;
+        break;
+    case 16:
+        k.musicDistance = musicFeatureDistanceFixed<16>;
+        k.fixedMusic = true;
+        break;
+    default:
+        break;
+    }
+    return k;
+}
+
+double calculateHipVectorDistanceSparse(FrameSpan frames1,
+                                        const array<double, 4> *hip2,
+                                        size_t count,
+                                        int step) {
+    double total_distance = 0.0;
+    int len = min(frames1.size(), count);
+    for (int i = 0; i < len; i += step) {
+        const auto &q1 = frames1[i].hipQuaternion;
+        const auto &q2 = hip2[i];
+        double dx = q1[0] - q2[0];
+        double dy = q1[1] - q2[1];
+        double dz = q1[2] - q2[2];
+        double dw = q1[3] - q2[3];
+        total_distance += sqrt(dx * dx + dy * dy + dz * dz + dw * dw);
+    }
+    return total_distance;
+}
+
+double calculateHipVectorDistanceSparse(const vector<FrameData> &frames1,
+                                        const vector<FrameData> &frames2,
+                                        int step) {
+    double total_distance = 0.0;
+    int minLen = min(frames1.size(), frames2.size());
+    for (int i = 0; i < minLen; i += step) {
+        const auto &q1 = frames1[i].hipQuaternion;
+        const auto &q2 = frames2[i].hipQuaternion;
+        double dx = q1[0] - q2[0];
+        double dy = q1[1] - q2[1];
+        double dz = q1[2] - q2[2];
+        double dw = q1[3] - q2[3];
+        total_distance += sqrt(dx * dx + dy * dy + dz * dz + dw * dw);
+    }
+    return total_distance;
+}
+
+void gemmBlockedNT(const double *A, const double *B, double *C, int m, int n, int k) {
+    // A のブロック (MB × KB) と B のブロック (NB × KB) が L2 に収まる大きさ
+    const int MB = 32, NB = 256, KB = 256;
+    fill(C, C + (size_t)m * n, 0.0);
+    for (int k0 = 0; k0 < k; k0 += KB) {
+        int kl = min(KB, k - k0);
+        for (int j0 = 0; j0 < n; j0 += NB) {
+            int j1 = min(j0 + NB, n);
+            for (int i0 = 0; i0 < m; i0 += MB) {
+                int i1 = min(i0 + MB, m);
+                for (int i = i0; i < i1; i++) {
+                    const double *a = A + (size_t)i * k + k0;
+                    double *c = C + (size_t)i * n;
+                    for (int j = j0; j < j1; j++) {
+                        const double *b = B + (size_t)j * k + k0;
+                        // 4 本の部分和で依存を切る
+                        double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+                        int l = 0;
+                        for (; l + 4 <= kl; l += 4) {
+                            s0 += a[l] * b[l];
+                            s1 += a[l + 1] * b[l + 1];
+                            s2 += a[l + 2] * b[l + 2];
+                            s3 += a[l + 3] * b[l + 3];
+                        }
+                        for (; l < kl; l++)
+                            s0 += a[l] * b[l];
+                        c[j] += (s0 + s1) + (s2 + s3);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void symmetricEigen(vector<double> a, int n, vector<double> &eigenvalues, vector<double> &eigenvectors) {
+    vector<double> v(n * n, 0.0);
+    for (int i = 0; i < n; i++)
+        v[i * n + i] = 1.0;
+    for (int sweep = 0; sweep < 100; sweep++) {
+        double off = 0.0;
+        for (int p = 0; p < n; p++)
+            for (int q = p + 1; q < n; q++)
+                off += a[p * n + q] * a[p * n + q];
+        if (off < 1e-22)
+            break;
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                double apq = a[p * n + q];
+                if (fabs(apq) < 1e-300)
+                    continue;
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0), sn = t * c;
+                for (int r = 0; r < n; r++) {
+                    double arp = a[r * n + p], arq = a[r * n + q];
+                    a[r * n + p] = c * arp - sn * arq;
+                    a[r * n + q] = sn * arp + c * arq;
+                }
+                for (int r = 0; r < n; r++) {
+                    double apr = a[p * n + r], aqr = a[q * n + r];
+                    a[p * n + r] = c * apr - sn * aqr;
+                    a[q * n + r] = sn * apr + c * aqr;
+                }
+                for (int r = 0; r < n; r++) {
+                    double vrp = v[r * n + p], vrq = v[r * n + q];
+                    v[r * n + p] = c * vrp - sn * vrq;
+                    v[r * n + q] = sn * vrp + c * vrq;
+                }
+            }
+        }
+    }
+    vector<int> order(n);
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](int x, int y) { return a[x * n + x] > a[y * n + y]; });
+    eigenvalues.resize(n);
+    eigenvectors.resize(n * n);
+    for (int i = 0; i < n; i++) {
+        eigenvalues[i] = a[order[i] * n + order[i]];
+        for (int r = 0; r < n; r++)
+            eigenvectors[i * n + r] = v[r * n + order[i]];
+    }
+}
+
+// 基数 2 の FFT（in-place, a.size() は 2 のべき乗）。inverse=true で逆変換（1/n 倍込み）
+void fft(vector<complex<double>> &a, bool inverse) {
+    fft(a.data(), a.size(), inverse);
+}
+
+void fft(complex<double> *a, size_t size, bool inverse) {
+    int n = size;
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            swap(a[i], a[j]);
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        double ang = 2.0 * M_PI / len * (inverse ? 1.0 : -1.0);
+        complex<double> wlen(cos(ang), sin(ang));
+        for (int i = 0; i < n; i += len) {
+            complex<double> w(1.0, 0.0);
+            for (int k = 0; k < len / 2; k++) {
+                complex<double> u = a[i + k];
+                complex<double> v = a[i + k + len / 2] * w;
+                a[i + k] = u + v;
+                a[i + k + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+    if (inverse) {
+        for (int i = 0; i < n; i++)
+            a[i] /= n;
+    }
+}
+
+SlidingDistanceProfiler::SlidingDistanceProfiler(FrameSpan query, int step) : query_(query), step_(step) {
+    numJoints_ = query.empty() ? 0 : query[0].positions.size();
+    for (size_t t = 0; t < query.size(); t += step) {
+        for (int j = 0; j < numJoints_; j++) {
+            const auto &p = query[t].positions[j];
+            queryNorm_ += p[0] * p[0] + p[1] * p[1] + p[2] * p[2];
+        }
+    }
+}
+
+vector<double> SlidingDistanceProfiler::profile(const vector<FrameData> &candidate, bool rootRelative) {
+    return profile(candidate.data(), candidate.size(), rootRelative);
+}
+
+namespace {
+
+int fftLength(int length) {
+    int n = 1;
+    while (n < length)
+        n <<= 1;
+    return n;
+}
+
+} // namespace
+
+vector<double> SlidingDistanceProfiler::profile(const FrameData *candidate, int length, bool rootRelative) {
+    int m = query_.size();
+    if (m == 0 || length < m)
+        return {};
+    int n = fftLength(length);
+    vector<complex<double>> acc(n), buf(n);
+    vector<double> candNorm(length), dist(length - m + 1);
+    computeProfile(candidate, length, rootRelative, acc.data(), buf.data(), candNorm.data(), dist.data());
+    return dist;
+}
+
+Span<const double> SlidingDistanceProfiler::profile(const FrameData *candidate, int length, bool rootRelative,
+                                                    Arena &arena) {
+    int m = query_.size();
+    if (m == 0 || length < m)
+        return {};
+    int n = fftLength(length);
+    // 結果は呼び出し側が使うので先に切り出し、作業領域だけを戻す
+    Span<double> dist = arena.allocateArray<double>(length - m + 1);
+    Arena::Mark scratch = arena.mark();
+    Span<complex<double>> acc = arena.allocateArray<complex<double>>(n);
+    Span<complex<double>> buf = arena.allocateArray<complex<double>>(n);
+    Span<double> candNorm = arena.allocateArray<double>(length);
+    computeProfile(candidate, length, rootRelative, acc.data(), buf.data(), candNorm.data(), dist.data());
+    arena.rewind(scratch);
+    return dist;
+}
+
+void SlidingDistanceProfiler::prepare(int length) {
+    if (!query_.empty() && length >= (int)query_.size())
+        querySpectra(fftLength(length));
+}
+
+size_t SlidingDistanceProfiler::scratchBytes(int length) {
+    // 切り出しごとの境界合わせの分も見込む
+    return 2 * fftLength(length) * sizeof(complex<double>) + 2 * length * sizeof(double) + 4 * alignof(max_align_t);
+}
+
+void SlidingDistanceProfiler::computeProfile(const FrameData *candidate, int length, bool rootRelative,
+                                             complex<double> *acc, complex<double> *buf, double *candNorm,
+                                             double *out) {
+    int m = query_.size();
+    int len = length;
+    int n = fftLength(len);
+    const Spectra &qs = querySpectra(n);
+    int numJoints = min(numJoints_, candidate[0].positions.empty() ? 0 : (int)candidate[0].positions.size());
+
+    // Σ_ch C_ch * conj(Q_ch) と ‖c‖² の相関を周波数領域で足し合わせ、逆変換は 1 回だけ行う
+    fill(acc, acc + n, 0.0);
+    fill(candNorm, candNorm + len, 0.0);
+    for (int j = 0; j < numJoints; j++) {
+        for (int d = 0; d < 3; d++) {
+            fill(buf, buf + n, 0.0);
+            for (int t = 0; t < len; t++) {
+                double v = candidate[t].positions[j][d];
+                if (rootRelative)
+                    v -= candidate[t].positions[0][d];
+                buf[t] = v;
+                candNorm[t] += v * v;
+            }
+            fft(buf, n, false);
+            const auto &q = qs.channels[j * 3 + d];
+            for (int k = 0; k < n; k++)
+                acc[k] -= 2.0 * buf[k] * conj(q[k]);
+        }
+    }
+    fill(buf, buf + n, 0.0);
+    for (int t = 0; t < len; t++)
+        buf[t] = candNorm[t];
+    fft(buf, n, false);
+    for (int k = 0; k < n; k++)
+        acc[k] += buf[k] * conj(qs.mask[k]);
+    fft(acc, n, true);
+
+    for (int o = 0; o <= len - m; o++)
+        out[o] = max(0.0, queryNorm_ + acc[o].real());
+}
+
+const SlidingDistanceProfiler::Spectra &SlidingDistanceProfiler::querySpectra(int n) {
+    auto it = spectra_.find(n);
+    if (it != spectra_.end())
+        return it->second;
+    Spectra s;
+    int m = query_.size();
+    for (int j = 0; j < numJoints_; j++) {
+        for (int d = 0; d < 3; d++) {
+            vector<complex<double>> buf(n, 0.0);
+            for (int t = 0; t < m; t += step_)
+                buf[t] = query_[t].positions[j][d];
+            fft(buf, false);
+            s.channels.push_back(move(buf));
+        }
+    }
+    s.mask.assign(n, 0.0);
+    for (int t = 0; t < m; t += step_)
+        s.mask[t] = 1.0;
+    fft(s.mask, false);
+    return spectra_.emplace(n, move(s)).first->second;
+}
+
+namespace {
+
+// [begin, end) のフレーム（カーネルが範囲外にかからない部分）をカーネル長を固定して平滑化する
+template <int KernelSize>
+void gaussianInterior(const vector<array<double, 3>> &data, const double *kernel, int begin, int end,
+                      vector<array<double, 3>> &smoothed) {
+    const int half = KernelSize / 2;
+    for (int i = begin; i < end; i++) {
+        const array<double, 3> *window = data.data() + (i - half);
+        double outx = 0.0, outy = 0.0, outz = 0.0;
+        for (int k = 0; k < KernelSize; k++) {
+            outx += window[k][0] * kernel[k];
+            outy += window[k][1] * kernel[k];
+            outz += window[k][2] * kernel[k];
+        }
+        smoothed[i] = {outx, outy, outz};
+    }
+}
+
+} // namespace
+
+vector<array<double, 3>> applyGaussianFilter(const vector<array<double, 3>> &data, double sigma) {
+    int kernelSize = max(3, (int)ceil(6.0 * sigma));
+    if (kernelSize % 2 == 0)
+        kernelSize += 1;
+    vector<double> kernel(kernelSize);
+    int half = kernelSize / 2;
+    double sum = 0.0;
+    double invS2 = 1.0 / (2.0 * sigma * sigma);
+    for (int i = 0; i < kernelSize; i++) {
+        int x = i - half;
+        double val = exp(-x * x * invS2);
+        kernel[i] = val;
+        sum += val;
+    }
+    for (int i = 0; i < kernelSize; i++) {
+        kernel[i] /= sum;
+    }
+    int n = data.size();
+    vector<array<double, 3>> smoothed(n, {0.0, 0.0, 0.0});
+    auto smoothClamped = [&](int i) {
+        double outx = 0.0, outy = 0.0, outz = 0.0;
+        for (int k = 0; k < kernelSize; k++) {
+            int index = i + (k - half);
+            if (index < 0)
+                index = 0;
+            if (index >= n)
+                index = n - 1;
+            outx += data[index][0] * kernel[k];
+            outy += data[index][1] * kernel[k];
+            outz += data[index][2] * kernel[k];
+        }
+        return array<double, 3>{outx, outy, outz};
+    };
+    // 端の値で埋める必要があるのは先頭・末尾 half フレームだけなので、残りは範囲の確認なしで計算する
+    int interiorBegin = 0, interiorEnd = 0;
+    if (kernelSize == 61 && n > 2 * half) {
+        interiorBegin = half;
+        interiorEnd = n - half;
+        gaussianInterior<61>(data, kernel.data(), interiorBegin, interiorEnd, smoothed);
+    }
+    for (int i = 0; i < interiorBegin; i++)
+        smoothed[i] = smoothClamped(i);
+    for (int i = interiorEnd; i < n; i++)
+        smoothed[i] = smoothClamped(i);
+    return smoothed;
+}
+
+LookaheadGaussianFilter::LookaheadGaussianFilter(double sigma, int lookaheadFrames) {
+    int kernelSize = max(3, (int)ceil(6.0 * sigma));
+    if (kernelSize % 2 == 0)
+        kernelSize += 1;
+    half = kernelSize / 2;
+    lookahead = max(0, min(lookaheadFrames, half));
+    kernel.resize(half + lookahead + 1);
+    double sum = 0.0;
+    double invS2 = 1.0 / (2.0 * sigma * sigma);
+    for (int k = 0; k < (int)kernel.size(); k++) {
+        int x = k - half;
+        kernel[k] = exp(-x * x * invS2);
+        sum += kernel[k];
+    }
+    for (auto &w : kernel)
+        w /= sum;
+}
+
+array<double, 3> LookaheadGaussianFilter::apply(const vector<array<double, 3>> &data, int i) const {
+    int n = data.size();
+    double outx = 0.0, outy = 0.0, outz = 0.0;
+    for (int k = 0; k < (int)kernel.size(); k++) {
+        int index = i + (k - half);
+        if (index < 0)
+            index = 0;
+        if (index >= n)
+            index = n - 1;
+        outx += data[index][0] * kernel[k];
+        outy += data[index][1] * kernel[k];
+        outz += data[index][2] * kernel[k];
+    }
+    return {outx, outy, outz};
+}
+
+vector<double> normalizeValues(const vector<double> &vals) {
+    vector<double> out(vals.size());
+    normalizeValues(vals.data(), vals.size(), out.data());
+    return out;
+}
+
+void normalizeValues(const double *vals, size_t n, double *out) {
+    if (n == 0)
+        return;
+    double minV = vals[0], maxV = vals[0];
+    for (size_t i = 0; i < n; i++) {
+        if (vals[i] < minV)
+            minV = vals[i];
+        if (vals[i] > maxV)
+            maxV = vals[i];
+    }
+    double range = maxV - minV;
+    if (range == 0.0) {
+        fill(out, out + n, 0.0);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        out[i] = (vals[i] - minV) / range;
+    }
+}
+
+vector<vector<FrameData>> splitByFrameIntervals(const vector<FrameData> &data,
+                                                 const vector<int> &frameIntervals) {
+    vector<vector<FrameData>> segments;
+    int start = 0;
+    int n = data.size();
+    for (auto interval : frameIntervals) {
+        int end = start + interval;
+        if (end > n)
+            end = n;
+        vector<FrameData> segment;
+        for (int i = start; i < end; i++) {
+            segment.push_back(data[i]);
+        }
+        segments.push_back(segment);
+        start = end;
+        if (start >= n)
+            break;
+    }
+    return segments;
+}
+
+vector<FrameSpan> sliceByFrameIntervals(FrameSpan data, const vector<int> &frameIntervals) {
+    vector<FrameSpan> segments;
+    int start = 0;
+    int n = data.size();
+    for (auto interval : frameIntervals) {
+        int end = start + interval;
+        if (end > n)
+            end = n;
+        segments.push_back(data.subspan(start, max(0, end - start)));
+        start = end;
+        if (start >= n)
+            break;
+    }
+    return segments;
+}
+
+// フレームごとに、入力セグメントと候補セグメントの1次元ベクトルの差分を計算する。
+// step 間隔でサンプルし、各次元の差分を足し合わせたものを返す（各要素は各次元の総和）。
+// 次元数
+vector<double> calculateMusicFeatureDistanceSparse(const vector<vector<double>> &inputSegment,
+    const vector<vector<double>> &candidateSegment,
+    int step) {
+int n = min(inputSegment.size(), candidateSegment.size());
+vector<double> diffSum(1, 0.0);
+for (int i = 0; i < n; i += step) {
+for (int k = 0; k < 1; k++) {
+diffSum[k] += fabs(inputSegment[i][k] - candidateSegment[i][k]);
+}
+}
+return diffSum;
+}
+
+double calculateMusicFeatureDistanceSparse(MusicSpan inputSegment,
+                                           const vector<double> *candidateSegment,
+                                           size_t count,
+                                           int step) {
+    int n = min(inputSegment.size(), count);
+    double diffSum = 0.0;
+    for (int i = 0; i < n; i += step)
+        diffSum += fabs(inputSegment[i][0] - candidateSegment[i][0]);
+    return diffSum;
+}
+
+double framesToMilliseconds(int frames, int fps) {
+    return (double(frames) / fps) * 1000.0;
+}
+
+// BeatData 版の BPM 平均値算出（ストリーミングで逐次受け取ったビート用）
+double calculateAverageBpmInInterval(const vector<BeatData> &beats, int startFrame, int endFrame, int fps) {
+    double startMs = framesToMilliseconds(startFrame, fps);
+    double endMs = framesToMilliseconds(endFrame, fps);
+    double sumBpm = 0.0;
+    int cnt = 0;
+    for (const auto &b : beats) {
+        if (b.startMs >= startMs && b.startMs < endMs) {
+            sumBpm += b.bpm;
+            cnt++;
+        }
+    }
+    return (cnt == 0) ? 0.0 : sumBpm / cnt;
+}
+
+} // namespace camsynth
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <complex>
+#include <map>
+#include <vector>
+
+#include "arena.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// 入力セグメント・候補区間への所有しない参照
+using FrameSpan = Span<const FrameData>;
+using MusicSpan = Span<const std::vector<double>>;
+
+// 各フレームの各ジョイント間のユークリッド距離の総和（step 間隔でサンプル）
+double calculateJointDistanceSparse(const std::vector<FrameData> &frames1,
+                                    const std::vector<FrameData> &frames2,
+                                    int step);
+
+// root 基準の姿勢 standFrames と、データベースの raw 姿勢 (rawFrames[0] から standFrames.size() フレーム) の距離
+// raw 側は各フレームの root (ジョイント 0) を引きながら比較するので、Stand_Split を別に持たなくてよい
+double calculateRootRelativeJointDistanceSparse(FrameSpan standFrames,
+                                                const FrameData *rawFrames,
+                                                int step);
+
+// ヒップのクォータニオン間の距離の総和（step 間隔でサンプル）
+double calculateHipVectorDistanceSparse(const std::vector<FrameData> &frames1,
+                                        const std::vector<FrameData> &frames2,
+                                        int step);
+
+// hip2 はデータベース側のクォータニオン列（先頭から count 個まで比較する）
+double calculateHipVectorDistanceSparse(FrameSpan frames1,
+                                        const std::array<double, 4> *hip2,
+                                        size_t count,
+                                        int step);
+
+// フレームごとに、入力セグメントと候補セグメントの1次元ベクトルの差分を計算する。
+std::vector<double> calculateMusicFeatureDistanceSparse(const std::vector<std::vector<double>> &inputSegment,
+                                                        const std::vector<std::vector<double>> &candidateSegment,
+                                                        int step);
+
+// candidateSegment はデータベース側の楽曲特徴量列（先頭から count フレームまで比較する）
+// 上の版の要素 0（先頭の次元の差の総和）を返す
+double calculateMusicFeatureDistanceSparse(MusicSpan inputSegment,
+                                           const std::vector<double> *candidateSegment,
+                                           size_t count,
+                                           int step);
+
+// 楽曲特徴量をフレーム順に dims 間隔で詰めた列の差分（先頭の次元の絶対差の総和、step 間隔でサンプル）
+// 上の calculateMusicFeatureDistanceSparse の要素 0 と同じ値になる
+double calculateMusicFeatureDistanceFlat(const double *input, const double *candidate, size_t count, int step, int dims);
+
+// ジョイント数・楽曲特徴量の次元数をコンパイル時に決めた版
+// フレームごとの長さの確認がなく、ジョイントのループは完全に展開される。
+// 全フレームのジョイント数・次元数がテンプレート引数と一致するときだけ使う（明示的インスタンス化は下の組のみ）。
+template <int NumJoints>
+double rootRelativeJointDistanceFixed(FrameSpan standFrames, const FrameData *rawFrames, int step);
+template <int MusicDims>
+double musicFeatureDistanceFixed(const double *input, const double *candidate, size_t count, int step, int dims);
+
+extern template double rootRelativeJointDistanceFixed<23>(FrameSpan, const FrameData *, int);
+extern template double musicFeatureDistanceFixed<1>(const double *, const double *, size_t, int, int);
+extern template double musicFeatureDistanceFixed<4>(const double *, const double *, size_t, int, int);
+extern template double musicFeatureDistanceFixed<16>(const double *, const double *, size_t, int, int);
+
+// データベースのレイアウトに合わせて選んだ距離計算の組
+// 専用版がないジョイント数・次元数（0 はフレームごとに揃っていないことを表す）では汎用版になる
+struct DistanceKernels {
+    int numJoints = 0;
+    int musicDims = 0;
+    double (*jointDistance)(FrameSpan, const FrameData *, int) =
+        calculateRootRelativeJointDistanceSparse;
+    double (*musicDistance)(const double *, const double *, size_t, int, int) = calculateMusicFeatureDistanceFlat;
+    bool fixedJoints = false;
+    bool fixedMusic = false;
+};
+
+DistanceKernels selectDistanceKernels(int numJoints, int musicDims);
+
+// C (m × n) = A (m × k) · B (n × k)^T（すべて行優先）
+// A・B の行をキャッシュに収まるブロックに分けて内積をまとめて計算する
+void gemmBlockedNT(const double *A, const double *B, double *C, int m, int n, int k);
+
+// 対称行列 a (n × n, 行優先) の固有値分解（Jacobi 法）
+// 固有値の降順に eigenvalues と eigenvectors（行ごとに 1 本）を返す
+void symmetricEigen(std::vector<double> a, int n, std::vector<double> &eigenvalues, std::vector<double> &eigenvectors);
+
+// 基数 2 の FFT（a.size() は 2 のべき乗）
+void fft(std::vector<std::complex<double>> &a, bool inverse);
+void fft(std::complex<double> *a, size_t n, bool inverse);
+
+// 候補セグメント内の全オフセットについて、入力セグメントとの二乗距離を求める (MASS 方式)
+// 全ジョイントの座標を 1 本のチャンネル列とみなし、
+//   D(o) = Σ_t ‖q_t‖² + Σ_t ‖c_{t+o}‖² - 2 Σ_t q_t·c_{t+o}   (t は step 間隔)
+// の第 2 項・第 3 項を FFT による相互相関でまとめて計算するので、1 候補あたり O(n log n) になる。
+// 入力側のスペクトルは FFT 長ごとにキャッシュして候補間で使い回す。
+class SlidingDistanceProfiler {
+public:
+    // query の指す先はプロファイラより長く使う
+    SlidingDistanceProfiler(FrameSpan query, int step);
+
+    // candidate の各オフセット o (0 <= o <= candidate.size() - query.size()) での二乗距離
+    // rootRelative=true のときは candidate を raw 姿勢とみなし、各フレームの root を引いてから比較する
+    std::vector<double> profile(const std::vector<FrameData> &candidate, bool rootRelative = false);
+    // candidate[0] から length フレームを候補とする版
+    std::vector<double> profile(const FrameData *candidate, int length, bool rootRelative = false);
+    // 作業領域と結果を arena から切り出す版（結果は arena を戻すまで有効）
+    Span<const double> profile(const FrameData *candidate, int length, bool rootRelative, Arena &arena);
+
+    // length フレームの候補に使う入力スペクトルを先に作っておく（走査中にキャッシュを増やさないため）
+    void prepare(int length);
+    // length フレームの候補 1 つで arena から切り出す作業領域の大きさ
+    static size_t scratchBytes(int length);
+
+private:
+    struct Spectra {
+        std::vector<std::vector<std::complex<double>>> channels; // ジョイント座標ごとの入力スペクトル
+        std::vector<std::complex<double>> mask;                  // step 間隔のサンプル位置 (1/0) のスペクトル
+    };
+
+    const Spectra &querySpectra(int n);
+    // acc・buf は FFT 長、candNorm は length、out は length - query.size() + 1 要素
+    void computeProfile(const FrameData *candidate, int length, bool rootRelative, std::complex<double> *acc,
+                        std::complex<double> *buf, double *candNorm, double *out);
+
+    FrameSpan query_;
+    int step_;
+    int numJoints_ = 0;
+    double queryNorm_ = 0.0;
+    std::map<int, Spectra> spectra_;
+};
+
+// translations に対してガウスフィルタを適用する
+// 既定の sigma = 10 のカーネル長 (61) では、端以外をカーネル長を固定した展開版で計算する
+std::vector<std::array<double, 3>> applyGaussianFilter(const std::vector<std::array<double, 3>> &data, double sigma);
+
+// 先読みを lookahead フレームに制限したガウスフィルタ（ストリーミング用）
+// 未来側のカーネルを lookahead で打ち切り、残った重みで正規化し直す。
+// lookahead >= half のときは applyGaussianFilter と同じ結果になる。
+struct LookaheadGaussianFilter {
+    std::vector<double> kernel; // オフセット -half ～ +lookahead の重み
+    int half = 0;
+    int lookahead = 0;
+
+    LookaheadGaussianFilter(double sigma, int lookaheadFrames);
+
+    // data の i 番目を平滑化する（範囲外は端の値で埋める）
+    std::array<double, 3> apply(const std::vector<std::array<double, 3>> &data, int i) const;
+};
+
+// min-max 正規化
+std::vector<double> normalizeValues(const std::vector<double> &vals);
+// vals の n 要素を正規化して out に書く
+void normalizeValues(const double *vals, size_t n, double *out);
+
+// フレーム間隔ごとにデータを分割する
+std::vector<std::vector<FrameData>> splitByFrameIntervals(const std::vector<FrameData> &data,
+                                                          const std::vector<int> &frameIntervals);
+// splitByFrameIntervals と同じ区間を、コピーせずに data を指す参照で返す
+std::vector<FrameSpan> sliceByFrameIntervals(FrameSpan data, const std::vector<int> &frameIntervals);
+
+double framesToMilliseconds(int frames, int fps = 30);
+
+// [startFrame, endFrame) に始まるビートの BPM の平均
+double calculateAverageBpmInInterval(const std::vector<BeatData> &beats, int startFrame, int endFrame, int fps = 30);
+
+} // namespace camsynth
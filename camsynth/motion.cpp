@@ -0,0 +1,131 @@
+#include "motion.hpp"
+
+#include <cmath>
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+// 使用するジョイント番号（23 ジョイントの並び）
+const int kHipJoint = 0;
+const int kUpperBody2Joint = 2;
+const int kLeftShoulderJoint = 15;
+const int kRightShoulderJoint = 19;
+
+const array<double, 4> kIdentityQuaternion = {0.0, 0.0, 0.0, 1.0};
+
+// 回転行列 → クォータニオン [x, y, z, w]
+// scipy.spatial.transform.Rotation.from_matrix と同じ分岐（対角成分とトレースの最大で選ぶ）なので符号もそろう
+array<double, 4> matrixToQuaternion(const double m[3][3]) {
+    double decision[4] = {m[0][0], m[1][1], m[2][2], m[0][0] + m[1][1] + m[2][2]};
+    int choice = 0;
+    for (int c = 1; c < 4; c++) {
+        if (decision[c] > decision[choice])
+            choice = c;
+    }
+    array<double, 4> q;
+    if (choice != 3) {
+        int i = choice, j = (i + 1) % 3, k = (j + 1) % 3;
+        q[i] = 1.0 - decision[3] + 2.0 * m[i][i];
+        q[j] = m[j][i] + m[i][j];
+        q[k] = m[k][i] + m[i][k];
+        q[3] = m[k][j] - m[j][k];
+    } else {
+        q[0] = m[2][1] - m[1][2];
+        q[1] = m[0][2] - m[2][0];
+        q[2] = m[1][0] - m[0][1];
+        q[3] = 1.0 + decision[3];
+    }
+    double norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (auto &v : q)
+        v /= norm;
+    return q;
+}
+
+} // namespace
+
+vector<FrameData> deriveStandPositions(const vector<FrameData> &raw) {
+    vector<FrameData> stand(raw.size());
+    for (size_t t = 0; t < raw.size(); t++) {
+        const auto &src = raw[t].positions;
+        auto &dst = stand[t].positions;
+        dst.resize(src.size());
+        if (src.empty())
+            continue;
+        const double rx = src[0][0], ry = src[0][1], rz = src[0][2];
+        // ジョイント方向に連続した 3 要素ずつの引き算なので、そのままベクトル化される
+        for (size_t j = 0; j < src.size(); j++) {
+            dst[j][0] = src[j][0] - rx;
+            dst[j][1] = src[j][1] - ry;
+            dst[j][2] = src[j][2] - rz;
+        }
+    }
+    return stand;
+}
+
+array<double, 4> computeHipOrientationQuaternion(const vector<array<double, 3>> &positions) {
+    if (positions.size() <= (size_t)kRightShoulderJoint)
+        return kIdentityQuaternion;
+    const auto &hip = positions[kHipJoint];
+    const auto &upperBody2 = positions[kUpperBody2Joint];
+    const auto &leftShoulder = positions[kLeftShoulderJoint];
+    const auto &rightShoulder = positions[kRightShoulderJoint];
+
+    // 1) Up ベクトル: hip → upper_body2
+    double u[3] = {upperBody2[0] - hip[0], upperBody2[1] - hip[1], upperBody2[2] - hip[2]};
+    double normUp = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+    if (normUp < 1e-6)
+        return kIdentityQuaternion;
+    for (auto &v : u)
+        v /= normUp;
+
+    // 2) Raw right ベクトル: left_shoulder → right_shoulder
+    double r[3] = {rightShoulder[0] - leftShoulder[0], rightShoulder[1] - leftShoulder[1], rightShoulder[2] - leftShoulder[2]};
+    double normRight0 = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    if (normRight0 < 1e-6)
+        return kIdentityQuaternion;
+
+    // 3) Gram–Schmidt で right を up に直交化
+    double proj = r[0] * u[0] + r[1] * u[1] + r[2] * u[2];
+    for (int d = 0; d < 3; d++)
+        r[d] -= proj * u[d];
+    double normR = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    if (normR < 1e-6)
+        return kIdentityQuaternion;
+    for (auto &v : r)
+        v /= normR;
+
+    // 4) Forward ベクトル = up × right
+    double f[3] = {u[1] * r[2] - u[2] * r[1], u[2] * r[0] - u[0] * r[2], u[0] * r[1] - u[1] * r[0]};
+    double normF = sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    if (normF < 1e-6)
+        return kIdentityQuaternion;
+    for (auto &v : f)
+        v /= normF;
+
+    // 5) 回転行列を列ベクトル [right, up, forward] で構築
+    //    forward = up × right なので行列式は -1（左手系）になるが、hip.py と同じ値になるようそのまま変換する
+    double m[3][3];
+    for (int d = 0; d < 3; d++) {
+        m[d][0] = r[d];
+        m[d][1] = u[d];
+        m[d][2] = f[d];
+    }
+    return matrixToQuaternion(m);
+}
+
+vector<FrameData> deriveHipDirections(const vector<FrameData> &raw) {
+    vector<FrameData> hip(raw.size());
+    for (size_t t = 0; t < raw.size(); t++)
+        hip[t].hipQuaternion = computeHipOrientationQuaternion(raw[t].positions);
+    return hip;
+}
+
+void deriveInputFromRaw(InputData &input) {
+    input.stand = deriveStandPositions(input.raw);
+    input.hip = deriveHipDirections(input.raw);
+}
+
+} // namespace camsynth
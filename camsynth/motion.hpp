@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "types.hpp"
+
+namespace camsynth {
+
+// raw のモーションから検索に使う入力を求める
+// （scripts/my_utils/standardization.py・hip.py と同じ計算を読み込み時にまとめて行う）
+
+// root（ジョイント 0）基準の位置に変換する
+std::vector<FrameData> deriveStandPositions(const std::vector<FrameData> &raw);
+
+// 腰の向きを表すクォータニオン [qx, qy, qz, qw] を求める
+// up = 腰 → 上半身2、right = 左肩 → 右肩（up に直交化）、forward = up × right を列に並べた回転行列から変換する。
+// 退化している場合は単位クォータニオンを返す。
+std::array<double, 4> computeHipOrientationQuaternion(const std::vector<std::array<double, 3>> &positions);
+
+// 全フレームの腰の向きを求める（hip.msgpack と同じく hipQuaternion だけを持つ FrameData 列）
+std::vector<FrameData> deriveHipDirections(const std::vector<FrameData> &raw);
+
+// input.raw から input.stand / input.hip を求める
+void deriveInputFromRaw(InputData &input);
+
+} // namespace camsynth
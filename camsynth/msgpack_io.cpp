@@ -0,0 +1,213 @@
+#include "msgpack_io.hpp"
+
+#include <fstream>
+#include <iostream>
+
+#include "prefetch.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+// msgpack::object_handle readMsgpack(const string &path) {
+//     ifstream ifs(path, ios::binary);
+//     vector<char> buffer((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+//     return msgpack::unpack(buffer.data(), buffer.size());
+// }
+
+msgpack::object_handle readMsgpack(const string &path) {
+    // 1) ファイルを開く
+    ifstream ifs(path, ios::binary);
+    if (!ifs) {
+        cerr << "[readMsgpack] ファイルオープン失敗: " << path << endl;
+        // 必要ならここで例外を投げるか、デフォルトの空オブジェクトを返す
+        throw runtime_error("Cannot open file: " + path);
+    }
+
+    // 2) 全バイトを読み込む
+    vector<char> buffer((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    return unpackMsgpack(buffer, path);
+}
+
+msgpack::object_handle unpackMsgpack(const vector<char> &buffer, const string &path) {
+    size_t bufSize = buffer.size();
+
+    // 3) unpack を試みる
+    try {
+        return msgpack::unpack(buffer.data(), bufSize);
+    }
+    catch (const msgpack::v1::insufficient_bytes &e) {
+        // ここで「ファイル名」と「読み込んだバッファ長」を出力
+        cerr << "[readMsgpack] insufficient_bytes 例外: " << e.what() << "\n"
+             << "  → 対象ファイル: " << path << "\n"
+             << "  → 読み込んだバイト数: " << bufSize << endl;
+        // もしこれ以上処理を止めたくないなら、デフォルトの空オブジェクトを返すなども可能ですが、
+        // 今回はこのまま再スローして呼び出し元でさらにキャッチする例を示します。
+        throw;
+    }
+    catch (const std::exception &e) {
+        // その他の例外をキャッチしたい場合
+        cerr << "[readMsgpack] その他の例外: " << e.what() << "\n"
+             << "  → 対象ファイル: " << path << "\n"
+             << "  → 読み込んだバイト数: " << bufSize << endl;
+        throw;
+    }
+}
+
+const msgpack::object* getMember(const msgpack::object &obj, const string &key) {
+    if(obj.type != msgpack::type::MAP)
+        return nullptr;
+    for (size_t i = 0; i < obj.via.map.size; i++) {
+        const msgpack::object &k = obj.via.map.ptr[i].key;
+        if (k.type == msgpack::type::STR) {
+            string kstr(k.via.str.ptr, k.via.str.size);
+            if (kstr == key)
+                return &obj.via.map.ptr[i].val;
+        }
+    }
+    return nullptr;
+}
+
+// MessagePack を用いた joint_positions の読み込み関数
+vector<FrameData> loadJointPositions(const string &msgpackFilePath) {
+    msgpack::object_handle oh = readMsgpack(msgpackFilePath);
+    return parseJointPositions(oh.get());
+}
+
+vector<FrameData> parseJointPositions(const msgpack::object &obj) {
+    vector<FrameData> frames;
+    for (size_t i = 0; i < obj.via.array.size; i++) {
+        msgpack::object frameObj = obj.via.array.ptr[i];
+        if(frameObj.type != msgpack::type::MAP)
+            continue;
+        FrameData fd;
+
+        // デバック用
+        // const msgpack::object* posObj = getMember(frameObj, "Position");
+        // if (!posObj) {
+        //     cerr << "デバッグ: フレーム " << i << " でキー 'Position' が見つかりませんでした。" << endl;
+        // } else {
+        //     if (posObj->type != msgpack::type::ARRAY) {
+        //         cerr << "デバッグ: フレーム " << i << " の 'Position' は ARRAY ではありません。型コード: " 
+        //              << posObj->type << endl;
+        //     } else {
+        //         cout << "デバッグ: フレーム " << i << " の 'Position' キーが見つかりました。内容: " 
+        //              << *posObj << endl;
+        //     }
+        // }
+
+        // "Position" キーから各ジョイントの位置を取得
+        const msgpack::object* posObj = getMember(frameObj, "Position");
+        if (posObj && posObj->type == msgpack::type::ARRAY) {
+            for (size_t j = 0; j < posObj->via.array.size; j++) {
+                msgpack::object joint = posObj->via.array.ptr[j];
+                if (joint.type == msgpack::type::ARRAY && joint.via.array.size >= 3) {
+                    array<double, 3> p;
+                    p[0] = joint.via.array.ptr[0].as<double>();
+                    p[1] = joint.via.array.ptr[1].as<double>();
+                    p[2] = joint.via.array.ptr[2].as<double>();
+                    fd.positions.push_back(p);
+                }
+            }
+        }
+        // "HipRotationQuaternion" キーからヒップ回転（クォータニオン）を取得
+        const msgpack::object* hipObj = getMember(frameObj, "HipRotationQuaternion");
+        if (hipObj && hipObj->type == msgpack::type::ARRAY && hipObj->via.array.size >= 4) {
+            fd.hipQuaternion[0] = hipObj->via.array.ptr[0].as<double>();
+            fd.hipQuaternion[1] = hipObj->via.array.ptr[1].as<double>();
+            fd.hipQuaternion[2] = hipObj->via.array.ptr[2].as<double>();
+            fd.hipQuaternion[3] = hipObj->via.array.ptr[3].as<double>();
+        }
+        frames.push_back(fd);
+    }
+    return frames;
+}
+
+
+// 指定した msgpack オブジェクトから start ～ end (end は除く) の音楽特徴量シーケンスを抽出する関数
+vector<vector<double>> extractMusicFeatureSegment(const msgpack::object &musicObj, int start, int end) {
+    vector<vector<double>> segment;
+    int total = musicObj.via.array.size;
+    for (int i = start; i < end && i < total; i++) {
+        const msgpack::object &frameObj = musicObj.via.array.ptr[i];
+        // 次元数
+        if (frameObj.type == msgpack::type::ARRAY && frameObj.via.array.size == 1) {
+            vector<double> vec(1);
+            for (int k = 0; k < 1; k++) {
+                vec[k] = frameObj.via.array.ptr[k].as<double>();
+            }
+            segment.push_back(vec);
+        } else {
+            cerr << "Warning: Frame " << i << " is not a valid 1-dim vector." << endl;
+        }
+    }
+    return segment;
+}
+
+vector<BeatData> loadBeatsMsgpack(const string &path) {
+    vector<BeatData> beats;
+    msgpack::object_handle oh = readMsgpack(path);
+    const msgpack::object* beatsMember = getMember(oh.get(), "beats");
+    if (!beatsMember || beatsMember->type != msgpack::type::ARRAY)
+        return beats;
+    for (size_t i = 0; i < beatsMember->via.array.size; i++) {
+        msgpack::object beatObj = beatsMember->via.array.ptr[i];
+        const msgpack::object* startObj = getMember(beatObj, "start");
+        const msgpack::object* bpmObj = getMember(beatObj, "bpm");
+        if (!startObj || !bpmObj)
+            continue;
+        const msgpack::object* positionObj = getMember(beatObj, "position");
+        int position = positionObj ? positionObj->as<int>() : 0;
+        beats.push_back({startObj->as<double>(), bpmObj->as<double>(), position});
+    }
+    return beats;
+}
+
+vector<vector<double>> loadMusicFeaturesMsgpack(const string &path) {
+    msgpack::object_handle oh = readMsgpack(path);
+    msgpack::object obj = oh.get();
+    if (obj.type != msgpack::type::ARRAY) {
+        cerr << "Error: Input music feature file " << path
+             << " does not contain an array." << endl;
+        return {};
+    }
+    return extractMusicFeatureSegment(obj, 0, obj.via.array.size);
+}
+
+void writeJointPositionsMsgpack(const string &path, const vector<FrameData> &frames) {
+    msgpack::sbuffer buf;
+    msgpack::packer<msgpack::sbuffer> pk(&buf);
+    pk.pack_array(frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        pk.pack_map(2);
+        pk.pack(string("Frame"));
+        pk.pack(static_cast<uint64_t>(i));
+        pk.pack(string("Position"));
+        pk.pack_array(frames[i].positions.size());
+        for (const auto &p : frames[i].positions) {
+            pk.pack_array(3);
+            pk.pack(p[0]);
+            pk.pack(p[1]);
+            pk.pack(p[2]);
+        }
+    }
+    writeFileAtomically(path, buf.data(), buf.size());
+}
+
+void writeHipDirectionsMsgpack(const string &path, const vector<FrameData> &frames) {
+    msgpack::sbuffer buf;
+    msgpack::packer<msgpack::sbuffer> pk(&buf);
+    pk.pack_array(frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        pk.pack_map(2);
+        pk.pack(string("Frame"));
+        pk.pack(static_cast<uint64_t>(i));
+        pk.pack(string("HipRotationQuaternion"));
+        pk.pack_array(4);
+        for (double v : frames[i].hipQuaternion)
+            pk.pack(v);
+    }
+    writeFileAtomically(path, buf.data(), buf.size());
+}
+
+} // namespace camsynth
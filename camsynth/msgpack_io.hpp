@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// MessagePack のヘッダ
+#include <msgpack.hpp>
+
+#include "types.hpp"
+
+namespace camsynth {
+
+// MessagePack ファイルを読み込んで unpack する
+msgpack::object_handle readMsgpack(const std::string &path);
+// 読み込み済みのバイト列を unpack する（path はエラー表示用）
+msgpack::object_handle unpackMsgpack(const std::vector<char> &buffer, const std::string &path);
+
+// MAP 型オブジェクトから key に対応する値を探す（見つからなければ nullptr）
+const msgpack::object* getMember(const msgpack::object &obj, const std::string &key);
+
+// MessagePack を用いた joint_positions の読み込み関数
+std::vector<FrameData> loadJointPositions(const std::string &msgpackFilePath);
+// unpack 済みのオブジェクトから joint_positions を取り出す
+std::vector<FrameData> parseJointPositions(const msgpack::object &obj);
+
+// 指定した msgpack オブジェクトから start ～ end (end は除く) の音楽特徴量シーケンスを抽出する関数
+std::vector<std::vector<double>> extractMusicFeatureSegment(const msgpack::object &musicObj, int start, int end);
+
+// beat.msgpack の "beats" を読み込む
+std::vector<BeatData> loadBeatsMsgpack(const std::string &path);
+
+// music.msgpack（フレームごとの特徴量ベクトルの配列）を読み込む
+std::vector<std::vector<double>> loadMusicFeaturesMsgpack(const std::string &path);
+
+// raw.msgpack / stand.msgpack と同じ形式（フレームごとの {"Frame", "Position"}）で書く
+void writeJointPositionsMsgpack(const std::string &path, const std::vector<FrameData> &frames);
+// hip.msgpack と同じ形式（フレームごとの {"Frame", "HipRotationQuaternion"}）で書く
+void writeHipDirectionsMsgpack(const std::string &path, const std::vector<FrameData> &frames);
+
+} // namespace camsynth
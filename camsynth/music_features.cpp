@@ -0,0 +1,445 @@
+#include "music_features.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include "kernels.hpp"
+#include "msgpack_io.hpp"
+#include "prefetch.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+uint32_t readLe(const unsigned char *p, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// 第 1 種変形ベッセル関数 I0（Kaiser 窓用の級数展開）
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-17)
+            break;
+    }
+    return sum;
+}
+
+// Slaney 式のメル尺度（librosa.hz_to_mel / mel_to_hz の htk=False）
+const double kMelLinearStep = 200.0 / 3.0;
+const double kMelMinLogHz = 1000.0;
+const double kMelMinLogMel = kMelMinLogHz / kMelLinearStep;
+const double kMelLogStep = log(6.4) / 27.0;
+
+double hzToMel(double hz) {
+    if (hz >= kMelMinLogHz)
+        return kMelMinLogMel + log(hz / kMelMinLogHz) / kMelLogStep;
+    return hz / kMelLinearStep;
+}
+
+double melToHz(double mel) {
+    if (mel >= kMelMinLogMel)
+        return kMelMinLogHz * exp(kMelLogStep * (mel - kMelMinLogMel));
+    return kMelLinearStep * mel;
+}
+
+} // namespace
+
+WavReader::WavReader(const string &path) : file_(path, ios::binary), path_(path) {
+    if (!file_)
+        throw runtime_error("Cannot open file: " + path);
+    unsigned char header[12];
+    if (!file_.read(reinterpret_cast<char *>(header), 12) || memcmp(header, "RIFF", 4) != 0 ||
+        memcmp(header + 8, "WAVE", 4) != 0)
+        throw runtime_error("Not a RIFF/WAVE file: " + path);
+    int format = 0, blockAlign = 0;
+    bool haveFormat = false;
+    for (;;) {
+        unsigned char chunk[8];
+        if (!file_.read(reinterpret_cast<char *>(chunk), 8))
+            throw runtime_error("WAV file has no data chunk: " + path);
+        uint32_t size = readLe(chunk + 4, 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            vector<unsigned char> fmt(size);
+            if (size < 16 || !file_.read(reinterpret_cast<char *>(fmt.data()), size))
+                throw runtime_error("Broken fmt chunk: " + path);
+            format = readLe(fmt.data(), 2);
+            channels_ = readLe(fmt.data() + 2, 2);
+            sampleRate_ = readLe(fmt.data() + 4, 4);
+            blockAlign = readLe(fmt.data() + 12, 2);
+            bitsPerSample_ = readLe(fmt.data() + 14, 2);
+            // WAVE_FORMAT_EXTENSIBLE はサブフォーマットの GUID の先頭 2 バイトが形式
+            if (format == 0xFFFE && size >= 26)
+                format = readLe(fmt.data() + 24, 2);
+            if (size % 2)
+                file_.ignore(1);
+            haveFormat = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat)
+                throw runtime_error("WAV data chunk before fmt chunk: " + path);
+            uint64_t dataBytes = size;
+            // 長さの分からないまま書かれたファイル（0xFFFFFFFF）はファイルの終わりまでをデータとする
+            if (size == 0xFFFFFFFFu) {
+                streampos here = file_.tellg();
+                file_.seekg(0, ios::end);
+                dataBytes = (uint64_t)(file_.tellg() - here);
+                file_.seekg(here);
+            }
+            frames_ = blockAlign > 0 ? dataBytes / blockAlign : 0;
+            break;
+        } else {
+            file_.ignore(size + (size % 2));
+        }
+    }
+    isFloat_ = (format == 3);
+    bool supported = (format == 1 && (bitsPerSample_ == 8 || bitsPerSample_ == 16 || bitsPerSample_ == 24 ||
+                                      bitsPerSample_ == 32)) ||
+                     (format == 3 && (bitsPerSample_ == 32 || bitsPerSample_ == 64));
+    if (!supported || channels_ <= 0 || sampleRate_ <= 0 || blockAlign != channels_ * bitsPerSample_ / 8)
+        throw runtime_error("Unsupported WAV format (format " + to_string(format) + ", " +
+                            to_string(bitsPerSample_) + " bit): " + path);
+    remaining_ = frames_;
+}
+
+size_t WavReader::readMono(float *out, size_t maxFrames) {
+    size_t n = (size_t)min<uint64_t>(maxFrames, remaining_);
+    int bytes = bitsPerSample_ / 8;
+    size_t blockAlign = (size_t)channels_ * bytes;
+    buffer_.resize(n * blockAlign);
+    file_.read(buffer_.data(), buffer_.size());
+    n = file_.gcount() / blockAlign;
+    remaining_ = file_ ? remaining_ - n : 0;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer_.data());
+    for (size_t i = 0; i < n; i++) {
+        double sum = 0.0;
+        for (int c = 0; c < channels_; c++, p += bytes) {
+            double v;
+            if (isFloat_ && bytes == 4) {
+                float f;
+                memcpy(&f, p, 4);
+                v = f;
+            } else if (isFloat_) {
+                double d;
+                memcpy(&d, p, 8);
+                v = d;
+            } else if (bytes == 1) {
+                v = (p[0] - 128) / 128.0;
+            } else {
+                // 符号付き整数を上位ビットにそろえて符号拡張する
+                int32_t s = (int32_t)(readLe(p, bytes) << (32 - 8 * bytes));
+                v = s / 2147483648.0;
+            }
+            sum += v;
+        }
+        out[i] = (float)(sum / channels_);
+    }
+    return n;
+}
+
+Resampler::Resampler(int inRate, int outRate) {
+    int64_t g = gcd((int64_t)inRate, (int64_t)outRate);
+    up_ = outRate / g;
+    down_ = inRate / g;
+    if (up_ == down_)
+        return;
+    // 通過域は新しいナイキスト周波数の 94%、窓の中に sinc の零点を 32 個ずつ
+    const double rolloff = 0.94, zeros = 32.0, beta = 10.0;
+    double cutoff = rolloff * min(1.0, (double)up_ / down_);
+    double halfWidth = zeros / cutoff;
+    halfTaps_ = (int)ceil(halfWidth);
+    int taps = 2 * halfTaps_;
+    table_.assign((size_t)up_ * taps, 0.0f);
+    double i0Beta = besselI0(beta);
+    for (int64_t p = 0; p < up_; p++) {
+        double frac = (double)p / up_;
+        for (int j = -halfTaps_ + 1; j <= halfTaps_; j++) {
+            double t = frac - j;
+            if (fabs(t) >= halfWidth)
+                continue;
+            double x = cutoff * t;
+            double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double u = t / halfWidth;
+            double w = besselI0(beta * sqrt(max(0.0, 1.0 - u * u))) / i0Beta;
+            table_[p * taps + (j + halfTaps_ - 1)] = (float)(cutoff * sinc * w);
+        }
+    }
+    // 先頭より前は 0
+    buffer_.assign(halfTaps_, 0.0f);
+    bufferStart_ = -halfTaps_;
+}
+
+void Resampler::push(const float *in, size_t n, vector<float> &out) {
+    if (up_ == down_) {
+        out.insert(out.end(), in, in + n);
+        return;
+    }
+    buffer_.insert(buffer_.end(), in, in + n);
+    consumed_ += n;
+    produce(out, consumed_);
+}
+
+void Resampler::finish(vector<float> &out) {
+    if (up_ == down_)
+        return;
+    // 末尾の後ろも 0 として、出力の長さ ceil(consumed * up / down) までを出す
+    buffer_.insert(buffer_.end(), halfTaps_ + 1, 0.0f);
+    int64_t total = (consumed_ * up_ + down_ - 1) / down_;
+    int taps = 2 * halfTaps_;
+    for (; next_ < total; next_++) {
+        int64_t pos = next_ * down_;
+        int64_t base = pos / up_ - halfTaps_ + 1 - bufferStart_;
+        const float *x = buffer_.data() + base;
+        const float *h = table_.data() + (pos % up_) * taps;
+        float acc = 0.0f;
+        for (int j = 0; j < taps; j++)
+            acc += x[j] * h[j];
+        out.push_back(acc);
+    }
+}
+
+void Resampler::produce(vector<float> &out, int64_t available) {
+    int taps = 2 * halfTaps_;
+    for (;; next_++) {
+        int64_t pos = next_ * down_;
+        int64_t center = pos / up_;
+        if (center + halfTaps_ >= available)
+            break;
+        const float *x = buffer_.data() + (center - halfTaps_ + 1 - bufferStart_);
+        const float *h = table_.data() + (pos % up_) * taps;
+        float acc = 0.0f;
+        for (int j = 0; j < taps; j++)
+            acc += x[j] * h[j];
+        out.push_back(acc);
+    }
+    // 次の出力より前にしか使わないサンプルを捨てる（ある程度たまってからまとめて）
+    int64_t keepFrom = (next_ * down_) / up_ - halfTaps_ + 1;
+    size_t drop = (size_t)max<int64_t>(0, keepFrom - bufferStart_);
+    if (drop > (1u << 16) && drop * 2 > buffer_.size()) {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + drop);
+        bufferStart_ += drop;
+    }
+}
+
+MelSpectrogramStream::MelSpectrogramStream() {
+    // scipy.signal.get_window("hann", n_fft)（周期版）
+    window_.resize(kFftSize);
+    for (int i = 0; i < kFftSize; i++)
+        window_[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / kFftSize);
+
+    // librosa.filters.mel(sr, n_fft, n_mels=128, fmin=0, fmax=sr/2, htk=False, norm="slaney")
+    int bins = kFftSize / 2 + 1;
+    vector<double> melF(kMels + 2);
+    double maxMel = hzToMel(kOnsetSampleRate / 2.0);
+    for (int i = 0; i < kMels + 2; i++)
+        melF[i] = melToHz(maxMel * i / (kMels + 1));
+    melBasis_.assign((size_t)kMels * bins, 0.0f);
+    bandBegin_.assign(kMels, bins);
+    bandEnd_.assign(kMels, 0);
+    for (int m = 0; m < kMels; m++) {
+        double lowerWidth = melF[m + 1] - melF[m];
+        double upperWidth = melF[m + 2] - melF[m + 1];
+        double enorm = 2.0 / (melF[m + 2] - melF[m]);
+        for (int k = 0; k < bins; k++) {
+            double f = (double)k * kOnsetSampleRate / kFftSize;
+            double lower = (f - melF[m]) / lowerWidth;
+            double upper = (melF[m + 2] - f) / upperWidth;
+            float w = (float)(max(0.0, min(lower, upper)) * enorm);
+            melBasis_[(size_t)m * bins + k] = w;
+            if (w != 0.0f) {
+                bandBegin_[m] = min(bandBegin_[m], k);
+                bandEnd_[m] = k + 1;
+            }
+        }
+    }
+    fftBuffer_.resize(kFftSize);
+    power_.resize(bins);
+
+    // center=True: 先頭に n_fft / 2 の 0 を置く
+    pending_.assign(kFftSize / 2, 0.0f);
+}
+
+void MelSpectrogramStream::push(const float *samples, size_t n) {
+    pending_.insert(pending_.end(), samples, samples + n);
+    samples_ += n;
+    size_t pos = 0;
+    for (; pos + kFftSize <= pending_.size(); pos += kOnsetHopLength)
+        computeFrame(pending_.data() + pos);
+    pending_.erase(pending_.begin(), pending_.begin() + pos);
+}
+
+void MelSpectrogramStream::finish() {
+    // 末尾にも n_fft / 2 の 0 を置き、1 + サンプル数 / hop フレームになるまで求める
+    size_t total = 1 + samples_ / kOnsetHopLength;
+    pending_.insert(pending_.end(), kFftSize / 2, 0.0f);
+    size_t pos = 0;
+    while (numFrames() < total) {
+        if (pos + kFftSize > pending_.size())
+            pending_.resize(pos + kFftSize, 0.0f);
+        computeFrame(pending_.data() + pos);
+        pos += kOnsetHopLength;
+    }
+    pending_.clear();
+}
+
+void MelSpectrogramStream::computeFrame(const float *x) {
+    int bins = kFftSize / 2 + 1;
+    for (int i = 0; i < kFftSize; i++)
+        fftBuffer_[i] = x[i] * window_[i];
+    fft(fftBuffer_, false);
+    for (int k = 0; k < bins; k++)
+        power_[k] = norm(fftBuffer_[k]);
+    // 各バンドの三角フィルタが 0 でない範囲だけを足す
+    for (int m = 0; m < kMels; m++) {
+        const float *w = melBasis_.data() + (size_t)m * bins;
+        double sum = 0.0;
+        for (int k = bandBegin_[m]; k < bandEnd_[m]; k++)
+            sum += w[k] * power_[k];
+        frames_.push_back((float)sum);
+    }
+}
+
+vector<double> onsetStrengthEnvelope(const MelSpectrogramStream &mel) {
+    const int mels = MelSpectrogramStream::kMels;
+    size_t numFrames = mel.numFrames();
+    // power_to_db(S, ref=1.0, amin=1e-10, top_db=80.0)
+    vector<double> db(mel.frames().size());
+    double maxDb = -numeric_limits<double>::infinity();
+    for (size_t i = 0; i < db.size(); i++) {
+        db[i] = 10.0 * log10(max(1e-10, (double)mel.frames()[i]));
+        maxDb = max(maxDb, db[i]);
+    }
+    for (double &v : db)
+        v = max(v, maxDb - 80.0);
+
+    // 1 つ前のフレームからの増分の平均。center=True なので lag 1 + n_fft / (2 * hop) = 3 フレームずらす
+    const size_t shift = 1 + MelSpectrogramStream::kFftSize / (2 * kOnsetHopLength);
+    vector<double> envelope(numFrames, 0.0);
+    for (size_t t = shift; t < numFrames; t++) {
+        const double *cur = db.data() + (t - shift + 1) * mels;
+        const double *prev = db.data() + (t - shift) * mels;
+        double sum = 0.0;
+        for (int m = 0; m < mels; m++)
+            sum += max(0.0, cur[m] - prev[m]);
+        envelope[t] = sum / mels;
+    }
+    return envelope;
+}
+
+vector<int> detectOnsets(const vector<double> &envelope, int sampleRate, int hopLength) {
+    vector<int> onsets;
+    size_t n = envelope.size();
+    if (n == 0)
+        return onsets;
+    // 0 ～ 1 に正規化する
+    double minV = *min_element(envelope.begin(), envelope.end());
+    vector<double> x(n);
+    for (size_t i = 0; i < n; i++)
+        x[i] = envelope[i] - minV;
+    double maxV = *max_element(x.begin(), x.end());
+    if (maxV <= 0.0)
+        return onsets;
+    for (double &v : x)
+        v /= maxV + numeric_limits<float>::min();
+
+    // librosa の既定（秒で決めた長さを hop 単位に切り捨てる）
+    int preMax = (int)floor(0.03 * sampleRate / hopLength);
+    int postMax = (int)floor(0.00 * sampleRate / hopLength) + 1;
+    int preAvg = (int)floor(0.10 * sampleRate / hopLength);
+    int postAvg = (int)floor(0.10 * sampleRate / hopLength) + 1;
+    int wait = (int)floor(0.03 * sampleRate / hopLength);
+    const double delta = 0.07;
+
+    // x[i] が x[i - preMax : i + postMax] の最大で、x[i - preAvg : i + postAvg] の平均 + delta 以上ならピーク
+    vector<double> prefix(n + 1, 0.0);
+    for (size_t i = 0; i < n; i++)
+        prefix[i + 1] = prefix[i] + x[i];
+    long lastOnset = numeric_limits<long>::min() / 2;
+    for (size_t i = 0; i < n; i++) {
+        if (x[i] == 0.0)
+            continue;
+        size_t maxBegin = i >= (size_t)preMax ? i - preMax : 0;
+        size_t maxEnd = min(n, i + postMax);
+        if (*max_element(x.begin() + maxBegin, x.begin() + maxEnd) != x[i])
+            continue;
+        size_t avgBegin = i >= (size_t)preAvg ? i - preAvg : 0;
+        size_t avgEnd = min(n, i + postAvg);
+        double avg = (prefix[avgEnd] - prefix[avgBegin]) / (avgEnd - avgBegin);
+        if (x[i] < avg + delta)
+            continue;
+        if ((long)i > lastOnset + wait) {
+            onsets.push_back(i);
+            lastOnset = i;
+        }
+    }
+    return onsets;
+}
+
+vector<double> onsetDensity(const vector<int> &onsets, size_t numFrames, int window) {
+    window = max(window, 1);
+    vector<int> count(numFrames + 1, 0);
+    for (int f : onsets) {
+        if (f >= 0 && (size_t)f < numFrames)
+            count[f + 1] = 1;
+    }
+    partial_sum(count.begin(), count.end(), count.begin());
+    // np.convolve(x, ones(window), mode="same") は x[i - window / 2 : i + window - window / 2] の和
+    int left = window / 2, right = window - left;
+    vector<double> density(numFrames);
+    for (size_t i = 0; i < numFrames; i++) {
+        size_t begin = i >= (size_t)left ? i - left : 0;
+        size_t end = min(numFrames, i + right);
+        density[i] = count[end] - count[begin];
+    }
+    return density;
+}
+
+vector<double> extractOnsetDensity(const string &wavPath, size_t maxFrames) {
+    WavReader reader(wavPath);
+    Resampler resampler(reader.sampleRate(), kOnsetSampleRate);
+    MelSpectrogramStream mel;
+    const size_t chunk = 1 << 16;
+    vector<float> in(chunk), resampled;
+    for (;;) {
+        size_t n = reader.readMono(in.data(), chunk);
+        if (n == 0)
+            break;
+        resampled.clear();
+        resampler.push(in.data(), n, resampled);
+        mel.push(resampled.data(), resampled.size());
+    }
+    resampled.clear();
+    resampler.finish(resampled);
+    mel.push(resampled.data(), resampled.size());
+    mel.finish();
+
+    vector<double> envelope = onsetStrengthEnvelope(mel);
+    vector<double> density = onsetDensity(detectOnsets(envelope), envelope.size());
+    if (maxFrames > 0 && density.size() > maxFrames)
+        density.resize(maxFrames);
+    return density;
+}
+
+void writeMusicFeaturesMsgpack(const string &path, const vector<double> &feature) {
+    msgpack::sbuffer buf;
+    msgpack::packer<msgpack::sbuffer> pk(&buf);
+    pk.pack_array(feature.size());
+    for (double v : feature) {
+        pk.pack_array(1);
+        pk.pack(v);
+    }
+    writeFileAtomically(path, buf.data(), buf.size());
+}
+
+} // namespace camsynth
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace camsynth {
+
+// 楽曲のオンセット密度（scripts/my_utils/music.py と同じ特徴量）
+// 音声を 30 fps × hop 512 のサンプリングレート (15360 Hz) に変換し、librosa の既定と同じ手順
+// （STFT 2048 点・Hann 窓・center padding → メルスペクトログラム 128 バンド (Slaney) → dB →
+//   フレーム間の増分の平均 = オンセット強度 → 正規化してピーク検出）で求めたオンセットを、
+// 前後 1 秒 (30 フレーム) の窓で数えたものを music.msgpack の 1 次元特徴量とする。
+// WAV は少しずつ読みながら変換・STFT まで進めるので、音声全体をメモリに載せない
+// （保持するのはフレームごとのメルスペクトル 128 値だけ）。
+
+const int kMusicFps = 30;
+const int kOnsetHopLength = 512;
+const int kOnsetSampleRate = kMusicFps * kOnsetHopLength;
+
+// PCM (8 / 16 / 24 / 32 bit 整数、32 / 64 bit 浮動小数) の WAV を少しずつ読む
+// 読めない形式のときは例外
+class WavReader {
+public:
+    explicit WavReader(const std::string &path);
+
+    int sampleRate() const { return sampleRate_; }
+    int channels() const { return channels_; }
+    std::uint64_t frames() const { return frames_; }
+
+    // 最大 maxFrames フレームをチャンネルの平均（モノラル、[-1, 1]）で out に書き、読んだフレーム数を返す
+    size_t readMono(float *out, size_t maxFrames);
+
+private:
+    std::ifstream file_;
+    std::string path_;
+    int sampleRate_ = 0;
+    int channels_ = 0;
+    int bitsPerSample_ = 0;
+    bool isFloat_ = false;
+    std::uint64_t frames_ = 0;
+    std::uint64_t remaining_ = 0;
+    std::vector<char> buffer_;
+};
+
+// 有理数比のサンプリングレート変換（Kaiser 窓付き sinc のポリフェーズフィルタ）
+// 入力を少しずつ渡し、出来上がった分から出力する。出力の長さは ceil(入力の長さ × outRate / inRate)。
+class Resampler {
+public:
+    Resampler(int inRate, int outRate);
+
+    void push(const float *in, size_t n, std::vector<float> &out);
+    // 残りを出力する（入力の後ろは 0 とみなす）
+    void finish(std::vector<float> &out);
+
+private:
+    void produce(std::vector<float> &out, std::int64_t available);
+
+    std::int64_t up_ = 1, down_ = 1;  // 出力 k の位置は入力の k * down_ / up_
+    int halfTaps_ = 0;
+    std::vector<float> table_;         // 位相ごとの係数 (up_ × 2 * halfTaps_)
+    std::vector<float> buffer_;        // 入力（buffer_[0] が入力の bufferStart_ 番目）
+    std::int64_t bufferStart_ = 0;
+    std::int64_t consumed_ = 0;        // 受け取った入力のサンプル数
+    std::int64_t next_ = 0;            // 次に出力する番号
+};
+
+// 15360 Hz のモノラル音声からメルスペクトログラム（power、フレーム × 128）を順に求める
+class MelSpectrogramStream {
+public:
+    MelSpectrogramStream();
+
+    void push(const float *samples, size_t n);
+    // 末尾の padding 分を処理する。フレーム数は 1 + サンプル数 / 512
+    void finish();
+
+    size_t numFrames() const { return frames_.size() / kMels; }
+    const std::vector<float> &frames() const { return frames_; }
+
+    static const int kFftSize = 2048;
+    static const int kMels = 128;
+
+private:
+    void computeFrame(const float *window);
+
+    std::vector<float> pending_;       // まだフレームにしていないサンプル（先頭は次のフレームの先頭）
+    std::vector<double> window_;       // Hann 窓（周期版）
+    std::vector<float> melBasis_;      // kMels × (kFftSize / 2 + 1)
+    std::vector<int> bandBegin_, bandEnd_; // バンドごとの 0 でない係数の範囲
+    std::vector<std::complex<double>> fftBuffer_;
+    std::vector<double> power_;
+    std::vector<float> frames_;
+    std::uint64_t samples_ = 0;
+};
+
+// メルスペクトログラムからオンセット強度（librosa.onset.onset_strength と同じ、lag 1・center あり）を求める
+std::vector<double> onsetStrengthEnvelope(const MelSpectrogramStream &mel);
+
+// オンセット強度を 0 ～ 1 に正規化してピークを検出し、オンセットのフレーム番号を返す
+// （librosa.onset.onset_detect の既定のパラメータ）
+std::vector<int> detectOnsets(const std::vector<double> &envelope, int sampleRate = kOnsetSampleRate,
+                              int hopLength = kOnsetHopLength);
+
+// 各フレームの前後 window フレーム（np.convolve(..., mode="same") と同じ位置）にあるオンセットの数
+std::vector<double> onsetDensity(const std::vector<int> &onsets, size_t numFrames, int window = kMusicFps);
+
+// WAV ファイルからフレームごとのオンセット密度を求める（maxFrames > 0 なら先頭からその長さまで）
+std::vector<double> extractOnsetDensity(const std::string &wavPath, size_t maxFrames = 0);
+
+// music.msgpack（フレームごとの [密度] の配列）を書く
+void writeMusicFeaturesMsgpack(const std::string &path, const std::vector<double> &feature);
+
+} // namespace camsynth
@@ -0,0 +1,99 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace camsynth {
+
+vector<int> parseCpuList(const string &list) {
+    vector<int> cpus;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty() || item == "\n")
+            continue;
+        size_t dash = item.find('-');
+        try {
+            if (dash == string::npos) {
+                cpus.push_back(stoi(item));
+            } else {
+                int first = stoi(item.substr(0, dash));
+                int last = stoi(item.substr(dash + 1));
+                for (int c = first; c <= last; c++)
+                    cpus.push_back(c);
+            }
+        }
+        catch (const std::exception &) {
+            // 読めない項目は飛ばす
+        }
+    }
+    return cpus;
+}
+
+vector<NumaNode> detectNumaNodes() {
+    vector<NumaNode> nodes;
+    error_code ec;
+    const fs::path root = "/sys/devices/system/node";
+    for (const auto &entry : fs::directory_iterator(root, ec)) {
+        string name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+            !all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            continue;
+        ifstream ifs(entry.path() / "cpulist");
+        string list;
+        if (!ifs || !getline(ifs, list))
+            continue;
+        NumaNode node;
+        node.id = stoi(name.substr(4));
+        node.cpus = parseCpuList(list);
+        // CPU のないノード（メモリだけのノード）にはワーカーを置かない
+        if (!node.cpus.empty())
+            nodes.push_back(move(node));
+    }
+    sort(nodes.begin(), nodes.end(), [](const NumaNode &a, const NumaNode &b) { return a.id < b.id; });
+    if (nodes.empty()) {
+        NumaNode node;
+        unsigned n = max(thread::hardware_concurrency(), 1u);
+        for (unsigned c = 0; c < n; c++)
+            node.cpus.push_back(c);
+        nodes.push_back(move(node));
+    }
+    return nodes;
+}
+
+bool bindToNumaNode(const NumaNode &node) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : node.cpus) {
+        if (c >= 0 && c < CPU_SETSIZE)
+            CPU_SET(c, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return false;
+    // メモリはそのノードを優先する（足りなければ他のノードから取る）。失敗しても CPU の固定だけで
+    // ファーストタッチによりほぼ同じノードに載る
+    vector<unsigned long> mask(node.id / (8 * sizeof(unsigned long)) + 1, 0);
+    mask[node.id / (8 * sizeof(unsigned long))] |= 1ul << (node.id % (8 * sizeof(unsigned long)));
+    syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1);
+    return true;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+} // namespace camsynth
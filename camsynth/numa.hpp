@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace camsynth {
+
+// NUMA ノード 1 つ分（ノード番号とそのノードの CPU）
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// sysfs (/sys/devices/system/node) から NUMA ノードと CPU を調べる
+// NUMA でない・調べられないときは全 CPU を持つノード 0 だけを返す
+std::vector<NumaNode> detectNumaNodes();
+
+// 呼び出したスレッドを node の CPU に固定し、以降のメモリ確保をなるべくそのノードから行う
+// （fork した直後、スレッドを作る前に呼ぶと、後から作るスレッドも同じ設定を引き継ぐ）
+// 固定できなければ false
+bool bindToNumaNode(const NumaNode &node);
+
+// "0-3,8,10-11" の形の CPU リストを展開する
+std::vector<int> parseCpuList(const std::string &list);
+
+} // namespace camsynth
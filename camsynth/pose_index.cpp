@@ -0,0 +1,141 @@
+#include "pose_index.hpp"
+
+#include <algorithm>
+
+#include "database.hpp"
+#include "kernels.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+// root 基準の座標を numJoints × 3 の連続領域に並べる（足りないジョイントは 0）
+void flattenRootRelative(const FrameData &frame, int numJoints, double *out) {
+    fill(out, out + numJoints * 3, 0.0);
+    const auto &p = frame.positions;
+    if (p.empty())
+        return;
+    int n = min((int)p.size(), numJoints);
+    for (int j = 0; j < n; j++) {
+        for (int d = 0; d < 3; d++)
+            out[j * 3 + d] = p[j][d] - p[0][d];
+    }
+}
+
+} // namespace
+
+PoseIndex::PoseIndex(const Database &db, int pcaComponents) {
+    for (const auto &kv : db.clips) {
+        for (const auto &f : kv.second.raw) {
+            if (!f.positions.empty()) {
+                numJoints_ = f.positions.size();
+                break;
+            }
+        }
+        if (numJoints_ > 0)
+            break;
+    }
+    int rawDims = numJoints_ * 3;
+    vector<double> x(rawDims);
+
+    // PCA: データベースの全フレームの共分散行列の上位 pcaComponents 本の固有ベクトルに射影する
+    if (pcaComponents > 0 && pcaComponents < rawDims) {
+        mean_.assign(rawDims, 0.0);
+        vector<double> cov(rawDims * rawDims, 0.0);
+        size_t count = 0;
+        for (const auto &kv : db.clips) {
+            const MotionClip &clip = kv.second;
+            for (int t = 0; t < clip.frames(); t++) {
+                if (!clip.covers(t, t + 1))
+                    continue;
+                flattenRootRelative(clip.raw[t], numJoints_, x.data());
+                for (int a = 0; a < rawDims; a++) {
+                    mean_[a] += x[a];
+                    for (int b = a; b < rawDims; b++)
+                        cov[a * rawDims + b] += x[a] * x[b];
+                }
+                count++;
+            }
+        }
+        if (count > 0) {
+            for (auto &m : mean_)
+                m /= count;
+            for (int a = 0; a < rawDims; a++) {
+                for (int b = a; b < rawDims; b++) {
+                    double c = cov[a * rawDims + b] / count - mean_[a] * mean_[b];
+                    cov[a * rawDims + b] = c;
+                    cov[b * rawDims + a] = c;
+                }
+            }
+            vector<double> eigenvalues, eigenvectors;
+            symmetricEigen(cov, rawDims, eigenvalues, eigenvectors);
+            pcaComponents_ = pcaComponents;
+            basis_.assign(eigenvectors.begin(), eigenvectors.begin() + pcaComponents * rawDims);
+            double total = 0.0, kept = 0.0;
+            for (int i = 0; i < rawDims; i++) {
+                total += max(eigenvalues[i], 0.0);
+                if (i < pcaComponents)
+                    kept += max(eigenvalues[i], 0.0);
+            }
+            explainedVariance_ = (total > 0.0) ? kept / total : 1.0;
+        }
+    }
+    dims_ = (pcaComponents_ > 0) ? pcaComponents_ : rawDims;
+
+    for (const auto &kv : db.clips) {
+        const MotionClip &clip = kv.second;
+        ClipFeatures &cf = clips_[kv.first];
+        cf.frames = clip.frames();
+        cf.features.assign((size_t)cf.frames * dims_, 0.0);
+        cf.norms.assign(cf.frames, 0.0);
+        for (int t = 0; t < cf.frames; t++) {
+            flattenRootRelative(clip.raw[t], numJoints_, x.data());
+            double *row = cf.features.data() + (size_t)t * dims_;
+            projectRow(x.data(), row);
+            double norm = 0.0;
+            for (int d = 0; d < dims_; d++)
+                norm += row[d] * row[d];
+            cf.norms[t] = norm;
+        }
+    }
+}
+
+void PoseIndex::projectRow(const double *x, double *out) const {
+    int rawDims = numJoints_ * 3;
+    if (pcaComponents_ == 0) {
+        copy(x, x + rawDims, out);
+        return;
+    }
+    for (int c = 0; c < pcaComponents_; c++) {
+        const double *b = basis_.data() + (size_t)c * rawDims;
+        double s = 0.0;
+        for (int a = 0; a < rawDims; a++)
+            s += (x[a] - mean_[a]) * b[a];
+        out[c] = s;
+    }
+}
+
+vector<double> PoseIndex::project(const vector<FrameData> &stand) const {
+    int rawDims = numJoints_ * 3;
+    vector<double> x(rawDims);
+    vector<double> out(stand.size() * dims_, 0.0);
+    for (size_t t = 0; t < stand.size(); t++) {
+        // 入力はすでに root 基準なので、そのまま並べる
+        fill(x.begin(), x.end(), 0.0);
+        int n = min((int)stand[t].positions.size(), numJoints_);
+        for (int j = 0; j < n; j++)
+            for (int d = 0; d < 3; d++)
+                x[j * 3 + d] = stand[t].positions[j][d];
+        projectRow(x.data(), out.data() + t * dims_);
+    }
+    return out;
+}
+
+const PoseIndex::ClipFeatures *PoseIndex::clip(const string &fileNumber) const {
+    auto it = clips_.find(fileNumber);
+    return (it == clips_.end()) ? nullptr : &it->second;
+}
+
+} // namespace camsynth
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+
+namespace camsynth {
+
+class Database;
+
+// 二乗 L2 距離用の姿勢特徴量
+// 各フレームの root 基準の全ジョイント座標を 1 行に並べ、クリップごとに (フレーム数 × dims) の行列で持つ。
+// pcaComponents > 0 のときはデータベース全フレームの主成分に射影して dims = pcaComponents にする。
+// フレームごとのノルム ‖c_t‖² も前もって求めておき、
+//   Σ_t ‖q_t - c_t‖² = Σ_t ‖q_t‖² + Σ_t ‖c_t‖² - 2 Σ_t q_t·c_t
+// の第 3 項だけを行列積 (gemmBlockedNT) で計算する。
+class PoseIndex {
+public:
+    struct ClipFeatures {
+        int frames = 0;
+        std::vector<double> features; // frames × dims（行優先）
+        std::vector<double> norms;    // 各フレームの ‖c_t‖²
+    };
+
+    PoseIndex(const Database &db, int pcaComponents);
+
+    int dims() const { return dims_; }
+    int pcaComponents() const { return pcaComponents_; }
+    // PCA で残した分散の割合（PCA なしなら 1）
+    double explainedVariance() const { return explainedVariance_; }
+
+    // root 基準の姿勢列を特徴量に変換する（frames × dims の行優先）
+    std::vector<double> project(const std::vector<FrameData> &stand) const;
+
+    // クリップ番号から特徴量を引く（見つからなければ nullptr）
+    const ClipFeatures *clip(const std::string &fileNumber) const;
+
+private:
+    // root 基準の座標 (numJoints × 3) を特徴量 1 行に変換する
+    void projectRow(const double *x, double *out) const;
+
+    int numJoints_ = 0;
+    int dims_ = 0;
+    int pcaComponents_ = 0;
+    double explainedVariance_ = 1.0;
+    std::vector<double> mean_;  // PCA の平均（numJoints × 3）
+    std::vector<double> basis_; // PCA の主成分（dims × numJoints × 3, 行ごとに 1 本）
+    std::unordered_map<std::string, ClipFeatures> clips_;
+};
+
+} // namespace camsynth
@@ -0,0 +1,266 @@
+#include "prefetch.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef CAMSYNTH_WITH_IO_URING
+#include <liburing.h>
+#endif
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+// 開いて大きさを調べる（失敗したら -1）
+int openForRead(const string &path, size_t &size, string &error) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Cannot open file: " + path;
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        error = "Cannot stat file: " + path;
+        return -1;
+    }
+    size = st.st_size;
+    return fd;
+}
+
+} // namespace
+
+bool readWholeFile(const string &path, vector<char> &data, string &error) {
+    size_t size = 0;
+    int fd = openForRead(path, size, error);
+    if (fd < 0)
+        return false;
+    data.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, data.data() + done, size - done);
+        if (n < 0) {
+            close(fd);
+            error = "Cannot read file: " + path;
+            return false;
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    data.resize(done);
+    return true;
+}
+
+void writeFileAtomically(const string &path, const char *data, size_t size) {
+    // 一時ファイルは同じディレクトリに mkstemp で作る（同じ path に書くプロセスが複数あっても衝突しない）
+    string tmpl = path + ".XXXXXX";
+    vector<char> tmpPath(tmpl.begin(), tmpl.end());
+    tmpPath.push_back('\0');
+    int fd = mkstemp(tmpPath.data());
+    if (fd < 0)
+        throw runtime_error("Cannot open file: " + tmpl);
+    auto fail = [&](const string &target) {
+        close(fd);
+        unlink(tmpPath.data());
+        throw runtime_error("Cannot write file: " + target);
+    };
+    // mkstemp は 0600 で作るので、これまでの open(..., 0644) と同じ権限にする
+    if (fchmod(fd, 0644) != 0)
+        fail(tmpPath.data());
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n <= 0)
+            fail(tmpPath.data());
+        done += n;
+    }
+    if (fsync(fd) != 0)
+        fail(tmpPath.data());
+    if (close(fd) != 0) {
+        unlink(tmpPath.data());
+        throw runtime_error("Cannot write file: " + string(tmpPath.data()));
+    }
+    if (rename(tmpPath.data(), path.c_str()) != 0) {
+        unlink(tmpPath.data());
+        throw runtime_error("Cannot write file: " + path);
+    }
+}
+
+#ifdef CAMSYNTH_WITH_IO_URING
+struct PrefetchReader::Uring {
+    io_uring ring;
+};
+#else
+struct PrefetchReader::Uring {};
+#endif
+
+PrefetchReader::PrefetchReader(vector<string> paths, int threads, int depth)
+    : paths_(move(paths)), slots_(paths_.size()), depth_(max(depth, 0)) {
+    if (depth_ == 0 || threads <= 0 || paths_.empty())
+        return;
+#ifdef CAMSYNTH_WITH_IO_URING
+    // リングを作れなければスレッド版にする
+    auto uring = make_unique<Uring>();
+    if (io_uring_queue_init(depth_, &uring->ring, 0) == 0) {
+        uring_ = move(uring);
+        workers_.emplace_back(&PrefetchReader::uringLoop, this);
+        return;
+    }
+#endif
+    for (int t = 0; t < threads; t++)
+        workers_.emplace_back(&PrefetchReader::readerLoop, this);
+}
+
+PrefetchReader::~PrefetchReader() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    readable_.notify_all();
+    for (auto &w : workers_)
+        w.join();
+#ifdef CAMSYNTH_WITH_IO_URING
+    if (uring_)
+        io_uring_queue_exit(&uring_->ring);
+#endif
+}
+
+const char *PrefetchReader::backend() const {
+    if (uring_)
+        return "io_uring";
+    return workers_.empty() ? "sync" : "threads";
+}
+
+bool PrefetchReader::take(size_t i, vector<char> &data, string &error) {
+    if (workers_.empty()) {
+        consumed_ = i + 1;
+        return readWholeFile(paths_[i], data, error);
+    }
+    unique_lock<mutex> lock(mutex_);
+    ready_.wait(lock, [&] { return slots_[i].ready; });
+    Slot &slot = slots_[i];
+    bool ok = slot.ok;
+    data = move(slot.data);
+    error = move(slot.error);
+    slot.data = vector<char>();
+    consumed_ = max(consumed_, i + 1);
+    lock.unlock();
+    readable_.notify_all();
+    return ok;
+}
+
+bool PrefetchReader::nextIndex(size_t &index, bool wait) {
+    unique_lock<mutex> lock(mutex_);
+    auto available = [&] { return stop_ || next_ >= paths_.size() || next_ < consumed_ + depth_; };
+    if (wait)
+        readable_.wait(lock, available);
+    else if (!available())
+        return false;
+    if (stop_ || next_ >= paths_.size())
+        return false;
+    index = next_++;
+    return true;
+}
+
+void PrefetchReader::complete(size_t index, bool ok, vector<char> data, string error) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        Slot &slot = slots_[index];
+        slot.ready = true;
+        slot.ok = ok;
+        slot.data = move(data);
+        slot.error = move(error);
+    }
+    ready_.notify_all();
+}
+
+void PrefetchReader::readerLoop() {
+    size_t index;
+    while (nextIndex(index, true)) {
+        vector<char> data;
+        string error;
+        bool ok = readWholeFile(paths_[index], data, error);
+        complete(index, ok, move(data), move(error));
+    }
+}
+
+void PrefetchReader::uringLoop() {
+#ifdef CAMSYNTH_WITH_IO_URING
+    struct Pending {
+        int fd;
+        vector<char> data;
+        size_t done;
+    };
+    io_uring &ring = uring_->ring;
+    map<size_t, Pending> inflight;
+    auto submitRead = [&](size_t index, Pending &p) {
+        io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_read(sqe, p.fd, p.data.data() + p.done, p.data.size() - p.done, p.done);
+        io_uring_sqe_set_data64(sqe, index);
+    };
+    for (;;) {
+        // 先読み数に空きがある分だけ読み始める（読み込み中のものがなければ空きができるまで待つ）
+        size_t index;
+        bool added = false;
+        while (nextIndex(index, inflight.empty())) {
+            Pending p{-1, {}, 0};
+            size_t size = 0;
+            string error;
+            p.fd = openForRead(paths_[index], size, error);
+            if (p.fd < 0) {
+                complete(index, false, {}, move(error));
+                continue;
+            }
+            if (size == 0) {
+                close(p.fd);
+                complete(index, true, {}, "");
+                continue;
+            }
+            p.data.resize(size);
+            submitRead(index, inflight.emplace(index, move(p)).first->second);
+            added = true;
+        }
+        if (inflight.empty())
+            break;
+        if (added)
+            io_uring_submit(&ring);
+
+        io_uring_cqe *cqe;
+        if (io_uring_wait_cqe(&ring, &cqe) < 0)
+            continue;
+        size_t done = io_uring_cqe_get_data64(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        Pending &p = inflight.at(done);
+        if (res > 0) {
+            p.done += res;
+            // 途中までしか読めなかったら残りを読み直す
+            if (p.done < p.data.size()) {
+                submitRead(done, p);
+                io_uring_submit(&ring);
+                continue;
+            }
+        }
+        close(p.fd);
+        if (res < 0) {
+            complete(done, false, {}, "Cannot read file: " + paths_[done]);
+        } else {
+            p.data.resize(p.done);
+            complete(done, true, move(p.data), "");
+        }
+        inflight.erase(done);
+    }
+#endif
+}
+
+} // namespace camsynth
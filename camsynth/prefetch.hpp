@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace camsynth {
+
+// ファイルの先読み
+// paths の順に取り出す前提で、まだ取り出していないファイルを最大 depth 個まで裏で読んでおく。
+// 取り出した側で unpack・デコードをしている間に次のファイルが読まれるので、
+// キャッシュに載っていないデータやネットワーク越しのストレージでも CPU が I/O 待ちで止まりにくい。
+// 読み込みは io_uring（CAMSYNTH_WITH_IO_URING を定義して liburing とリンクしたとき）で行い、
+// 使えなければ threads 本の読み込みスレッドで行う。depth = 0 か threads = 0 なら先読みせず take の中で読む。
+class PrefetchReader {
+public:
+    PrefetchReader(std::vector<std::string> paths, int threads, int depth);
+    ~PrefetchReader();
+
+    PrefetchReader(const PrefetchReader &) = delete;
+    PrefetchReader &operator=(const PrefetchReader &) = delete;
+
+    // i 番目のファイルの中身を取り出す（i は 0 から順に 1 回ずつ呼ぶ）
+    // 読めなかったときは false を返し、error に理由を入れる
+    bool take(size_t i, std::vector<char> &data, std::string &error);
+
+    // 使っている読み込み方式 ("io_uring" / "threads" / "sync")
+    const char *backend() const;
+
+private:
+    struct Slot {
+        bool ready = false;
+        bool ok = false;
+        std::vector<char> data;
+        std::string error;
+    };
+    struct Uring;
+
+    void readerLoop();
+    void uringLoop();
+    // 次に読み始めるファイルの番号を取る（先読み数に空きがなければ待つ。終わりなら false）
+    bool nextIndex(size_t &index, bool wait);
+    void complete(size_t index, bool ok, std::vector<char> data, std::string error);
+
+    std::vector<std::string> paths_;
+    std::vector<Slot> slots_;
+    size_t depth_;
+    size_t next_ = 0;     // 次に読み始めるファイル
+    size_t consumed_ = 0; // 取り出し済みのファイル数
+    bool stop_ = false;
+    std::unique_ptr<Uring> uring_;
+    std::mutex mutex_;
+    std::condition_variable readable_; // 先読み数に空きができた
+    std::condition_variable ready_;    // ファイルを読み終えた
+    std::vector<std::thread> workers_;
+};
+
+// ファイル全体を読む（読めなければ false と error）
+bool readWholeFile(const std::string &path, std::vector<char> &data, std::string &error);
+
+// 同じディレクトリの一時ファイル（書き手ごとに別の名前）に書いて fsync してから rename で置き換える
+// （読む側は古い中身か新しい中身の一方だけを見る。失敗したら例外）
+void writeFileAtomically(const std::string &path, const char *data, size_t size);
+
+} // namespace camsynth
@@ -0,0 +1,313 @@
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include "bvh.hpp"
+#include "msgpack_io.hpp"
+#include "prefetch.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace camsynth {
+
+namespace {
+
+const int kEntryVersion = 1;
+
+// FNV-1a（プロセスや実行環境によらず同じ値になるもの）
+struct Fnv1a {
+    uint64_t h = 1469598103934665603ull;
+
+    void bytes(const void *data, size_t size) {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+    }
+    template <typename T>
+    void value(const T &v) {
+        bytes(&v, sizeof(v));
+    }
+    // 長さも入れて、区切りの違う文字列の並びが同じ値にならないようにする
+    void text(const string &s) {
+        value<uint64_t>(s.size());
+        bytes(s.data(), s.size());
+    }
+    void ints(const vector<int> &v) {
+        value<uint64_t>(v.size());
+        bytes(v.data(), v.size() * sizeof(int));
+    }
+    string hex() const {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+        return buf;
+    }
+};
+
+// ファイルの中身（なければ「ない」こと）を入れる
+void hashFile(Fnv1a &hash, const string &path) {
+    vector<char> data;
+    string error;
+    bool exists = fs::exists(path) && readWholeFile(path, data, error);
+    hash.text(fs::path(path).filename().string());
+    hash.value(exists);
+    if (exists) {
+        hash.value<uint64_t>(data.size());
+        hash.bytes(data.data(), data.size());
+    }
+}
+
+// ファイル・ディレクトリ直下のファイルの名前・サイズ・更新時刻を入れる（中身は読まない）
+void hashListing(Fnv1a &hash, const string &path) {
+    error_code ec;
+    hash.text(path);
+    if (fs::is_regular_file(path, ec)) {
+        hash.value<uint64_t>(fs::file_size(path, ec));
+        hash.value(fs::last_write_time(path, ec).time_since_epoch().count());
+        return;
+    }
+    vector<tuple<string, uint64_t, int64_t>> files;
+    for (const auto &entry : fs::directory_iterator(path, ec)) {
+        if (!entry.is_regular_file(ec))
+            continue;
+        files.emplace_back(entry.path().filename().string(), entry.file_size(ec),
+                           entry.last_write_time(ec).time_since_epoch().count());
+    }
+    sort(files.begin(), files.end());
+    hash.value<uint64_t>(files.size());
+    for (const auto &f : files) {
+        hash.text(get<0>(f));
+        hash.value(get<1>(f));
+        hash.value(get<2>(f));
+    }
+}
+
+void packTriples(msgpack::packer<msgpack::sbuffer> &pk, const vector<array<double, 3>> &v) {
+    pk.pack_array(v.size());
+    for (const auto &a : v) {
+        pk.pack_array(3);
+        for (double x : a)
+            pk.pack(x);
+    }
+}
+
+bool readTriples(const msgpack::object &obj, const string &key, vector<array<double, 3>> &out) {
+    const msgpack::object *arr = getMember(obj, key);
+    if (!arr || arr->type != msgpack::type::ARRAY)
+        return false;
+    out.resize(arr->via.array.size);
+    for (size_t i = 0; i < out.size(); i++) {
+        const msgpack::object &row = arr->via.array.ptr[i];
+        if (row.type != msgpack::type::ARRAY || row.via.array.size != 3)
+            return false;
+        for (int k = 0; k < 3; k++)
+            out[i][k] = row.via.array.ptr[k].as<double>();
+    }
+    return true;
+}
+
+// キャッシュのエントリー（*.msgpack）
+bool isEntry(const fs::directory_entry &entry) {
+    error_code ec;
+    return entry.is_regular_file(ec) && entry.path().extension() == ".msgpack";
+}
+
+} // namespace
+
+string resultCacheDatabaseVersion(const DatabaseDirs &dirs, bool includeIngest) {
+    Fnv1a hash;
+    for (const string &dir : {dirs.PositionDatabaseDir, dirs.HipDirectionDatabaseDir, dirs.MusicDatabaseDir,
+                              dirs.CameraPositionDir, dirs.CameraRotationDir, dirs.BpmData})
+        hashListing(hash, dir);
+    // 取り込んだファイルは書き換えないので、MANIFEST の中身で取り込み・圧縮が分かる
+    if (includeIngest)
+        hashFile(hash, dirs.IngestDir + "/MANIFEST");
+    return hash.hex();
+}
+
+string resultCacheKey(const string &motionDir,
+                      const string &musicDir,
+                      const string &inputNumber,
+                      const vector<int> &frameIntervals,
+                      const vector<int> &modes,
+                      const SearchOptions &options,
+                      const string &dbVersion) {
+    Fnv1a hash;
+    hash.value(kEntryVersion);
+    if (isBvhPath(motionDir))
+        hashFile(hash, motionDir);
+    else
+        for (const char *name : {"raw.msgpack", "stand.msgpack", "hip.msgpack"})
+            hashFile(hash, motionDir + "/" + name);
+    for (const char *name : {"beat.msgpack", "music.msgpack"})
+        hashFile(hash, musicDir + "/" + name);
+    hash.text(inputNumber);
+    hash.ints(frameIntervals);
+    hash.ints(modes);
+    hash.value(options.step);
+    hash.value(options.slidingOffset);
+    hash.value(options.clipWindows);
+    hash.value(options.windowStride);
+    hash.value(options.squaredL2);
+    hash.value(options.pcaComponents);
+    hash.value(options.globalSelection);
+    hash.value(options.globalTopK);
+    hash.value(options.transitionWeight);
+    hash.value(options.modePenalty);
+    hash.value(options.sigma);
+    hash.text(dbVersion);
+    return hash.hex();
+}
+
+bool resultCacheable(const SearchOptions &options) {
+    return options.timeBudgetMs <= 0.0 && options.alternatives <= 0;
+}
+
+ResultCache::ResultCache(const string &dir, uint64_t maxBytes, const string &dbVersion)
+    : dir_(dir), maxBytes_(maxBytes) {
+    vector<char> stored;
+    string error;
+    if (readWholeFile(dir_ + "/DB_VERSION", stored, error) && string(stored.begin(), stored.end()) == dbVersion)
+        return;
+    // データベースが変わった（または初めて使う）ので、古い版のエントリーを消す
+    error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir_, ec)) {
+        if (isEntry(entry))
+            fs::remove(entry.path(), ec);
+    }
+    try {
+        fs::create_directories(dir_);
+        writeFileAtomically(dir_ + "/DB_VERSION", dbVersion.data(), dbVersion.size());
+    }
+    catch (const std::exception &e) {
+        // キャッシュは使えなくても合成はできるので止めない（load は外れ、store は警告を出すだけになる）
+        cerr << "[WARN] キャッシュのディレクトリを準備できません: " << dir_ << " (" << e.what() << ")" << endl;
+    }
+}
+
+string ResultCache::entryPath(const string &key) const {
+    return dir_ + "/" + key + ".msgpack";
+}
+
+bool ResultCache::load(const string &key, CachedResult &result) const {
+    string path = entryPath(key);
+    vector<char> data;
+    string error;
+    if (!readWholeFile(path, data, error))
+        return false;
+    try {
+        msgpack::object_handle oh = unpackMsgpack(data, path);
+        const msgpack::object &obj = oh.get();
+        const msgpack::object *storedKey = getMember(obj, "key");
+        const msgpack::object *choices = getMember(obj, "choices");
+        const msgpack::object *lengths = getMember(obj, "lengths");
+        const msgpack::object *fov = getMember(obj, "fov");
+        if (!storedKey || storedKey->as<string>() != key || !choices || choices->type != msgpack::type::ARRAY ||
+            !lengths || lengths->type != msgpack::type::ARRAY || !fov || fov->type != msgpack::type::ARRAY)
+            return false;
+        CachedResult r;
+        for (size_t i = 0; i < choices->via.array.size; i++) {
+            const msgpack::object &c = choices->via.array.ptr[i];
+            if (c.type != msgpack::type::ARRAY || c.via.array.size != 2)
+                return false;
+            r.choices.push_back({c.via.array.ptr[0].as<string>(), c.via.array.ptr[1].as<int>()});
+        }
+        for (size_t i = 0; i < lengths->via.array.size; i++)
+            r.lengths.push_back(lengths->via.array.ptr[i].as<int>());
+        if (!readTriples(obj, "position", r.track.position) || !readTriples(obj, "rotation", r.track.rotation))
+            return false;
+        for (size_t i = 0; i < fov->via.array.size; i++)
+            r.track.viewangle.push_back(fov->via.array.ptr[i].as<double>());
+        result = move(r);
+    }
+    catch (const std::exception &) {
+        // 壊れたエントリーは使わない（次の store で書き直される）
+        return false;
+    }
+    // 最後に使った時刻（LRU の順）
+    error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void ResultCache::store(const string &key, const CachedResult &result) {
+    msgpack::sbuffer buf;
+    msgpack::packer<msgpack::sbuffer> pk(&buf);
+    pk.pack_map(7);
+    pk.pack(string("version"));
+    pk.pack(kEntryVersion);
+    pk.pack(string("key"));
+    pk.pack(key);
+    pk.pack(string("choices"));
+    pk.pack_array(result.choices.size());
+    for (const auto &c : result.choices) {
+        pk.pack_array(2);
+        pk.pack(c.file);
+        pk.pack(c.offset);
+    }
+    pk.pack(string("lengths"));
+    pk.pack_array(result.lengths.size());
+    for (int len : result.lengths)
+        pk.pack(len);
+    pk.pack(string("position"));
+    packTriples(pk, result.track.position);
+    pk.pack(string("rotation"));
+    packTriples(pk, result.track.rotation);
+    pk.pack(string("fov"));
+    pk.pack_array(result.track.viewangle.size());
+    for (double v : result.track.viewangle)
+        pk.pack(v);
+    try {
+        writeFileAtomically(entryPath(key), buf.data(), buf.size());
+        evict();
+    }
+    catch (const std::exception &e) {
+        // 出力はもう書いてあるので、保存できなくても失敗にはしない
+        cerr << "[WARN] 合成結果をキャッシュに保存できません: " << entryPath(key) << " (" << e.what() << ")" << endl;
+    }
+}
+
+size_t ResultCache::entries() const {
+    size_t n = 0;
+    error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir_, ec))
+        n += isEntry(entry);
+    return n;
+}
+
+uint64_t ResultCache::totalBytes() const {
+    uint64_t total = 0;
+    error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir_, ec)) {
+        if (isEntry(entry))
+            total += entry.file_size(ec);
+    }
+    return total;
+}
+
+void ResultCache::evict() {
+    vector<pair<fs::file_time_type, fs::path>> files;
+    uint64_t total = 0;
+    error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir_, ec)) {
+        if (!isEntry(entry))
+            continue;
+        files.emplace_back(entry.last_write_time(ec), entry.path());
+        total += entry.file_size(ec);
+    }
+    sort(files.begin(), files.end());
+    // 最も新しいエントリー（今書いたもの）は残す
+    for (size_t i = 0; i + 1 < files.size() && total > maxBytes_; i++) {
+        uint64_t size = fs::file_size(files[i].second, ec);
+        if (fs::remove(files[i].second, ec))
+            total -= min(total, size);
+    }
+}
+
+} // namespace camsynth
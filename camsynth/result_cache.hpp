@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace camsynth {
+
+// 合成結果のキャッシュ
+// 同じ入力ファイル・同じ設定・同じデータベースでの合成結果（セグメントごとの選択ファイルとカメラデータ）を
+// ディレクトリに 1 エントリー 1 ファイルで保存し、2 回目からはデータベースを読み込まずにファイルから返す。
+// キーは入力の msgpack ファイルの中身・フレーム間隔・modes・結果に効く検索設定・データベースの版のハッシュ。
+// データベースの版はファイルを読まずに求める（resultCacheDatabaseVersion）。版が変わるとキャッシュを丸ごと消す。
+// エントリーの合計サイズが上限を超えたら、最後に使われた時刻の古いものから消す (LRU)。
+//
+//   <dir>/DB_VERSION     エントリーを作ったときのデータベースの版
+//   <dir>/<キー>.msgpack  {"key", "choices": [[ファイル名, offset], ...], "lengths", "position", "rotation", "fov"}
+//
+// 書き込みは一時ファイルから rename で置き換えるので、複数のプロセスが同じディレクトリを使ってもよい。
+
+// キャッシュした合成結果
+struct CachedResult {
+    std::vector<SegmentChoice> choices; // 各セグメントで選ばれた候補
+    std::vector<int> lengths;           // 各セグメントの長さ
+    CameraTrack track;                  // 組み立てたカメラデータ
+};
+
+// データベースの版
+// 各ディレクトリのファイル名・サイズ・更新時刻、average_bpm.msgpack と取り込みの MANIFEST から求める。
+// ファイルの追加・差し替え・取り込み・圧縮で変わる（CameraColumns は読み込み時に作られるだけなので含めない）
+// includeIngest が false なら取り込みの MANIFEST を含めない（ブロック圧縮データベースの元データの版）
+std::string resultCacheDatabaseVersion(const DatabaseDirs &dirs, bool includeIngest = true);
+
+// 合成結果のキー
+// 入力ファイル（raw / stand / hip.msgpack または BVH と beat / music.msgpack）の中身、入力番号、frameIntervals、modes、
+// 結果を変える検索設定（step・照合方法・全体最適化・平滑化など）と dbVersion のハッシュ
+std::string resultCacheKey(const std::string &motionDir,
+                           const std::string &musicDir,
+                           const std::string &inputNumber,
+                           const std::vector<int> &frameIntervals,
+                           const std::vector<int> &modes,
+                           const SearchOptions &options,
+                           const std::string &dbVersion);
+
+// options でキャッシュを使えるか（時間の上限のある検索は実行ごとに結果が変わり、別案は保存しないので使わない）
+bool resultCacheable(const SearchOptions &options);
+
+class ResultCache {
+public:
+    // dir がなければ作る。DB_VERSION が dbVersion と違えば全エントリーを消す（作れなければ警告を出す）
+    ResultCache(const std::string &dir, std::uint64_t maxBytes, const std::string &dbVersion);
+
+    // key のエントリーがあれば読んで true（使った時刻を更新する）
+    bool load(const std::string &key, CachedResult &result) const;
+    // key のエントリーを書き、合計サイズが上限を超えていれば古いものから消す（書けなければ警告を出すだけ）
+    void store(const std::string &key, const CachedResult &result);
+
+    // 現在のエントリー数と合計サイズ
+    size_t entries() const;
+    std::uint64_t totalBytes() const;
+
+private:
+    std::string entryPath(const std::string &key) const;
+    void evict();
+
+    std::string dir_;
+    std::uint64_t maxBytes_;
+};
+
+} // namespace camsynth
@@ -0,0 +1,1332 @@
+#include "search.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+
+#include "kernels.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+// 検索候補 1 つ分（クリップ内の区間 [start, start + frames)）
+struct CandidateWindow {
+    string fileName;
+    const MotionClip *clip = nullptr;
+    int start = 0;
+    int frames = 0;
+    int hipFrames = 0;
+    int musicFrames = 0;
+    double bpm = 0.0;
+    size_t unit = 0; // 走査の単位（切り出し区間の番号、またはクリップの番号）
+    const string *clipNumber = nullptr;
+    size_t order = 0; // 切り出し区間のデータベース全体での走査順
+};
+
+// 検索候補を列挙する
+// 既定では切り出しファイルの区間そのもの。options.clipWindows のときはクリップ全体から
+// windowStride フレームおきに区間を切り出す（スライディング照合では区間を stride - 1 フレーム延ばし、
+// 全ての開始位置に届くようにする）。
+vector<CandidateWindow> enumerateCandidates(const Database &db, const string &inputNumber,
+                                            int segmentLen, const SearchOptions &options) {
+    vector<CandidateWindow> candidates;
+    if (!options.clipWindows) {
+        for (size_t i = 0; i < db.segments.size(); i++) {
+            const DatabaseSegment &seg = db.segments[i];
+            if (seg.fileName.find("m" + inputNumber + "_") == 0)
+                continue;
+            const MotionClip *clip = db.clip(seg.fileNumber);
+            if (!clip)
+                continue;
+            candidates.push_back({seg.fileName, clip, seg.start, seg.frames, seg.hipFrames, seg.musicFrames, seg.bpm, i,
+                                  &seg.fileNumber, seg.order});
+        }
+        return candidates;
+    }
+    int stride = max(options.windowStride, 1);
+    int span = options.slidingOffset ? segmentLen + stride - 1 : segmentLen;
+    size_t unit = 0;
+    for (const auto &kv : db.clips) {
+        unit++;
+        if (kv.first == inputNumber)
+            continue;
+        const MotionClip &clip = kv.second;
+        for (int start = 0; start + segmentLen <= clip.frames(); start += stride) {
+            int end = min(start + span, clip.frames());
+            if (!clip.covers(start, end))
+                continue;
+            candidates.push_back({windowFileName(kv.first, start, end), &clip, start,
+                                  end - start, end - start, end - start, clip.windowBpm(start, end), unit - 1, &kv.first});
+        }
+    }
+    return candidates;
+}
+
+// 候補名 "m62_(0,550).msgpack" のクリップ番号
+string clipNumberOf(const string &fileName) {
+    string fileNumber;
+    int start, end;
+    return parseSegmentFilename(fileName, fileNumber, start, end) ? fileNumber : fileName;
+}
+
+// 正規化・順位付けに使う候補ごとの距離の列（走査順、i 番目が *names[i] の候補）
+struct RankColumns {
+    Span<const string *> names;
+    Span<const double> segment;
+    Span<const double> hip;
+    Span<const double> bpm;
+    Span<const double> feature;
+    Span<const int> offsets;
+};
+
+// 1 セグメント分の問い合わせと、走査中に集める候補ごとの距離
+// 距離の列・走査順・作業領域は arena から候補の数だけ先に切り出しておき、候補ごとの計算ではヒープを使わない。
+struct SegmentQuery {
+    FrameSpan inputSegment;
+    FrameSpan hipSegment;
+    MusicSpan inputMusicSegment;
+    double bpm;
+    SlidingDistanceProfiler profiler;
+    // データベースのレイアウト用の距離計算（入力のジョイント数・次元数が違えば汎用版に戻す）
+    DistanceKernels kernels;
+    vector<double> inputMusicFlat; // 入力の楽曲特徴量を kernels.musicDims 間隔で詰めたもの
+
+    // 二乗 L2 のときの入力側の特徴量（step 間隔でサンプルした行だけ）と、クリップ全フレームとの内積
+    shared_ptr<const PoseIndex> poseIndex;
+    vector<double> queryFeatures; // サンプル数 × dims
+    vector<double> queryNorms;
+    vector<int> sampledFrames;
+    const string *gramClip = nullptr;
+    int gramFirst = 0, gramCount = 0;
+    vector<double> gram;          // サンプル数 × gramCount
+
+    // 候補の番号 (candidates の添字) で引く距離の列（scored[i] が 0 の候補は距離を求めていない）
+    Arena &arena;
+    const vector<CandidateWindow> &candidates;
+    Span<double> segmentDistances, hipDistances, bpmDiffs, featureDiffs;
+    Span<int> offsets;
+    Span<unsigned char> scored;
+    Span<size_t> visit; // 時間の上限があるときの走査順
+    size_t numScored = 0;
+    double bytesScanned = 0.0;
+
+    SegmentQuery(const Database &db, const vector<CandidateWindow> &candidates, FrameSpan inputSegment,
+                 FrameSpan hipSegment, MusicSpan inputMusicSegment, double bpm, const SearchOptions &options,
+                 Arena &arena)
+        : inputSegment(inputSegment), hipSegment(hipSegment), inputMusicSegment(inputMusicSegment), bpm(bpm),
+          profiler(inputSegment, options.step), kernels(db.kernels), arena(arena), candidates(candidates) {
+        for (const auto &f : inputSegment) {
+            if ((int)f.positions.size() != kernels.numJoints) {
+                kernels.jointDistance = calculateRootRelativeJointDistanceSparse;
+                break;
+            }
+        }
+        for (const auto &m : inputMusicSegment) {
+            if ((int)m.size() != kernels.musicDims) {
+                kernels.musicDims = 0;
+                break;
+            }
+        }
+        if (kernels.musicDims > 0) {
+            inputMusicFlat.reserve(inputMusicSegment.size() * kernels.musicDims);
+            for (const auto &m : inputMusicSegment)
+                inputMusicFlat.insert(inputMusicFlat.end(), m.begin(), m.end());
+        }
+        if (options.squaredL2) {
+            poseIndex = db.poseIndex(options.pcaComponents);
+            vector<FrameData> sampled;
+            for (size_t t = 0; t < inputSegment.size(); t += options.step) {
+                sampled.push_back(inputSegment[t]);
+                sampledFrames.push_back(t);
+            }
+            int dims = poseIndex->dims();
+            queryFeatures = poseIndex->project(sampled);
+            for (size_t r = 0; r < sampled.size(); r++) {
+                double norm = 0.0;
+                for (int d = 0; d < dims; d++)
+                    norm += queryFeatures[r * dims + d] * queryFeatures[r * dims + d];
+                queryNorms.push_back(norm);
+            }
+        }
+
+        size_t n = candidates.size();
+        segmentDistances = arena.allocateArray<double>(n);
+        hipDistances = arena.allocateArray<double>(n);
+        bpmDiffs = arena.allocateArray<double>(n);
+        featureDiffs = arena.allocateArray<double>(n);
+        offsets = arena.allocateArray<int>(n);
+        scored = arena.allocateArray<unsigned char>(n);
+        visit = arena.allocateArray<size_t>(n);
+
+        // 走査中に確保が起きないよう、入力のスペクトル・内積の行列・候補ごとの作業領域の大きさを先にそろえる
+        if (!options.slidingOffset)
+            return;
+        size_t scratch = 0, gramCols = 0;
+        for (const CandidateWindow &cand : candidates) {
+            const PoseIndex::ClipFeatures *cf = poseIndex ? poseIndex->clip(*cand.clipNumber) : nullptr;
+            if (cf) {
+                gramCols = max(gramCols, (size_t)(options.clipWindows ? cf->frames : cand.frames));
+            } else {
+                profiler.prepare(cand.frames);
+                scratch = max(scratch, SlidingDistanceProfiler::scratchBytes(cand.frames));
+            }
+        }
+        gram.reserve(sampledFrames.size() * gramCols);
+        arena.reserve(scratch);
+    }
+
+    // clipNumber のクリップのフレーム [first, first + count) との内積（範囲が変わったときだけ計算し直す）
+    void computeGram(const string &clipNumber, const PoseIndex::ClipFeatures &cf, int first, int count) {
+        if (gramClip && *gramClip == clipNumber && gramFirst == first && gramCount == count)
+            return;
+        gramClip = &clipNumber;
+        gramFirst = first;
+        gramCount = count;
+        gram.resize(sampledFrames.size() * (size_t)count);
+        gemmBlockedNT(queryFeatures.data(), cf.features.data() + (size_t)first * poseIndex->dims(), gram.data(),
+                      sampledFrames.size(), count, poseIndex->dims());
+    }
+
+    // クリップのフレーム start から始まる区間との二乗 L2 距離（computeGram の範囲内）
+    double squaredL2At(const PoseIndex::ClipFeatures &cf, int start) const {
+        double dist = 0.0;
+        for (size_t r = 0; r < sampledFrames.size(); r++) {
+            int f = start + sampledFrames[r];
+            dist += queryNorms[r] + cf.norms[f] - 2.0 * gram[r * gramCount + (f - gramFirst)];
+        }
+        return max(0.0, dist);
+    }
+
+    // オフセットが 1 つだけのときは対角の内積だけを直接求める
+    double squaredL2Direct(const PoseIndex::ClipFeatures &cf, int start) const {
+        int dims = poseIndex->dims();
+        double dist = 0.0;
+        for (size_t r = 0; r < sampledFrames.size(); r++) {
+            int f = start + sampledFrames[r];
+            const double *a = queryFeatures.data() + r * dims;
+            const double *b = cf.features.data() + (size_t)f * dims;
+            double dot = 0.0;
+            for (int d = 0; d < dims; d++)
+                dot += a[d] * b[d];
+            dist += queryNorms[r] + cf.norms[f] - 2.0 * dot;
+        }
+        return max(0.0, dist);
+    }
+
+    // 距離を求めた候補を走査順に詰めた列（arena から切り出す）
+    RankColumns columns() const {
+        Span<const string *> names = arena.allocateArray<const string *>(numScored);
+        Span<double> seg = arena.allocateArray<double>(numScored);
+        Span<double> hip = arena.allocateArray<double>(numScored);
+        Span<double> bpm = arena.allocateArray<double>(numScored);
+        Span<double> feature = arena.allocateArray<double>(numScored);
+        Span<int> offs = arena.allocateArray<int>(numScored);
+        size_t k = 0;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (!scored[i])
+                continue;
+            names[k] = &candidates[i].fileName;
+            seg[k] = segmentDistances[i];
+            hip[k] = hipDistances[i];
+            bpm[k] = bpmDiffs[i];
+            feature[k] = featureDiffs[i];
+            offs[k] = offsets[i];
+            k++;
+        }
+        return {names, seg, hip, bpm, feature, offs};
+    }
+
+    // 距離を求めた候補を走査順に並べたもの
+    CandidateDistances distances() const {
+        CandidateDistances d;
+        d.bytesScanned = bytesScanned;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (!scored[i])
+                continue;
+            d.fileNames.push_back(candidates[i].fileName);
+            d.offsets.push_back(offsets[i]);
+            d.order.push_back(candidates[i].order);
+            d.segmentDistances.push_back(segmentDistances[i]);
+            d.hipDistances.push_back(hipDistances[i]);
+            d.bpmDiffs.push_back(bpmDiffs[i]);
+            d.featureDiffs.push_back(featureDiffs[i]);
+        }
+        return d;
+    }
+};
+
+// index 番目の候補の距離を計算して q に記録する（長さが足りない候補は飛ばす）
+void scoreCandidate(size_t index, SegmentQuery &q, const SearchOptions &options) {
+    const CandidateWindow &cand = q.candidates[index];
+    FrameSpan inputSegment = q.inputSegment;
+    FrameSpan hipSegment = q.hipSegment;
+    MusicSpan inputMusicSegment = q.inputMusicSegment;
+    int segmentLen = inputSegment.size();
+    int step = options.step;
+
+    const MotionClip &clip = *cand.clip;
+
+    // 姿勢は raw のまま持っているので、距離計算の中で root を引いて root 基準にする
+    if (cand.frames < segmentLen)
+        return;
+    // ヒップ方向データ
+    if (cand.hipFrames < segmentLen)
+        return;
+    const FrameData *dbPositions = clip.raw.data() + cand.start;
+    const array<double, 4> *dbHipPositions = clip.hip.data() + cand.start;
+    int offset = 0;
+    double segDist;
+    const PoseIndex::ClipFeatures *cf = q.poseIndex ? q.poseIndex->clip(*cand.clipNumber) : nullptr;
+    if (cf && !options.slidingOffset) {
+        segDist = q.squaredL2Direct(*cf, cand.start);
+    } else if (cf) {
+        // 二乗 L2: 候補のフレームとの内積を行列積でまとめて求めておき、各オフセットは対角の和で評価する
+        // クリップ全体から切り出す場合は区間が重なるので、クリップ全フレーム分を 1 回だけ計算して使い回す
+        if (options.clipWindows)
+            q.computeGram(*cand.clipNumber, *cf, 0, cf->frames);
+        else
+            q.computeGram(*cand.clipNumber, *cf, cand.start, cand.frames);
+        int numOffsets = min(cand.frames, cand.hipFrames) - segmentLen + 1;
+        segDist = numeric_limits<double>::infinity();
+        for (int o = 0; o < numOffsets; o++) {
+            double d = q.squaredL2At(*cf, cand.start + o);
+            if (d < segDist) {
+                segDist = d;
+                offset = o;
+            }
+        }
+    } else {
+        if (options.slidingOffset) {
+            // 全オフセットの二乗距離プロファイルから最も近い位置を選ぶ（プロファイルは選んだら戻す）
+            Arena::Mark scratch = q.arena.mark();
+            Span<const double> profile = q.profiler.profile(dbPositions, cand.frames, true, q.arena);
+            size_t numOffsets = min(profile.size(), (size_t)(cand.hipFrames - segmentLen + 1));
+            offset = min_element(profile.begin(), profile.begin() + numOffsets) - profile.begin();
+            q.arena.rewind(scratch);
+        }
+        segDist = q.kernels.jointDistance(inputSegment, dbPositions + offset, step);
+    }
+    double hipDist = calculateHipVectorDistanceSparse(hipSegment, dbHipPositions + offset, segmentLen, step);
+    double bpmDiff = fabs(q.bpm - cand.bpm);
+    // 候補区間のうち距離計算で読んだフレーム数 × 1 フレーム分（姿勢・ヒップ・楽曲特徴量）のバイト数
+    int scannedFrames = options.slidingOffset ? cand.frames : segmentLen;
+    size_t frameBytes = dbPositions->positions.size() * sizeof(array<double, 3>) + sizeof(array<double, 4>) +
+                        clip.music[cand.start].size() * sizeof(double);
+    q.bytesScanned += (double)scannedFrames * frameBytes;
+    // 楽曲特徴量の差分計算（候補側は区間 [start + offset, end) のシーケンス）
+    int musicOffset = min(offset, cand.musicFrames);
+    double featureDiff;
+    if (q.kernels.musicDims > 0 && !clip.musicFlat.empty()) {
+        int dims = q.kernels.musicDims;
+        size_t count = min(inputMusicSegment.size(), (size_t)(cand.musicFrames - musicOffset));
+        featureDiff = q.kernels.musicDistance(q.inputMusicFlat.data(),
+                                              clip.musicFlat.data() + (size_t)(cand.start + musicOffset) * dims,
+                                              count, step, dims);
+    } else {
+        featureDiff = calculateMusicFeatureDistanceSparse(inputMusicSegment, clip.music.data() + cand.start + musicOffset,
+                                                          cand.musicFrames - musicOffset, step);
+    }
+    q.segmentDistances[index] = segDist;
+    q.hipDistances[index] = hipDist;
+    q.bpmDiffs[index] = bpmDiff;
+    q.featureDiffs[index] = featureDiff;
+    q.offsets[index] = offset;
+    q.scored[index] = 1;
+    q.numScored++;
+}
+
+using SearchClock = chrono::steady_clock;
+
+// 候補を順に調べて q に距離を集め、調べた候補数を返す
+// deadline が time_point::max() なら走査順に全候補を調べる。そうでなければ BPM の近い候補から調べ、
+// deadline を過ぎたらそこで打ち切る（比べる相手がいるよう、少なくとも minScored 件は距離を求める）。
+// 距離は候補の番号の位置に書くので、全候補を調べ終えれば打ち切りなしの結果と同じになる。
+size_t scoreCandidates(SegmentQuery &q, const SearchOptions &options, SearchClock::time_point deadline) {
+    const vector<CandidateWindow> &candidates = q.candidates;
+    if (deadline == SearchClock::time_point::max()) {
+        for (size_t i = 0; i < candidates.size(); i++)
+            scoreCandidate(i, q, options);
+        return candidates.size();
+    }
+    const size_t minScored = 5;
+    const size_t checkInterval = 8; // 時計を見る間隔（候補数）
+    Span<size_t> visit = q.visit;
+    for (size_t i = 0; i < visit.size(); i++)
+        visit[i] = i;
+    // BPM の差が同じなら走査順（std::sort は作業領域を確保しない）
+    sort(visit.begin(), visit.end(), [&](size_t a, size_t b) {
+        double da = fabs(candidates[a].bpm - q.bpm), db = fabs(candidates[b].bpm - q.bpm);
+        return da < db || (da == db && a < b);
+    });
+    size_t examined = 0;
+    for (; examined < visit.size(); examined++) {
+        if (examined % checkInterval == 0 && q.numScored >= minScored && SearchClock::now() >= deadline)
+            break;
+        scoreCandidate(visit[examined], q, options);
+    }
+    return examined;
+}
+
+// 距離を正規化してスコアを求め、スコア順に上位候補を残す（作業用の列は arena から切り出す）
+vector<CandidateScore> rankColumns(const RankColumns &columns, const SearchOptions &options, Arena &arena) {
+    size_t numCandidates = columns.names.size();
+    Span<double> normSegDist = arena.allocateArray<double>(numCandidates);
+    Span<double> normHipDist = arena.allocateArray<double>(numCandidates);
+    Span<double> normBpmDiff = arena.allocateArray<double>(numCandidates);
+    Span<double> normFeatureScore = arena.allocateArray<double>(numCandidates);
+    normalizeValues(columns.segment.data(), numCandidates, normSegDist.data());
+    normalizeValues(columns.hip.data(), numCandidates, normHipDist.data());
+    normalizeValues(columns.bpm.data(), numCandidates, normBpmDiff.data());
+    // 楽曲特徴量の差は次元ごとに正規化してから総和し、その総和をもう一度正規化する（次元数は 1）
+    normalizeValues(columns.feature.data(), numCandidates, normFeatureScore.data());
+    normalizeValues(normFeatureScore.data(), numCandidates, normFeatureScore.data());
+
+    // 類似度の重み付け
+    double weight_motion = 1, weight_music = 1;
+
+    Span<double> scores = arena.allocateArray<double>(numCandidates);
+    Span<size_t> order = arena.allocateArray<size_t>(numCandidates);
+    for (size_t i = 0; i < numCandidates; i++) {
+        scores[i] = weight_motion * (normSegDist[i] + normHipDist[i]) + weight_music * (normFeatureScore[i] + normBpmDiff[i]);
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scores[a] < scores[b]; });
+    auto nameAt = [&](int rank) -> const string & { return *columns.names[order[rank]]; };
+    int top_n = numCandidates < 5 ? numCandidates : 5;
+    int numKept = min((int)numCandidates, max(top_n, options.globalSelection ? options.globalTopK : 0));
+    // 別案を作るときは、異なるクリップが alternatives 個そろうまで候補を残す
+    if (options.alternatives > 0) {
+        set<string> clips;
+        for (int i = 0; i < numKept; i++)
+            clips.insert(clipNumberOf(nameAt(i)));
+        while (numKept < (int)numCandidates && (int)clips.size() < options.alternatives)
+            clips.insert(clipNumberOf(nameAt(numKept++)));
+    }
+    vector<CandidateScore> ranked;
+    for (int i = 0; i < numKept; i++)
+        ranked.push_back({nameAt(i), scores[order[i]], columns.offsets[order[i]]});
+    return ranked;
+}
+
+} // namespace
+
+// 距離を正規化してスコアを求め、スコア順に上位候補を残す
+vector<CandidateScore> rankCandidates(const CandidateDistances &distances, const SearchOptions &options) {
+    Arena arena;
+    Span<const string *> names = arena.allocateArray<const string *>(distances.size());
+    for (size_t i = 0; i < names.size(); i++)
+        names[i] = &distances.fileNames[i];
+    RankColumns columns = {names,
+                           distances.segmentDistances,
+                           distances.hipDistances,
+                           distances.bpmDiffs,
+                           distances.featureDiffs,
+                           distances.offsets};
+    return rankColumns(columns, options, arena);
+}
+
+// スコア順の上位候補から、mode に応じて採用するファイルを選ぶ
+SegmentSearchResult chooseCandidate(const Database &db,
+                                    const vector<CandidateScore> &ranked,
+                                    int segmentLen,
+                                    size_t segIndex,
+                                    int currentMode,
+                                    const SearchOptions &options) {
+    vector<pair<string, double>> scores;
+    unordered_map<string, int> candidateOffsets;
+    for (const auto &c : ranked) {
+        scores.push_back({c.file, c.score});
+        candidateOffsets[c.file] = c.offset;
+    }
+    auto offsetOf = [&](const string &file) {
+        auto it = candidateOffsets.find(file);
+        return (it == candidateOffsets.end()) ? 0 : it->second;
+    };
+    // mode ごとの評価に使うカメラの統計量（選ばれた位置から segmentLen フレーム分）
+    auto distanceAverageOf = [&](const string &file) {
+        return getDistanceAverageForCandidate(db, file, segmentLen, offsetOf(file));
+    };
+    auto movementOf = [&](const string &file) {
+        return getPositionAverageForCandidate(db, file, segmentLen, offsetOf(file));
+    };
+    int top_n = scores.size() < 5 ? scores.size() : 5;
+    SegmentSearchResult result;
+    result.topCandidates = ranked;
+    result.mode = currentMode;
+    cout << "----- Top 5 candidates for segment " << segIndex << " -----\n";
+    for (int i = 0; i < top_n; i++) {
+        cout << "   Rank " << (i + 1) << ": " << scores[i].first
+             << " Score=" << scores[i].second;
+        if (options.slidingOffset)
+            cout << " Offset=" << offsetOf(scores[i].first);
+        cout << "\n";
+    }
+    string chosenFile;
+    double min_score = 0.0;
+    // currentMode: セグメントごとの mode
+
+    if (currentMode == 1) {
+        // Mode 1: 俯瞰視点 (引き)
+        // Distance の平均が最も小さい候補を採用
+        double min_distance_val = std::numeric_limits<double>::infinity();
+        std::string best_file;
+        double best_score = 0.0;
+        for (int i = 0; i < top_n; i++) {
+            std::string candidate_file = scores[i].first;
+            double candidate_score = scores[i].second;
+            double avg_dist = distanceAverageOf(candidate_file);
+            if (avg_dist < min_distance_val) {
+                min_distance_val = avg_dist;
+                best_file = candidate_file;
+                best_score = candidate_score;
+            }
+        }
+        chosenFile = best_file;
+        min_score = best_score;
+        std::cout << "[Selected file (引き)] " << chosenFile 
+                  << " with DistanceAvg = " << min_distance_val 
+                  << ", Score = " << min_score << std::endl;
+
+    } else if (currentMode == 2) {
+        // Mode 2: 寄り視点
+        // Distance の平均が最も大きい候補を採用 (ただし avg_dist < -5 の条件付き)
+        double max_distance_val = -std::numeric_limits<double>::infinity();
+        std::string best_file;
+        double best_score = 0.0;
+        for (int i = 0; i < top_n; i++) {
+            std::string candidate_file = scores[i].first;
+            double candidate_score = scores[i].second;
+            double avg_dist = distanceAverageOf(candidate_file);
+            if (avg_dist > max_distance_val && avg_dist < -5) {
+                max_distance_val = avg_dist;
+                best_file = candidate_file;
+                best_score = candidate_score;
+            }
+        }
+        chosenFile = best_file;
+        min_score = best_score;
+        std::cout << "[Selected file (寄り)] " << chosenFile 
+                << " with DistanceAvg = " << max_distance_val 
+                << ", Score = " << min_score << std::endl;
+    
+    } else if (currentMode == 3) {
+        // Mode 3: 動きが多いカメラワーク
+        // Camera Movement (カメラ位置の移動距離) が最も大きい候補を採用
+        double max_camera_movement = -1.0;
+        std::string best_file;
+        double best_score = 0.0;
+        for (int i = 0; i < top_n; i++) {
+            std::string candidate_file = scores[i].first;
+            double candidate_score = scores[i].second;
+            double movement_distance = movementOf(candidate_file);
+            if (movement_distance > max_camera_movement) {
+                max_camera_movement = movement_distance;
+                best_file = candidate_file;
+                best_score = candidate_score;
+            }
+        }
+        chosenFile = best_file;
+        min_score = best_score;
+        std::cout << "[Selected file (カメラ移動最大)] " << chosenFile 
+                  << " with Camera Movement = " << max_camera_movement 
+                  << ", Score = " << min_score << std::endl;
+    } else if (currentMode == 4) {
+        // Mode 4: 動きが少ないカメラワーク
+        // Camera Movement が最も小さい候補を採用
+        double min_camera_movement = 100.0; // 適切な初期値を設定
+        std::string best_file;
+        double best_score = 0.0;
+        for (int i = 0; i < top_n; i++) {
+            std::string candidate_file = scores[i].first;
+            double candidate_score = scores[i].second;
+            double movement_distance = movementOf(candidate_file);
+            if (movement_distance < min_camera_movement) {
+                min_camera_movement = movement_distance;
+                best_file = candidate_file;
+                best_score = candidate_score;
+            }
+        }
+        chosenFile = best_file;
+        min_score = best_score;
+        std::cout << "[Selected file (カメラ移動最小)] " << chosenFile 
+                    << " with Camera Movement = " << min_camera_movement 
+                    << ", Score = " << min_score << std::endl;
+
+    } else if (currentMode == 5) {
+        // Mode 5: 視点引き (mode==1) と 動き多め (mode==3) の両方を考慮
+        std::unordered_map<std::string, int> rank_mode1;
+        std::unordered_map<std::string, int> rank_mode3;
+        
+        // 視点引き (mode==1) の評価: Distance の平均が小さい順にソート
+        std::vector<std::pair<std::string, double>> sorted_mode1(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode1.begin(), sorted_mode1.end(), [&](const auto &a, const auto &b) {
+            return distanceAverageOf(a.first) <
+                    distanceAverageOf(b.first);
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode1.size()); ++rank) {
+            rank_mode1[sorted_mode1[rank - 1].first] = rank;
+        }
+        
+        // 動き多め (mode==3) の評価: Camera Movement が大きい順にソート
+        std::vector<std::pair<std::string, double>> sorted_mode3(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode3.begin(), sorted_mode3.end(), [&](const auto &a, const auto &b) {
+            return movementOf(a.first) >
+                    movementOf(b.first);
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode3.size()); ++rank) {
+            rank_mode3[sorted_mode3[rank - 1].first] = rank;
+        }
+        
+        // 合計ランクの計算
+        std::unordered_map<std::string, int> rank_sum;
+        for (const auto &p : rank_mode1) {
+            if (rank_mode3.find(p.first) != rank_mode3.end())
+                rank_sum[p.first] = p.second + rank_mode3[p.first];
+        }
+        int min_rank = std::numeric_limits<int>::max();
+        std::string best_file;
+        for (const auto &p : rank_sum) {
+            if (p.second < min_rank) {
+                min_rank = p.second;
+                best_file = p.first;
+            }
+        }
+        chosenFile = best_file;
+        min_score = static_cast<double>(min_rank);
+        std::cout << "[Selected file (視点引き + 動き多め)] " << chosenFile 
+                    << " with rank sum = " << min_rank << std::endl;
+
+    } else if (currentMode == 6) {
+        // Mode 6: 視点寄り (mode==2) と 動き多め (mode==3) の両方を考慮
+        std::unordered_map<std::string, int> rank_mode2;
+        std::unordered_map<std::string, int> rank_mode3;
+        
+        // 視点寄り (mode==2) の評価: 特定条件付きソート
+        std::vector<std::pair<std::string, double>> sorted_mode2(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode2.begin(), sorted_mode2.end(), [&](const auto &a, const auto &b) {
+            double pa = movementOf(a.first);
+            double pb = movementOf(b.first);
+            if ((pa > -5) != (pb > -5)) {
+                return (pa <= -5);  // 値が -5 以下のものを優先
+            } else {
+                double da = distanceAverageOf(a.first);
+                double db = distanceAverageOf(b.first);
+                return da > db; 
+            }
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode2.size()); ++rank) {
+            rank_mode2[sorted_mode2[rank - 1].first] = rank;
+        }
+        
+        // 動き多め (mode==3) の評価: Camera Movement が大きい順
+        std::vector<std::pair<std::string, double>> sorted_mode3(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode3.begin(), sorted_mode3.end(), [&](const auto &a, const auto &b) {
+            return movementOf(a.first) >
+                    movementOf(b.first);
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode3.size()); ++rank) {
+            rank_mode3[sorted_mode3[rank - 1].first] = rank;
+        }
+        
+        std::unordered_map<std::string, int> rank_sum;
+        for (const auto &p : rank_mode2) {
+            if (rank_mode3.find(p.first) != rank_mode3.end())
+                rank_sum[p.first] = p.second + rank_mode3[p.first];
+        }
+        int min_rank = std::numeric_limits<int>::max();
+        std::string best_file;
+        for (const auto &p : rank_sum) {
+            if (p.second < min_rank) {
+                min_rank = p.second;
+                best_file = p.first;
+            }
+        }
+        chosenFile = best_file;
+        min_score = static_cast<double>(min_rank);
+        std::cout << "[Selected file (視点寄り + 動き多め)] " << chosenFile 
+                    << " with rank sum = " << min_rank << std::endl;
+
+    } else if (currentMode == 7) {
+        // Mode 7: 視点引き (mode==1) と 動き少なめ (mode==4) の両方を考慮
+        std::unordered_map<std::string, int> rank_mode1;
+        std::unordered_map<std::string, int> rank_mode4;
+        
+        std::vector<std::pair<std::string, double>> sorted_mode1(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode1.begin(), sorted_mode1.end(), [&](const auto &a, const auto &b) {
+            return distanceAverageOf(a.first) <
+                    distanceAverageOf(b.first);
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode1.size()); ++rank) {
+            rank_mode1[sorted_mode1[rank - 1].first] = rank;
+        }
+        
+        std::vector<std::pair<std::string, double>> sorted_mode4(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode4.begin(), sorted_mode4.end(), [&](const auto &a, const auto &b) {
+            return movementOf(a.first) <
+                    movementOf(b.first);
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode4.size()); ++rank) {
+            rank_mode4[sorted_mode4[rank - 1].first] = rank;
+        }
+        
+        std::unordered_map<std::string, int> rank_sum;
+        for (const auto &p : rank_mode1) {
+            if (rank_mode4.find(p.first) != rank_mode4.end())
+                rank_sum[p.first] = p.second + rank_mode4[p.first];
+        }
+        int min_rank = std::numeric_limits<int>::max();
+        std::string best_file;
+        for (const auto &p : rank_sum) {
+            if (p.second < min_rank) {
+                min_rank = p.second;
+                best_file = p.first;
+            }
+        }
+        chosenFile = best_file;
+        min_score = static_cast<double>(min_rank);
+        std::cout << "[Selected file (視点引き + 動き少なめ)] " << chosenFile 
+                    << " with rank sum = " << min_rank << std::endl;
+    } else if (currentMode == 8) {
+        // Mode 8: 視点寄り (mode==2) と 動き少なめ (mode==4) の両方を考慮
+        std::unordered_map<std::string, int> rank_mode2;
+        std::unordered_map<std::string, int> rank_mode4;
+        
+        std::vector<std::pair<std::string, double>> sorted_mode2(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode2.begin(), sorted_mode2.end(), [&](const auto &a, const auto &b) {
+            double pa = movementOf(a.first);
+            double pb = movementOf(b.first);
+            if ((pa > -5) != (pb > -5)) {
+                return (pa <= -5);
+            } else {
+                double da = distanceAverageOf(a.first);
+                double db = distanceAverageOf(b.first);
+                return da > db;
+            }
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode2.size()); ++rank) {
+            rank_mode2[sorted_mode2[rank - 1].first] = rank;
+        }
+        
+        std::vector<std::pair<std::string, double>> sorted_mode4(scores.begin(), scores.begin() + top_n);
+        std::sort(sorted_mode4.begin(), sorted_mode4.end(), [&](const auto &a, const auto &b) {
+            return movementOf(a.first) <
+                    movementOf(b.first);
+        });
+        for (int rank = 1; rank <= static_cast<int>(sorted_mode4.size()); ++rank) {
+            rank_mode4[sorted_mode4[rank - 1].first] = rank;
+        }
+        
+        std::unordered_map<std::string, int> rank_sum;
+        for (const auto &p : rank_mode2) {
+            if (rank_mode4.find(p.first) != rank_mode4.end())
+                rank_sum[p.first] = p.second + rank_mode4[p.first];
+        }
+        int min_rank = std::numeric_limits<int>::max();
+        std::string best_file;
+        for (const auto &p : rank_sum) {
+            if (p.second < min_rank) {
+                min_rank = p.second;
+                best_file = p.first;
+            }
+        }
+        chosenFile = best_file;
+        min_score = static_cast<double>(min_rank);
+        std::cout << "[Selected file (視点寄り + 動き少なめ)] " << chosenFile 
+                    << " with rank sum = " << min_rank << std::endl;
+    } else {
+        // その他（ミックス視点）：スコア最小の候補をそのまま採用
+        chosenFile = scores[0].first;
+        min_score = scores[0].second;
+        std::cout << "[Selected file (ミックス: Score最小)] " << chosenFile 
+                    << " with score = " << min_score << std::endl;
+    }
+    cout << "選択ファイル: " << chosenFile;
+    if (options.slidingOffset)
+        cout << " (offset " << offsetOf(chosenFile) << ")";
+    cout << "\n";
+    result.choice = {chosenFile, offsetOf(chosenFile)};
+    return result;
+}
+
+namespace {
+
+// 集めた距離を正規化してスコアを求め、mode に応じて採用するファイルを選ぶ
+SegmentSearchResult selectCandidate(const Database &db,
+                                    const SegmentQuery &q,
+                                    size_t segIndex,
+                                    int currentMode,
+                                    const SearchOptions &options) {
+    return chooseCandidate(db, rankColumns(q.columns(), options, q.arena), q.inputSegment.size(), segIndex,
+                           currentMode, options);
+}
+
+// deadline までに調べた候補で 1 セグメント分の検索を行う（作業領域は arena から切り出す）
+SegmentSearchResult searchSegmentUntil(const Database &db,
+                                       const string &inputNumber,
+                                       FrameSpan inputSegment,
+                                       FrameSpan hipSegment,
+                                       MusicSpan inputMusicSegment,
+                                       double segmentBpmInput,
+                                       size_t segIndex,
+                                       int currentMode,
+                                       const SearchOptions &options,
+                                       SearchClock::time_point deadline,
+                                       Arena &arena) {
+    // データベースの各区間を走査
+    vector<CandidateWindow> candidates = enumerateCandidates(db, inputNumber, inputSegment.size(), options);
+    SegmentQuery q(db, candidates, inputSegment, hipSegment, inputMusicSegment, segmentBpmInput, options, arena);
+    uint64_t allocationsBefore = heapAllocationCount();
+    size_t examined = scoreCandidates(q, options, deadline);
+    uint64_t scanAllocations = heapAllocationCount() - allocationsBefore;
+    if (deadline != SearchClock::time_point::max()) {
+        cout << "[INFO] セグメント " << segIndex << ": 時間の上限までに候補 " << examined << "/" << candidates.size()
+             << " を評価" << endl;
+    }
+    SegmentSearchResult result = selectCandidate(db, q, segIndex, currentMode, options);
+    result.candidatesExamined = examined;
+    result.candidatesTotal = candidates.size();
+    result.scanAllocations = scanAllocations;
+    return result;
+}
+
+// 時間の上限 budgetMs（0 以下なら上限なし）の期限
+SearchClock::time_point deadlineAfter(double budgetMs) {
+    if (budgetMs <= 0.0)
+        return SearchClock::time_point::max();
+    return SearchClock::now() + chrono::duration_cast<SearchClock::duration>(chrono::duration<double, milli>(budgetMs));
+}
+
+} // namespace
+
+// 1 セグメント分の類似ファイル検索
+// データベースの各候補とのスコアを計算し、mode に応じて採用するファイルを選ぶ
+// options.timeBudgetMs > 0 なら、このセグメントの検索にその時間までかける
+SegmentSearchResult searchSegment(const Database &db,
+                                  const string &inputNumber,
+                                  FrameSpan inputSegment,
+                                  FrameSpan hipSegment,
+                                  MusicSpan inputMusicSegment,
+                                  double segmentBpmInput,
+                                  size_t segIndex,
+                                  int currentMode,
+                                  const SearchOptions &options) {
+    Arena arena;
+    return searchSegmentUntil(db, inputNumber, inputSegment, hipSegment, inputMusicSegment, segmentBpmInput, segIndex,
+                              currentMode, options, deadlineAfter(options.timeBudgetMs), arena);
+}
+
+// 1 セグメント分の候補ごとの距離を求める（正規化・選択はしない）
+CandidateDistances computeCandidateDistances(const Database &db,
+                                             const string &inputNumber,
+                                             FrameSpan inputSegment,
+                                             FrameSpan hipSegment,
+                                             MusicSpan inputMusicSegment,
+                                             double segmentBpmInput,
+                                             const SearchOptions &options) {
+    Arena arena;
+    vector<CandidateWindow> candidates = enumerateCandidates(db, inputNumber, inputSegment.size(), options);
+    SegmentQuery q(db, candidates, inputSegment, hipSegment, inputMusicSegment, segmentBpmInput, options, arena);
+    scoreCandidates(q, options, SearchClock::time_point::max());
+    return q.distances();
+}
+
+// 選択ファイルの root と入力の root の差分から、各フレームの平行移動を計算して追加する
+void appendSegmentTranslations(const Database &db,
+                               FrameSpan rawSegment,
+                               const SegmentChoice &choice,
+                               int segmentLen,
+                               vector<array<double, 3>> &translations) {
+    ClipWindow window;
+    if (!db.resolveWindow(choice.file, window))
+        return;
+    const vector<FrameData> &dbFrames = window.motion->raw;
+    size_t windowEnd = min((size_t)max(window.end, window.start), dbFrames.size());
+    size_t first = min((size_t)max(window.start + choice.offset, 0), windowEnd);
+    size_t count = min({windowEnd - first, (size_t)max(segmentLen, 0), rawSegment.size()});
+    // 各フレームごとの平行移動（root の差分）を計算
+    for (size_t i = 0; i < count; i++) {
+        array<double, 3> rootInput = rawSegment[i].positions[0];
+        array<double, 3> rootChosen = dbFrames[first + i].positions[0];
+        array<double, 3> trans = {rootInput[0] - rootChosen[0],
+                                  rootInput[1] - rootChosen[1],
+                                  rootInput[2] - rootChosen[2]};
+        translations.push_back(trans);
+    }
+}
+
+namespace {
+
+// 候補カメラのセグメント境界での状態（平行移動込みの位置・FOV・Distance）
+struct CameraBoundaryState {
+    bool valid = false;
+    array<double, 3> startPos = {0.0, 0.0, 0.0};
+    array<double, 3> endPos = {0.0, 0.0, 0.0};
+    double startFov = 0.0, endFov = 0.0;
+    double startDistance = 0.0, endDistance = 0.0;
+};
+
+// 候補の先頭・末尾フレームでのカメラ状態を求める
+// 位置には入力と候補の root の差分（平滑化前の平行移動）を加える
+CameraBoundaryState computeBoundaryState(const Database &db,
+                                         const CandidateScore &cand,
+                                         FrameSpan rawSegment) {
+    CameraBoundaryState state;
+    ClipWindow window;
+    const CameraClip *track = db.resolveWindow(cand.file, window) ? window.camera : nullptr;
+    if (rawSegment.empty() || !track)
+        return state;
+    int trackLen = min({track->eyeFrames(), track->fovFrames(), track->distanceFrames()});
+    int startIndex = window.start + cand.offset;
+    int endIndex = min(startIndex + (int)rawSegment.size(), trackLen) - 1;
+    if (startIndex < 0 || endIndex < startIndex)
+        return state;
+    const vector<FrameData> &dbFrames = window.motion->raw;
+    int first = startIndex;
+    int last = min({startIndex + (int)rawSegment.size(), window.end, (int)dbFrames.size()}) - 1;
+    if (last < first)
+        return state;
+    const auto &inFirst = rawSegment.front().positions[0];
+    const auto &inLast = rawSegment[min((int)rawSegment.size(), last - first + 1) - 1].positions[0];
+    const auto &dbFirst = dbFrames[first].positions[0];
+    const auto &dbLast = dbFrames[last].positions[0];
+    array<double, 3> eyeFirst = track->eye(startIndex);
+    array<double, 3> eyeLast = track->eye(endIndex);
+    for (int d = 0; d < 3; d++) {
+        state.startPos[d] = eyeFirst[d] + (inFirst[d] - dbFirst[d]);
+        state.endPos[d] = eyeLast[d] + (inLast[d] - dbLast[d]);
+    }
+    state.startFov = track->fov(startIndex);
+    state.endFov = track->fov(endIndex);
+    state.startDistance = track->distance(startIndex);
+    state.endDistance = track->distance(endIndex);
+    state.valid = true;
+    return state;
+}
+
+} // namespace
+
+// セグメントごとの上位候補から、つなぎ目も考慮して全体で最適な組み合わせを選ぶ (Viterbi)
+// コスト = Σ (候補スコア + mode ペナルティ) + transitionWeight × Σ つなぎ目コスト
+// つなぎ目コストは前セグメント末尾と次セグメント先頭のカメラ状態の差
+// （位置の跳び・FOV の跳び・Distance の変化）を、それぞれ全候補対の平均で割って足し合わせたもの。
+// 境界状態は候補ごとに 1 回だけ求めるので、DP 自体は セグメント数 × K² の四則演算で済む。
+vector<SegmentChoice> selectGlobalPath(const Database &db,
+                                       const vector<SegmentSearchResult> &searchResults,
+                                       const vector<FrameSpan> &rawInputSegments,
+                                       const SearchOptions &options) {
+    size_t numSegments = searchResults.size();
+    // 候補の列と単独コスト、境界状態を用意する
+    vector<vector<CandidateScore>> states(numSegments);
+    vector<vector<double>> unary(numSegments);
+    vector<vector<CameraBoundaryState>> boundary(numSegments);
+    for (size_t s = 0; s < numSegments; s++) {
+        const auto &sr = searchResults[s];
+        int k = min((int)sr.topCandidates.size(), options.globalTopK);
+        for (int i = 0; i < k; i++)
+            states[s].push_back(sr.topCandidates[i]);
+        if (states[s].empty())
+            states[s].push_back({sr.choice.file, 0.0, sr.choice.offset});
+        for (const auto &cand : states[s]) {
+            double penalty = (cand.file == sr.choice.file) ? 0.0 : options.modePenalty;
+            unary[s].push_back(cand.score + penalty);
+            boundary[s].push_back(computeBoundaryState(db, cand, rawInputSegments[s]));
+        }
+    }
+
+    // 全候補対のつなぎ目の差を求め、項ごとの平均でスケールをそろえる
+    // jumps[s][i][j][c]: セグメント s の候補 i → セグメント s+1 の候補 j の差（c = 位置, FOV, Distance）
+    vector<vector<vector<array<double, 3>>>> jumps(numSegments > 0 ? numSegments - 1 : 0);
+    array<double, 3> sum = {0.0, 0.0, 0.0};
+    int count = 0;
+    for (size_t s = 0; s + 1 < numSegments; s++) {
+        jumps[s].assign(states[s].size(), vector<array<double, 3>>(states[s + 1].size(), {0.0, 0.0, 0.0}));
+        for (size_t i = 0; i < states[s].size(); i++) {
+            const auto &a = boundary[s][i];
+            for (size_t j = 0; j < states[s + 1].size(); j++) {
+                const auto &b = boundary[s + 1][j];
+                if (!a.valid || !b.valid)
+                    continue;
+                double dx = b.startPos[0] - a.endPos[0];
+                double dy = b.startPos[1] - a.endPos[1];
+                double dz = b.startPos[2] - a.endPos[2];
+                array<double, 3> jump = {sqrt(dx * dx + dy * dy + dz * dz),
+                                         fabs(b.startFov - a.endFov),
+                                         fabs(b.startDistance - a.endDistance)};
+                jumps[s][i][j] = jump;
+                for (int c = 0; c < 3; c++)
+                    sum[c] += jump[c];
+                count++;
+            }
+        }
+    }
+    array<double, 3> invMean = {0.0, 0.0, 0.0};
+    for (int c = 0; c < 3; c++) {
+        if (count > 0 && sum[c] > 0.0)
+            invMean[c] = count / sum[c];
+    }
+
+    // DP
+    vector<vector<double>> cost(numSegments);
+    vector<vector<int>> back(numSegments);
+    for (size_t s = 0; s < numSegments; s++) {
+        size_t k = states[s].size();
+        cost[s].assign(k, numeric_limits<double>::infinity());
+        back[s].assign(k, -1);
+        for (size_t j = 0; j < k; j++) {
+            if (s == 0) {
+                cost[s][j] = unary[s][j];
+                continue;
+            }
+            for (size_t i = 0; i < states[s - 1].size(); i++) {
+                const auto &jump = jumps[s - 1][i][j];
+                double transition = (jump[0] * invMean[0] + jump[1] * invMean[1] + jump[2] * invMean[2]) / 3.0;
+                double c = cost[s - 1][i] + options.transitionWeight * transition;
+                if (c < cost[s][j]) {
+                    cost[s][j] = c;
+                    back[s][j] = i;
+                }
+            }
+            cost[s][j] += unary[s][j];
+        }
+    }
+
+    // 経路の復元
+    vector<SegmentChoice> choices(numSegments);
+    if (numSegments == 0)
+        return choices;
+    int best = min_element(cost.back().begin(), cost.back().end()) - cost.back().begin();
+    for (size_t s = numSegments; s-- > 0;) {
+        const auto &cand = states[s][best];
+        choices[s] = {cand.file, cand.offset};
+        best = back[s][best];
+    }
+    cout << "----- Global selection (Viterbi) -----\n";
+    for (size_t s = 0; s < numSegments; s++) {
+        cout << "   Segment " << s << ": " << choices[s].file;
+        if (choices[s].file != searchResults[s].choice.file)
+            cout << " (変更: " << searchResults[s].choice.file << ")";
+        cout << "\n";
+    }
+    return choices;
+}
+
+PreparedInput prepareInput(const InputData &input, const vector<int> &frameIntervals) {
+    PreparedInput prepared;
+
+    // 入力側の音楽特徴量と BPM をセグメントごとに抽出する
+    int segStartFrame = 0;
+    for (auto segLen : frameIntervals) {
+        int segEndFrame = segStartFrame + segLen;
+        prepared.inputBpmList.push_back(calculateAverageBpmInInterval(input.beats, segStartFrame, segEndFrame, 30));
+        int musicStart = min(segStartFrame, (int)input.music.size());
+        int musicEnd = min(segEndFrame, (int)input.music.size());
+        prepared.inputMusicSegments.push_back(MusicSpan(input.music).subspan(musicStart, max(0, musicEnd - musicStart)));
+        segStartFrame = segEndFrame;
+    }
+
+    prepared.rawInputSegments = sliceByFrameIntervals(input.raw, frameIntervals);
+    prepared.inputSegments = sliceByFrameIntervals(input.stand, frameIntervals);
+    prepared.hipSegments = sliceByFrameIntervals(input.hip, frameIntervals);
+    return prepared;
+}
+
+// セグメントごとの検索結果から、全体最適化・平行移動の計算（平滑化まで）を行う
+void finishSearch(const Database &db, const PreparedInput &prepared, const SearchOptions &options,
+                  SearchResult &result) {
+    for (const auto &sr : result.segments)
+        result.choices.push_back(sr.choice);
+    // つなぎ目を考慮した全体最適化
+    if (options.globalSelection)
+        result.choices = selectGlobalPath(db, result.segments, prepared.rawInputSegments, options);
+
+    for (size_t segIndex = 0; segIndex < result.choices.size(); segIndex++) {
+        int segmentLen = prepared.inputSegments[segIndex].size();
+        appendSegmentTranslations(db, prepared.rawInputSegments[segIndex], result.choices[segIndex], segmentLen,
+                                  result.translations);
+        result.lengths.push_back(segmentLen);
+    }
+    // 全フレームの translations にガウスフィルタを適用
+    result.translations = applyGaussianFilter(result.translations, options.sigma);
+}
+
+// メインの類似ファイル検索
+SearchResult searchSegments(const Database &db,
+                            const InputData &input,
+                            const vector<int> &frameIntervals,
+                            const vector<int> &modes,
+                            const SearchOptions &options) {
+    SearchResult result;
+    PreparedInput prepared = prepareInput(input, frameIntervals);
+
+    // 各セグメントごとに類似ファイルを検索
+    // 時間の上限があるときは、残り時間を残りのセグメントで等分して各セグメントの期限にする
+    // 作業領域はセグメントごとに空にして使い回すので、2 つ目以降のセグメントの走査ではヒープ確保が起きない
+    SearchClock::time_point end = deadlineAfter(options.timeBudgetMs);
+    size_t numSegments = prepared.inputSegments.size();
+    Arena arena;
+    for (size_t segIndex = 0; segIndex < numSegments; segIndex++) {
+        arena.reset();
+        double segmentBpmInput = (segIndex < prepared.inputBpmList.size()) ? prepared.inputBpmList[segIndex] : 0.0;
+        int currentMode = (segIndex < modes.size()) ? modes[segIndex] : 10;
+        SearchClock::time_point deadline = end;
+        if (end != SearchClock::time_point::max()) {
+            SearchClock::time_point now = SearchClock::now();
+            deadline = now + max(end - now, SearchClock::duration::zero()) / (numSegments - segIndex);
+        }
+        result.segments.push_back(searchSegmentUntil(db, input.inputNumber, prepared.inputSegments[segIndex],
+                                                     prepared.hipSegments[segIndex],
+                                                     prepared.inputMusicSegments[segIndex], segmentBpmInput, segIndex,
+                                                     currentMode, options, deadline, arena));
+    }
+    finishSearch(db, prepared, options, result);
+    return result;
+}
+
+// 複数の入力をまとめて検索する
+// データベースの走査単位（切り出し区間、clipWindows のときはクリップ）ごとに、
+// 全入力の全セグメントについてその単位の候補との距離を計算してから次の単位に進む。
+// 候補のデータがキャッシュにある間に全セグメントと比較するので、データベースの読み出しはバッチ全体で 1 回になる。
+// 正規化と候補の選択はセグメントごとに行うので、結果は searchSegments を入力ごとに呼んだものと同じ。
+vector<SearchResult> searchSegmentsBatch(const Database &db,
+                                         const vector<SearchRequest> &requests,
+                                         const SearchOptions &options) {
+    vector<PreparedInput> prepared;
+    for (const auto &req : requests)
+        prepared.push_back(prepareInput(req.input, req.frameIntervals));
+
+    // 候補の列挙は除外番号とセグメント長で決まるので、同じものは使い回す
+    map<pair<string, int>, vector<CandidateWindow>> candidateLists;
+    Arena arena;
+    struct PendingQuery {
+        size_t request;
+        size_t segIndex;
+        unique_ptr<SegmentQuery> query;
+        const vector<CandidateWindow> *candidates;
+        size_t cursor;
+    };
+    vector<PendingQuery> pending;
+    for (size_t r = 0; r < requests.size(); r++) {
+        const PreparedInput &p = prepared[r];
+        for (size_t segIndex = 0; segIndex < p.inputSegments.size(); segIndex++) {
+            double segmentBpmInput = (segIndex < p.inputBpmList.size()) ? p.inputBpmList[segIndex] : 0.0;
+            int segmentLen = p.inputSegments[segIndex].size();
+            pair<string, int> key(requests[r].input.inputNumber, options.clipWindows ? segmentLen : 0);
+            auto it = candidateLists.find(key);
+            if (it == candidateLists.end())
+                it = candidateLists.emplace(key, enumerateCandidates(db, key.first, segmentLen, options)).first;
+            pending.push_back({r, segIndex,
+                               make_unique<SegmentQuery>(db, it->second, p.inputSegments[segIndex],
+                                                         p.hipSegments[segIndex], p.inputMusicSegments[segIndex],
+                                                         segmentBpmInput, options, arena),
+                               &it->second, 0});
+        }
+    }
+
+    // データベースを 1 回だけ走査する
+    size_t numUnits = options.clipWindows ? db.clips.size() : db.segments.size();
+    for (size_t unit = 0; unit < numUnits; unit++) {
+        for (auto &pq : pending) {
+            const vector<CandidateWindow> &cands = *pq.candidates;
+            for (; pq.cursor < cands.size() && cands[pq.cursor].unit == unit; pq.cursor++)
+                scoreCandidate(pq.cursor, *pq.query, options);
+        }
+    }
+
+    vector<SearchResult> results(requests.size());
+    for (auto &pq : pending) {
+        const vector<int> &modes = requests[pq.request].modes;
+        int currentMode = (pq.segIndex < modes.size()) ? modes[pq.segIndex] : 10;
+        SegmentSearchResult sr = selectCandidate(db, *pq.query, pq.segIndex, currentMode, options);
+        sr.candidatesExamined = sr.candidatesTotal = pq.candidates->size();
+        results[pq.request].segments.push_back(move(sr));
+    }
+    for (size_t r = 0; r < requests.size(); r++)
+        finishSearch(db, prepared[r], options, results[r]);
+    return results;
+}
+
+namespace {
+
+// 同順位は平均順位にする
+vector<double> ranksOf(const vector<double> &values) {
+    vector<size_t> order(values.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+    vector<double> ranks(values.size());
+    for (size_t i = 0; i < order.size();) {
+        size_t j = i;
+        while (j + 1 < order.size() && values[order[j + 1]] == values[order[i]])
+            j++;
+        for (size_t k = i; k <= j; k++)
+            ranks[order[k]] = (i + j) / 2.0;
+        i = j + 1;
+    }
+    return ranks;
+}
+
+double spearman(const vector<double> &a, const vector<double> &b) {
+    vector<double> ra = ranksOf(a), rb = ranksOf(b);
+    size_t n = ra.size();
+    if (n < 2)
+        return 1.0;
+    double ma = 0.0, mb = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        ma += ra[i];
+        mb += rb[i];
+    }
+    ma /= n;
+    mb /= n;
+    double sab = 0.0, saa = 0.0, sbb = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sab += (ra[i] - ma) * (rb[i] - mb);
+        saa += (ra[i] - ma) * (ra[i] - ma);
+        sbb += (rb[i] - mb) * (rb[i] - mb);
+    }
+    return (saa > 0.0 && sbb > 0.0) ? sab / sqrt(saa * sbb) : 1.0;
+}
+
+vector<size_t> topIndices(const vector<double> &values, size_t k) {
+    vector<size_t> order(values.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    k = min(k, order.size());
+    partial_sort(order.begin(), order.begin() + k, order.end(),
+                 [&](size_t a, size_t b) { return values[a] < values[b]; });
+    order.resize(k);
+    return order;
+}
+
+} // namespace
+
+// 姿勢の距離を 2 通りで計算して比べる
+vector<MetricComparison> compareMotionMetrics(const Database &db,
+                                              const InputData &input,
+                                              const vector<int> &frameIntervals,
+                                              const SearchOptions &options) {
+    SearchOptions jointOptions = options;
+    jointOptions.squaredL2 = false;
+    SearchOptions l2Options = options;
+    l2Options.squaredL2 = true;
+    // 特徴量の作成（PCA を含む）は比較の時間に含めない
+    db.poseIndex(options.pcaComponents);
+
+    PreparedInput prepared = prepareInput(input, frameIntervals);
+    vector<MetricComparison> comparisons;
+    Arena arena;
+    for (size_t segIndex = 0; segIndex < prepared.inputSegments.size(); segIndex++) {
+        double segmentBpmInput = (segIndex < prepared.inputBpmList.size()) ? prepared.inputBpmList[segIndex] : 0.0;
+        vector<CandidateWindow> cands =
+            enumerateCandidates(db, input.inputNumber, prepared.inputSegments[segIndex].size(), options);
+        arena.reset();
+
+        SegmentQuery jointQuery(db, cands, prepared.inputSegments[segIndex], prepared.hipSegments[segIndex],
+                                prepared.inputMusicSegments[segIndex], segmentBpmInput, jointOptions, arena);
+        auto t0 = chrono::steady_clock::now();
+        scoreCandidates(jointQuery, jointOptions, SearchClock::time_point::max());
+        auto t1 = chrono::steady_clock::now();
+        SegmentQuery l2Query(db, cands, prepared.inputSegments[segIndex], prepared.hipSegments[segIndex],
+                             prepared.inputMusicSegments[segIndex], segmentBpmInput, l2Options, arena);
+        scoreCandidates(l2Query, l2Options, SearchClock::time_point::max());
+        auto t2 = chrono::steady_clock::now();
+
+        // どちらも同じ候補を同じ順に並べる
+        vector<double> a = jointQuery.distances().segmentDistances;
+        vector<double> b = l2Query.distances().segmentDistances;
+        MetricComparison c;
+        c.segIndex = segIndex;
+        c.numCandidates = a.size();
+        c.jointMs = chrono::duration<double, milli>(t1 - t0).count();
+        c.squaredL2Ms = chrono::duration<double, milli>(t2 - t1).count();
+        if (!a.empty() && a.size() == b.size()) {
+            c.rankCorrelation = spearman(a, b);
+            vector<size_t> topA = topIndices(a, 5), topB = topIndices(b, 5);
+            for (size_t i : topA)
+                c.topOverlap += count(topB.begin(), topB.end(), i);
+            c.sameBest = (topA[0] == topB[0]);
+        }
+        comparisons.push_back(c);
+    }
+    return comparisons;
+}
+
+// 検索結果の候補リストから、別案のカメラワークを count 個作る
+// 0 番目は result そのもの。k 番目は各セグメントで、0 ～ k-1 番目の案に使われていないクリップの候補
+// （なければ使われていないファイルの候補）から、元と同じ mode で chooseCandidate により選ぶ
+// （mode で選べなければ残りのうち最もスコアの良い候補、候補が尽きたら元の選択）。
+// options.globalSelection のときは、残りの候補でつなぎ目を考慮した全体最適化をやり直す。
+// 距離計算はやり直さず、候補の選び直しと平行移動の計算・平滑化だけを行う。
+vector<SearchResult> buildAlternativeResults(const Database &db,
+                                             const InputData &input,
+                                             const SearchResult &result,
+                                             int count,
+                                             const SearchOptions &options) {
+    vector<SearchResult> alternatives;
+    if (count <= 0)
+        return alternatives;
+    alternatives.push_back(result);
+    vector<FrameSpan> rawInputSegments = sliceByFrameIntervals(input.raw, result.lengths);
+    size_t numSegments = result.choices.size();
+    vector<set<string>> usedClips(numSegments), usedFiles(numSegments);
+    for (size_t s = 0; s < numSegments; s++) {
+        usedClips[s].insert(clipNumberOf(result.choices[s].file));
+        usedFiles[s].insert(result.choices[s].file);
+    }
+    for (int k = 1; k < count; k++) {
+        cout << "----- Alternative " << k << " -----\n";
+        SearchResult alt;
+        alt.segments = result.segments;
+        alt.lengths = result.lengths;
+        // 各セグメントで、まだ使われていない候補だけを残して mode で選び直す
+        vector<SegmentSearchResult> remaining(numSegments);
+        for (size_t s = 0; s < numSegments; s++) {
+            const SegmentSearchResult &sr = result.segments[s];
+            vector<CandidateScore> unused;
+            for (const auto &cand : sr.topCandidates) {
+                if (!usedClips[s].count(clipNumberOf(cand.file)))
+                    unused.push_back(cand);
+            }
+            if (unused.empty()) {
+                for (const auto &cand : sr.topCandidates) {
+                    if (!usedFiles[s].count(cand.file))
+                        unused.push_back(cand);
+                }
+            }
+            if (unused.empty()) {
+                remaining[s].choice = result.choices[s];
+                remaining[s].mode = sr.mode;
+                continue;
+            }
+            remaining[s] = chooseCandidate(db, unused, result.lengths[s], s, sr.mode, options);
+            if (remaining[s].choice.file.empty())
+                remaining[s].choice = {unused[0].file, unused[0].offset};
+        }
+        if (options.globalSelection) {
+            alt.choices = selectGlobalPath(db, remaining, rawInputSegments, options);
+        } else {
+            for (const auto &sr : remaining)
+                alt.choices.push_back(sr.choice);
+        }
+        for (size_t s = 0; s < numSegments; s++) {
+            const SegmentChoice &choice = alt.choices[s];
+            usedClips[s].insert(clipNumberOf(choice.file));
+            usedFiles[s].insert(choice.file);
+            if (s < rawInputSegments.size())
+                appendSegmentTranslations(db, rawInputSegments[s], choice, result.lengths[s], alt.translations);
+        }
+        alt.translations = applyGaussianFilter(alt.translations, options.sigma);
+        alternatives.push_back(move(alt));
+    }
+    return alternatives;
+}
+
+} // namespace camsynth
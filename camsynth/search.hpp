@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "database.hpp"
+#include "kernels.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// 1 セグメント分の類似ファイル検索
+// データベースの各候補とのスコアを計算し、mode に応じて採用するファイルを選ぶ
+SegmentSearchResult searchSegment(const Database &db,
+                                  const std::string &inputNumber,
+                                  FrameSpan inputSegment,
+                                  FrameSpan hipSegment,
+                                  MusicSpan inputMusicSegment,
+                                  double segmentBpmInput,
+                                  size_t segIndex,
+                                  int currentMode,
+                                  const SearchOptions &options);
+
+// 1 セグメント分の候補ごとの距離を求める（正規化・選択はしない）
+CandidateDistances computeCandidateDistances(const Database &db,
+                                             const std::string &inputNumber,
+                                             FrameSpan inputSegment,
+                                             FrameSpan hipSegment,
+                                             MusicSpan inputMusicSegment,
+                                             double segmentBpmInput,
+                                             const SearchOptions &options);
+
+// 候補ごとの距離を正規化してスコアを求め、スコア順に上位候補（上位 5 件と、全体最適化・別案に使う分）を残す
+std::vector<CandidateScore> rankCandidates(const CandidateDistances &distances, const SearchOptions &options);
+
+// スコア順の上位候補から mode に応じて採用するファイルを選ぶ（db は上位候補のカメラデータだけあればよい）
+SegmentSearchResult chooseCandidate(const Database &db,
+                                    const std::vector<CandidateScore> &ranked,
+                                    int segmentLen,
+                                    size_t segIndex,
+                                    int currentMode,
+                                    const SearchOptions &options);
+
+// 選択ファイルの root と入力の root の差分から、各フレームの平行移動を計算して追加する
+void appendSegmentTranslations(const Database &db,
+                               FrameSpan rawSegment,
+                               const SegmentChoice &choice,
+                               int segmentLen,
+                               std::vector<std::array<double, 3>> &translations);
+
+// セグメントごとの上位候補から、つなぎ目も考慮して全体で最適な組み合わせを選ぶ (Viterbi)
+std::vector<SegmentChoice> selectGlobalPath(const Database &db,
+                                            const std::vector<SegmentSearchResult> &searchResults,
+                                            const std::vector<FrameSpan> &rawInputSegments,
+                                            const SearchOptions &options);
+
+// セグメントごとに切り分けた入力（コピーせずに InputData を指すので、元の入力より長く使わない）
+struct PreparedInput {
+    std::vector<FrameSpan> rawInputSegments;
+    std::vector<FrameSpan> inputSegments;
+    std::vector<FrameSpan> hipSegments;
+    std::vector<MusicSpan> inputMusicSegments;
+    std::vector<double> inputBpmList;
+};
+
+// 入力をフレーム間隔ごとに切り分け、セグメントごとの楽曲特徴量と BPM を求める
+PreparedInput prepareInput(const InputData &input, const std::vector<int> &frameIntervals);
+
+// セグメントごとの検索結果 (result.segments) から、全体最適化・平行移動の計算（平滑化まで）を行う
+void finishSearch(const Database &db, const PreparedInput &prepared, const SearchOptions &options,
+                  SearchResult &result);
+
+// 全セグメントの類似ファイル検索と平行移動の計算（平滑化まで）
+SearchResult searchSegments(const Database &db,
+                            const InputData &input,
+                            const std::vector<int> &frameIntervals,
+                            const std::vector<int> &modes,
+                            const SearchOptions &options);
+
+// 複数の入力をまとめて検索する（データベースの走査はバッチ全体で 1 回）
+// 結果は requests の順で、それぞれ searchSegments を呼んだものと同じ
+std::vector<SearchResult> searchSegmentsBatch(const Database &db,
+                                              const std::vector<SearchRequest> &requests,
+                                              const SearchOptions &options);
+
+// 姿勢の距離を既定のジョイント距離と二乗 L2 (options.pcaComponents を使う) の両方で計算し、
+// セグメントごとに候補の並びがどれだけ一致するかを比べる
+std::vector<MetricComparison> compareMotionMetrics(const Database &db,
+                                                   const InputData &input,
+                                                   const std::vector<int> &frameIntervals,
+                                                   const SearchOptions &options);
+
+// 検索結果の候補リストから、別案のカメラワークを count 個作る（0 番目は result そのもの）
+// 同じセグメントでは案ごとに異なるクリップを使い、残りの候補から元と同じ mode で選ぶ
+// （options.globalSelection なら全体最適化もやり直す）。距離計算はやり直さない。
+std::vector<SearchResult> buildAlternativeResults(const Database &db,
+                                                  const InputData &input,
+                                                  const SearchResult &result,
+                                                  int count,
+                                                  const SearchOptions &options);
+
+} // namespace camsynth
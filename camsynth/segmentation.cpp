@@ -0,0 +1,127 @@
+#include "segmentation.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "bvh.hpp"
+#include "msgpack_io.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+// ミリ秒 → フレーム数（Python の round と同じく偶数丸め）
+int millisecondsToFrames(double ms, int fps) {
+    return static_cast<int>(nearbyint(ms * fps / 1000));
+}
+
+bool inChorus(int frame, const vector<ChorusRange> &chorus) {
+    for (const ChorusRange &r : chorus) {
+        if (r.startFrame <= frame && frame <= r.endFrame)
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+vector<int> beatFrameIntervals(const vector<BeatData> &beats,
+                               size_t motionFrames,
+                               const vector<ChorusRange> &chorus,
+                               const SegmentationOptions &options) {
+    vector<double> downbeats;
+    for (const BeatData &b : beats) {
+        if (b.position == 1)
+            downbeats.push_back(b.startMs);
+    }
+
+    // 区切りの時刻 [ms]: 小節の頭の 3 個目、以降は 4 個目から downbeatsPerSegment 個おき
+    vector<int> intervals;
+    if (downbeats.size() >= 3) {
+        vector<double> times = {downbeats[2]};
+        for (size_t i = 3; i < downbeats.size();) {
+            times.push_back(downbeats[i]);
+            int step = inChorus(millisecondsToFrames(downbeats[i], options.fps), chorus)
+                           ? options.chorusDownbeatsPerSegment
+                           : options.downbeatsPerSegment;
+            i += max(1, step);
+        }
+        intervals.push_back(millisecondsToFrames(times[0], options.fps));
+        for (size_t i = 1; i < times.size(); i++)
+            intervals.push_back(millisecondsToFrames(times[i] - times[i - 1], options.fps));
+    }
+    if (motionFrames == 0)
+        return {};
+
+    long long total = 0;
+    for (int v : intervals)
+        total += v;
+    // モーションの終わり以降に始まるセグメントを除く
+    long long frames = static_cast<long long>(motionFrames);
+    while (!intervals.empty() && total - intervals.back() >= frames) {
+        total -= intervals.back();
+        intervals.pop_back();
+    }
+    // 差分を最後のセグメントに足す（大きければ 1 つのセグメントにする）
+    long long diff = frames - total;
+    if (intervals.empty())
+        intervals.push_back(static_cast<int>(frames));
+    else if (diff < options.mergeThreshold)
+        intervals.back() += static_cast<int>(diff);
+    else
+        intervals.push_back(static_cast<int>(diff));
+    return intervals;
+}
+
+vector<int> chorusSegmentIndices(const vector<int> &frameIntervals, const vector<ChorusRange> &chorus) {
+    vector<int> indices;
+    int endFrame = 0;
+    for (size_t i = 0; i < frameIntervals.size(); i++) {
+        endFrame += frameIntervals[i];
+        if (inChorus(endFrame, chorus))
+            indices.push_back(static_cast<int>(i));
+    }
+    return indices;
+}
+
+vector<ChorusRange> loadChorusRangesMsgpack(const string &path, int fps) {
+    vector<ChorusRange> ranges;
+    msgpack::object_handle oh = readMsgpack(path);
+    for (const char *key : {"chorusSegments", "repeatSegments"}) {
+        const msgpack::object *segments = getMember(oh.get(), key);
+        if (!segments || segments->type != msgpack::type::ARRAY)
+            continue;
+        for (size_t i = 0; i < segments->via.array.size; i++) {
+            const msgpack::object *repeats = getMember(segments->via.array.ptr[i], "repeats");
+            if (!repeats || repeats->type != msgpack::type::ARRAY)
+                continue;
+            for (size_t j = 0; j < repeats->via.array.size; j++) {
+                const msgpack::object *start = getMember(repeats->via.array.ptr[j], "start");
+                const msgpack::object *duration = getMember(repeats->via.array.ptr[j], "duration");
+                if (!start || !duration)
+                    continue;
+                double startMs = start->as<double>();
+                double durationMs = duration->as<double>();
+                ranges.push_back({millisecondsToFrames(startMs, fps), millisecondsToFrames(startMs + durationMs, fps)});
+            }
+        }
+    }
+    return ranges;
+}
+
+size_t countMotionFrames(const string &motionDir) {
+    if (isBvhPath(motionDir)) {
+        BvhReader reader(motionDir);
+        vector<double> values;
+        size_t frames = 0;
+        while (reader.nextFrame(values))
+            frames++;
+        return frames;
+    }
+    msgpack::object_handle oh = readMsgpack(motionDir + "/raw.msgpack");
+    return oh.get().type == msgpack::type::ARRAY ? oh.get().via.array.size : 0;
+}
+
+} // namespace camsynth
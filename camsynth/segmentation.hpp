@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+namespace camsynth {
+
+// 新しい入力のビートに合わせたセグメント分割
+// （scripts/my_utils/frameinterval.py・sabi+frameinterval.py と同じ計算を読み込み済みのビートとフレーム数から行う）
+
+// サビ（繰り返し区間）1 つ分のフレーム範囲（両端を含む）
+struct ChorusRange {
+    int startFrame;
+    int endFrame;
+};
+
+struct SegmentationOptions {
+    int fps = 30;
+    // 1 セグメントに入れる小節の頭の数（サビとそれ以外）。大きくするほどカットが減る
+    int downbeatsPerSegment = 2;
+    int chorusDownbeatsPerSegment = 2;
+    // ビートの合計とモーションのフレーム数の差がこれより小さければ最後のセグメントに足し、
+    // そうでなければ 1 つのセグメントとして加える
+    int mergeThreshold = 90;
+};
+
+// 小節の頭 (position == 1) の 3 個目までを 1 セグメント目とし、以降は options の数ごとに区切った
+// フレーム間隔を求め、合計が motionFrames になるように最後を調整する。
+// 区切りがサビの範囲に入っていれば、次のセグメントには chorusDownbeatsPerSegment を使う。
+// ビートがモーションより長い場合は、はみ出したセグメントを除いてから調整する。
+std::vector<int> beatFrameIntervals(const std::vector<BeatData> &beats,
+                                    size_t motionFrames,
+                                    const std::vector<ChorusRange> &chorus = {},
+                                    const SegmentationOptions &options = {});
+
+// 終了フレーム（フレーム間隔の累積和）がサビの範囲に入るセグメントの番号（昇順）
+std::vector<int> chorusSegmentIndices(const std::vector<int> &frameIntervals, const std::vector<ChorusRange> &chorus);
+
+// Songle の chorus.json を msgpack にしたもの（sabi.msgpack）から、chorusSegments と repeatSegments の
+// 全ての repeats をフレーム範囲にして読み込む
+std::vector<ChorusRange> loadChorusRangesMsgpack(const std::string &path, int fps = 30);
+
+// 入力モーションのフレーム数（raw.msgpack のあるディレクトリまたは BVH ファイル）
+size_t countMotionFrames(const std::string &motionDir);
+
+} // namespace camsynth
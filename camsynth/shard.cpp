@@ -0,0 +1,688 @@
+#include "shard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "camera.hpp"
+#include "msgpack_io.hpp"
+#include "numa.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+namespace {
+
+using Packer = msgpack::packer<msgpack::sbuffer>;
+
+bool writeAll(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+bool readAll(int fd, char *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+// メッセージ 1 つ分（長さ uint64 + msgpack）
+bool sendMessage(int fd, const msgpack::sbuffer &buf) {
+    uint64_t n = buf.size();
+    return writeAll(fd, reinterpret_cast<const char *>(&n), sizeof(n)) && writeAll(fd, buf.data(), n);
+}
+
+bool receiveMessage(int fd, vector<char> &data) {
+    uint64_t n = 0;
+    if (!readAll(fd, reinterpret_cast<char *>(&n), sizeof(n)))
+        return false;
+    data.resize(n);
+    return readAll(fd, data.data(), n);
+}
+
+void packDoubles(Packer &pk, const double *v, size_t n) {
+    pk.pack_array(n);
+    for (size_t i = 0; i < n; i++)
+        pk.pack(v[i]);
+}
+
+vector<double> toDoubles(const msgpack::object &o) {
+    vector<double> v;
+    if (o.type != msgpack::type::ARRAY)
+        return v;
+    v.reserve(o.via.array.size);
+    for (size_t i = 0; i < o.via.array.size; i++)
+        v.push_back(o.via.array.ptr[i].as<double>());
+    return v;
+}
+
+array<double, 3> toVec3(const msgpack::object &o) {
+    vector<double> v = toDoubles(o);
+    v.resize(3, 0.0);
+    return {v[0], v[1], v[2]};
+}
+
+const msgpack::object &requireMember(const msgpack::object &obj, const string &key) {
+    const msgpack::object *m = getMember(obj, key);
+    if (!m)
+        throw runtime_error("Missing '" + key + "' in shard message");
+    return *m;
+}
+
+const msgpack::object &requireArray(const msgpack::object &obj, const string &key) {
+    const msgpack::object &m = requireMember(obj, key);
+    if (m.type != msgpack::type::ARRAY)
+        throw runtime_error("'" + key + "' is not an array in shard message");
+    return m;
+}
+
+// ---- 距離計算の要求 ----
+//   {"type": "score", "input": 入力番号, "options": {...},
+//    "segments": [{"stand": [[[x,y,z], ...], ...], "hip": [[x,y,z,w], ...], "music": [[...], ...], "bpm": BPM}, ...]}
+// 応答: {"seconds": 計算時間, "segments": [{"files", "offsets", "order", "motion", "hip", "bpm", "music", "bytes"}, ...]}
+
+void packScoreRequest(msgpack::sbuffer &buf, const string &inputNumber, const PreparedInput &prepared,
+                      const SearchOptions &options) {
+    Packer pk(&buf);
+    pk.pack_map(4);
+    pk.pack(string("type"));
+    pk.pack(string("score"));
+    pk.pack(string("input"));
+    pk.pack(inputNumber);
+    // 距離計算に関係する設定だけを送る
+    pk.pack(string("options"));
+    pk.pack_map(6);
+    pk.pack(string("step"));
+    pk.pack(options.step);
+    pk.pack(string("sliding"));
+    pk.pack(options.slidingOffset);
+    pk.pack(string("clip_windows"));
+    pk.pack(options.clipWindows);
+    pk.pack(string("window_stride"));
+    pk.pack(options.windowStride);
+    pk.pack(string("squared_l2"));
+    pk.pack(options.squaredL2);
+    pk.pack(string("pca"));
+    pk.pack(options.pcaComponents);
+    size_t numSegments = prepared.inputSegments.size();
+    pk.pack(string("segments"));
+    pk.pack_array(numSegments);
+    for (size_t s = 0; s < numSegments; s++) {
+        pk.pack_map(4);
+        pk.pack(string("stand"));
+        pk.pack_array(prepared.inputSegments[s].size());
+        for (const auto &f : prepared.inputSegments[s]) {
+            pk.pack_array(f.positions.size());
+            for (const auto &p : f.positions)
+                packDoubles(pk, p.data(), 3);
+        }
+        pk.pack(string("hip"));
+        pk.pack_array(prepared.hipSegments[s].size());
+        for (const auto &f : prepared.hipSegments[s])
+            packDoubles(pk, f.hipQuaternion.data(), 4);
+        pk.pack(string("music"));
+        pk.pack_array(prepared.inputMusicSegments[s].size());
+        for (const auto &m : prepared.inputMusicSegments[s])
+            packDoubles(pk, m.data(), m.size());
+        pk.pack(string("bpm"));
+        pk.pack(s < prepared.inputBpmList.size() ? prepared.inputBpmList[s] : 0.0);
+    }
+}
+
+void answerScore(const Database &db, const msgpack::object &req, msgpack::sbuffer &buf, int threads) {
+    string inputNumber = requireMember(req, "input").as<string>();
+    const msgpack::object &opt = requireMember(req, "options");
+    SearchOptions options;
+    options.step = requireMember(opt, "step").as<int>();
+    options.slidingOffset = requireMember(opt, "sliding").as<bool>();
+    options.clipWindows = requireMember(opt, "clip_windows").as<bool>();
+    options.windowStride = requireMember(opt, "window_stride").as<int>();
+    options.squaredL2 = requireMember(opt, "squared_l2").as<bool>();
+    options.pcaComponents = requireMember(opt, "pca").as<int>();
+
+    struct SegmentInput {
+        vector<FrameData> stand, hip;
+        vector<vector<double>> music;
+        double bpm = 0.0;
+    };
+    const msgpack::object &segments = requireArray(req, "segments");
+    size_t numSegments = segments.via.array.size;
+    vector<SegmentInput> inputs(numSegments);
+    for (size_t s = 0; s < numSegments; s++) {
+        const msgpack::object &seg = segments.via.array.ptr[s];
+        const msgpack::object &stand = requireArray(seg, "stand");
+        const msgpack::object &hip = requireArray(seg, "hip");
+        const msgpack::object &music = requireArray(seg, "music");
+        SegmentInput &in = inputs[s];
+        in.stand.resize(stand.via.array.size);
+        in.hip.resize(hip.via.array.size);
+        for (size_t t = 0; t < stand.via.array.size; t++) {
+            const msgpack::object &joints = stand.via.array.ptr[t];
+            for (size_t j = 0; j < joints.via.array.size; j++)
+                in.stand[t].positions.push_back(toVec3(joints.via.array.ptr[j]));
+        }
+        for (size_t t = 0; t < hip.via.array.size; t++) {
+            vector<double> q = toDoubles(hip.via.array.ptr[t]);
+            q.resize(4, 0.0);
+            copy(q.begin(), q.end(), in.hip[t].hipQuaternion.begin());
+        }
+        for (size_t t = 0; t < music.via.array.size; t++)
+            in.music.push_back(toDoubles(music.via.array.ptr[t]));
+        in.bpm = requireMember(seg, "bpm").as<double>();
+    }
+
+    // セグメントごとの距離計算は互いに独立なので、threads 本のスレッドで取り合う
+    vector<CandidateDistances> results(numSegments);
+    atomic<size_t> next(0);
+    exception_ptr failure;
+    mutex failureMutex;
+    auto work = [&] {
+        for (size_t s; (s = next++) < numSegments;) {
+            try {
+                const SegmentInput &in = inputs[s];
+                results[s] = computeCandidateDistances(db, inputNumber, in.stand, in.hip, in.music, in.bpm, options);
+            }
+            catch (...) {
+                lock_guard<mutex> lock(failureMutex);
+                failure = current_exception();
+            }
+        }
+    };
+    auto t0 = chrono::steady_clock::now();
+    int numThreads = max(1, min(threads, (int)numSegments));
+    vector<thread> pool;
+    for (int t = 1; t < numThreads; t++)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    if (failure)
+        rethrow_exception(failure);
+
+    Packer pk(&buf);
+    pk.pack_map(2);
+    pk.pack(string("seconds"));
+    pk.pack(seconds);
+    pk.pack(string("segments"));
+    pk.pack_array(numSegments);
+    for (const CandidateDistances &d : results) {
+        pk.pack_map(8);
+        pk.pack(string("files"));
+        pk.pack_array(d.fileNames.size());
+        for (const auto &f : d.fileNames)
+            pk.pack(f);
+        pk.pack(string("offsets"));
+        pk.pack_array(d.offsets.size());
+        for (int o : d.offsets)
+            pk.pack(o);
+        pk.pack(string("order"));
+        pk.pack_array(d.order.size());
+        for (size_t o : d.order)
+            pk.pack(static_cast<uint64_t>(o));
+        pk.pack(string("motion"));
+        packDoubles(pk, d.segmentDistances.data(), d.segmentDistances.size());
+        pk.pack(string("hip"));
+        packDoubles(pk, d.hipDistances.data(), d.hipDistances.size());
+        pk.pack(string("bpm"));
+        packDoubles(pk, d.bpmDiffs.data(), d.bpmDiffs.size());
+        pk.pack(string("music"));
+        packDoubles(pk, d.featureDiffs.data(), d.featureDiffs.size());
+        pk.pack(string("bytes"));
+        pk.pack(d.bytesScanned);
+    }
+}
+
+CandidateDistances parseDistances(const msgpack::object &obj) {
+    CandidateDistances d;
+    const msgpack::object &files = requireArray(obj, "files");
+    for (size_t i = 0; i < files.via.array.size; i++)
+        d.fileNames.push_back(files.via.array.ptr[i].as<string>());
+    const msgpack::object &offsets = requireArray(obj, "offsets");
+    for (size_t i = 0; i < offsets.via.array.size; i++)
+        d.offsets.push_back(offsets.via.array.ptr[i].as<int>());
+    const msgpack::object &order = requireArray(obj, "order");
+    for (size_t i = 0; i < order.via.array.size; i++)
+        d.order.push_back(order.via.array.ptr[i].as<uint64_t>());
+    d.segmentDistances = toDoubles(requireArray(obj, "motion"));
+    d.hipDistances = toDoubles(requireArray(obj, "hip"));
+    d.bpmDiffs = toDoubles(requireArray(obj, "bpm"));
+    d.featureDiffs = toDoubles(requireArray(obj, "music"));
+    d.bytesScanned = requireMember(obj, "bytes").as<double>();
+    size_t n = d.fileNames.size();
+    if (d.offsets.size() != n || d.order.size() != n || d.segmentDistances.size() != n ||
+        d.hipDistances.size() != n || d.bpmDiffs.size() != n || d.featureDiffs.size() != n)
+        throw runtime_error("Inconsistent candidate distances from shard");
+    return d;
+}
+
+// ---- 区間の取り寄せ ----
+//   {"type": "fetch", "windows": [[クリップ番号, 開始, 終了], ...]}
+// 応答: {"windows": [{"clip", "from", "frames", "root", "lengths", "eye", "rotation", "fov", "distance"}, ...]}
+// root はモーションの [from, 終了) の root 位置、カメラの列は列ごとの長さで切った [from, 終了)
+
+struct WindowRequest {
+    string clip;
+    int from = 0;
+    int to = 0;
+};
+
+void answerFetch(const Database &db, const msgpack::object &req, msgpack::sbuffer &buf) {
+    const msgpack::object &windows = requireArray(req, "windows");
+    Packer pk(&buf);
+    pk.pack_map(1);
+    pk.pack(string("windows"));
+    pk.pack_array(windows.via.array.size);
+    for (size_t w = 0; w < windows.via.array.size; w++) {
+        const msgpack::object &item = windows.via.array.ptr[w];
+        if (item.type != msgpack::type::ARRAY || item.via.array.size < 3)
+            throw runtime_error("Invalid window request");
+        string num = item.via.array.ptr[0].as<string>();
+        int from = max(item.via.array.ptr[1].as<int>(), 0);
+        int to = item.via.array.ptr[2].as<int>();
+        const MotionClip *motion = db.clip(num);
+        const CameraClip *camera = db.camera(num);
+        if (!motion || !camera)
+            throw runtime_error("Unknown clip in fetch: " + num);
+        pk.pack_map(9);
+        pk.pack(string("clip"));
+        pk.pack(num);
+        pk.pack(string("from"));
+        pk.pack(from);
+        pk.pack(string("frames"));
+        pk.pack(motion->frames());
+        pk.pack(string("root"));
+        int rootEnd = max(min(to, motion->frames()), from);
+        pk.pack_array(rootEnd - from);
+        for (int i = from; i < rootEnd; i++) {
+            const auto &p = motion->raw[i].positions;
+            array<double, 3> root = p.empty() ? array<double, 3>{0.0, 0.0, 0.0} : p[0];
+            packDoubles(pk, root.data(), 3);
+        }
+        array<size_t, 4> lengths = {camera->eyeFrames(), camera->rotationFrames(), camera->fovFrames(),
+                                    camera->distanceFrames()};
+        pk.pack(string("lengths"));
+        pk.pack_array(4);
+        for (size_t n : lengths)
+            pk.pack(static_cast<uint64_t>(n));
+        auto endOf = [&](size_t n) { return max(min(to, (int)n), from); };
+        pk.pack(string("eye"));
+        pk.pack_array(endOf(lengths[0]) - from);
+        for (int i = from; i < endOf(lengths[0]); i++) {
+            array<double, 3> e = camera->eye(i);
+            packDoubles(pk, e.data(), 3);
+        }
+        pk.pack(string("rotation"));
+        pk.pack_array(endOf(lengths[1]) - from);
+        for (int i = from; i < endOf(lengths[1]); i++) {
+            array<double, 3> r = {camera->column(CameraClip::RotationX)[i], camera->column(CameraClip::RotationY)[i],
+                                  camera->column(CameraClip::RotationZ)[i]};
+            packDoubles(pk, r.data(), 3);
+        }
+        pk.pack(string("fov"));
+        pk.pack_array(endOf(lengths[2]) - from);
+        for (int i = from; i < endOf(lengths[2]); i++)
+            pk.pack(camera->fov(i));
+        pk.pack(string("distance"));
+        pk.pack_array(endOf(lengths[3]) - from);
+        for (int i = from; i < endOf(lengths[3]); i++)
+            pk.pack(camera->distance(i));
+    }
+}
+
+// ---- 状態 ----
+//   {"type": "stats"} → {"clips": クリップ数, "segments": 区間数}
+
+void answerStats(const Database &db, msgpack::sbuffer &buf) {
+    Packer pk(&buf);
+    pk.pack_map(2);
+    pk.pack(string("clips"));
+    pk.pack(static_cast<uint64_t>(db.clips.size()));
+    pk.pack(string("segments"));
+    pk.pack(static_cast<uint64_t>(db.segments.size()));
+}
+
+void packType(msgpack::sbuffer &buf, const string &type, size_t extraFields) {
+    Packer pk(&buf);
+    pk.pack_map(1 + extraFields);
+    pk.pack(string("type"));
+    pk.pack(type);
+}
+
+} // namespace
+
+void serveShard(const Database &db, int fd, int threads) {
+    vector<char> message;
+    while (receiveMessage(fd, message)) {
+        msgpack::sbuffer reply;
+        try {
+            msgpack::object_handle oh = msgpack::unpack(message.data(), message.size());
+            const msgpack::object &req = oh.get();
+            string type = requireMember(req, "type").as<string>();
+            if (type == "score")
+                answerScore(db, req, reply, threads);
+            else if (type == "fetch")
+                answerFetch(db, req, reply);
+            else if (type == "stats")
+                answerStats(db, reply);
+            else
+                throw runtime_error("Unknown request: " + type);
+        }
+        catch (const std::exception &e) {
+            // 応答の途中で失敗したときは作りかけを捨ててエラーを返す
+            reply.clear();
+            Packer pk(&reply);
+            pk.pack_map(1);
+            pk.pack(string("error"));
+            pk.pack(string(e.what()));
+        }
+        if (!sendMessage(fd, reply))
+            return;
+    }
+}
+
+ShardCluster::ShardCluster(const DatabaseDirs &dirs, int numShards, const ShardPlacement &placement) {
+    vector<NumaNode> nodes;
+    if (placement.numa)
+        nodes = detectNumaNodes();
+    if (numShards <= 0)
+        numShards = placement.numa ? nodes.size() : 1;
+    for (int k = 0; k < numShards; k++) {
+        const NumaNode *node = nodes.empty() ? nullptr : &nodes[k % nodes.size()];
+        int threads = placement.threadsPerShard;
+        if (threads <= 0)
+            threads = node ? node->cpus.size() : max(thread::hardware_concurrency(), 1u);
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            shutdown();
+            throw runtime_error("socketpair failed");
+        }
+        // 子プロセスに書きかけの出力を複製しないようにしてから fork する
+        cout.flush();
+        cerr.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for (const auto &w : workers_)
+                close(w.fd);
+            int code = 0;
+            try {
+                // 読み込み前に固定して、担当分のデータをこのノードのメモリに置く
+                if (node && !bindToNumaNode(*node))
+                    cerr << "[WARN] シャード " << k << " を NUMA ノード " << node->id << " に固定できません" << endl;
+                DatabaseDirs shardDirs = dirs;
+                shardDirs.ShardCount = numShards;
+                shardDirs.ShardIndex = k;
+                Database db = loadDatabase(shardDirs);
+                serveShard(db, fds[1], threads);
+            }
+            catch (const std::exception &e) {
+                cerr << "[ERROR] シャード " << k << ": " << e.what() << endl;
+                code = 1;
+            }
+            cout.flush();
+            _exit(code);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            shutdown();
+            throw runtime_error("fork failed");
+        }
+        workers_.push_back({pid, fds[0]});
+        ShardStats st;
+        st.node = node ? node->id : -1;
+        stats_.push_back(st);
+    }
+
+    // 全ワーカーの読み込みが終わるのを待つ（各ワーカーは並行して読み込む）
+    msgpack::sbuffer request;
+    packType(request, "stats", 0);
+    for (const auto &w : workers_)
+        sendMessage(w.fd, request);
+    for (size_t k = 0; k < workers_.size(); k++) {
+        vector<char> message;
+        if (!receiveMessage(workers_[k].fd, message)) {
+            shutdown();
+            throw runtime_error("Shard " + to_string(k) + " failed to load the database");
+        }
+        msgpack::object_handle oh = msgpack::unpack(message.data(), message.size());
+        const msgpack::object *clips = getMember(oh.get(), "clips");
+        stats_[k].clips = clips ? clips->as<uint64_t>() : 0;
+    }
+}
+
+ShardCluster::~ShardCluster() {
+    shutdown();
+}
+
+void ShardCluster::shutdown() {
+    // 接続を閉じるとワーカーは serveShard から戻って終了する
+    for (auto &w : workers_) {
+        close(w.fd);
+        int status;
+        while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {
+        }
+    }
+    workers_.clear();
+}
+
+namespace {
+
+// 応答を受け取る（ワーカーがエラーを返したら例外）
+msgpack::object_handle receiveReply(int fd, size_t shard) {
+    vector<char> message;
+    if (!receiveMessage(fd, message))
+        throw runtime_error("Shard " + to_string(shard) + " did not respond");
+    msgpack::object_handle oh = msgpack::unpack(message.data(), message.size());
+    if (const msgpack::object *error = getMember(oh.get(), "error"))
+        throw runtime_error("Shard " + to_string(shard) + ": " + error->as<string>());
+    return oh;
+}
+
+} // namespace
+
+SearchResult ShardCluster::search(const InputData &input,
+                                  const vector<int> &frameIntervals,
+                                  const vector<int> &modes,
+                                  const SearchOptions &options) {
+    if (options.squaredL2 && options.pcaComponents > 0)
+        throw invalid_argument("PCA projection needs the whole database and cannot be used with shards");
+    PreparedInput prepared = prepareInput(input, frameIntervals);
+    size_t numSegments = prepared.inputSegments.size();
+
+    // scatter: 全セグメントを全ワーカーに送る（ワーカーは並行して距離を計算する）
+    msgpack::sbuffer request;
+    packScoreRequest(request, input.inputNumber, prepared, options);
+    for (size_t k = 0; k < workers_.size(); k++) {
+        if (!sendMessage(workers_[k].fd, request))
+            throw runtime_error("Shard " + to_string(k) + " is not running");
+    }
+    // gather
+    vector<vector<CandidateDistances>> replies(workers_.size());
+    for (size_t k = 0; k < workers_.size(); k++) {
+        msgpack::object_handle oh = receiveReply(workers_[k].fd, k);
+        stats_[k].seconds += requireMember(oh.get(), "seconds").as<double>();
+        const msgpack::object &segments = requireArray(oh.get(), "segments");
+        if (segments.via.array.size != numSegments)
+            throw runtime_error("Shard " + to_string(k) + " returned a wrong number of segments");
+        for (size_t s = 0; s < numSegments; s++) {
+            replies[k].push_back(parseDistances(segments.via.array.ptr[s]));
+            stats_[k].bytesScanned += replies[k].back().bytesScanned;
+        }
+    }
+
+    // セグメントごとに、1 プロセスで読んだときの走査順に並べ直して連結する
+    // 切り出し区間は全体での走査順、clipWindows ではクリップ番号の順（Database::clips の順）でクリップ内は開始位置の順
+    vector<vector<CandidateScore>> ranked(numSegments);
+    for (size_t s = 0; s < numSegments; s++) {
+        struct Entry {
+            size_t shard, index;
+            string clip;
+            int start;
+            size_t order;
+        };
+        vector<Entry> entries;
+        for (size_t k = 0; k < replies.size(); k++) {
+            const CandidateDistances &d = replies[k][s];
+            for (size_t i = 0; i < d.size(); i++) {
+                Entry e{k, i, "", 0, d.order[i]};
+                int end;
+                parseSegmentFilename(d.fileNames[i], e.clip, e.start, end);
+                owners_[e.clip] = k;
+                entries.push_back(move(e));
+            }
+        }
+        stable_sort(entries.begin(), entries.end(), [&](const Entry &a, const Entry &b) {
+            if (!options.clipWindows)
+                return a.order < b.order;
+            if (a.clip != b.clip)
+                return a.clip < b.clip;
+            return a.start < b.start;
+        });
+        CandidateDistances merged;
+        for (const Entry &e : entries) {
+            const CandidateDistances &d = replies[e.shard][s];
+            merged.fileNames.push_back(d.fileNames[e.index]);
+            merged.offsets.push_back(d.offsets[e.index]);
+            merged.order.push_back(d.order[e.index]);
+            merged.segmentDistances.push_back(d.segmentDistances[e.index]);
+            merged.hipDistances.push_back(d.hipDistances[e.index]);
+            merged.bpmDiffs.push_back(d.bpmDiffs[e.index]);
+            merged.featureDiffs.push_back(d.featureDiffs[e.index]);
+        }
+        ranked[s] = rankCandidates(merged, options);
+    }
+
+    fetchWindows(ranked, prepared);
+    SearchResult result;
+    for (size_t s = 0; s < numSegments; s++) {
+        int currentMode = (s < modes.size()) ? modes[s] : 10;
+        result.segments.push_back(
+            chooseCandidate(windows_, ranked[s], prepared.inputSegments[s].size(), s, currentMode, options));
+    }
+    finishSearch(windows_, prepared, options, result);
+    return result;
+}
+
+void ShardCluster::fetchWindows(const vector<vector<CandidateScore>> &ranked, const PreparedInput &prepared) {
+    // 候補ごとに、選ばれた位置から segmentLen フレーム分（カメラの統計量・平行移動・カメラの組み立てに使う範囲）
+    vector<set<tuple<string, int, int>>> requests(workers_.size());
+    for (size_t s = 0; s < ranked.size(); s++) {
+        int segmentLen = prepared.inputSegments[s].size();
+        for (const auto &cand : ranked[s]) {
+            string num;
+            int start, end;
+            if (!parseSegmentFilename(cand.file, num, start, end))
+                continue;
+            auto owner = owners_.find(num);
+            if (owner == owners_.end())
+                continue;
+            int from = max(start + cand.offset, 0);
+            requests[owner->second].insert({num, from, start + cand.offset + segmentLen});
+        }
+    }
+    vector<size_t> asked;
+    for (size_t k = 0; k < workers_.size(); k++) {
+        if (requests[k].empty())
+            continue;
+        msgpack::sbuffer buf;
+        packType(buf, "fetch", 1);
+        Packer pk(&buf);
+        pk.pack(string("windows"));
+        pk.pack_array(requests[k].size());
+        for (const auto &r : requests[k]) {
+            pk.pack_array(3);
+            pk.pack(get<0>(r));
+            pk.pack(get<1>(r));
+            pk.pack(get<2>(r));
+        }
+        if (!sendMessage(workers_[k].fd, buf))
+            throw runtime_error("Shard " + to_string(k) + " is not running");
+        asked.push_back(k);
+    }
+
+    set<string> touched;
+    for (size_t k : asked) {
+        msgpack::object_handle oh = receiveReply(workers_[k].fd, k);
+        const msgpack::object &windows = requireArray(oh.get(), "windows");
+        for (size_t w = 0; w < windows.via.array.size; w++) {
+            const msgpack::object &win = windows.via.array.ptr[w];
+            string num = requireMember(win, "clip").as<string>();
+            int from = requireMember(win, "from").as<int>();
+            size_t frames = requireMember(win, "frames").as<uint64_t>();
+            // モーションは root だけを元のフレーム番号の位置に置く
+            MotionClip &motion = windows_.clips[num];
+            if (motion.raw.size() != frames)
+                motion.raw.resize(frames);
+            const msgpack::object &root = requireArray(win, "root");
+            for (size_t i = 0; i < root.via.array.size && from + i < frames; i++)
+                motion.raw[from + i].positions = {toVec3(root.via.array.ptr[i])};
+
+            vector<double> lengths = toDoubles(requireArray(win, "lengths"));
+            lengths.resize(4, 0.0);
+            CameraColumns &cc = cameraColumns_[num];
+            cc.eye.resize(lengths[0], {0.0, 0.0, 0.0});
+            cc.rotation.resize(lengths[1], {0.0, 0.0, 0.0});
+            cc.fov.resize(lengths[2], 0.0);
+            cc.distance.resize(lengths[3], 0.0);
+            const msgpack::object &eye = requireArray(win, "eye");
+            for (size_t i = 0; i < eye.via.array.size && from + i < cc.eye.size(); i++)
+                cc.eye[from + i] = toVec3(eye.via.array.ptr[i]);
+            const msgpack::object &rotation = requireArray(win, "rotation");
+            for (size_t i = 0; i < rotation.via.array.size && from + i < cc.rotation.size(); i++)
+                cc.rotation[from + i] = toVec3(rotation.via.array.ptr[i]);
+            vector<double> fov = toDoubles(requireArray(win, "fov"));
+            for (size_t i = 0; i < fov.size() && from + i < cc.fov.size(); i++)
+                cc.fov[from + i] = fov[i];
+            vector<double> distance = toDoubles(requireArray(win, "distance"));
+            for (size_t i = 0; i < distance.size() && from + i < cc.distance.size(); i++)
+                cc.distance[from + i] = distance[i];
+            touched.insert(num);
+        }
+    }
+    for (const string &num : touched) {
+        const CameraColumns &cc = cameraColumns_[num];
+        windows_.cameras.insert_or_assign(num, CameraClip(cc.eye, cc.rotation, cc.fov, cc.distance));
+    }
+}
+
+vector<SearchResult> ShardCluster::alternatives(const InputData &input, const SearchResult &result, int count,
+                                                const SearchOptions &options) const {
+    return buildAlternativeResults(windows_, input, result, count, options);
+}
+
+CameraTrack ShardCluster::assembleCamera(const SearchResult &result) const {
+    return assembleCameraTrack(windows_, result.choices, result.lengths, result.translations);
+}
+
+} // namespace camsynth
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "database.hpp"
+#include "search.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// データベースを分割して複数のワーカープロセスで検索する（scatter-gather）
+// データベースをクリップ単位で numShards 個に分け (shardOfClip)、それぞれを子プロセスのワーカーが読み込んで持つ。
+// 調整役（このプロセス）は全セグメントの入力を全ワーカーに送り、ワーカーは自分の候補の正規化前の距離
+// (CandidateDistances) を返す。調整役はそれを 1 プロセスで読んだときの走査順に並べ直して連結し、
+// rankCandidates で正規化と上位候補の選択を行う。正規化の最小値・最大値も候補の並びも同じになるので、
+// 結果は 1 プロセスで検索したもの (searchSegments) と同じになる。
+// mode による選択・平行移動・カメラの組み立てに必要な区間（上位候補の root 位置とカメラデータ）だけを
+// 持ち主のワーカーから取り寄せて windows() に入れる。調整役はデータベース全体を読み込まない。
+//
+// ワーカーとのやりとりは「長さ (uint64) + msgpack」のメッセージで、serveShard は任意のソケットで使える。
+// ワーカーは fork で作るので、スレッドを作る前に構築する。search はスレッドセーフではない。
+
+// ワーカーの置き方
+struct ShardPlacement {
+    // NUMA ノードごとにワーカーを置く。ワーカー k はノード k % ノード数の CPU に固定してからデータベースを読むので、
+    // 担当分のデータはそのノードのメモリに載り、距離計算もそのノードの CPU で行う
+    bool numa = false;
+    // ワーカー内でセグメントを並行して計算するスレッド数（0 なら配置したノードの CPU 数）
+    int threadsPerShard = 1;
+};
+
+// ワーカーごとの状態と、これまでの距離計算で読んだ量
+struct ShardStats {
+    int node = -1;            // 固定した NUMA ノード（固定していなければ -1）
+    size_t clips = 0;         // 担当するクリップ数
+    double bytesScanned = 0.0; // 距離計算で読んだデータベースのバイト数（概算）
+    double seconds = 0.0;     // 距離計算にかかった時間
+};
+
+class ShardCluster {
+public:
+    // numShards = 0 なら、placement.numa のときはノード数、そうでなければ 1
+    ShardCluster(const DatabaseDirs &dirs, int numShards, const ShardPlacement &placement = ShardPlacement());
+    // ワーカーへの接続を閉じて終了を待つ
+    ~ShardCluster();
+
+    ShardCluster(const ShardCluster &) = delete;
+    ShardCluster &operator=(const ShardCluster &) = delete;
+
+    int size() const { return workers_.size(); }
+    // ワーカーごとの状態（帯域は bytesScanned / seconds）
+    const std::vector<ShardStats> &stats() const { return stats_; }
+
+    // フレーム間隔ごとに類似ファイルを検索し、平行移動（平滑化済み）まで求める
+    // options.pcaComponents > 0 の二乗 L2 は主成分がデータベース全体で決まるので使えない（例外）
+    SearchResult search(const InputData &input,
+                        const std::vector<int> &frameIntervals,
+                        const std::vector<int> &modes,
+                        const SearchOptions &options = SearchOptions());
+
+    // 検索結果の候補リストから別案を count 個作る（0 番目は result そのもの）
+    std::vector<SearchResult> alternatives(const InputData &input, const SearchResult &result, int count,
+                                           const SearchOptions &options = SearchOptions()) const;
+
+    // 検索結果からカメラデータを組み立てる
+    CameraTrack assembleCamera(const SearchResult &result) const;
+
+    // これまでの検索で取り寄せた区間だけを持つデータベース
+    const Database &windows() const { return windows_; }
+
+private:
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;
+    };
+    // 取り寄せたカメラデータ（列ごとの長さは元のまま、取り寄せていないフレームは 0）
+    struct CameraColumns {
+        std::vector<std::array<double, 3>> eye, rotation;
+        std::vector<double> fov, distance;
+    };
+
+    void shutdown();
+    // 上位候補の区間を持ち主のワーカーから取り寄せて windows_ に入れる
+    void fetchWindows(const std::vector<std::vector<CandidateScore>> &ranked, const PreparedInput &prepared);
+
+    std::vector<Worker> workers_;
+    std::vector<ShardStats> stats_;
+    std::map<std::string, int> owners_; // クリップ番号 → ワーカー
+    std::map<std::string, CameraColumns> cameraColumns_;
+    Database windows_;
+};
+
+// ワーカー側: fd からの要求に db で答える（fd が閉じられると戻る）
+// threads > 1 なら、1 つの要求のセグメントを threads 本のスレッドで分けて計算する
+void serveShard(const Database &db, int fd, int threads = 1);
+
+} // namespace camsynth
@@ -0,0 +1,144 @@
+#include "streaming.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "camera.hpp"
+#include "search.hpp"
+
+using namespace std;
+
+namespace camsynth {
+
+StreamingSynthesizer::StreamingSynthesizer(const Database &db,
+                                           const string &inputNumber,
+                                           const vector<int> &frameIntervals,
+                                           const vector<int> &modes,
+                                           const SearchOptions &searchOptions,
+                                           const StreamingOptions &options)
+    : db_(db), inputNumber_(inputNumber), searchOptions_(searchOptions),
+      filter_(searchOptions.sigma, options.lookaheadFrames) {
+    // maxDelayFrames が指定されていれば、遅延が上限に収まるように長いセグメントを分割する
+    // 1 フレームのセグメントでも遅延は先読みの分だけあるので、先読みが上限より長ければ上限まで減らす
+    int maxSegmentLen = numeric_limits<int>::max();
+    if (options.maxDelayFrames > 0) {
+        if (filter_.lookahead > options.maxDelayFrames) {
+            cerr << "[WARN] 出力遅延の上限 (" << options.maxDelayFrames << " フレーム) が平滑化の先読み ("
+                 << filter_.lookahead << " フレーム) より短いため、先読みを " << options.maxDelayFrames
+                 << " フレームに減らします" << endl;
+            filter_ = LookaheadGaussianFilter(searchOptions.sigma, options.maxDelayFrames);
+        }
+        maxSegmentLen = max(1, options.maxDelayFrames - filter_.lookahead + 1);
+    }
+    for (size_t i = 0; i < frameIntervals.size(); i++) {
+        int rest = frameIntervals[i];
+        int mode = (i < modes.size()) ? modes[i] : 10;
+        while (rest > 0) {
+            int len = min(rest, maxSegmentLen);
+            intervals_.push_back(len);
+            modes_.push_back(mode);
+            rest -= len;
+        }
+    }
+    for (auto len : intervals_)
+        guaranteedDelay_ = max(guaranteedDelay_, len + filter_.lookahead - 1);
+}
+
+void StreamingSynthesizer::pushFrame(const FrameData &raw, const FrameData &stand, const FrameData &hip,
+                                     const vector<double> &music) {
+    raw_.push_back(raw);
+    stand_.push_back(stand);
+    hip_.push_back(hip);
+    music_.push_back(music);
+    while (nextSegment_ < intervals_.size() && (int)stand_.size() >= intervals_[nextSegment_]) {
+        finalizeSegment(intervals_[nextSegment_]);
+    }
+}
+
+void StreamingSynthesizer::finish() {
+    while (nextSegment_ < intervals_.size() && !stand_.empty()) {
+        finalizeSegment(min(intervals_[nextSegment_], (int)stand_.size()));
+    }
+    finished_ = true;
+}
+
+size_t StreamingSynthesizer::popFrames(CameraTrack &out) {
+    // translations_ と camera_ の添字は trackBase_ からの相対位置
+    int n = translations_.size();
+    int limit = trackBase_ + (int)camera_.position.size();
+    if (!finished_)
+        limit = min(limit, trackBase_ + n - filter_.lookahead);
+    int received = segStart_ + (int)stand_.size();
+    size_t count = 0;
+    for (; emitted_ < limit; emitted_++, count++) {
+        int i = emitted_ - trackBase_;
+        array<double, 3> pos = camera_.position[i];
+        if (i < n) {
+            array<double, 3> trans = filter_.apply(translations_, i);
+            pos[0] += trans[0];
+            pos[1] += trans[1];
+            pos[2] += trans[2];
+        }
+        out.position.push_back(pos);
+        out.rotation.push_back(camera_.rotation[i]);
+        out.viewangle.push_back(camera_.viewangle[i]);
+        if (!finished_)
+            maxObservedDelay_ = max(maxObservedDelay_, received - (emitted_ + 1));
+    }
+    // 出力済みのフレームは、平滑化で参照する half フレーム分だけ残して捨てる
+    int drop = emitted_ - filter_.half - trackBase_;
+    if (drop > 0) {
+        translations_.erase(translations_.begin(), translations_.begin() + drop);
+        camera_.position.erase(camera_.position.begin(), camera_.position.begin() + drop);
+        camera_.rotation.erase(camera_.rotation.begin(), camera_.rotation.begin() + drop);
+        camera_.viewangle.erase(camera_.viewangle.begin(), camera_.viewangle.begin() + drop);
+        trackBase_ += drop;
+    }
+    return count;
+}
+
+void StreamingSynthesizer::finalizeSegment(int segmentLen) {
+    // raw_ などの入力は segStart_ 以降のフレームだけを持つ
+    int start = segStart_;
+    int end = start + segmentLen;
+    FrameSpan rawSegment = FrameSpan(raw_).subspan(0, segmentLen);
+    FrameSpan inputSegment = FrameSpan(stand_).subspan(0, segmentLen);
+    FrameSpan hipSegment = FrameSpan(hip_).subspan(0, segmentLen);
+    MusicSpan musicSegment = MusicSpan(music_).subspan(0, segmentLen);
+    double segmentBpm = calculateAverageBpmInInterval(beats_, start, end, 30);
+
+    SegmentChoice choice = searchSegment(db_, inputNumber_, inputSegment, hipSegment, musicSegment,
+                                         segmentBpm, nextSegment_, modes_[nextSegment_], searchOptions_).choice;
+    appendSegmentTranslations(db_, rawSegment, choice, segmentLen, translations_);
+    appendCameraSegment(db_, camera_, choice.file, segmentLen, choice.offset);
+    // 使える候補がない・選択ファイルやカメラデータが短いときは segmentLen フレームに足りないので、
+    // 直前のフレーム（なければ 0 / 空ファイルのときと同じ既定のカメラ）で埋めて、translations_ と camera_ を
+    // 入力のフレーム番号とそろえておく（popFrames は同じ番号の平行移動とカメラを組み合わせる）
+    array<double, 3> lastTrans = translations_.empty() ? array<double, 3>{0.0, 0.0, 0.0} : translations_.back();
+    translations_.resize(end - trackBase_, lastTrans);
+    bool hasCamera = !camera_.position.empty();
+    array<double, 3> lastPos = hasCamera ? camera_.position.back() : array<double, 3>{0.0, 0.0, 0.0};
+    array<double, 3> lastRot = hasCamera ? camera_.rotation.back() : array<double, 3>{0.0, 0.0, 0.0};
+    double lastFov = hasCamera ? camera_.viewangle.back() : 60.0;
+    camera_.position.resize(end - trackBase_, lastPos);
+    camera_.rotation.resize(end - trackBase_, lastRot);
+    camera_.viewangle.resize(end - trackBase_, lastFov);
+    if (camera_.position.size() != translations_.size())
+        throw runtime_error("Streaming camera and translations are out of sync");
+    closestFiles_.push_back(choice.file);
+    segStart_ = end;
+    nextSegment_++;
+
+    // 検索は次のセグメントのフレームだけを使うので、確定したセグメントの入力とビートは捨てる
+    raw_.erase(raw_.begin(), raw_.begin() + segmentLen);
+    stand_.erase(stand_.begin(), stand_.begin() + segmentLen);
+    hip_.erase(hip_.begin(), hip_.begin() + segmentLen);
+    music_.erase(music_.begin(), music_.begin() + segmentLen);
+    double segStartMs = framesToMilliseconds(segStart_, 30);
+    beats_.erase(remove_if(beats_.begin(), beats_.end(), [&](const BeatData &b) { return b.startMs < segStartMs; }),
+                 beats_.end());
+}
+
+} // namespace camsynth
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "database.hpp"
+#include "kernels.hpp"
+#include "types.hpp"
+
+namespace camsynth {
+
+// ストリーミング（オンライン）合成
+// モーション・音楽のフレームを逐次受け取り、フレーム間隔が閉じたセグメントから
+// 類似ファイル検索とカメラデータの取得を行う。translations の平滑化は先読みを
+// lookaheadFrames に制限したフィルタで行い、先読み分が揃ったフレームから出力する。
+// 出力遅延は「最長セグメント長 + lookaheadFrames - 1」フレーム以下に収まる。
+// 確定したセグメントの入力と、出力済みのフレーム（平滑化で参照する分を除く）は捨てるので、
+// 保持するフレーム数は入力の長さによらず遅延の上限程度に収まる。
+// db は StreamingSynthesizer より長く生存している必要がある。
+class StreamingSynthesizer {
+public:
+    StreamingSynthesizer(const Database &db,
+                         const std::string &inputNumber,
+                         const std::vector<int> &frameIntervals,
+                         const std::vector<int> &modes,
+                         const SearchOptions &searchOptions,
+                         const StreamingOptions &options);
+
+    void pushBeat(const BeatData &beat) { beats_.push_back(beat); }
+
+    // 1 フレーム分の入力を追加し、フレーム間隔が閉じたセグメントを確定する
+    void pushFrame(const FrameData &raw, const FrameData &stand, const FrameData &hip,
+                   const std::vector<double> &music);
+
+    // 入力の終了。途中のセグメントは届いたフレームまでで確定する
+    void finish();
+
+    // 出力可能になったカメラフレームを out の末尾に追加し、追加したフレーム数を返す
+    size_t popFrames(CameraTrack &out);
+
+    int guaranteedDelay() const { return guaranteedDelay_; }
+    int maxObservedDelay() const { return maxObservedDelay_; }
+    const std::vector<std::string> &closestFiles() const { return closestFiles_; }
+
+private:
+    void finalizeSegment(int segmentLen);
+
+    const Database &db_;
+    std::string inputNumber_;
+    SearchOptions searchOptions_;
+    LookaheadGaussianFilter filter_;
+    std::vector<int> intervals_;
+    std::vector<int> modes_;
+
+    std::vector<FrameData> raw_, stand_, hip_;  // segStart_ 以降の入力
+    std::vector<std::vector<double>> music_;
+    std::vector<BeatData> beats_;              // segStart_ 以降に始まるビート
+
+    size_t nextSegment_ = 0;
+    int segStart_ = 0;
+    int trackBase_ = 0;                               // translations_ / camera_ の先頭のフレーム番号
+    std::vector<std::array<double, 3>> translations_; // 平滑化前の平行移動
+    CameraTrack camera_;                              // 平行移動前のカメラデータ
+    std::vector<std::string> closestFiles_;
+    int emitted_ = 0;
+    bool finished_ = false;
+    int guaranteedDelay_ = 0;
+    int maxObservedDelay_ = 0;
+};
+
+} // namespace camsynth
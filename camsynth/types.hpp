@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace camsynth {
+
+// 簡易的な構造体定義
+struct FrameData {
+    // 各ジョイントの Position
+    std::vector<std::array<double, 3>> positions;
+    // ヒップのクォータニオン（4要素）
+    std::array<double, 4> hipQuaternion;
+};
+
+// ビート 1 つ分（開始時刻 [ms] と BPM、小節内の拍の位置 (1 が小節の頭、不明なら 0)）
+struct BeatData {
+    double startMs;
+    double bpm;
+    int position = 0;
+};
+
+// データベースのディレクトリ一式
+struct DatabaseDirs {
+    // 全身のデータ(23ジョイント)。root 基準の姿勢は読み込み時ではなく距離計算の中で求める
+    std::string PositionDatabaseDir = "Database/Split";
+    // ヒップ方向データ
+    std::string HipDirectionDatabaseDir = "Database/Hip_Direction_Split";
+    // 音楽データ
+    std::string MusicDatabaseDir = "Database/Music_Features_Split";
+    // カメラデータ
+    std::string CameraPositionDir = "Database/CameraCentric";
+    std::string CameraRotationDir = "Database/CameraInterpolated";
+    // カメラデータの列ファイル (c<N>.ccol) の置き場所。ディレクトリがあれば初回読み込み時に作る
+    std::string CameraColumnDir = "Database/CameraColumns";
+    // BPM データ
+    std::string BpmData = "Database/BPM/average_bpm.msgpack";
+    // 追記型で取り込んだクリップ（MANIFEST と *.cseg）。ディレクトリがあれば読み込む
+    std::string IngestDir = "Database/Ingest";
+    // ブロック圧縮データベース（MANIFEST と c<N>.cblk、scripts/blockdb で作る）。
+    // ディレクトリがあり、元の Split などから変わっていなければ区間ファイルの代わりに読み込む
+    std::string BlockStoreDir = "Database/Blocks";
+    // 区間ファイルの先読み: 読み込みスレッド数と、取り出し前に読んでおくファイル数の上限（0 なら先読みしない）
+    int IoThreads = 4;
+    int PrefetchDepth = 32;
+    // シャード分割: ShardCount > 1 なら shardOfClip(クリップ番号) == ShardIndex のクリップだけを読み込む
+    int ShardCount = 1;
+    int ShardIndex = 0;
+};
+
+// 入力データ（モーション・音楽）
+struct InputData {
+    std::string inputNumber = "0";          // 入力モーションの番号（同じ番号の候補は除外する）
+    std::vector<FrameData> raw;             // raw.msgpack
+    std::vector<FrameData> stand;           // stand.msgpack (root 基準)
+    std::vector<FrameData> hip;             // hip.msgpack
+    std::vector<BeatData> beats;            // beat.msgpack
+    std::vector<std::vector<double>> music; // music.msgpack
+};
+
+// 検索の設定
+struct SearchOptions {
+    int step = 1;                  // 距離計算でサンプルするフレーム間隔
+    bool slidingOffset = false;    // 候補内の全オフセットを探索する（MASS 方式のスライディング照合）
+    bool clipWindows = false;      // 切り出しファイルの区間に限らず、クリップ全体から候補区間を切り出す
+    int windowStride = 15;         // clipWindows のときの候補区間の開始位置の間隔（フレーム）
+    bool squaredL2 = false;        // 姿勢の距離をジョイントごとの距離の和ではなく二乗 L2 にする（行列積でまとめて計算）
+    int pcaComponents = 0;         // squaredL2 のとき、姿勢を主成分に射影する次元数（0 なら射影しない）
+    bool globalSelection = false;  // セグメント間のつなぎ目も考慮して全体で候補を選ぶ（Viterbi）
+    int globalTopK = 5;            // 全体最適化でセグメントごとに残す候補数
+    double transitionWeight = 1.0; // つなぎ目コストの重み
+    double modePenalty = 0.5;      // mode で選ばれた候補以外を採用するときのペナルティ
+    double sigma = 10.0;           // translations を平滑化するガウス σ
+    int alternatives = 0;          // 別案として作るカメラワークの数（候補リストをその分だけ残す）
+    double timeBudgetMs = 0.0;     // 検索全体の時間の上限（ミリ秒）。超えたら BPM の近い候補から調べた分で選ぶ（0 なら全候補）
+};
+
+// バッチ検索の入力 1 つ分（アルバムの 1 曲など）
+struct SearchRequest {
+    InputData input;
+    std::vector<int> frameIntervals;
+    std::vector<int> modes; // 足りない分は mode 10（スコア最小）
+};
+
+// ストリーミング合成の設定
+struct StreamingOptions {
+    int lookaheadFrames = 15; // 平滑化で先読みするフレーム数
+    int maxDelayFrames = 0;   // 出力遅延の上限（0 ならフレーム間隔の最大値で決まる）
+};
+
+// セグメントごとの検索結果
+struct SegmentChoice {
+    std::string file; // 選ばれたファイル
+    int offset = 0;   // 候補セグメント先頭からのずれ
+};
+
+// スコア付きの候補
+struct CandidateScore {
+    std::string file;
+    double score;
+    int offset;
+};
+
+// 1 セグメント分の候補ごとの距離（正規化前、データベースの走査順）
+// データベースを分けて求めたものも、全体の走査順に並べ直して連結すれば 1 つで求めたものと同じになる
+struct CandidateDistances {
+    std::vector<std::string> fileNames;
+    std::vector<int> offsets;
+    std::vector<size_t> order;                     // 切り出し区間の全体での走査順（clipWindows のときは使わない）
+    std::vector<double> segmentDistances;          // 姿勢
+    std::vector<double> hipDistances;              // ヒップ方向
+    std::vector<double> bpmDiffs;                  // BPM の差
+    std::vector<double> featureDiffs;              // 楽曲特徴量の差
+    double bytesScanned = 0.0;                     // 距離計算で読んだデータベースのバイト数（帯域の計測用の概算）
+
+    size_t size() const { return fileNames.size(); }
+};
+
+struct SegmentSearchResult {
+    std::vector<CandidateScore> topCandidates; // スコア順の上位候補
+    SegmentChoice choice;                      // mode に応じて選ばれた候補
+    int mode = 10;                             // choice を選んだ mode（別案も同じ mode で選ぶ）
+    size_t candidatesExamined = 0;             // 時間の上限までに調べた候補数
+    size_t candidatesTotal = 0;                // 候補の総数
+    std::uint64_t scanAllocations = 0;         // 候補の走査中のヒープ確保の回数（数えるビルドのときだけ）
+};
+
+// 姿勢距離の比較結果（既定のジョイント距離と二乗 L2 を同じ候補で計算したもの、セグメントごと）
+struct MetricComparison {
+    size_t segIndex = 0;
+    size_t numCandidates = 0;
+    double rankCorrelation = 0.0; // 候補の距離の順位相関 (Spearman)
+    int topOverlap = 0;           // 距離の上位 5 件の重なり
+    bool sameBest = false;        // 距離最小の候補が同じか
+    double jointMs = 0.0;         // 既定の距離の計算時間
+    double squaredL2Ms = 0.0;     // 二乗 L2 の計算時間（行列積を含む）
+};
+
+// 全セグメントの検索結果
+struct SearchResult {
+    std::vector<SegmentChoice> choices;              // 各セグメントで選ばれた候補
+    std::vector<int> lengths;                        // 各セグメントの長さ
+    std::vector<SegmentSearchResult> segments;       // 各セグメントの上位候補
+    std::vector<std::array<double, 3>> translations; // 全フレーム分の平行移動（平滑化済み）
+};
+
+// カメラデータ
+struct CameraTrack {
+    std::vector<std::array<double, 3>> position;
+    std::vector<std::array<double, 3>> rotation;
+    std::vector<double> viewangle;
+};
+
+} // namespace camsynth
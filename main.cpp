@@ -20,456 +20,14 @@
 #include "rapidjson/prettywriter.h"
 #include <iostream>
 
+// 合成エンジン本体 (libcamsynth)
+#include "camsynth/camsynth.hpp"
+#include "camsynth/msgpack_io.hpp"
+
 using namespace std;
+using namespace camsynth;
 namespace fs = std::filesystem;
 
-// 簡易的な構造体定義
-struct FrameData {
-    // 各ジョイントの Position
-    vector<array<double, 3>> positions;
-    // ヒップのクォータニオン（4要素）
-    array<double, 4> hipQuaternion;
-};
-
-// MessagePack のヘルパー関数
-// msgpack::object_handle readMsgpack(const string &path) {
-//     ifstream ifs(path, ios::binary);
-//     vector<char> buffer((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
-//     return msgpack::unpack(buffer.data(), buffer.size());
-// }
-
-msgpack::object_handle readMsgpack(const string &path) {
-    // 1) ファイルを開く
-    ifstream ifs(path, ios::binary);
-    if (!ifs) {
-        cerr << "[readMsgpack] ファイルオープン失敗: " << path << endl;
-        // 必要ならここで例外を投げるか、デフォルトの空オブジェクトを返す
-        throw runtime_error("Cannot open file: " + path);
-    }
-
-    // 2) 全バイトを読み込む
-    vector<char> buffer((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
-    size_t bufSize = buffer.size();
-
-    // 3) unpack を試みる
-    try {
-        return msgpack::unpack(buffer.data(), bufSize);
-    }
-    catch (const msgpack::v1::insufficient_bytes &e) {
-        // ここで「ファイル名」と「読み込んだバッファ長」を出力
-        cerr << "[readMsgpack] insufficient_bytes 例外: " << e.what() << "\n"
-             << "  → 対象ファイル: " << path << "\n"
-             << "  → 読み込んだバイト数: " << bufSize << endl;
-        // もしこれ以上処理を止めたくないなら、デフォルトの空オブジェクトを返すなども可能ですが、
-        // 今回はこのまま再スローして呼び出し元でさらにキャッチする例を示します。
-        throw;
-    }
-    catch (const std::exception &e) {
-        // その他の例外をキャッチしたい場合
-        cerr << "[readMsgpack] その他の例外: " << e.what() << "\n"
-             << "  → 対象ファイル: " << path << "\n"
-             << "  → 読み込んだバイト数: " << bufSize << endl;
-        throw;
-    }
-}
-
-const msgpack::object* getMember(const msgpack::object &obj, const string &key) {
-    if(obj.type != msgpack::type::MAP)
-        return nullptr;
-    for (size_t i = 0; i < obj.via.map.size; i++) {
-        const msgpack::object &k = obj.via.map.ptr[i].key;
-        if (k.type == msgpack::type::STR) {
-            string kstr(k.via.str.ptr, k.via.str.size);
-            if (kstr == key)
-                return &obj.via.map.ptr[i].val;
-        }
-    }
-    return nullptr;
-}
-
-// MessagePack を用いた joint_positions の読み込み関数
-vector<FrameData> loadJointPositions(const string &msgpackFilePath) {
-    vector<FrameData> frames;
-    msgpack::object_handle oh = readMsgpack(msgpackFilePath);
-    msgpack::object obj = oh.get();
-    for (size_t i = 0; i < obj.via.array.size; i++) {
-        msgpack::object frameObj = obj.via.array.ptr[i];
-        if(frameObj.type != msgpack::type::MAP)
-            continue;
-        FrameData fd;
-
-        // デバック用
-        // const msgpack::object* posObj = getMember(frameObj, "Position");
-        // if (!posObj) {
-        //     cerr << "デバッグ: フレーム " << i << " でキー 'Position' が見つかりませんでした。" << endl;
-        // } else {
-        //     if (posObj->type != msgpack::type::ARRAY) {
-        //         cerr << "デバッグ: フレーム " << i << " の 'Position' は ARRAY ではありません。型コード: " 
-        //              << posObj->type << endl;
-        //     } else {
-        //         cout << "デバッグ: フレーム " << i << " の 'Position' キーが見つかりました。内容: " 
-        //              << *posObj << endl;
-        //     }
-        // }
-
-        // "Position" キーから各ジョイントの位置を取得
-        const msgpack::object* posObj = getMember(frameObj, "Position");
-        if (posObj && posObj->type == msgpack::type::ARRAY) {
-            for (size_t j = 0; j < posObj->via.array.size; j++) {
-                msgpack::object joint = posObj->via.array.ptr[j];
-                if (joint.type == msgpack::type::ARRAY && joint.via.array.size >= 3) {
-                    array<double, 3> p;
-                    p[0] = joint.via.array.ptr[0].as<double>();
-                    p[1] = joint.via.array.ptr[1].as<double>();
-                    p[2] = joint.via.array.ptr[2].as<double>();
-                    fd.positions.push_back(p);
-                }
-            }
-        }
-        // "HipRotationQuaternion" キーからヒップ回転（クォータニオン）を取得
-        const msgpack::object* hipObj = getMember(frameObj, "HipRotationQuaternion");
-        if (hipObj && hipObj->type == msgpack::type::ARRAY && hipObj->via.array.size >= 4) {
-            fd.hipQuaternion[0] = hipObj->via.array.ptr[0].as<double>();
-            fd.hipQuaternion[1] = hipObj->via.array.ptr[1].as<double>();
-            fd.hipQuaternion[2] = hipObj->via.array.ptr[2].as<double>();
-            fd.hipQuaternion[3] = hipObj->via.array.ptr[3].as<double>();
-        }
-        frames.push_back(fd);
-    }
-    return frames;
-}
-
-// JSONに依存しない計算処理
-double calculateJointDistanceSparse(const vector<FrameData> &frames1,
-                                    const vector<FrameData> &frames2,
-                                    int step) {
-    double total_distance = 0.0;
-    int minLen = min(frames1.size(), frames2.size());
-    for (int i = 0; i < minLen; i += step) {
-        const auto &joints1 = frames1[i].positions;
-        const auto &joints2 = frames2[i].positions;
-        int numJoints = min(joints1.size(), joints2.size());
-        double frameDistance = 0.0;
-        for (int j = 0; j < numJoints; j++) {
-            double dx = joints1[j][0] - joints2[j][0];
-            double dy = joints1[j][1] - joints2[j][1];
-            double dz = joints1[j][2] - joints2[j][2];
-            frameDistance += sqrt(dx * dx + dy * dy + dz * dz);
-        }
-        total_distance += frameDistance;
-    }
-    return total_distance;
-}
-
-double calculateHipVectorDistanceSparse(const vector<FrameData> &frames1,
-                                        const vector<FrameData> &frames2,
-                                        int step) {
-    double total_distance = 0.0;
-    int minLen = min(frames1.size(), frames2.size());
-    for (int i = 0; i < minLen; i += step) {
-        const auto &q1 = frames1[i].hipQuaternion;
-        const auto &q2 = frames2[i].hipQuaternion;
-        double dx = q1[0] - q2[0];
-        double dy = q1[1] - q2[1];
-        double dz = q1[2] - q2[2];
-        double dw = q1[3] - q2[3];
-        total_distance += sqrt(dx * dx + dy * dy + dz * dz + dw * dw);
-    }
-    return total_distance;
-}
-
-vector<array<double, 3>> applyGaussianFilter(const vector<array<double, 3>> &data, double sigma) {
-    int kernelSize = max(3, (int)ceil(6.0 * sigma));
-    if (kernelSize % 2 == 0)
-        kernelSize += 1;
-    vector<double> kernel(kernelSize);
-    int half = kernelSize / 2;
-    double sum = 0.0;
-    double invS2 = 1.0 / (2.0 * sigma * sigma);
-    for (int i = 0; i < kernelSize; i++) {
-        int x = i - half;
-        double val = exp(-x * x * invS2);
-        kernel[i] = val;
-        sum += val;
-    }
-    for (int i = 0; i < kernelSize; i++) {
-        kernel[i] /= sum;
-    }
-    int n = data.size();
-    vector<array<double, 3>> smoothed(n, {0.0, 0.0, 0.0});
-    for (int i = 0; i < n; i++) {
-        double outx = 0.0, outy = 0.0, outz = 0.0;
-        for (int k = 0; k < kernelSize; k++) {
-            int index = i + (k - half);
-            if (index < 0)
-                index = 0;
-            if (index >= n)
-                index = n - 1;
-            outx += data[index][0] * kernel[k];
-            outy += data[index][1] * kernel[k];
-            outz += data[index][2] * kernel[k];
-        }
-        smoothed[i] = {outx, outy, outz};
-    }
-    return smoothed;
-}
-
-vector<double> normalizeValues(const vector<double> &vals) {
-    vector<double> out;
-    if (vals.empty())
-        return out;
-    double minV = vals[0], maxV = vals[0];
-    for (auto v : vals) {
-        if (v < minV)
-            minV = v;
-        if (v > maxV)
-            maxV = v;
-    }
-    double range = maxV - minV;
-    out.resize(vals.size());
-    if (range == 0.0) {
-        fill(out.begin(), out.end(), 0.0);
-        return out;
-    }
-    for (size_t i = 0; i < vals.size(); i++) {
-        out[i] = (vals[i] - minV) / range;
-    }
-    return out;
-}
-
-vector<vector<FrameData>> splitByFrameIntervals(const vector<FrameData> &data,
-                                                 const vector<int> &frameIntervals) {
-    vector<vector<FrameData>> segments;
-    int start = 0;
-    int n = data.size();
-    for (auto interval : frameIntervals) {
-        int end = start + interval;
-        if (end > n)
-            end = n;
-        vector<FrameData> segment;
-        for (int i = start; i < end; i++) {
-            segment.push_back(data[i]);
-        }
-        segments.push_back(segment);
-        start = end;
-        if (start >= n)
-            break;
-    }
-    return segments;
-}
-
-// 距離の平均値算出
-double getDistanceAverageForCandidateMsgpack(const string &candidateFile,
-                                               int lengthFrames,
-                                               const string &CameraPositionDir) {
-    string baseName = candidateFile;
-    if (baseName.size() > 7 && baseName.substr(baseName.size() - 7) == ".msgpack") {
-        baseName = baseName.substr(0, baseName.size() - 7);
-    }
-    size_t underscorePos = baseName.find('_');
-    if (underscorePos == string::npos)
-        return 0.0;
-    string firstPart = baseName.substr(0, underscorePos);
-    string secondPart = baseName.substr(underscorePos + 1);
-    string fileNumberStr = firstPart.substr(1);
-    if (!secondPart.empty() && secondPart.front() == '(')
-        secondPart.erase(0, 1);
-    if (!secondPart.empty() && secondPart.back() == ')')
-        secondPart.pop_back();
-    size_t commaPos = secondPart.find(',');
-    if (commaPos == string::npos)
-        return 0.0;
-    int segStart = stoi(secondPart.substr(0, commaPos));
-    int segEnd = stoi(secondPart.substr(commaPos + 1));
-    
-    string cameraPositionFile = CameraPositionDir + "/c" + fileNumberStr + ".msgpack";
-    msgpack::object_handle oh = readMsgpack(cameraPositionFile);
-    msgpack::object obj = oh.get();
-    const msgpack::object* distanceObj = getMember(obj, "Distance");
-    if (!distanceObj || distanceObj->type != msgpack::type::ARRAY)
-        return 0.0;
-    int totalSize = distanceObj->via.array.size;
-    int startIndex = segStart;
-    int endIndex = segStart + lengthFrames;
-    if (startIndex < 0)
-        startIndex = 0;
-    if (endIndex > totalSize)
-        endIndex = totalSize;
-    if (endIndex <= startIndex)
-        return 0.0;
-    double sumDist = 0.0;
-    int count = 0;
-    for (int i = startIndex; i < endIndex; i++) {
-        double d = distanceObj->via.array.ptr[i].as<double>();
-        sumDist += d;
-        count++;
-    }
-    return (count == 0) ? 0.0 : sumDist / count;
-}
-
-double framesToMilliseconds(int frames, int fps = 30) {
-    return (double(frames) / fps) * 1000.0;
-}
-
-// BPM の平均値算出
-double calculateAverageBpmInIntervalMsgpack(const msgpack::object &beats, int startFrame, int endFrame, int fps = 30) {
-    double startMs = framesToMilliseconds(startFrame, fps);
-    double endMs = framesToMilliseconds(endFrame, fps);
-    double sumBpm = 0.0;
-    int cnt = 0;
-    if (beats.type != msgpack::type::ARRAY)
-        return 0.0;
-    for (size_t i = 0; i < beats.via.array.size; i++) {
-        msgpack::object beatObj = beats.via.array.ptr[i];
-        const msgpack::object* startObj = getMember(beatObj, "start");
-        const msgpack::object* bpmObj = getMember(beatObj, "bpm");
-        if (!startObj || !bpmObj)
-            continue;
-        double beatStart = startObj->as<double>();
-        if (beatStart >= startMs && beatStart < endMs) {
-            double bpmVal = bpmObj->as<double>();
-            sumBpm += bpmVal;
-            cnt++;
-        }
-    }
-    return (cnt == 0) ? 0.0 : sumBpm / cnt;
-}
-
-// ファイル名から (file_number, start_frame, end_frame) を抽出
-bool parseSegmentFilename(const string &filename, string &outFileNumber, int &outStart, int &outEnd) {
-    string name = filename;
-    if (name.size() > 7 && name.substr(name.size() - 7) == ".msgpack") {
-        name = name.substr(0, name.size() - 7);
-    }
-    size_t underscorePos = name.find('_');
-    if (underscorePos == string::npos)
-        return false;
-    string part1 = name.substr(0, underscorePos);
-    string part2 = name.substr(underscorePos + 1);
-    if (part1.size() <= 1)
-        return false;
-    outFileNumber = part1.substr(1);
-    if (!part2.empty() && part2.front() == '(')
-        part2.erase(0, 1);
-    if (!part2.empty() && part2.back() == ')')
-        part2.pop_back();
-    size_t commaPos = part2.find(',');
-    if (commaPos == string::npos)
-        return false;
-    outStart = stoi(part2.substr(0, commaPos));
-    outEnd = stoi(part2.substr(commaPos + 1));
-    return true;
-}
-
-// BPM 値を取得する
-double getBpmFromBpmMsgpack(const string &BpmData,
-                             const string &fileNumberStr,
-                             int startFrame,
-                             int endFrame) {
-    msgpack::object_handle oh = readMsgpack(BpmData);
-    msgpack::object obj = oh.get();
-    const msgpack::object* fileObj = getMember(obj, fileNumberStr);
-    if (!fileObj || fileObj->type != msgpack::type::ARRAY)
-        return 0.0;
-    for (size_t i = 0; i < fileObj->via.array.size; i++) {
-        msgpack::object intervalObj = fileObj->via.array.ptr[i];
-        const msgpack::object* fr = getMember(intervalObj, "interval_frames");
-        if (!fr || fr->type != msgpack::type::ARRAY || fr->via.array.size < 2)
-            continue;
-        int startVal = fr->via.array.ptr[0].as<int>();
-        int endVal = fr->via.array.ptr[1].as<int>();
-        if (startVal == startFrame && endVal == endFrame) {
-            const msgpack::object* avgBpmObj = getMember(intervalObj, "average_bpm");
-            if (avgBpmObj)
-                return avgBpmObj->as<double>();
-        }
-    }
-    return 0.0;
-}
-
-// 指定した msgpack オブジェクトから start ～ end (end は除く) の音楽特徴量シーケンスを抽出する関数
-vector<vector<double>> extractMusicFeatureSegment(const msgpack::object &musicObj, int start, int end) {
-    vector<vector<double>> segment;
-    int total = musicObj.via.array.size;
-    for (int i = start; i < end && i < total; i++) {
-        const msgpack::object &frameObj = musicObj.via.array.ptr[i];
-        // 次元数
-        if (frameObj.type == msgpack::type::ARRAY && frameObj.via.array.size == 1) {
-            vector<double> vec(1);
-            for (int k = 0; k < 1; k++) {
-                vec[k] = frameObj.via.array.ptr[k].as<double>();
-            }
-            segment.push_back(vec);
-        } else {
-            cerr << "Warning: Frame " << i << " is not a valid 1-dim vector." << endl;
-        }
-    }
-    return segment;
-}
-
-// フレームごとに、入力セグメントと候補セグメントの1次元ベクトルの差分を計算する。
-// step 間隔でサンプルし、各次元の差分を足し合わせたものを返す（各要素は各次元の総和）。
-// 次元数
-vector<double> calculateMusicFeatureDistanceSparse(const vector<vector<double>> &inputSegment,
-    const vector<vector<double>> &candidateSegment,
-    int step) {
-int n = min(inputSegment.size(), candidateSegment.size());
-vector<double> diffSum(1, 0.0);
-for (int i = 0; i < n; i += step) {
-for (int k = 0; k < 1; k++) {
-diffSum[k] += fabs(inputSegment[i][k] - candidateSegment[i][k]);
-}
-}
-return diffSum;
-}
-
-// カメラ位置の平均（移動距離）を取得する
-double getPositionAverageForCandidateMsgpack(const string &candidateFile,
-                                               int segmentLen,
-                                               const string &CameraPositionDir) {
-    string fileNumberStr;
-    int segStart = 0, segEnd = 0;
-    if (!parseSegmentFilename(candidateFile, fileNumberStr, segStart, segEnd)) {
-        cerr << "parseSegmentFilename失敗: " << candidateFile << endl;
-        return 0.0;
-    }
-    string cameraDataFile = CameraPositionDir + "/c" + fileNumberStr + ".msgpack";
-    msgpack::object_handle oh = readMsgpack(cameraDataFile);
-    msgpack::object obj = oh.get();
-    const msgpack::object* cameraEyeObj = getMember(obj, "camera_eye");
-    if (!cameraEyeObj || cameraEyeObj->type != msgpack::type::ARRAY) {
-        cerr << "camera_eye がありません: " << cameraDataFile << endl;
-        return 0.0;
-    }
-    int totalSize = cameraEyeObj->via.array.size;
-    int startIndex = segStart;
-    int endIndex = segStart + segmentLen;
-    if (startIndex < 0)
-        startIndex = 0;
-    if (endIndex > totalSize)
-        endIndex = totalSize;
-    if (endIndex <= startIndex)
-        return 0.0;
-    array<double, 3> firstPos = {0.0, 0.0, 0.0};
-    array<double, 3> lastPos = {0.0, 0.0, 0.0};
-    msgpack::object firstFrame = cameraEyeObj->via.array.ptr[startIndex];
-    if (firstFrame.type == msgpack::type::ARRAY && firstFrame.via.array.size >= 3) {
-        firstPos[0] = firstFrame.via.array.ptr[0].as<double>();
-        firstPos[1] = firstFrame.via.array.ptr[1].as<double>();
-        firstPos[2] = firstFrame.via.array.ptr[2].as<double>();
-    }
-    msgpack::object lastFrame = cameraEyeObj->via.array.ptr[endIndex - 1];
-    if (lastFrame.type == msgpack::type::ARRAY && lastFrame.via.array.size >= 3) {
-        lastPos[0] = lastFrame.via.array.ptr[0].as<double>();
-        lastPos[1] = lastFrame.via.array.ptr[1].as<double>();
-        lastPos[2] = lastFrame.via.array.ptr[2].as<double>();
-    }
-    double dx = lastPos[0] - firstPos[0];
-    double dy = lastPos[1] - firstPos[1];
-    double dz = lastPos[2] - firstPos[2];
-    return sqrt(dx * dx + dy * dy + dz * dz);
-}
-
 int getIntervalIndex(int frameNumber, const vector<int> &frameIntervals) {
     int cumulative = 0;
     for (size_t i = 0; i < frameIntervals.size(); i++) {
@@ -492,569 +50,14 @@ vector<int> convertFramesToIndices(const vector<int> &frameNumbers, const vector
     return indices;
 }
 
-// メインの類似ファイル検索
-struct CalDistance2Result {
-    vector<string> closestFiles;   // 各セグメントで選ばれたファイル
-    vector<int> lengths;           // 各セグメントの長さ
-    string inputNumber;            // 入力モーションの番号
-    vector<array<double, 3>> translations; // 全フレーム分の平行移動
-};
-
-CalDistance2Result calDistance2Msgpack(const string &inputNumber,
-                                       const string &inputPositionPath,
-                                       const string &inputStandPositionPath,
-                                       const string &inputHipPath,
-                                       const string &inputBeatPath,
-                                       const string &inputMusicPath,
-                                       const string &StandPositionDatabaseDir,
-                                       const string &PositionDatabaseDir,
-                                       const string &HipDirectionDatabaseDir,
-                                       const string &MusicDatabaseDir,
-                                       const string &CameraPositionDir,
-                                       const string &BpmData,
-                                       const vector<int> &frameIntervals,
-                                       const vector<int> &modes,
-                                       int step) {
-
-    CalDistance2Result result;
-    
-    // 入力モーションの BPM ファイル読み込み
-    msgpack::object_handle beatOh = readMsgpack(inputBeatPath);
-    msgpack::object beatObj = beatOh.get();
-    const msgpack::object* beatsMember = getMember(beatObj, "beats");
-
-    // --- 入力側音楽特徴量のロード ---
-    msgpack::object_handle inputMusicOh = readMsgpack(inputMusicPath);
-    msgpack::object inputMusicObj = inputMusicOh.get();
-    if (inputMusicObj.type != msgpack::type::ARRAY) {
-        cerr << "Error: Input music feature file " << inputMusicPath
-             << " does not contain an array." << endl;
-    }
-
-    // 入力側の音楽特徴量をセグメントごとに抽出する
-    vector< vector<vector<double>> > inputMusicSegments;
-    vector<double> inputBpmList;
-
-    int segStartFrame = 0;
-    for (auto segLen : frameIntervals) {
-        int segEndFrame = segStartFrame + segLen;
-
-        double avgBpm = 0.0;
-        if (beatsMember && beatsMember->type == msgpack::type::ARRAY) {
-            avgBpm = calculateAverageBpmInIntervalMsgpack(*beatsMember, segStartFrame, segEndFrame, 30);
-        }
-        inputBpmList.push_back(avgBpm);
-
-        vector<vector<double>> seg = extractMusicFeatureSegment(inputMusicObj, segStartFrame, segEndFrame);
-        inputMusicSegments.push_back(seg);
-
-        segStartFrame = segEndFrame;
-    }
-
-    // 入力モーションデータの読み込み
-    vector<FrameData> inputStandPositions = loadJointPositions(inputStandPositionPath);
-    vector<FrameData> inputHipDirections = loadJointPositions(inputHipPath);
-    vector<FrameData> inputPositionFrames = loadJointPositions(inputPositionPath);
-    vector<vector<FrameData>> rawInputSegments = splitByFrameIntervals(inputPositionFrames, frameIntervals);
-    vector<vector<FrameData>> inputSegments = splitByFrameIntervals(inputStandPositions, frameIntervals);
-    vector<vector<FrameData>> hipSegments = splitByFrameIntervals(inputHipDirections, frameIntervals);
-    
-    // 各セグメントごとに類似ファイルを検索
-    for (size_t segIndex = 0; segIndex < inputSegments.size(); segIndex++) {
-        const auto &inputSegment = inputSegments[segIndex];
-        const auto &rawSegment = rawInputSegments[segIndex];
-        const auto &hipSegment = hipSegments[segIndex];
-        int segmentLen = inputSegment.size();
-        double segmentBpmInput = (segIndex < inputBpmList.size()) ? inputBpmList[segIndex] : 0.0;
-        // 入力側の音楽特徴量シーケンス（フレームごと3次元ベクトル）
-        const vector<vector<double>> &inputMusicSegment = inputMusicSegments[segIndex];
-
-        vector<double> segmentDistances;
-        vector<double> hipDistances;
-        vector<double> bpmDiffs;
-        vector<string> fileNames;
-        vector<vector<double>> candidateFeatureDiffs;
-
-        // データベースディレクトリ内の各ファイルを走査
-        for (const auto &entry : fs::directory_iterator(StandPositionDatabaseDir)) {
-            if (!entry.is_regular_file())
-                continue;
-            string fname = entry.path().filename().string(); // 例："m62_(0,550).msgpack"
-
-            if (fname.find("m" + inputNumber + "_") == 0)
-                continue;
-            if (fname.size() <= 8 || fname.substr(fname.size() - 8) != ".msgpack")
-                continue;
-            string dbFilePath = entry.path().string();
-            vector<FrameData> dbPositions = loadJointPositions(dbFilePath);
-
-            // ここでデバッグ出力：候補ファイルのフレーム数と現在のセグメントの長さを出力
-            // cout << "候補ファイル " << fname << " のフレーム数: " 
-            // << dbPositions.size() << ", セグメントの長さ: " << segmentLen << "\n";
-            
-            if (dbPositions.size() < (size_t)segmentLen)
-                continue;
-            // ヒップ方向データの取得
-            string dbFileNumberStr;
-            int dbStart = 0, dbEnd = 0;
-            if (!parseSegmentFilename(fname, dbFileNumberStr, dbStart, dbEnd))
-                continue;
-            string dbHipFilePath = HipDirectionDatabaseDir + "/m" + dbFileNumberStr + "_(" +
-                                    to_string(dbStart) + ", " + to_string(dbEnd) + ").msgpack";
-            vector<FrameData> dbHipPositions = loadJointPositions(dbHipFilePath);
-            if (dbHipPositions.size() < (size_t)segmentLen)
-                continue;
-            double segDist = calculateJointDistanceSparse(inputSegment,
-                             vector<FrameData>(dbPositions.begin(), dbPositions.begin() + segmentLen), step);
-            double hipDist = calculateHipVectorDistanceSparse(hipSegment,
-                             vector<FrameData>(dbHipPositions.begin(), dbHipPositions.begin() + segmentLen), step);
-            double dbBpmVal = getBpmFromBpmMsgpack(BpmData, dbFileNumberStr, dbStart, dbEnd);
-            double bpmDiff = fabs(segmentBpmInput - dbBpmVal);
-            segmentDistances.push_back(segDist);
-            hipDistances.push_back(hipDist);
-            bpmDiffs.push_back(bpmDiff);
-            fileNames.push_back(fname);
-            // 楽曲特徴量の差分計算
-            // 候補側は musicDatabaseDir 内の "a[dbFileNumberStr].msgpack" から、対象区間のシーケンスを抽出
-            string candidateMusicFile = MusicDatabaseDir + "/m" + dbFileNumberStr + "_(" +
-                                   to_string(dbStart) + "," + to_string(dbEnd) + ").msgpack";
-            msgpack::object_handle candidateMusicOh = readMsgpack(candidateMusicFile);
-            msgpack::object candidateMusicObj = candidateMusicOh.get();
-            vector<vector<double>> candidateMusicSegment = extractMusicFeatureSegment(candidateMusicObj, dbStart, dbEnd);
-            vector<double> diffVec = calculateMusicFeatureDistanceSparse(inputMusicSegment, candidateMusicSegment, step);
-            candidateFeatureDiffs.push_back(diffVec);
-        }
-        vector<double> normSegDist = normalizeValues(segmentDistances);
-        vector<double> normHipDist = normalizeValues(hipDistances);
-        vector<double> normBpmDiff = normalizeValues(bpmDiffs);
-
-        // 各次元ごとに、各候補の楽曲特徴量差分を正規化
-        // 次元数
-        int numCandidates = candidateFeatureDiffs.size();
-        vector<double> featureScores(numCandidates, 0.0);
-        for (int k = 0; k < 1; k++) {
-            vector<double> col;
-            for (int i = 0; i < numCandidates; i++) {
-                col.push_back(candidateFeatureDiffs[i][k]);
-            }
-            vector<double> normCol = normalizeValues(col);
-            for (int i = 0; i < numCandidates; i++) {
-                candidateFeatureDiffs[i][k] = normCol[i];
-            }
-        }
-        // 各候補の正規化済み3次元差分を総和してスカラーに
-        // 次元数
-        for (int i = 0; i < numCandidates; i++) {
-            double score = 0.0;
-            for (int k = 0; k < 1; k++) {
-                score += candidateFeatureDiffs[i][k];
-            }
-            featureScores[i] = score;
-        }
-        vector<double> normFeatureScore = normalizeValues(featureScores);
- 
-        // 類似度の重み付け
-        double weight_motion = 1, weight_music = 1;
-
-        vector<pair<string, double>> scores;
-        for (size_t i = 0; i < fileNames.size(); i++) {
-            double s = weight_motion * (normSegDist[i] + normHipDist[i]) + weight_music * (normFeatureScore[i] + normBpmDiff[i]);
-            scores.push_back({fileNames[i], s});
-        }
-        sort(scores.begin(), scores.end(), [](auto &a, auto &b) { return a.second < b.second; });
-        int top_n = scores.size() < 5 ? scores.size() : 5;
-        cout << "----- Top 5 candidates for segment " << segIndex << " -----\n";
-        for (int i = 0; i < top_n; i++) {
-            cout << "   Rank " << (i + 1) << ": " << scores[i].first
-                 << " Score=" << scores[i].second << "\n";
-        }
-        string chosenFile;
-        double min_score = 0.0;
-        int currentMode = modes[segIndex];  // セグメントごとの mode
-
-        if (currentMode == 1) {
-            // Mode 1: 俯瞰視点 (引き)
-            // Distance の平均が最も小さい候補を採用
-            double min_distance_val = std::numeric_limits<double>::infinity();
-            std::string best_file;
-            double best_score = 0.0;
-            for (int i = 0; i < top_n; i++) {
-                std::string candidate_file = scores[i].first;
-                double candidate_score = scores[i].second;
-                double avg_dist = getDistanceAverageForCandidateMsgpack(candidate_file, segmentLen, CameraPositionDir);
-                if (avg_dist < min_distance_val) {
-                    min_distance_val = avg_dist;
-                    best_file = candidate_file;
-                    best_score = candidate_score;
-                }
-            }
-            chosenFile = best_file;
-            min_score = best_score;
-            std::cout << "[Selected file (引き)] " << chosenFile 
-                      << " with DistanceAvg = " << min_distance_val 
-                      << ", Score = " << min_score << std::endl;
-
-        } else if (currentMode == 2) {
-            // Mode 2: 寄り視点
-            // Distance の平均が最も大きい候補を採用 (ただし avg_dist < -5 の条件付き)
-            double max_distance_val = -std::numeric_limits<double>::infinity();
-            std::string best_file;
-            double best_score = 0.0;
-            for (int i = 0; i < top_n; i++) {
-                std::string candidate_file = scores[i].first;
-                double candidate_score = scores[i].second;
-                double avg_dist = getDistanceAverageForCandidateMsgpack(candidate_file, segmentLen, CameraPositionDir);
-                if (avg_dist > max_distance_val && avg_dist < -5) {
-                    max_distance_val = avg_dist;
-                    best_file = candidate_file;
-                    best_score = candidate_score;
-                }
-            }
-            chosenFile = best_file;
-            min_score = best_score;
-            std::cout << "[Selected file (寄り)] " << chosenFile 
-                    << " with DistanceAvg = " << max_distance_val 
-                    << ", Score = " << min_score << std::endl;
-        
-        } else if (currentMode == 3) {
-            // Mode 3: 動きが多いカメラワーク
-            // Camera Movement (カメラ位置の移動距離) が最も大きい候補を採用
-            double max_camera_movement = -1.0;
-            std::string best_file;
-            double best_score = 0.0;
-            for (int i = 0; i < top_n; i++) {
-                std::string candidate_file = scores[i].first;
-                double candidate_score = scores[i].second;
-                double movement_distance = getPositionAverageForCandidateMsgpack(candidate_file, segmentLen, CameraPositionDir);
-                if (movement_distance > max_camera_movement) {
-                    max_camera_movement = movement_distance;
-                    best_file = candidate_file;
-                    best_score = candidate_score;
-                }
-            }
-            chosenFile = best_file;
-            min_score = best_score;
-            std::cout << "[Selected file (カメラ移動最大)] " << chosenFile 
-                      << " with Camera Movement = " << max_camera_movement 
-                      << ", Score = " << min_score << std::endl;
-        } else if (currentMode == 4) {
-            // Mode 4: 動きが少ないカメラワーク
-            // Camera Movement が最も小さい候補を採用
-            double min_camera_movement = 100.0; // 適切な初期値を設定
-            std::string best_file;
-            double best_score = 0.0;
-            for (int i = 0; i < top_n; i++) {
-                std::string candidate_file = scores[i].first;
-                double candidate_score = scores[i].second;
-                double movement_distance = getPositionAverageForCandidateMsgpack(candidate_file, segmentLen, CameraPositionDir);
-                if (movement_distance < min_camera_movement) {
-                    min_camera_movement = movement_distance;
-                    best_file = candidate_file;
-                    best_score = candidate_score;
-                }
-            }
-            chosenFile = best_file;
-            min_score = best_score;
-            std::cout << "[Selected file (カメラ移動最小)] " << chosenFile 
-                        << " with Camera Movement = " << min_camera_movement 
-                        << ", Score = " << min_score << std::endl;
-
-        } else if (currentMode == 5) {
-            // Mode 5: 視点引き (mode==1) と 動き多め (mode==3) の両方を考慮
-            std::unordered_map<std::string, int> rank_mode1;
-            std::unordered_map<std::string, int> rank_mode3;
-            
-            // 視点引き (mode==1) の評価: Distance の平均が小さい順にソート
-            std::vector<std::pair<std::string, double>> sorted_mode1(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode1.begin(), sorted_mode1.end(), [&](const auto &a, const auto &b) {
-                return getDistanceAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir) <
-                        getDistanceAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode1.size()); ++rank) {
-                rank_mode1[sorted_mode1[rank - 1].first] = rank;
-            }
-            
-            // 動き多め (mode==3) の評価: Camera Movement が大きい順にソート
-            std::vector<std::pair<std::string, double>> sorted_mode3(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode3.begin(), sorted_mode3.end(), [&](const auto &a, const auto &b) {
-                return getPositionAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir) >
-                        getPositionAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode3.size()); ++rank) {
-                rank_mode3[sorted_mode3[rank - 1].first] = rank;
-            }
-            
-            // 合計ランクの計算
-            std::unordered_map<std::string, int> rank_sum;
-            for (const auto &p : rank_mode1) {
-                if (rank_mode3.find(p.first) != rank_mode3.end())
-                    rank_sum[p.first] = p.second + rank_mode3[p.first];
-            }
-            int min_rank = std::numeric_limits<int>::max();
-            std::string best_file;
-            for (const auto &p : rank_sum) {
-                if (p.second < min_rank) {
-                    min_rank = p.second;
-                    best_file = p.first;
-                }
-            }
-            chosenFile = best_file;
-            min_score = static_cast<double>(min_rank);
-            std::cout << "[Selected file (視点引き + 動き多め)] " << chosenFile 
-                        << " with rank sum = " << min_rank << std::endl;
-
-        } else if (currentMode == 6) {
-            // Mode 6: 視点寄り (mode==2) と 動き多め (mode==3) の両方を考慮
-            std::unordered_map<std::string, int> rank_mode2;
-            std::unordered_map<std::string, int> rank_mode3;
-            
-            // 視点寄り (mode==2) の評価: 特定条件付きソート
-            std::vector<std::pair<std::string, double>> sorted_mode2(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode2.begin(), sorted_mode2.end(), [&](const auto &a, const auto &b) {
-                double pa = getPositionAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir);
-                double pb = getPositionAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-                if ((pa > -5) != (pb > -5)) {
-                    return (pa <= -5);  // 値が -5 以下のものを優先
-                } else {
-                    double da = getDistanceAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir);
-                    double db = getDistanceAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-                    return da > db; 
-                }
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode2.size()); ++rank) {
-                rank_mode2[sorted_mode2[rank - 1].first] = rank;
-            }
-            
-            // 動き多め (mode==3) の評価: Camera Movement が大きい順
-            std::vector<std::pair<std::string, double>> sorted_mode3(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode3.begin(), sorted_mode3.end(), [&](const auto &a, const auto &b) {
-                return getPositionAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir) >
-                        getPositionAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode3.size()); ++rank) {
-                rank_mode3[sorted_mode3[rank - 1].first] = rank;
-            }
-            
-            std::unordered_map<std::string, int> rank_sum;
-            for (const auto &p : rank_mode2) {
-                if (rank_mode3.find(p.first) != rank_mode3.end())
-                    rank_sum[p.first] = p.second + rank_mode3[p.first];
-            }
-            int min_rank = std::numeric_limits<int>::max();
-            std::string best_file;
-            for (const auto &p : rank_sum) {
-                if (p.second < min_rank) {
-                    min_rank = p.second;
-                    best_file = p.first;
-                }
-            }
-            chosenFile = best_file;
-            min_score = static_cast<double>(min_rank);
-            std::cout << "[Selected file (視点寄り + 動き多め)] " << chosenFile 
-                        << " with rank sum = " << min_rank << std::endl;
-
-        } else if (currentMode == 7) {
-            // Mode 7: 視点引き (mode==1) と 動き少なめ (mode==4) の両方を考慮
-            std::unordered_map<std::string, int> rank_mode1;
-            std::unordered_map<std::string, int> rank_mode4;
-            
-            std::vector<std::pair<std::string, double>> sorted_mode1(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode1.begin(), sorted_mode1.end(), [&](const auto &a, const auto &b) {
-                return getDistanceAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir) <
-                        getDistanceAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode1.size()); ++rank) {
-                rank_mode1[sorted_mode1[rank - 1].first] = rank;
-            }
-            
-            std::vector<std::pair<std::string, double>> sorted_mode4(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode4.begin(), sorted_mode4.end(), [&](const auto &a, const auto &b) {
-                return getPositionAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir) <
-                        getPositionAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode4.size()); ++rank) {
-                rank_mode4[sorted_mode4[rank - 1].first] = rank;
-            }
-            
-            std::unordered_map<std::string, int> rank_sum;
-            for (const auto &p : rank_mode1) {
-                if (rank_mode4.find(p.first) != rank_mode4.end())
-                    rank_sum[p.first] = p.second + rank_mode4[p.first];
-            }
-            int min_rank = std::numeric_limits<int>::max();
-            std::string best_file;
-            for (const auto &p : rank_sum) {
-                if (p.second < min_rank) {
-                    min_rank = p.second;
-                    best_file = p.first;
-                }
-            }
-            chosenFile = best_file;
-            min_score = static_cast<double>(min_rank);
-            std::cout << "[Selected file (視点引き + 動き少なめ)] " << chosenFile 
-                        << " with rank sum = " << min_rank << std::endl;
-        } else if (currentMode == 8) {
-            // Mode 8: 視点寄り (mode==2) と 動き少なめ (mode==4) の両方を考慮
-            std::unordered_map<std::string, int> rank_mode2;
-            std::unordered_map<std::string, int> rank_mode4;
-            
-            std::vector<std::pair<std::string, double>> sorted_mode2(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode2.begin(), sorted_mode2.end(), [&](const auto &a, const auto &b) {
-                double pa = getPositionAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir);
-                double pb = getPositionAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-                if ((pa > -5) != (pb > -5)) {
-                    return (pa <= -5);
-                } else {
-                    double da = getDistanceAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir);
-                    double db = getDistanceAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-                    return da > db;
-                }
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode2.size()); ++rank) {
-                rank_mode2[sorted_mode2[rank - 1].first] = rank;
-            }
-            
-            std::vector<std::pair<std::string, double>> sorted_mode4(scores.begin(), scores.begin() + top_n);
-            std::sort(sorted_mode4.begin(), sorted_mode4.end(), [&](const auto &a, const auto &b) {
-                return getPositionAverageForCandidateMsgpack(a.first, segmentLen, CameraPositionDir) <
-                        getPositionAverageForCandidateMsgpack(b.first, segmentLen, CameraPositionDir);
-            });
-            for (int rank = 1; rank <= static_cast<int>(sorted_mode4.size()); ++rank) {
-                rank_mode4[sorted_mode4[rank - 1].first] = rank;
-            }
-            
-            std::unordered_map<std::string, int> rank_sum;
-            for (const auto &p : rank_mode2) {
-                if (rank_mode4.find(p.first) != rank_mode4.end())
-                    rank_sum[p.first] = p.second + rank_mode4[p.first];
-            }
-            int min_rank = std::numeric_limits<int>::max();
-            std::string best_file;
-            for (const auto &p : rank_sum) {
-                if (p.second < min_rank) {
-                    min_rank = p.second;
-                    best_file = p.first;
-                }
-            }
-            chosenFile = best_file;
-            min_score = static_cast<double>(min_rank);
-            std::cout << "[Selected file (視点寄り + 動き少なめ)] " << chosenFile 
-                        << " with rank sum = " << min_rank << std::endl;
-        } else {
-            // その他（ミックス視点）：スコア最小の候補をそのまま採用
-            chosenFile = scores[0].first;
-            min_score = scores[0].second;
-            std::cout << "[Selected file (ミックス: Score最小)] " << chosenFile 
-                        << " with score = " << min_score << std::endl;
-        }
-        cout << "選択ファイル: " << chosenFile << "\n";
-        string chosenDbPath = PositionDatabaseDir + "/" + chosenFile;
-        vector<FrameData> chosenDbFrames = loadJointPositions(chosenDbPath);
-        if (chosenDbFrames.size() > (size_t)segmentLen)
-            chosenDbFrames.resize(segmentLen);
-        // 各フレームごとの平行移動（root の差分）を計算
-        for (int i = 0; i < segmentLen; i++) {
-            if (i >= rawSegment.size() || i >= chosenDbFrames.size())
-                break;
-            array<double, 3> rootInput = rawSegment[i].positions[0];
-            array<double, 3> rootChosen = chosenDbFrames[i].positions[0];
-            array<double, 3> trans = {rootInput[0] - rootChosen[0],
-                                      rootInput[1] - rootChosen[1],
-                                      rootInput[2] - rootChosen[2]};
-            result.translations.push_back(trans);
-        }
-        result.closestFiles.push_back(chosenFile);
-        result.lengths.push_back(segmentLen);
-    }
-    // 全フレームの translations にガウスフィルタを適用
-    double sigma = 10.0;
-    result.translations = applyGaussianFilter(result.translations, sigma);
-    return result;
-}
-
-// カメラデータの取得
-struct CameraRetrievalResult {
-    vector<array<double, 3>> position;
-    vector<array<double, 3>> rotation;
-    vector<double> viewangle;
-};
-
-CameraRetrievalResult cameraDataRetrievalMsgpack(const string &CameraPositionDir,
-                                                   const string &CameraRotationDir,
-                                                   const vector<string> &closestFiles,
-                                                   const vector<int> &lengths,
-                                                   const string &inputNumber,
-                                                   const vector<array<double, 3>> &translations) {
-    CameraRetrievalResult camRes;
-    for (size_t segIndex = 0; segIndex < closestFiles.size(); segIndex++) {
-        int lengthFrames = lengths[segIndex];
-        string fileName = closestFiles[segIndex];
-        if (fileName.empty()) {
-            for (int i = 0; i < lengthFrames; i++) {
-                camRes.position.push_back({0, 0, 0});
-                camRes.rotation.push_back({0, 0, 0});
-                camRes.viewangle.push_back(60.0);
-            }
-            continue;
-        }
-        string fileNumberStr;
-        int segStart = 0, segEnd = 0;
-        parseSegmentFilename(fileName, fileNumberStr, segStart, segEnd);
-        string posFile = CameraPositionDir + "/c" + fileNumberStr + ".msgpack";
-        string rotFile = CameraRotationDir + "/c" + fileNumberStr + ".msgpack";
-        msgpack::object_handle posOh = readMsgpack(posFile);
-        msgpack::object posObj = posOh.get();
-        msgpack::object_handle rotOh = readMsgpack(rotFile);
-        msgpack::object rotObj = rotOh.get();
-        const msgpack::object* eyeArray = getMember(posObj, "camera_eye");
-        const msgpack::object* fovArray = getMember(posObj, "Fov");
-        const msgpack::object* rotArray = getMember(rotObj, "Rotation");
-        if (!eyeArray || !fovArray || !rotArray) {
-            cerr << "カメラデータが不足しています: " << posFile << " または " << rotFile << "\n";
-            continue;
-        }
-        int totalSize_eye = eyeArray->via.array.size;
-        int totalSize_rot = rotArray->via.array.size;
-        int totalSize_fov = fovArray->via.array.size;
-        int startIndex = segStart;
-        int endIndex = segStart + lengthFrames;
-        if (endIndex > totalSize_eye)
-            endIndex = totalSize_eye;
-        if (endIndex > totalSize_rot)
-            endIndex = min(endIndex, totalSize_rot);
-        if (endIndex > totalSize_fov)
-            endIndex = min(endIndex, totalSize_fov);
-        for (int i = startIndex; i < endIndex; i++) {
-            msgpack::object e = eyeArray->via.array.ptr[i];
-            array<double, 3> epos = { e.via.array.ptr[0].as<double>(),
-                                      e.via.array.ptr[1].as<double>(),
-                                      e.via.array.ptr[2].as<double>() };
-            msgpack::object r = rotArray->via.array.ptr[i];
-            array<double, 3> rrot = { r.via.array.ptr[0].as<double>(),
-                                      r.via.array.ptr[1].as<double>(),
-                                      r.via.array.ptr[2].as<double>() };
-            double fv = fovArray->via.array.ptr[i].as<double>();
-            camRes.position.push_back(epos);
-            camRes.rotation.push_back(rrot);
-            camRes.viewangle.push_back(fv);
-        }
-    }
-    int n = min((int)camRes.position.size(), (int)translations.size());
-    for (int i = 0; i < n; i++) {
-        camRes.position[i][0] += translations[i][0];
-        camRes.position[i][1] += translations[i][1];
-        camRes.position[i][2] += translations[i][2];
-    }
-    return camRes;
-}
-
 // JSON 出力（RapidJSON 使用）
-// MessagePack から読み込んだカメラデータを JSON 形式で出力
+// 組み立てたカメラデータを JSON 形式で出力
 void outputCameraJson(const vector<array<double, 3>> &position,
                       const vector<array<double, 3>> &rotation,
                       const vector<double> &viewangle,
                       const string &outputDir,
-                      const string &inputNumber) {
+                      const string &inputNumber,
+                      const string &fileName = "output.json") {
     rapidjson::Document doc;
     doc.SetObject();
     rapidjson::Document::AllocatorType &allocator = doc.GetAllocator();
@@ -1086,7 +89,7 @@ void outputCameraJson(const vector<array<double, 3>> &position,
         records.PushBack(frameData, allocator);
     }
     doc.AddMember("CameraKeyFrameRecord", records, allocator);
-    string outPath = outputDir + "/output.json";
+    string outPath = outputDir + "/" + fileName;
     ofstream ofs(outPath);
     if (!ofs.is_open()) {
         cerr << "出力ファイルを開けません: " << outPath << endl;
@@ -1104,9 +107,30 @@ int main(int argc, char* argv[]){
     if (argc < 4) {
         std::cerr << "使い方: " << argv[0]
                   << " {input_motion_data_dir} {input_music_data_dir} {output_dir}\n"
-                     "  - input_motion_data_dir :  モーションデータがあるディレクトリ\n"
+                     "  - input_motion_data_dir :  モーションデータがあるディレクトリ（.bvh ファイルを渡すと直接読み込む）\n"
                      "  - input_music_data_dir :  音楽データがあるディレクトリ\n"
-                     "  - output_dir            :  結果のカメラデータを出力したいディレクトリ\n";
+                     "  - output_dir            :  結果のカメラデータを出力したいディレクトリ\n"
+                     "オプション:\n"
+                     "  --sliding               :  候補セグメント内の全オフセットを探索して照合する\n"
+                     "  --clip-windows          :  切り出し区間に限らず、クリップ全体から候補区間を切り出して照合する\n"
+                     "  --window-stride=N       :  --clip-windows の候補区間の開始位置の間隔 (既定 15)\n"
+                     "  --alternatives=K        :  別案のカメラワークを output_0.json ～ output_{K-1}.json に出力する\n"
+                     "  --metric=l2             :  姿勢の距離を二乗 L2（行列積でまとめて計算）にする\n"
+                     "  --pca=K                 :  --metric=l2 で姿勢を主成分 K 次元に射影する\n"
+                     "  --compare-metrics       :  既定の距離と二乗 L2 の候補順位を比べて表示する（合成は行わない）\n"
+                     "  --global                :  つなぎ目も考慮して全セグメントの候補をまとめて選ぶ\n"
+                     "  --global-k=N            :  --global でセグメントごとに残す候補数 (既定 5)\n"
+                     "  --budget-ms=N           :  検索の時間の上限（ミリ秒）。BPM の近い候補から調べ、時間内に調べた分で選ぶ\n"
+                     "  --io-threads=N          :  データベース読み込みの先読みスレッド数 (既定 4)\n"
+                     "  --prefetch=N            :  データベース読み込みで先に読んでおくファイル数 (既定 32, 0 で先読みしない)\n"
+                     "  --shards=N              :  データベースを N 個に分けて N 個のワーカープロセスで検索する\n"
+                     "  --numa                  :  NUMA ノードごとにワーカーを置いて CPU とメモリを固定する（--shards がなければノード数に分ける）\n"
+                     "  --shard-threads=N       :  ワーカー内で距離計算を行うスレッド数 (既定 1, 0 でノードの CPU 数)\n"
+                     "  --cache=DIR             :  合成結果を DIR にキャッシュし、同じ入力・設定・データベースなら再計算しない\n"
+                     "  --cache-size=MB         :  --cache の合計サイズの上限 (既定 512 MB、超えたら古いものから消す)\n"
+                     "  --stream                :  ストリーミング（オンライン）合成を行う\n"
+                     "  --lookahead=N           :  ストリーミング時の平滑化の先読みフレーム数 (既定 15)\n"
+                     "  --max-delay=N           :  ストリーミング時の出力遅延の上限フレーム数\n";
         return 1;
     }
 
@@ -1114,6 +138,70 @@ int main(int argc, char* argv[]){
     std::string inputMusicDir  = argv[2];
     std::string outputDir       = argv[3];
 
+    // オプション引数
+    bool streamMode = false;
+    bool compareMetrics = false;
+    int ioThreads = DatabaseDirs().IoThreads;
+    int prefetchDepth = DatabaseDirs().PrefetchDepth;
+    int numShards = 1;
+    bool numaShards = false;
+    ShardPlacement placement;
+    StreamingOptions streamingOptions;
+    SearchOptions searchOptions;
+    string cacheDir;
+    uint64_t cacheBytes = 512ull << 20;
+    for (int i = 4; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--stream") {
+            streamMode = true;
+        } else if (arg == "--sliding") {
+            searchOptions.slidingOffset = true;
+        } else if (arg == "--clip-windows") {
+            searchOptions.clipWindows = true;
+        } else if (arg.rfind("--window-stride=", 0) == 0) {
+            searchOptions.clipWindows = true;
+            searchOptions.windowStride = stoi(arg.substr(16));
+        } else if (arg.rfind("--alternatives=", 0) == 0) {
+            searchOptions.alternatives = stoi(arg.substr(15));
+        } else if (arg == "--metric=l2") {
+            searchOptions.squaredL2 = true;
+        } else if (arg == "--metric=joint") {
+            searchOptions.squaredL2 = false;
+        } else if (arg.rfind("--pca=", 0) == 0) {
+            searchOptions.pcaComponents = stoi(arg.substr(6));
+        } else if (arg == "--compare-metrics") {
+            compareMetrics = true;
+        } else if (arg == "--global") {
+            searchOptions.globalSelection = true;
+        } else if (arg.rfind("--global-k=", 0) == 0) {
+            searchOptions.globalSelection = true;
+            searchOptions.globalTopK = stoi(arg.substr(11));
+        } else if (arg.rfind("--budget-ms=", 0) == 0) {
+            searchOptions.timeBudgetMs = stod(arg.substr(12));
+        } else if (arg.rfind("--io-threads=", 0) == 0) {
+            ioThreads = stoi(arg.substr(13));
+        } else if (arg.rfind("--prefetch=", 0) == 0) {
+            prefetchDepth = stoi(arg.substr(11));
+        } else if (arg.rfind("--shards=", 0) == 0) {
+            numShards = stoi(arg.substr(9));
+        } else if (arg == "--numa") {
+            numaShards = true;
+            placement.numa = true;
+        } else if (arg.rfind("--shard-threads=", 0) == 0) {
+            placement.threadsPerShard = stoi(arg.substr(16));
+        } else if (arg.rfind("--cache=", 0) == 0) {
+            cacheDir = arg.substr(8);
+        } else if (arg.rfind("--cache-size=", 0) == 0) {
+            cacheBytes = stoull(arg.substr(13)) << 20;
+        } else if (arg.rfind("--lookahead=", 0) == 0) {
+            streamingOptions.lookaheadFrames = stoi(arg.substr(12));
+        } else if (arg.rfind("--max-delay=", 0) == 0) {
+            streamingOptions.maxDelayFrames = stoi(arg.substr(12));
+        } else {
+            std::cerr << "[WARN] 不明なオプションです: " << arg << std::endl;
+        }
+    }
+
     // 必要なら末尾にスラッシュを付与
     if (!outputDir.empty() && outputDir.back() != '/' && outputDir.back() != '\\') {
         outputDir += "/";
@@ -1256,43 +344,22 @@ int main(int argc, char* argv[]){
         }
     }
 
-    // 入力モーションデータ
-    string inputPositionPath = inputMotionDir + "/raw.msgpack";
-    string inputStandPositionPath = inputMotionDir + "/stand.msgpack"; 
-    string inputHipPath = inputMotionDir + "/hip.msgpack";
-    // 入力音楽データ
-    string inputBeatPath = inputMusicDir + "/beat.msgpack";
-    string inputMusicPath = inputMusicDir + "/music.msgpack";
-
     // フレーム間隔(カット頻度依存)
     if (file == "Existing"){
         FrameIntervals = "DataBase/Frame_Intervals/frame_intervals_" + std::to_string(cut_number) + ".msgpack";
-    } else if (file == "New") {
-        FrameIntervals = inputMusicDir + "/sabi_frame.msgpack";
     }
-    // データベースのディレクトリ
-    // 全身のデータ(23ジョイント)
-    string StandPositionDatabaseDir = "Database/Stand_Split";
-    string PositionDatabaseDir = "Database/Split";
-    // ヒップ方向データ
-    string HipDirectionDatabaseDir = "Database/Hip_Direction_Split";
-    // 音楽データ
-    string MusicDatabaseDir = "Database/Music_Features_Split";
-    // カメラデータ
-    string CameraPositionDir = "Database/CameraCentric";
-    string CameraRotationDir = "Database/CameraInterpolated";
-    // BPM データ
-    string BpmData = "Database/BPM/average_bpm.msgpack";
-
-
-    // frame_intervals の読み込み（MessagePack 版）
-    msgpack::object_handle intervalsOh = readMsgpack(FrameIntervals);
-    msgpack::object intervalsObj = intervalsOh.get();
+    // データベースのディレクトリ（既定値は Database/ 以下）
+    DatabaseDirs dirs;
+    dirs.IoThreads = ioThreads;
+    dirs.PrefetchDepth = prefetchDepth;
 
     // 対話入力で得た input_number_str を利用
     vector<int> frameIntervals;
     vector<int> sabi_indices;
     if (file == "Existing") {
+        // frame_intervals の読み込み（MessagePack 版）
+        msgpack::object_handle intervalsOh = readMsgpack(FrameIntervals);
+        msgpack::object intervalsObj = intervalsOh.get();
         const msgpack::object* fiMember = getMember(intervalsObj, inputNumber);
         if (fiMember && fiMember->type == msgpack::type::MAP) {
             const msgpack::object* arr = getMember(*fiMember, "frame_intervals");
@@ -1313,27 +380,31 @@ int main(int argc, char* argv[]){
             }
         }
     } else if (file == "New") {
-            const msgpack::object* arr = getMember(intervalsObj, "frame_intervals");
-            if (arr && arr->type == msgpack::type::ARRAY) {
-                for (size_t i = 0; i < arr->via.array.size; i++) {
-                    frameIntervals.push_back(arr->via.array.ptr[i].as<int>());
-                }
-            } else {
-                cerr << "Error: frame_intervals_msgpack に " << inputNumber << " が含まれていません\n";
-                return 1;
-            }
-            // sabi の読み込み（オプショナル）
-            const msgpack::object* sabiArr = getMember(intervalsObj, "sabi");
-            if (sabiArr && sabiArr->type == msgpack::type::ARRAY) {
-                for (size_t i = 0; i < sabiArr->via.array.size; i++) {
-                    sabi_indices.push_back(sabiArr->via.array.ptr[i].as<int>());
-            }
+        // ビート (beat.msgpack) の小節の頭とモーションのフレーム数からセグメントに分け、
+        // サビ (sabi.msgpack) の範囲に終わるセグメントを sabi_indices にする
+        // カットの頻度を低くする範囲では 1 セグメントを 4 小節分にする
+        SegmentationOptions segmentation;
+        if (cut_number == 1 || cut_number == 2)
+            segmentation.downbeatsPerSegment = 4;
+        if (cut_number == 1 || cut_number == 3)
+            segmentation.chorusDownbeatsPerSegment = 4;
+        vector<ChorusRange> chorus;
+        if (fs::exists(inputMusicDir + "/sabi.msgpack"))
+            chorus = loadChorusRangesMsgpack(inputMusicDir + "/sabi.msgpack", segmentation.fps);
+        else
+            cout << "[INFO] sabi.msgpack がないためサビなしとして分割します" << endl;
+        size_t motionFrames = countMotionFrames(inputMotionDir);
+        frameIntervals = beatFrameIntervals(loadBeatsMsgpack(inputMusicDir + "/beat.msgpack"), motionFrames, chorus,
+                                            segmentation);
+        if (frameIntervals.empty()) {
+            cerr << "Error: 入力モーションにフレームがありません\n";
+            return 1;
         }
+        sabi_indices = chorusSegmentIndices(frameIntervals, chorus);
     }
 
     // modes ベクトルの設定（すべて 10 で初期化）
     vector<int> modes(frameIntervals.size(), 10);
-    int step = 1;
 
     vector<int> view_indices, movement_indices;
     if (mode == "modify") {
@@ -1618,18 +689,157 @@ int main(int argc, char* argv[]){
     cout << endl;
 
 
+    // 合成結果のキャッシュ: 同じ入力・設定・データベースの結果があれば、データベースを読み込まずに出力する
+    unique_ptr<ResultCache> resultCache;
+    string cacheKey;
+    if (!cacheDir.empty()) {
+        if (compareMetrics || streamMode || !resultCacheable(searchOptions)) {
+            std::cerr << "[WARN] --cache は --compare-metrics / --stream / --alternatives / --budget-ms では使わません" << std::endl;
+        } else {
+            string dbVersion = resultCacheDatabaseVersion(dirs);
+            resultCache = make_unique<ResultCache>(cacheDir, cacheBytes, dbVersion);
+            cacheKey = resultCacheKey(inputMotionDir, inputMusicDir, inputNumber, frameIntervals, modes, searchOptions,
+                                      dbVersion);
+            CachedResult cached;
+            if (resultCache->load(cacheKey, cached)) {
+                cout << "[INFO] キャッシュの結果を使います: " << cacheDir << "/" << cacheKey << ".msgpack" << endl;
+                for (const auto &c : cached.choices)
+                    cout << "選択ファイル: " << c.file << endl;
+                outputCameraJson(cached.track.position, cached.track.rotation, cached.track.viewangle, outputDir,
+                                 inputNumber);
+                return 0;
+            }
+        }
+    }
+
+    // シャード分割: データベースはワーカーが分けて読み込み、このプロセスは選ばれた候補の区間だけを持つ
+    bool sharded = numShards > 1 || numaShards;
+    if (sharded && (compareMetrics || streamMode)) {
+        std::cerr << "[WARN] --shards / --numa は --compare-metrics / --stream では使えないため無視します" << std::endl;
+        sharded = false;
+    }
+    if (sharded && searchOptions.timeBudgetMs > 0.0) {
+        std::cerr << "[WARN] --budget-ms は --shards / --numa では使えないため、全候補を調べます" << std::endl;
+        searchOptions.timeBudgetMs = 0.0;
+    }
+    if (sharded && searchOptions.squaredL2 && searchOptions.pcaComponents > 0) {
+        std::cerr << "[WARN] --pca はデータベース全体の主成分を使うため --shards と併用できません。シャードに分けずに検索します" << std::endl;
+        sharded = false;
+    }
+    if (sharded) {
+        // --numa だけのときはノード数に分ける
+        ShardCluster cluster(dirs, numShards > 1 ? numShards : (numaShards ? 0 : 1), placement);
+        cout << "[INFO] シャード分割: " << cluster.size() << " プロセス (クリップ数";
+        for (const auto &st : cluster.stats())
+            cout << " " << st.clips;
+        cout << ")" << endl;
+        InputData input = loadInputData(inputMotionDir, inputMusicDir, inputNumber);
+        SearchResult searchRes = cluster.search(input, frameIntervals, modes, searchOptions);
+        // NUMA ノードごとの読み出し帯域（同じノードのワーカーは並行して動くので、時間は最も長いものを使う）
+        map<int, pair<double, double>> nodeBandwidth;
+        for (const auto &st : cluster.stats()) {
+            auto &nb = nodeBandwidth[st.node];
+            nb.first += st.bytesScanned;
+            nb.second = max(nb.second, st.seconds);
+        }
+        for (const auto &kv : nodeBandwidth) {
+            cout << "[INFO] " << (kv.first >= 0 ? "NUMA ノード " + to_string(kv.first) : string("ワーカー全体")) << ": "
+                 << kv.second.first / 1e9 << " GB を " << kv.second.second << " 秒で読み出し ("
+                 << (kv.second.second > 0.0 ? kv.second.first / kv.second.second / 1e9 : 0.0) << " GB/s)" << endl;
+        }
+        CameraTrack camRes = cluster.assembleCamera(searchRes);
+        outputCameraJson(camRes.position, camRes.rotation, camRes.viewangle, outputDir, inputNumber);
+        if (resultCache)
+            resultCache->store(cacheKey, {searchRes.choices, searchRes.lengths, camRes});
+        if (searchOptions.alternatives > 0) {
+            vector<SearchResult> alternatives = cluster.alternatives(input, searchRes, searchOptions.alternatives, searchOptions);
+            for (size_t k = 0; k < alternatives.size(); k++) {
+                CameraTrack altCam = cluster.assembleCamera(alternatives[k]);
+                outputCameraJson(altCam.position, altCam.rotation, altCam.viewangle, outputDir, inputNumber,
+                                 "output_" + to_string(k) + ".json");
+            }
+        }
+        return 0;
+    }
+
+    // データベースと入力データの読み込み
+    Engine engine(dirs);
+    engine.loadInput(inputMotionDir, inputMusicDir, inputNumber);
+    const DistanceKernels &kernels = engine.database().kernels;
+    cout << "[INFO] 距離計算: ジョイント " << (kernels.fixedJoints ? to_string(kernels.numJoints) + " 個の専用版" : "汎用版")
+         << " / 楽曲特徴量 " << (kernels.fixedMusic ? to_string(kernels.musicDims) + " 次元の専用版" : "汎用版") << endl;
+
+    // 姿勢距離の比較
+    if (compareMetrics) {
+        vector<MetricComparison> comparisons =
+            compareMotionMetrics(engine.database(), engine.input(), frameIntervals, searchOptions);
+        shared_ptr<const PoseIndex> poseIndex = engine.database().poseIndex(searchOptions.pcaComponents);
+        cout << "[INFO] 姿勢距離の比較 (二乗 L2: " << poseIndex->dims() << " 次元";
+        if (poseIndex->pcaComponents() > 0)
+            cout << ", PCA 寄与率 " << poseIndex->explainedVariance();
+        cout << ")" << endl;
+        cout << "seg\tcands\tspearman\ttop5\tbest\tjoint_ms\tl2_ms" << endl;
+        for (const auto &c : comparisons) {
+            cout << c.segIndex << "\t" << c.numCandidates << "\t" << c.rankCorrelation << "\t"
+                 << c.topOverlap << "/5\t" << (c.sameBest ? "same" : "diff") << "\t"
+                 << c.jointMs << "\t" << c.squaredL2Ms << endl;
+        }
+        return 0;
+    }
+
+    // ストリーミング合成
+    if (streamMode) {
+        if (searchOptions.globalSelection)
+            std::cerr << "[WARN] --global はストリーミング合成では使えないため無視します" << std::endl;
+        StreamingSynthesizer synthesizer(engine.database(), inputNumber, frameIntervals, modes, searchOptions, streamingOptions);
+
+        // ライブ入力の代わりに入力ファイルを 1 フレームずつ流し込む
+        const InputData &in = engine.input();
+        CameraTrack camRes;
+        size_t numFrames = min({in.raw.size(), in.stand.size(), in.hip.size(), in.music.size()});
+        size_t nextBeat = 0;
+        for (size_t f = 0; f < numFrames; f++) {
+            // このフレームの終わりまでに始まるビートを先に渡す
+            while (nextBeat < in.beats.size() && in.beats[nextBeat].startMs < framesToMilliseconds(f + 1, 30)) {
+                synthesizer.pushBeat(in.beats[nextBeat]);
+                nextBeat++;
+            }
+            synthesizer.pushFrame(in.raw[f], in.stand[f], in.hip[f], in.music[f]);
+            synthesizer.popFrames(camRes);
+        }
+        synthesizer.finish();
+        synthesizer.popFrames(camRes);
+        cout << "[INFO] 最大出力遅延: " << synthesizer.maxObservedDelay() << " フレーム (上限 "
+             << synthesizer.guaranteedDelay() << " フレーム)" << endl;
+
+        outputCameraJson(camRes.position, camRes.rotation, camRes.viewangle, outputDir, inputNumber);
+        return 0;
+    }
+
     // 類似ファイル検索
-    CalDistance2Result cd2Res = calDistance2Msgpack(inputNumber, inputPositionPath, inputStandPositionPath, inputHipPath, inputBeatPath, inputMusicPath, 
-                                                     StandPositionDatabaseDir, PositionDatabaseDir, HipDirectionDatabaseDir, MusicDatabaseDir,
-                                                     CameraPositionDir, BpmData, frameIntervals, modes, step
-                                                    );
+    SearchResult searchRes = engine.search(frameIntervals, modes, searchOptions);
+    if (heapAllocationsCounted()) {
+        for (size_t s = 0; s < searchRes.segments.size(); s++)
+            cout << "[INFO] セグメント " << s << ": 候補の走査中のヒープ確保 " << searchRes.segments[s].scanAllocations
+                 << " 回" << endl;
+    }
     // カメラデータ組み立て
-    CameraRetrievalResult camRes = cameraDataRetrievalMsgpack(CameraPositionDir, CameraRotationDir,
-                                                               cd2Res.closestFiles, cd2Res.lengths,
-                                                               cd2Res.inputNumber, cd2Res.translations);
-    
+    CameraTrack camRes = engine.assembleCamera(searchRes);
+
     // JSON 出力
-    outputCameraJson(camRes.position, camRes.rotation, camRes.viewangle, outputDir, cd2Res.inputNumber);
-    
+    outputCameraJson(camRes.position, camRes.rotation, camRes.viewangle, outputDir, inputNumber);
+    if (resultCache)
+        resultCache->store(cacheKey, {searchRes.choices, searchRes.lengths, camRes});
+
+    // 別案（同じ検索結果の候補リストから組み立てる）
+    if (searchOptions.alternatives > 0) {
+        vector<SearchResult> alternatives = engine.alternatives(searchRes, searchOptions.alternatives, searchOptions);
+        for (size_t k = 0; k < alternatives.size(); k++) {
+            CameraTrack altCam = engine.assembleCamera(alternatives[k]);
+            outputCameraJson(altCam.position, altCam.rotation, altCam.viewangle, outputDir, inputNumber,
+                             "output_" + to_string(k) + ".json");
+        }
+    }
+
     return 0;
 }
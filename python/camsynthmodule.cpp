@@ -0,0 +1,435 @@
+// libcamsynth の Python バインディング
+//
+//   import numpy as np, camsynth
+//   engine = camsynth.Engine(".")                      # ./Database 以下を読み込む
+//   out = engine.search(raw, stand, hip, music, beats, frame_intervals, modes=None)
+//   out["position"]  # (N, 3) float64
+//   out["rotation"]  # (N, 3) float64
+//   out["fov"]       # (N,)   float64
+//
+// 入力配列はバッファプロトコルでそのまま参照する（Python 側でのコピーや変換はしない）。
+// float64 かつ C 連続でない配列は TypeError にするので、必要なら呼び出し側で
+// np.ascontiguousarray(x, dtype=np.float64) を使う。出力はエンジンが組み立てた
+// カメラデータのバッファをコピーせずに NumPy 配列として返す。
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camsynth/camsynth.hpp"
+
+using namespace std;
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// 出力用バッファ（カメラデータを共有所有し、バッファプロトコルで公開する）
+// ---------------------------------------------------------------------------
+struct OwnedArrayObject {
+    PyObject_HEAD
+    shared_ptr<camsynth::CameraTrack> *owner;
+    double *buf;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+    int ndim;
+};
+
+void OwnedArray_dealloc(OwnedArrayObject *self) {
+    delete self->owner;
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+int OwnedArray_getbuffer(OwnedArrayObject *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "camsynth output buffers are read-only");
+        view->obj = nullptr;
+        return -1;
+    }
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->buf = self->buf;
+    view->len = self->shape[0] * (self->ndim == 2 ? self->shape[1] : 1) * sizeof(double);
+    view->readonly = 1;
+    view->itemsize = sizeof(double);
+    view->format = (flags & PyBUF_FORMAT) ? (char *)"d" : nullptr;
+    view->ndim = self->ndim;
+    view->shape = (flags & PyBUF_ND) ? self->shape : nullptr;
+    view->strides = (flags & PyBUF_STRIDES) ? self->strides : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+PyBufferProcs OwnedArray_as_buffer = {
+    (getbufferproc)OwnedArray_getbuffer,
+    nullptr,
+};
+
+PyTypeObject OwnedArrayType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+    "camsynth._OwnedArray",
+};
+
+// track 内の buf を指す (rows, cols) または (rows,) の配列を作り、NumPy があれば ndarray として返す
+PyObject *makeArray(const shared_ptr<camsynth::CameraTrack> &track, double *buf, Py_ssize_t rows, Py_ssize_t cols) {
+    OwnedArrayObject *obj = PyObject_New(OwnedArrayObject, &OwnedArrayType);
+    if (!obj)
+        return nullptr;
+    obj->owner = new shared_ptr<camsynth::CameraTrack>(track);
+    obj->buf = buf;
+    obj->ndim = (cols > 0) ? 2 : 1;
+    obj->shape[0] = rows;
+    obj->shape[1] = cols;
+    obj->strides[0] = (cols > 0 ? cols : 1) * sizeof(double);
+    obj->strides[1] = sizeof(double);
+
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (!numpy) {
+        // NumPy がなければバッファオブジェクトをそのまま返す（memoryview で読める）
+        PyErr_Clear();
+        return (PyObject *)obj;
+    }
+    PyObject *arr = PyObject_CallMethod(numpy, "asarray", "O", (PyObject *)obj);
+    Py_DECREF(numpy);
+    Py_DECREF(obj);
+    return arr;
+}
+
+// ---------------------------------------------------------------------------
+// 入力バッファ
+// ---------------------------------------------------------------------------
+struct BufferGuard {
+    Py_buffer view;
+    bool acquired = false;
+    ~BufferGuard() {
+        if (acquired)
+            PyBuffer_Release(&view);
+    }
+};
+
+// float64 の C 連続配列を取得する。ndim が expectedNdims のどれにも一致しなければ TypeError
+bool getDoubleBuffer(PyObject *obj, const char *name, BufferGuard &guard, initializer_list<int> expectedNdims) {
+    if (PyObject_GetBuffer(obj, &guard.view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+        PyErr_Format(PyExc_TypeError, "%s must be a C-contiguous buffer (numpy array)", name);
+        return false;
+    }
+    guard.acquired = true;
+    const char *fmt = guard.view.format ? guard.view.format : "B";
+    if (fmt[0] == '<' || fmt[0] == '=' || fmt[0] == '@')
+        fmt++;
+    if (strcmp(fmt, "d") != 0 || guard.view.itemsize != sizeof(double)) {
+        PyErr_Format(PyExc_TypeError, "%s must have dtype float64 (use np.ascontiguousarray(x, dtype=np.float64))", name);
+        return false;
+    }
+    for (int nd : expectedNdims) {
+        if (guard.view.ndim == nd)
+            return true;
+    }
+    PyErr_Format(PyExc_ValueError, "%s has unexpected ndim %d", name, guard.view.ndim);
+    return false;
+}
+
+// 整数の 1 次元配列（int32 / int64）を vector<int> にする
+bool getIntVector(PyObject *obj, const char *name, vector<int> &out) {
+    BufferGuard guard;
+    if (PyObject_GetBuffer(obj, &guard.view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+        PyErr_Format(PyExc_TypeError, "%s must be a C-contiguous integer buffer (numpy array)", name);
+        return false;
+    }
+    guard.acquired = true;
+    if (guard.view.ndim != 1) {
+        PyErr_Format(PyExc_ValueError, "%s must be 1-dimensional", name);
+        return false;
+    }
+    const char *fmt = guard.view.format ? guard.view.format : "B";
+    if (fmt[0] == '<' || fmt[0] == '=' || fmt[0] == '@')
+        fmt++;
+    Py_ssize_t n = guard.view.shape[0];
+    out.resize(n);
+    if ((fmt[0] == 'i' || fmt[0] == 'l' || fmt[0] == 'q') && guard.view.itemsize == 4) {
+        const int32_t *p = (const int32_t *)guard.view.buf;
+        for (Py_ssize_t i = 0; i < n; i++)
+            out[i] = p[i];
+    } else if ((fmt[0] == 'l' || fmt[0] == 'q') && guard.view.itemsize == 8) {
+        const int64_t *p = (const int64_t *)guard.view.buf;
+        for (Py_ssize_t i = 0; i < n; i++)
+            out[i] = (int)p[i];
+    } else {
+        PyErr_Format(PyExc_TypeError, "%s must have dtype int32 or int64", name);
+        return false;
+    }
+    return true;
+}
+
+// (T, J, 3) の関節位置を FrameData 列にする
+bool toPositions(const Py_buffer &view, vector<camsynth::FrameData> &out) {
+    if (view.shape[2] != 3) {
+        PyErr_SetString(PyExc_ValueError, "joint positions must have shape (T, J, 3)");
+        return false;
+    }
+    const double *p = (const double *)view.buf;
+    Py_ssize_t T = view.shape[0], J = view.shape[1];
+    out.resize(T);
+    for (Py_ssize_t t = 0; t < T; t++) {
+        out[t].positions.resize(J);
+        memcpy(out[t].positions.data(), p + t * J * 3, J * 3 * sizeof(double));
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Engine
+// ---------------------------------------------------------------------------
+struct EngineObject {
+    PyObject_HEAD
+    camsynth::Engine *engine;
+};
+
+void Engine_dealloc(EngineObject *self) {
+    delete self->engine;
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+int Engine_init(EngineObject *self, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"root", "io_threads", "prefetch_depth", nullptr};
+    const char *root = ".";
+    camsynth::DatabaseDirs dirs;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sii", (char **)kwlist, &root, &dirs.IoThreads,
+                                     &dirs.PrefetchDepth))
+        return -1;
+    string prefix = string(root) + "/";
+    for (string *d : {&dirs.PositionDatabaseDir, &dirs.HipDirectionDatabaseDir, &dirs.MusicDatabaseDir, &dirs.CameraPositionDir, &dirs.CameraRotationDir, &dirs.CameraColumnDir, &dirs.BpmData, &dirs.IngestDir, &dirs.BlockStoreDir})
+        *d = prefix + *d;
+    camsynth::Engine *engine = nullptr;
+    string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        engine = new camsynth::Engine(dirs);
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (!engine) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return -1;
+    }
+    delete self->engine;
+    self->engine = engine;
+    return 0;
+}
+
+// 検索結果とカメラデータを dict にする
+PyObject *trackDict(const camsynth::SearchResult &res, const shared_ptr<camsynth::CameraTrack> &track) {
+    // カメラデータは 3 要素配列の連続領域なので、コピーせずに (N, 3) のバッファとして渡す
+    static_assert(sizeof(array<double, 3>) == 3 * sizeof(double), "array<double, 3> must be tightly packed");
+    Py_ssize_t n = track->position.size();
+    PyObject *files = PyList_New(res.choices.size());
+    PyObject *offsets = PyList_New(res.choices.size());
+    for (size_t i = 0; i < res.choices.size(); i++) {
+        PyList_SET_ITEM(files, i, PyUnicode_FromString(res.choices[i].file.c_str()));
+        PyList_SET_ITEM(offsets, i, PyLong_FromLong(res.choices[i].offset));
+    }
+    PyObject *out = Py_BuildValue("{s:N,s:N,s:N,s:N,s:N}",
+                                  "position", makeArray(track, reinterpret_cast<double *>(track->position.data()), n, 3),
+                                  "rotation", makeArray(track, reinterpret_cast<double *>(track->rotation.data()), n, 3),
+                                  "fov", makeArray(track, track->viewangle.data(), n, 0),
+                                  "files", files,
+                                  "offsets", offsets);
+    return out;
+}
+
+PyObject *Engine_search(EngineObject *self, PyObject *args, PyObject *kwds) {
+    static const char *kwlist[] = {"raw", "stand", "hip", "music", "beats", "frame_intervals", "modes",
+                                   "input_number", "sliding", "global_selection", "global_k", "step",
+                                   "clip_windows", "window_stride", "alternatives", "squared_l2", "pca", "budget_ms", nullptr};
+    PyObject *rawObj, *standObj, *hipObj, *musicObj, *beatsObj, *intervalsObj, *modesObj = Py_None;
+    const char *inputNumber = "0";
+    int sliding = 0, globalSelection = 0, globalK = 5, step = 1, clipWindows = 0, windowStride = 15, numAlternatives = 0;
+    int squaredL2 = 0, pcaComponents = 0;
+    double budgetMs = 0.0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOOOOO|Ospiiipiipid", (char **)kwlist,
+                                     &rawObj, &standObj, &hipObj, &musicObj, &beatsObj, &intervalsObj,
+                                     &modesObj, &inputNumber, &sliding, &globalSelection, &globalK, &step,
+                                     &clipWindows, &windowStride, &numAlternatives, &squaredL2, &pcaComponents, &budgetMs))
+        return nullptr;
+    if (!self->engine) {
+        PyErr_SetString(PyExc_RuntimeError, "Engine is not initialized");
+        return nullptr;
+    }
+
+    camsynth::InputData input;
+    input.inputNumber = inputNumber;
+    {
+        BufferGuard raw, stand, hip, music, beats;
+        if (!getDoubleBuffer(rawObj, "raw", raw, {3}) || !getDoubleBuffer(musicObj, "music", music, {1, 2}) ||
+            !getDoubleBuffer(beatsObj, "beats", beats, {2}))
+            return nullptr;
+        if (!toPositions(raw.view, input.raw))
+            return nullptr;
+        // stand / hip を省略 (None) したときは raw から求める
+        if (standObj == Py_None) {
+            input.stand = camsynth::deriveStandPositions(input.raw);
+        } else if (!getDoubleBuffer(standObj, "stand", stand, {3}) || !toPositions(stand.view, input.stand)) {
+            return nullptr;
+        }
+        if (hipObj == Py_None) {
+            input.hip = camsynth::deriveHipDirections(input.raw);
+        } else {
+            if (!getDoubleBuffer(hipObj, "hip", hip, {2}))
+                return nullptr;
+            if (hip.view.shape[1] != 4) {
+                PyErr_SetString(PyExc_ValueError, "hip must have shape (T, 4)");
+                return nullptr;
+            }
+            const double *h = (const double *)hip.view.buf;
+            input.hip.resize(hip.view.shape[0]);
+            for (Py_ssize_t t = 0; t < hip.view.shape[0]; t++)
+                memcpy(input.hip[t].hipQuaternion.data(), h + t * 4, 4 * sizeof(double));
+        }
+        const double *m = (const double *)music.view.buf;
+        Py_ssize_t dim = (music.view.ndim == 2) ? music.view.shape[1] : 1;
+        input.music.resize(music.view.shape[0]);
+        for (Py_ssize_t t = 0; t < music.view.shape[0]; t++)
+            input.music[t].assign(m + t * dim, m + (t + 1) * dim);
+        if (beats.view.shape[1] != 2) {
+            PyErr_SetString(PyExc_ValueError, "beats must have shape (B, 2) as [start_ms, bpm]");
+            return nullptr;
+        }
+        const double *b = (const double *)beats.view.buf;
+        for (Py_ssize_t i = 0; i < beats.view.shape[0]; i++)
+            input.beats.push_back({b[i * 2], b[i * 2 + 1]});
+    }
+    vector<int> frameIntervals, modes;
+    if (!getIntVector(intervalsObj, "frame_intervals", frameIntervals))
+        return nullptr;
+    if (modesObj != Py_None) {
+        if (!getIntVector(modesObj, "modes", modes))
+            return nullptr;
+    }
+    modes.resize(frameIntervals.size(), 10);
+
+    camsynth::SearchOptions options;
+    options.step = max(1, step);
+    options.slidingOffset = sliding;
+    options.globalSelection = globalSelection;
+    options.globalTopK = globalK;
+    options.clipWindows = clipWindows;
+    options.windowStride = max(1, windowStride);
+    options.alternatives = max(0, numAlternatives);
+    options.squaredL2 = squaredL2;
+    options.pcaComponents = max(0, pcaComponents);
+    options.timeBudgetMs = budgetMs;
+
+    camsynth::SearchResult res;
+    auto track = make_shared<camsynth::CameraTrack>();
+    vector<camsynth::SearchResult> altResults;
+    vector<shared_ptr<camsynth::CameraTrack>> altTracks;
+    string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        res = self->engine->search(input, frameIntervals, modes, options);
+        *track = self->engine->assembleCamera(res);
+        altResults = self->engine->alternatives(input, res, options.alternatives, options);
+        for (const auto &alt : altResults)
+            altTracks.push_back(make_shared<camsynth::CameraTrack>(self->engine->assembleCamera(alt)));
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (!error.empty()) {
+        PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        return nullptr;
+    }
+
+    PyObject *out = trackDict(res, track);
+    if (!out || options.alternatives <= 0)
+        return out;
+    PyObject *alts = PyList_New(altResults.size());
+    for (size_t k = 0; k < altResults.size(); k++) {
+        PyObject *alt = trackDict(altResults[k], altTracks[k]);
+        if (!alt) {
+            Py_DECREF(alts);
+            Py_DECREF(out);
+            return nullptr;
+        }
+        PyList_SET_ITEM(alts, k, alt);
+    }
+    if (PyDict_SetItemString(out, "alternatives", alts) != 0) {
+        Py_DECREF(alts);
+        Py_DECREF(out);
+        return nullptr;
+    }
+    Py_DECREF(alts);
+    return out;
+}
+
+PyObject *Engine_num_segments(EngineObject *self, void *) {
+    return PyLong_FromSize_t(self->engine ? self->engine->database().segments.size() : 0);
+}
+
+PyMethodDef Engine_methods[] = {
+    {"search", (PyCFunction)(void (*)(void))Engine_search, METH_VARARGS | METH_KEYWORDS,
+     "search(raw, stand, hip, music, beats, frame_intervals, modes=None, input_number='0',\n"
+     "       sliding=False, global_selection=False, global_k=5, step=1) -> dict\n\n"
+     "raw/stand: (T, J, 3) float64, hip: (T, 4) float64, music: (T,) or (T, D) float64,\n"
+     "stand/hip may be None to derive them from raw.\n"
+     "beats: (B, 2) float64 [start_ms, bpm], frame_intervals/modes: 1-D int arrays.\n"
+     "Returns position (N, 3), rotation (N, 3), fov (N,), files and offsets.\n"
+     "With alternatives=K, 'alternatives' holds K such dicts built from the same search.\n"
+     "With budget_ms > 0, candidates are visited by BPM closeness and each segment stops at its share of the budget."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyGetSetDef Engine_getset[] = {
+    {"num_segments", (getter)Engine_num_segments, nullptr, "number of loaded database segments", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+PyTypeObject EngineType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+    "camsynth.Engine",
+};
+
+PyModuleDef camsynthModule = {
+    PyModuleDef_HEAD_INIT,
+    "camsynth",
+    "Python bindings for libcamsynth",
+    -1,
+    nullptr,
+};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_camsynth(void) {
+    OwnedArrayType.tp_basicsize = sizeof(OwnedArrayObject);
+    OwnedArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+    OwnedArrayType.tp_dealloc = (destructor)OwnedArray_dealloc;
+    OwnedArrayType.tp_as_buffer = &OwnedArray_as_buffer;
+    if (PyType_Ready(&OwnedArrayType) < 0)
+        return nullptr;
+
+    EngineType.tp_basicsize = sizeof(EngineObject);
+    EngineType.tp_flags = Py_TPFLAGS_DEFAULT;
+    EngineType.tp_doc = "Engine(root='.') -- loads <root>/Database once and synthesizes camera tracks";
+    EngineType.tp_new = PyType_GenericNew;
+    EngineType.tp_init = (initproc)Engine_init;
+    EngineType.tp_dealloc = (destructor)Engine_dealloc;
+    EngineType.tp_methods = Engine_methods;
+    EngineType.tp_getset = Engine_getset;
+    if (PyType_Ready(&EngineType) < 0)
+        return nullptr;
+
+    PyObject *m = PyModule_Create(&camsynthModule);
+    if (!m)
+        return nullptr;
+    Py_INCREF(&EngineType);
+    if (PyModule_AddObject(m, "Engine", (PyObject *)&EngineType) < 0) {
+        Py_DECREF(&EngineType);
+        Py_DECREF(m);
+        return nullptr;
+    }
+    return m;
+}
@@ -0,0 +1,204 @@
+// ブロック圧縮データベースの作成と計測
+//
+//   ./scripts/blockdb build [--codec=planes|lz4|zstd] [--block-frames=N]
+//   ./scripts/blockdb bench [--random=N]
+//   ./scripts/blockdb verify
+//
+// build は Split などの区間ファイルとカメラデータを読み込み、クリップごとに c<N>.cblk を書く（取り込んだクリップは含めない）。
+// bench はストア全体の読み込みと、ランダムに選んだブロックの展開の速さを測る。
+// verify は区間ファイルから読んだデータベースとストアから読んだものが同じかを確かめる。
+// オプション: --store=DIR（既定 Database/Blocks）
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "camsynth/block_store.hpp"
+#include "camsynth/database.hpp"
+
+namespace fs = std::filesystem;
+using namespace std;
+using namespace camsynth;
+
+namespace {
+
+double secondsSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+// 区間ファイルとカメラの msgpack のバイト数
+uintmax_t sourceBytes(const DatabaseDirs &dirs, const Database &db) {
+    uintmax_t total = 0;
+    error_code ec;
+    for (const string &dir : {dirs.PositionDatabaseDir, dirs.HipDirectionDatabaseDir, dirs.MusicDatabaseDir}) {
+        for (const auto &entry : fs::directory_iterator(dir, ec)) {
+            if (entry.is_regular_file())
+                total += entry.file_size();
+        }
+    }
+    for (const auto &kv : db.cameras) {
+        for (const string &dir : {dirs.CameraPositionDir, dirs.CameraRotationDir}) {
+            uintmax_t size = fs::file_size(dir + "/c" + kv.first + ".msgpack", ec);
+            if (!ec)
+                total += size;
+        }
+    }
+    return total;
+}
+
+bool sameDatabase(const Database &a, const Database &b, string &difference) {
+    if (a.segments.size() != b.segments.size() || a.scannedSegments != b.scannedSegments) {
+        difference = "区間の数";
+        return false;
+    }
+    for (size_t i = 0; i < a.segments.size(); i++) {
+        const DatabaseSegment &x = a.segments[i], &y = b.segments[i];
+        if (x.fileName != y.fileName || x.start != y.start || x.end != y.end || x.frames != y.frames ||
+            x.hipFrames != y.hipFrames || x.musicFrames != y.musicFrames || x.bpm != y.bpm || x.order != y.order) {
+            difference = "区間 " + x.fileName;
+            return false;
+        }
+    }
+    if (a.clips.size() != b.clips.size() || a.cameras.size() != b.cameras.size()) {
+        difference = "クリップの数";
+        return false;
+    }
+    for (const auto &kv : a.clips) {
+        const MotionClip *other = b.clip(kv.first);
+        const MotionClip &clip = kv.second;
+        bool same = other && clip.frames() == other->frames() && clip.hip == other->hip && clip.music == other->music &&
+                    clip.gapPrefix == other->gapPrefix && clip.bpmPrefix == other->bpmPrefix &&
+                    clip.musicPrefix == other->musicPrefix && clip.musicFlat == other->musicFlat;
+        for (int i = 0; same && i < clip.frames(); i++)
+            same = clip.raw[i].positions == other->raw[i].positions;
+        const CameraClip &cam = a.cameras.at(kv.first);
+        const CameraClip *otherCam = b.camera(kv.first);
+        for (int c = 0; same && c < CameraClip::NumColumns; c++) {
+            auto col = CameraClip::Column(c);
+            same = otherCam && cam.length(col) == otherCam->length(col) &&
+                   equal(cam.column(col), cam.column(col) + cam.length(col), otherCam->column(col));
+        }
+        if (!same) {
+            difference = "クリップ " + kv.first;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    DatabaseDirs dirs;
+    BlockStoreOptions options;
+    string codec = blockCodecName(options.codec);
+    size_t randomBlocks = 10000;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--store=", 0) == 0)
+            dirs.BlockStoreDir = arg.substr(8);
+        else if (arg.rfind("--codec=", 0) == 0)
+            codec = arg.substr(8);
+        else if (arg.rfind("--block-frames=", 0) == 0)
+            options.blockFrames = stoi(arg.substr(15));
+        else if (arg.rfind("--random=", 0) == 0)
+            randomBlocks = stoul(arg.substr(9));
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 1) {
+        cerr << "使い方: " << argv[0] << " build [--codec=planes|lz4|zstd] [--block-frames=N]\n"
+             << "       " << argv[0] << " bench [--random=N]\n"
+             << "       " << argv[0] << " verify\n";
+        return 1;
+    }
+    // 区間ファイルだけから読む設定（取り込んだクリップは MANIFEST ごとに変わるのでストアに入れない）
+    DatabaseDirs source = dirs;
+    source.BlockStoreDir = "";
+    source.IngestDir = "";
+
+    try {
+        options.codec = parseBlockCodec(codec);
+        if (args[0] == "build") {
+            auto t0 = chrono::steady_clock::now();
+            Database db = loadDatabase(source);
+            double loadSeconds = secondsSince(t0);
+            t0 = chrono::steady_clock::now();
+            BlockStoreStats st = writeBlockStore(db, source, dirs.BlockStoreDir, options);
+            double writeSeconds = secondsSince(t0);
+            uintmax_t msgpackBytes = sourceBytes(source, db);
+            cout << "[INFO] " << dirs.BlockStoreDir << " に " << st.clips << " クリップを書きました ("
+                 << blockCodecName(options.codec) << ", " << options.blockFrames << " フレーム/ブロック, "
+                 << st.blocks << " ブロック, うち圧縮なし " << st.storedBlocks << ")" << endl;
+            cout << "  元の msgpack   : " << msgpackBytes / 1e6 << " MB（読み込み " << loadSeconds << " 秒）" << endl;
+            cout << "  列（展開後）   : " << st.columnBytes / 1e6 << " MB" << endl;
+            cout << "  ブロック       : " << st.compressedBytes / 1e6 << " MB（ファイル " << st.fileBytes / 1e6
+                 << " MB, 書き込み " << writeSeconds << " 秒）" << endl;
+            cout << "  圧縮率         : 列に対して " << st.ratio() << " 倍, msgpack に対して "
+                 << (st.fileBytes ? double(msgpackBytes) / st.fileBytes : 0.0) << " 倍" << endl;
+        } else if (args[0] == "bench") {
+            Database db;
+            map<string, array<vector<char>, 3>> loaded;
+            BlockStoreStats st;
+            auto t0 = chrono::steady_clock::now();
+            if (!loadBlockStore(dirs, db, loaded, &st))
+                throw runtime_error("Cannot use block store: " + dirs.BlockStoreDir);
+            double loadSeconds = secondsSince(t0);
+            cout << "  全体の読み込み : " << loadSeconds << " 秒（展開 " << st.decodeSeconds << " 秒, "
+                 << st.decodeGBps() << " GB/s, 圧縮率 " << st.ratio() << " 倍）" << endl;
+
+            // ブロック単位のランダムアクセス
+            vector<unique_ptr<BlockClipFile>> files;
+            for (const auto &entry : fs::directory_iterator(dirs.BlockStoreDir)) {
+                if (entry.path().extension() == ".cblk")
+                    files.push_back(make_unique<BlockClipFile>(entry.path().string()));
+            }
+            if (files.empty() || randomBlocks == 0)
+                return 0;
+            mt19937 rng(0);
+            vector<char> out;
+            uint64_t bytes = 0;
+            size_t decoded = 0;
+            t0 = chrono::steady_clock::now();
+            for (size_t k = 0; k < randomBlocks; k++) {
+                const BlockClipFile &file = *files[rng() % files.size()];
+                const BlockClipDirectory &dir = file.directory();
+                int column = rng() % dir.columns.size();
+                const BlockColumn &c = dir.columns[column];
+                if (c.blocks.empty())
+                    continue;
+                size_t block = rng() % c.blocks.size();
+                out.resize(size_t(dir.blockFrames) * c.rowBytes());
+                bytes += file.decodeBlock(column, block, out.data()) * c.rowBytes();
+                decoded++;
+            }
+            double sec = secondsSince(t0);
+            cout << "  ランダムアクセス: " << decoded << " ブロック, " << (sec > 0 ? decoded / sec : 0.0)
+                 << " ブロック/秒, " << (sec > 0 ? bytes / sec / 1e9 : 0.0) << " GB/s" << endl;
+        } else if (args[0] == "verify") {
+            DatabaseDirs stored = source;
+            stored.BlockStoreDir = dirs.BlockStoreDir;
+            Database fromFiles = loadDatabase(source);
+            Database fromBlocks = loadDatabase(stored);
+            string difference;
+            if (!sameDatabase(fromFiles, fromBlocks, difference)) {
+                cerr << "Error: 区間ファイルから読んだものと異なります: " << difference << "\n";
+                return 1;
+            }
+            cout << "[INFO] 区間ファイルから読んだものと同じです (" << fromBlocks.clips.size() << " クリップ, "
+                 << fromBlocks.segments.size() << " 区間)" << endl;
+        } else {
+            cerr << "Error: 不明なコマンドです: " << args[0] << "\n";
+            return 1;
+        }
+    }
+    catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+// BVH から入力モーション (raw.msgpack) の作成
+// （scripts/my_utils/bvh2json.py・joint_extraction.py・json2msgpack の置き換え）
+//
+//   ./scripts/bvh2motion <raw.bvh> <output_dir>
+//
+// BVH を 1 行ずつ読みながら順運動学で全ノードの位置を求め、データベースと同じ 23 ジョイントを
+// output_dir/raw.msgpack に書く。
+// オプション: --derived（stand.msgpack・hip.msgpack も書く。camera_synthesis は無ければ raw から求める）
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "camsynth/bvh.hpp"
+#include "camsynth/motion.hpp"
+#include "camsynth/msgpack_io.hpp"
+
+namespace fs = std::filesystem;
+using namespace std;
+using namespace camsynth;
+
+int main(int argc, char *argv[]) {
+    bool derived = false;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--derived")
+            derived = true;
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2) {
+        cerr << "使い方: " << argv[0] << " [--derived] <raw.bvh> <output_dir>\n";
+        return 1;
+    }
+
+    try {
+        auto t0 = chrono::steady_clock::now();
+        vector<FrameData> raw = loadBvhMotion(args[0]);
+        if (raw.empty())
+            throw runtime_error("No frames in " + args[0]);
+        fs::create_directories(args[1]);
+        writeJointPositionsMsgpack(args[1] + "/raw.msgpack", raw);
+        if (derived) {
+            writeJointPositionsMsgpack(args[1] + "/stand.msgpack", deriveStandPositions(raw));
+            writeHipDirectionsMsgpack(args[1] + "/hip.msgpack", deriveHipDirections(raw));
+        }
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        cout << "[INFO] " << args[0] << " -> " << args[1] << " (" << raw.size() << " フレーム, " << sec << " 秒)"
+             << endl;
+    }
+    catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+// データベースへのクリップの追記と圧縮
+//
+//   ./scripts/ingest add <クリップ番号> <motion_dir> <music_dir> <CameraCentric の msgpack> <CameraInterpolated の msgpack> [frame_intervals の msgpack]
+//   ./scripts/ingest compact
+//   ./scripts/ingest list
+//
+// オプション: --store=DIR（既定 Database/Ingest）, --compact-threshold=N（追記後、ファイルが N 個以上なら裏で圧縮する。既定 8, 0 で圧縮しない）
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "camsynth/database.hpp"
+#include "camsynth/ingest.hpp"
+#include "camsynth/msgpack_io.hpp"
+
+namespace fs = std::filesystem;
+using namespace std;
+using namespace camsynth;
+
+int main(int argc, char *argv[]) {
+    DatabaseDirs dirs;
+    string store = dirs.IngestDir;
+    size_t compactThreshold = 8;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--store=", 0) == 0)
+            store = arg.substr(8);
+        else if (arg.rfind("--compact-threshold=", 0) == 0)
+            compactThreshold = stoul(arg.substr(20));
+        else
+            args.push_back(arg);
+    }
+    if (args.empty()) {
+        cerr << "使い方: " << argv[0] << " add <クリップ番号> <motion_dir> <music_dir> <camera_centric.msgpack> "
+             << "<camera_interpolated.msgpack> [frame_intervals.msgpack]\n"
+             << "       " << argv[0] << " compact\n"
+             << "       " << argv[0] << " list\n";
+        return 1;
+    }
+
+    try {
+        if (args[0] == "add" && (args.size() == 6 || args.size() == 7)) {
+            const string &num = args[1];
+            // Split から読み込むクリップと番号が重ならないようにする（カメラデータの有無だけを見る）
+            if (fs::exists(dirs.CameraPositionDir + "/c" + num + ".msgpack")) {
+                cerr << "Error: クリップ " << num << " はすでにデータベースにあります\n";
+                return 1;
+            }
+            vector<int> frameIntervals;
+            if (args.size() == 7) {
+                msgpack::object_handle oh = readMsgpack(args[6]);
+                const msgpack::object *arr = getMember(oh.get(), "frame_intervals");
+                if (arr && arr->type == msgpack::type::ARRAY) {
+                    for (size_t i = 0; i < arr->via.array.size; i++)
+                        frameIntervals.push_back(arr->via.array.ptr[i].as<int>());
+                }
+            }
+            IngestClip clip = buildIngestClip(num, args[2], args[3], args[4], args[5], frameIntervals);
+            string file = appendIngestClip(store, clip);
+            cout << "[INFO] クリップ " << num << " を取り込みました: " << store << "/" << file << " ("
+                 << clip.raw.size() << " フレーム, " << clip.segments.size() << " 区間)" << endl;
+            if (compactThreshold > 0 && countIngestFiles(store) >= compactThreshold) {
+                cout << "[INFO] 裏で圧縮を始めます" << endl;
+                startBackgroundCompaction(store, compactThreshold);
+            }
+        } else if (args[0] == "compact") {
+            bool done = compactIngestStore(store);
+            cout << (done ? "[INFO] 圧縮しました" : "[INFO] 圧縮するファイルがないか、別の圧縮が動いています") << endl;
+        } else if (args[0] == "list") {
+            vector<IngestClip> clips = loadIngestStore(store);
+            cout << countIngestFiles(store) << " ファイル, " << clips.size() << " クリップ" << endl;
+            for (const auto &c : clips)
+                cout << "  " << c.clipNumber << ": " << c.raw.size() << " フレーム, " << c.segments.size() << " 区間" << endl;
+        } else {
+            cerr << "Error: 不明なコマンドです: " << args[0] << "\n";
+            return 1;
+        }
+    }
+    catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
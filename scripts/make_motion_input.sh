@@ -1,19 +1,6 @@
-python3 scripts/my_utils/bvh2json.py \
---bvh_dir input \
---output_dir input 
+# BVH から 23 ジョイントの raw.msgpack を直接求める
+# (scripts/my_utils/bvh2json.py・joint_extraction.py・json2msgpack の代わり)
+./scripts/bvh2motion input/raw.bvh intermediate/motion
 
-python3 scripts/my_utils/joint_extraction.py \
---json_path input/raw.json \
---output_path input/raw.json \
-
-cp "input/raw.json" "intermediate/motion"
-
-python3 scripts/my_utils/hip.py \
---json_path input/raw.json \
---output_dir intermediate/motion \
-
-python3 scripts/my_utils/standardization.py \
---json_dir input \
---output_dir intermediate/motion \
-
-./scripts/json2msgpack intermediate/motion intermediate/motion/
+# stand.msgpack (root 基準の位置) と hip.msgpack (腰の向き) は camera_synthesis が raw.msgpack から求める
+# (書き出しておきたい場合は ./scripts/bvh2motion --derived とする)
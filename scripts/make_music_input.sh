@@ -6,21 +6,13 @@ python3 scripts/my_utils/beat.py \
 # ここに入力してください
 python3 scripts/my_utils/sabi.py \
 --page  [SONGLE_URL] \
---output_dir input
-
-python3 scripts/my_utils/music.py \
---audio input/music.wav \
---motion input/raw.json \
---output intermediate/music/music.json
-
-python3 scripts/my_utils/frameinterval.py \
---beat intermediate/music/beat.json \
---motion input/raw.json \
---output input/frame.json
+--output_dir intermediate/music
 
-python3 scripts/my_utils/sabi+frameinterval.py \
---chorus input/sabi.json \
---frame input/frame.json \
---output intermediate/music/sabi_frame.json
+# オンセット密度 (music.msgpack) はモーションの raw.msgpack のフレーム数に合わせて切り出す
+# (librosa を使う scripts/my_utils/music.py の代わり。WAV 以外の音声は先に WAV に変換しておく)
+./scripts/music_features input/music.wav intermediate/motion/raw.msgpack intermediate/music/music.msgpack
 
+# セグメントの分割 (frame_intervals) とサビのセグメント (sabi) は camera_synthesis が
+# beat.msgpack・sabi.msgpack とモーションのフレーム数から求める
+# (scripts/my_utils/frameinterval.py・sabi+frameinterval.py の代わり)
 ./scripts/json2msgpack intermediate/music intermediate/music/
@@ -0,0 +1,75 @@
+// 楽曲のオンセット密度 (music.msgpack) の作成（scripts/my_utils/music.py の置き換え）
+//
+//   ./scripts/music_features <music.wav> <raw.msgpack> <music.msgpack> [<music.wav> <raw.msgpack> <music.msgpack> ...]
+//
+// 3 つ組ごとに 1 曲を処理し、モーション (raw.msgpack) のフレーム数に合わせて先頭から切り出す
+// （raw.msgpack の代わりに "-" を渡すと切り出さない）。複数の曲は並列に処理する。
+// オプション: --threads=N（同時に処理する曲数。既定はコア数）
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camsynth/msgpack_io.hpp"
+#include "camsynth/music_features.hpp"
+
+using namespace std;
+using namespace camsynth;
+
+int main(int argc, char *argv[]) {
+    int threads = max(1u, thread::hardware_concurrency());
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--threads=", 0) == 0)
+            threads = max(1, stoi(arg.substr(10)));
+        else
+            args.push_back(arg);
+    }
+    if (args.empty() || args.size() % 3 != 0) {
+        cerr << "使い方: " << argv[0] << " [--threads=N] <music.wav> <raw.msgpack | -> <music.msgpack> [...]\n";
+        return 1;
+    }
+
+    size_t numJobs = args.size() / 3;
+    atomic<size_t> next(0);
+    atomic<int> failures(0);
+    mutex logMutex;
+    auto worker = [&]() {
+        for (size_t job; (job = next++) < numJobs;) {
+            const string &audio = args[job * 3];
+            const string &motion = args[job * 3 + 1];
+            const string &output = args[job * 3 + 2];
+            try {
+                auto t0 = chrono::steady_clock::now();
+                size_t maxFrames = 0;
+                if (motion != "-") {
+                    maxFrames = loadJointPositions(motion).size();
+                    if (maxFrames == 0)
+                        throw runtime_error("No frames in " + motion);
+                }
+                vector<double> density = extractOnsetDensity(audio, maxFrames);
+                writeMusicFeaturesMsgpack(output, density);
+                double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                lock_guard<mutex> lock(logMutex);
+                cout << "[INFO] " << audio << " -> " << output << " (" << density.size() << " フレーム, " << sec
+                     << " 秒)" << endl;
+            }
+            catch (const std::exception &e) {
+                failures++;
+                lock_guard<mutex> lock(logMutex);
+                cerr << "Error: " << audio << ": " << e.what() << "\n";
+            }
+        }
+    };
+    vector<thread> pool;
+    for (int t = 0; t < min<int>(threads, numJobs); t++)
+        pool.emplace_back(worker);
+    for (auto &t : pool)
+        t.join();
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+import argparse
+import importlib.util
+import json
+import random
+import struct
+import subprocess
+import tempfile
+from pathlib import Path
+
+MY_UTILS = Path(__file__).resolve().parent
+
+
+def load_module(name: str, path: Path):
+    """
+    ファイル名に + を含むスクリプト (sabi+frameinterval.py) も読み込めるよう、パスからモジュールを読み込む
+    """
+    spec = importlib.util.spec_from_file_location(name, path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+frameinterval = load_module("frameinterval", MY_UTILS / "frameinterval.py")
+sabi_frameinterval = load_module("sabi_frameinterval", MY_UTILS / "sabi+frameinterval.py")
+
+
+def pack_msgpack(obj) -> bytes:
+    """
+    beat.msgpack / sabi.msgpack を書くための最小限の MessagePack エンコーダ
+    （json2msgpack と同じ型: dict / list / str / int / float / bool）
+    """
+    if isinstance(obj, bool):
+        return b"\xc3" if obj else b"\xc2"
+    if isinstance(obj, int):
+        return b"\xd3" + struct.pack(">q", obj)
+    if isinstance(obj, float):
+        return b"\xcb" + struct.pack(">d", obj)
+    if isinstance(obj, str):
+        data = obj.encode("utf-8")
+        return b"\xdb" + struct.pack(">I", len(data)) + data
+    if isinstance(obj, list):
+        return b"\xdd" + struct.pack(">I", len(obj)) + b"".join(pack_msgpack(v) for v in obj)
+    if isinstance(obj, dict):
+        return b"\xdf" + struct.pack(">I", len(obj)) + b"".join(
+            pack_msgpack(k) + pack_msgpack(v) for k, v in obj.items()
+        )
+    raise TypeError(f"pack できない型です: {type(obj)}")
+
+
+def random_case(rng: random.Random):
+    """
+    ランダムなビート（テンポの揺れ・小節の途中から始まる・ms が小数のもの）、サビ、モーションのフレーム数を作る
+    フレーム数はビートの合計の前後（差分が 90 フレームの閾値をまたぐものを含む）にする
+    """
+    bpm = rng.uniform(70, 180)
+    t = rng.uniform(0, 2000)
+    position = rng.randint(1, 4)
+    beats = []
+    for i in range(rng.randint(0, 400)):
+        start = round(t, 1) if rng.random() < 0.5 else int(t)
+        beats.append({"start": start, "bpm": bpm, "position": position, "index": i})
+        t += 60000 / bpm * rng.uniform(0.97, 1.03)
+        position = position % 4 + 1
+    total_ms = t
+    chorus = {
+        "chorusSegments": [
+            {
+                "repeats": [
+                    {"start": rng.uniform(0, total_ms), "duration": rng.uniform(5000, 30000), "index": k}
+                    for k in range(rng.randint(0, 3))
+                ]
+            }
+        ],
+        "repeatSegments": [
+            {"repeats": [{"start": rng.uniform(0, total_ms), "duration": rng.uniform(5000, 20000)}]}
+            for _ in range(rng.randint(0, 3))
+        ],
+    }
+    offset = rng.choice([-300, -89, -30, 0, 20, 89, 90, 95, 400])
+    motion_frames = max(1, int(total_ms * 30 / 1000 + offset))
+    return beats, chorus, motion_frames
+
+
+def python_segmentation(beats: list, chorus: dict, motion_frames: int, fps: int = 30):
+    """
+    frameinterval.py の process_single_pair と sabi+frameinterval.py の merge_and_detect と同じ計算
+    （ファイルを介さずに関数を直接呼ぶ）
+    """
+    frame_intervals, beat_total_frames = frameinterval.calculate_intervals_with_start(beats, fps=fps)
+    diff = motion_frames - beat_total_frames
+    if frame_intervals:
+        if abs(diff) < 90:
+            frame_intervals[-1] += diff
+        else:
+            frame_intervals.append(diff)
+    else:
+        frame_intervals = [diff]
+    cumulative_frames = sabi_frameinterval.compute_cumulative_frames(frame_intervals)
+    chorus_ranges = sabi_frameinterval.collect_chorus_frame_ranges(chorus, fps=fps)
+    sabi = sabi_frameinterval.find_sabi_indices(cumulative_frames, chorus_ranges)
+    return frame_intervals, sabi
+
+
+def compare(segment_bin: Path, cases: int, seed: int) -> int:
+    """
+    cases 個のランダムなケースで Python 版と scripts/segment の結果を比べ、一致しなかった数を返す
+
+    ビートがモーションより長いと Python 版は 0 以下の間隔を出す。C++ 版ははみ出したセグメントを除くので、
+    そのケースは「全て正の間隔で、合計がモーションのフレーム数になる」ことだけを確かめる。
+    """
+    rng = random.Random(seed)
+    mismatches = 0
+    skipped = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        music_dir = Path(tmp)
+        for case in range(cases):
+            beats, chorus, motion_frames = random_case(rng)
+            (music_dir / "beat.msgpack").write_bytes(pack_msgpack({"beats": beats}))
+            (music_dir / "sabi.msgpack").write_bytes(pack_msgpack(chorus))
+            out = subprocess.run(
+                [str(segment_bin), str(music_dir), str(motion_frames)],
+                capture_output=True, text=True, check=True,
+            ).stdout
+            result = json.loads(out)
+            expected_intervals, expected_sabi = python_segmentation(beats, chorus, motion_frames)
+
+            if any(v <= 0 for v in expected_intervals):
+                skipped += 1
+                got = result["frame_intervals"]
+                if any(v <= 0 for v in got) or sum(got) != motion_frames:
+                    mismatches += 1
+                    print(f"[MISMATCH] case {case}: motion_frames={motion_frames} intervals={got}")
+                continue
+
+            if result["frame_intervals"] != expected_intervals or result["sabi"] != expected_sabi:
+                mismatches += 1
+                print(f"[MISMATCH] case {case}: motion_frames={motion_frames}")
+                print(f"  python: frame_intervals={expected_intervals} sabi={expected_sabi}")
+                print(f"  c++   : frame_intervals={result['frame_intervals']} sabi={result['sabi']}")
+
+    print(f"{cases} ケース中 {mismatches} ケースが不一致 "
+          f"(うち {skipped} ケースは Python 版が 0 以下の間隔を出すため合計と符号のみ確認)")
+    return mismatches
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="ランダムなビート・サビ・モーションの長さで、frameinterval.py・sabi+frameinterval.py と "
+                    "camera_synthesis のセグメント分割 (scripts/segment) の結果が同じかを確かめます。"
+    )
+    parser.add_argument(
+        "--segment",
+        type=str,
+        default="scripts/segment",
+        help="scripts/segment.cpp をビルドした実行ファイルのパス"
+    )
+    parser.add_argument("--cases", type=int, default=300, help="試すケース数 (デフォルト: 300)")
+    parser.add_argument("--seed", type=int, default=5, help="乱数のシード (デフォルト: 5)")
+    args = parser.parse_args()
+
+    raise SystemExit(1 if compare(Path(args.segment), args.cases, args.seed) else 0)
@@ -0,0 +1,71 @@
+// 新しい入力のセグメント分割 (frame_intervals) とサビのセグメント (sabi) の表示
+// （camera_synthesis が New のときに行う分割と同じ。scripts/my_utils/compare_segmentation.py で Python 版と比べる）
+//
+//   ./scripts/segment <music_dir> <motion_dir | raw.bvh | フレーム数>
+//
+// music_dir の beat.msgpack・sabi.msgpack（なければサビなし）とモーションのフレーム数から分割し、
+// sabi_frame.json と同じ形の JSON ({"frame_intervals": [...], "sabi": [...]}) を標準出力に書く。
+// オプション: --downbeats=N / --chorus-downbeats=N（1 セグメントの小節の頭の数。既定 2）
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "camsynth/msgpack_io.hpp"
+#include "camsynth/segmentation.hpp"
+
+namespace fs = std::filesystem;
+using namespace std;
+using namespace camsynth;
+
+namespace {
+
+void printArray(const char *name, const vector<int> &values) {
+    cout << "\"" << name << "\": [";
+    for (size_t i = 0; i < values.size(); i++)
+        cout << (i ? ", " : "") << values[i];
+    cout << "]";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    SegmentationOptions options;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--downbeats=", 0) == 0)
+            options.downbeatsPerSegment = stoi(arg.substr(12));
+        else if (arg.rfind("--chorus-downbeats=", 0) == 0)
+            options.chorusDownbeatsPerSegment = stoi(arg.substr(19));
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2) {
+        cerr << "使い方: " << argv[0] << " [--downbeats=N] [--chorus-downbeats=N] <music_dir> "
+             << "<motion_dir | raw.bvh | フレーム数>\n";
+        return 1;
+    }
+
+    try {
+        const string &musicDir = args[0];
+        const string &motion = args[1];
+        size_t motionFrames = motion.find_first_not_of("0123456789") == string::npos ? stoul(motion)
+                                                                                      : countMotionFrames(motion);
+        vector<ChorusRange> chorus;
+        if (fs::exists(musicDir + "/sabi.msgpack"))
+            chorus = loadChorusRangesMsgpack(musicDir + "/sabi.msgpack", options.fps);
+        vector<int> frameIntervals =
+            beatFrameIntervals(loadBeatsMsgpack(musicDir + "/beat.msgpack"), motionFrames, chorus, options);
+        cout << "{";
+        printArray("frame_intervals", frameIntervals);
+        cout << ", ";
+        printArray("sabi", chorusSegmentIndices(frameIntervals, chorus));
+        cout << "}" << endl;
+    }
+    catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}